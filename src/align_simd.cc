@@ -71,7 +71,14 @@
   maximize score
 */
 
-constexpr auto CHANNELS = 8;
+/*
+  On x86_64 this file is compiled three times: without any special
+  flags for SSE2 (8 channels), with -DAVX2 (16 channels) and with
+  -DAVX512BW (32 channels). The AVX2 and AVX-512BW builds only provide
+  search16_avx2() and search16_avx512bw(); the SSE2 build provides the
+  rest of the interface and picks the widest aligner the cpu supports.
+*/
+
 constexpr auto CDEPTH = 4;
 
 /*
@@ -90,21 +97,64 @@ constexpr auto CDEPTH = 4;
 
 constexpr auto MAXSEQLENPRODUCT = 25000000LL;
 
-static int64_t scorematrix[16][16];
+/*
+  The state below does not depend on the vector width, so it is shared
+  by all the builds of this file. The vectors are stored as arrays of
+  16-bit cells; dir is an array of DIRWORDs (see below).
+*/
+
+struct s16info_s
+{
+  CELL matrix[16 * 16];
+  CELL * hearray;
+  CELL * dprofile;
+  CELL ** qtable;
+  void * dir;
+  char * qseq;
+  uint64_t diralloc;
+
+  cigar_t * cigar;
+  cigar_t * cigarend;
+  int64_t cigaralloc;
+  struct arena_s * arena;
+  int opcount;
+  char op;
+
+  int channels;
+  int qlen;
+  int qalloc;
+  int maxdlen;
+  CELL penalty_gap_open_query_left;
+  CELL penalty_gap_open_target_left;
+  CELL penalty_gap_open_query_interior;
+  CELL penalty_gap_open_target_interior;
+  CELL penalty_gap_open_query_right;
+  CELL penalty_gap_open_target_right;
+  CELL penalty_gap_extension_query_left;
+  CELL penalty_gap_extension_target_left;
+  CELL penalty_gap_extension_query_interior;
+  CELL penalty_gap_extension_target_interior;
+  CELL penalty_gap_extension_query_right;
+  CELL penalty_gap_extension_target_right;
+};
 
 /*
   The macros below usually operate on 128-bit vectors of 8 signed
   short 16-bit integers. Additions and subtractions should be
   saturated.  The shift operation should shift left by 2 bytes (one
   short int) and shift in zeros. The v_mask_gt operation should
-  compare two vectors of signed shorts and return a 16-bit bitmask
-  with pairs of 2 bits set for each element greater in the first than
-  in the second argument.
+  compare two vectors of signed shorts and return a bitmask of type
+  DIRWORD with DIRBITS bits set for each element greater in the first
+  than in the second argument.
 */
 
 #ifdef __PPC__
 
+constexpr auto CHANNELS = 8;
+constexpr auto DIRBITS = 2;
+
 typedef __vector signed short VECTOR_SHORT;
+typedef unsigned short DIRWORD;
 
 const __vector unsigned char perm_merge_long_low =
   {0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,
@@ -114,7 +164,6 @@ const __vector unsigned char perm_merge_long_high =
   {0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f,
    0x18, 0x19, 0x1a, 0x1b, 0x1c, 0x1d, 0x1e, 0x1f};
 
-#define v_init(a,b,c,d,e,f,g,h) (const VECTOR_SHORT){a,b,c,d,e,f,g,h}
 #define v_load(a) vec_ld(0, (VECTOR_SHORT *)(a))
 #define v_store(a, b) vec_st((__vector unsigned char)(b), 0,    \
                              (__vector unsigned char *)(a))
@@ -133,12 +182,15 @@ const __vector unsigned char perm_merge_long_high =
 
 #elif defined __aarch64__
 
+constexpr auto CHANNELS = 8;
+constexpr auto DIRBITS = 2;
+
 typedef int16x8_t VECTOR_SHORT;
+typedef unsigned short DIRWORD;
 
 const uint16x8_t neon_mask =
   {0x0003, 0x000c, 0x0030, 0x00c0, 0x0300, 0x0c00, 0x3000, 0xc000};
 
-#define v_init(a,b,c,d,e,f,g,h) (const VECTOR_SHORT){a,b,c,d,e,f,g,h}
 #define v_load(a) vld1q_s16((const int16_t *)(a))
 #define v_store(a, b) vst1q_s16((int16_t *)(a), (b))
 #define v_merge_lo_16(a, b) vzip1q_s16((a),(b))
@@ -159,11 +211,74 @@ const uint16x8_t neon_mask =
 #define v_shift_left(a) vextq_s16((v_zero), (a), 7)
 #define v_mask_gt(a, b) vaddvq_u16(vandq_u16((vcgtq_s16((a), (b))), neon_mask))
 
-#elif __x86_64__
+#elif defined __x86_64__ && defined AVX512BW
+
+/* 512-bit vectors of 32 shorts, the compare gives one bit per element */
+
+constexpr auto CHANNELS = 32;
+constexpr auto DIRBITS = 1;
+
+typedef __m512i VECTOR_SHORT;
+typedef unsigned int DIRWORD;
+
+#define v_load(a) _mm512_load_si512((VECTOR_SHORT *)(a))
+#define v_store(a, b) _mm512_store_si512((VECTOR_SHORT *)(a), (b))
+#define v_add(a, b) _mm512_adds_epi16((a), (b))
+#define v_sub(a, b) _mm512_subs_epi16((a), (b))
+#define v_sub_unsigned(a, b) _mm512_subs_epu16((a), (b))
+#define v_max(a, b) _mm512_max_epi16((a), (b))
+#define v_min(a, b) _mm512_min_epi16((a), (b))
+#define v_dup(a) _mm512_set1_epi16(a)
+#define v_zero v_dup(0)
+#define v_and(a, b) _mm512_and_si512((a), (b))
+#define v_xor(a, b) _mm512_xor_si512((a), (b))
+#define v_shift_left(a) _mm512_alignr_epi8((a),                         \
+                                           _mm512_maskz_shuffle_i64x2   \
+                                           (0xfc, (a), (a), 0x90), 14)
+#define v_mask_gt(a, b) _mm512_cmpgt_epi16_mask((a), (b))
+
+#elif defined __x86_64__ && defined AVX2
+
+/* 256-bit vectors of 16 shorts, the merges work within 128-bit lanes */
+
+constexpr auto CHANNELS = 16;
+constexpr auto DIRBITS = 2;
+
+typedef __m256i VECTOR_SHORT;
+typedef unsigned int DIRWORD;
+
+#define v_load(a) _mm256_load_si256((VECTOR_SHORT *)(a))
+#define v_store(a, b) _mm256_store_si256((VECTOR_SHORT *)(a), (b))
+#define v_merge_lo_16(a, b) _mm256_unpacklo_epi16((a),(b))
+#define v_merge_hi_16(a, b) _mm256_unpackhi_epi16((a),(b))
+#define v_merge_lo_32(a, b) _mm256_unpacklo_epi32((a),(b))
+#define v_merge_hi_32(a, b) _mm256_unpackhi_epi32((a),(b))
+#define v_merge_lo_64(a, b) _mm256_unpacklo_epi64((a),(b))
+#define v_merge_hi_64(a, b) _mm256_unpackhi_epi64((a),(b))
+#define v_merge_lo_128(a, b) _mm256_permute2x128_si256((a), (b), 0x20)
+#define v_merge_hi_128(a, b) _mm256_permute2x128_si256((a), (b), 0x31)
+#define v_add(a, b) _mm256_adds_epi16((a), (b))
+#define v_sub(a, b) _mm256_subs_epi16((a), (b))
+#define v_sub_unsigned(a, b) _mm256_subs_epu16((a), (b))
+#define v_max(a, b) _mm256_max_epi16((a), (b))
+#define v_min(a, b) _mm256_min_epi16((a), (b))
+#define v_dup(a) _mm256_set1_epi16(a)
+#define v_zero v_dup(0)
+#define v_and(a, b) _mm256_and_si256((a), (b))
+#define v_xor(a, b) _mm256_xor_si256((a), (b))
+#define v_shift_left(a) _mm256_alignr_epi8((a),                         \
+                                           _mm256_permute2x128_si256    \
+                                           ((a), (a), 0x08), 14)
+#define v_mask_gt(a, b) _mm256_movemask_epi8(_mm256_cmpgt_epi16((a), (b)))
+
+#elif defined __x86_64__
+
+constexpr auto CHANNELS = 8;
+constexpr auto DIRBITS = 2;
 
 typedef __m128i VECTOR_SHORT;
+typedef unsigned short DIRWORD;
 
-#define v_init(a,b,c,d,e,f,g,h) _mm_set_epi16(h,g,f,e,d,c,b,a)
 #define v_load(a) _mm_load_si128((VECTOR_SHORT *)(a))
 #define v_store(a, b) _mm_store_si128((VECTOR_SHORT *)(a), (b))
 #define v_merge_lo_16(a, b) _mm_unpacklo_epi16((a),(b))
@@ -190,37 +305,9 @@ typedef __m128i VECTOR_SHORT;
 
 #endif
 
-struct s16info_s
-{
-  VECTOR_SHORT matrix[32];
-  VECTOR_SHORT * hearray;
-  VECTOR_SHORT * dprofile;
-  VECTOR_SHORT ** qtable;
-  unsigned short * dir;
-  char * qseq;
-  uint64_t diralloc;
-
-  char * cigar;
-  char * cigarend;
-  int64_t cigaralloc;
-  int opcount;
-  char op;
+#if ! defined AVX2 && ! defined AVX512BW
 
-  int qlen;
-  int maxdlen;
-  CELL penalty_gap_open_query_left;
-  CELL penalty_gap_open_target_left;
-  CELL penalty_gap_open_query_interior;
-  CELL penalty_gap_open_target_interior;
-  CELL penalty_gap_open_query_right;
-  CELL penalty_gap_open_target_right;
-  CELL penalty_gap_extension_query_left;
-  CELL penalty_gap_extension_target_left;
-  CELL penalty_gap_extension_query_interior;
-  CELL penalty_gap_extension_target_interior;
-  CELL penalty_gap_extension_query_right;
-  CELL penalty_gap_extension_target_right;
-};
+/* debugging aids, only present in the default build */
 
 auto _mm_print(VECTOR_SHORT x) -> void
 {
@@ -273,6 +360,113 @@ auto dumpscorematrix(CELL * m) -> void
     }
 }
 
+#endif
+
+namespace {
+  // anonymous namespace to avoid linker error (the functions below
+  // exist once in each build of this file)
+
+#if defined __x86_64__ && defined AVX512BW
+
+auto dprofile_fill16(CELL * dprofile_word,
+                     CELL * score_matrix_word,
+                     BYTE * dseq) -> void
+{
+  /*
+    The score matrix is symmetric, so the scores of the target symbols
+    in all 32 channels against query symbol i are found by permuting
+    row i of the matrix using the target symbols as indices.
+  */
+
+  VECTOR_SHORT rows[16];
+  for (int i = 0; i < 16; i++)
+    {
+      rows[i] = _mm512_castsi256_si512
+        (_mm256_load_si256((__m256i *) (score_matrix_word + 16 * i)));
+    }
+
+  for (int j = 0; j < CDEPTH; j++)
+    {
+      VECTOR_SHORT d = _mm512_cvtepu8_epi16
+        (_mm256_loadu_si256((__m256i *) (dseq + CHANNELS * j)));
+      for (int i = 0; i < 16; i++)
+        {
+          v_store(dprofile_word + CDEPTH * CHANNELS * i + CHANNELS * j,
+                  _mm512_permutexvar_epi16(d, rows[i]));
+        }
+    }
+}
+
+#elif defined __x86_64__ && defined AVX2
+
+auto dprofile_fill16(CELL * dprofile_word,
+                     CELL * score_matrix_word,
+                     BYTE * dseq) -> void
+{
+  /*
+    Each matrix row holds the scores against query symbols 0-7 in the
+    low lane and 8-15 in the high lane. The 8x8 transpose below works
+    within lanes, so it is done separately for channels 0-7 and 8-15,
+    and the lanes are combined afterwards.
+  */
+
+  for (int j = 0; j < CDEPTH; j++)
+    {
+      VECTOR_SHORT half[2][8];
+
+      for (int h = 0; h < 2; h++)
+        {
+          BYTE * d = dseq + CHANNELS * j + 8 * h;
+
+          VECTOR_SHORT reg0 = v_load(score_matrix_word + (d[0] << 4));
+          VECTOR_SHORT reg1 = v_load(score_matrix_word + (d[1] << 4));
+          VECTOR_SHORT reg2 = v_load(score_matrix_word + (d[2] << 4));
+          VECTOR_SHORT reg3 = v_load(score_matrix_word + (d[3] << 4));
+          VECTOR_SHORT reg4 = v_load(score_matrix_word + (d[4] << 4));
+          VECTOR_SHORT reg5 = v_load(score_matrix_word + (d[5] << 4));
+          VECTOR_SHORT reg6 = v_load(score_matrix_word + (d[6] << 4));
+          VECTOR_SHORT reg7 = v_load(score_matrix_word + (d[7] << 4));
+
+          VECTOR_SHORT reg8  = v_merge_lo_16(reg0,  reg1);
+          VECTOR_SHORT reg9  = v_merge_hi_16(reg0,  reg1);
+          VECTOR_SHORT reg10 = v_merge_lo_16(reg2,  reg3);
+          VECTOR_SHORT reg11 = v_merge_hi_16(reg2,  reg3);
+          VECTOR_SHORT reg12 = v_merge_lo_16(reg4,  reg5);
+          VECTOR_SHORT reg13 = v_merge_hi_16(reg4,  reg5);
+          VECTOR_SHORT reg14 = v_merge_lo_16(reg6,  reg7);
+          VECTOR_SHORT reg15 = v_merge_hi_16(reg6,  reg7);
+
+          VECTOR_SHORT reg16 = v_merge_lo_32(reg8,  reg10);
+          VECTOR_SHORT reg17 = v_merge_hi_32(reg8,  reg10);
+          VECTOR_SHORT reg18 = v_merge_lo_32(reg12, reg14);
+          VECTOR_SHORT reg19 = v_merge_hi_32(reg12, reg14);
+          VECTOR_SHORT reg20 = v_merge_lo_32(reg9,  reg11);
+          VECTOR_SHORT reg21 = v_merge_hi_32(reg9,  reg11);
+          VECTOR_SHORT reg22 = v_merge_lo_32(reg13, reg15);
+          VECTOR_SHORT reg23 = v_merge_hi_32(reg13, reg15);
+
+          half[h][0] = v_merge_lo_64(reg16, reg18);
+          half[h][1] = v_merge_hi_64(reg16, reg18);
+          half[h][2] = v_merge_lo_64(reg17, reg19);
+          half[h][3] = v_merge_hi_64(reg17, reg19);
+          half[h][4] = v_merge_lo_64(reg20, reg22);
+          half[h][5] = v_merge_hi_64(reg20, reg22);
+          half[h][6] = v_merge_lo_64(reg21, reg23);
+          half[h][7] = v_merge_hi_64(reg21, reg23);
+        }
+
+      for (int i = 0; i < 8; i++)
+        {
+          v_store(dprofile_word + CDEPTH * CHANNELS * i + CHANNELS * j,
+                  v_merge_lo_128(half[0][i], half[1][i]));
+          v_store(dprofile_word + CDEPTH * CHANNELS * (i + 8) + CHANNELS * j,
+                  v_merge_hi_128(half[0][i], half[1][i]));
+        }
+    }
+}
+
+#else
+
 auto dprofile_fill16(CELL * dprofile_word,
                      CELL * score_matrix_word,
                      BYTE * dseq) -> void
@@ -458,6 +652,8 @@ auto dprofile_fill16(CELL * dprofile_word,
 #endif
 }
 
+#endif
+
 /*
   The direction bits are set as follows:
   in DIR[0..1] if F>H initially (must go up) (4th pri)
@@ -574,7 +770,7 @@ auto aligncolumns_first(VECTOR_SHORT * Sm,
                         VECTOR_SHORT M_QR_q_interior,
                         VECTOR_SHORT M_QR_q_right,
                         int64_t ql,
-                        unsigned short * dir) -> void
+                        DIRWORD * dir) -> void
 {
 
   VECTOR_SHORT h4;
@@ -736,7 +932,7 @@ auto aligncolumns_rest(VECTOR_SHORT * Sm,
                        VECTOR_SHORT * _h_min,
                        VECTOR_SHORT * _h_max,
                        int64_t ql,
-                       unsigned short * dir) -> void
+                       DIRWORD * dir) -> void
 {
   VECTOR_SHORT h4;
   VECTOR_SHORT h5;
@@ -855,14 +1051,9 @@ inline auto pushop(s16info_s * s, char newop) -> void
     }
   else
     {
-      *--s->cigarend = s->op;
-      if (s->opcount > 1)
+      if (s->op)
         {
-          const int size = 11;
-          char buf[size];
-          int len = snprintf(buf, size, "%d", s->opcount);
-          s->cigarend -= len;
-          memcpy(s->cigarend, buf, len);
+          *--s->cigarend = cigar_pack(s->op, s->opcount);
         }
       s->op = newop;
       s->opcount = 1;
@@ -873,20 +1064,22 @@ inline auto finishop(s16info_s * s) -> void
 {
   if (s->op && s->opcount)
     {
-      *--s->cigarend = s->op;
-      if (s->opcount > 1)
-        {
-          const int size = 11;
-          char buf[size];
-          int len = snprintf(buf, size, "%d", s->opcount);
-          s->cigarend -= len;
-          memcpy(s->cigarend, buf, len);
-        }
+      *--s->cigarend = cigar_pack(s->op, s->opcount);
       s->op = 0;
       s->opcount = 0;
     }
 }
 
+inline auto search16_cigar(s16info_s * s, const cigar_t * cigar) -> cigar_t *
+{
+  /* copy a cigar to the caller's arena, or to the heap */
+  if (s->arena)
+    {
+      return cigar_arena_dup(s->arena, cigar);
+    }
+  return cigar_dup(cigar);
+}
+
 auto backtrack16(s16info_s * s,
                  char * dseq,
                  uint64_t dlen,
@@ -897,15 +1090,14 @@ auto backtrack16(s16info_s * s,
                  unsigned short * pmismatches,
                  unsigned short * pgaps) -> void
 {
-  unsigned short * dirbuffer = s->dir;
+  auto * dirbuffer = (DIRWORD *) s->dir;
   uint64_t dirbuffersize = s->qlen * s->maxdlen * 4;
   uint64_t qlen = s->qlen;
   char * qseq = s->qseq;
 
-  uint64_t maskup      = 3ULL << (2 * channel + 0);
-  uint64_t maskleft    = 3ULL << (2 * channel + 16);
-  uint64_t maskextup   = 3ULL << (2 * channel + 32);
-  uint64_t maskextleft = 3ULL << (2 * channel + 48);
+  /* each cell has four DIRWORDs: up, left, extend up, extend left */
+
+  auto mask = (DIRWORD) (((1ULL << DIRBITS) - 1) << (DIRBITS * channel));
 
 #if 0
 
@@ -915,17 +1107,17 @@ auto backtrack16(s16info_s * s,
     {
       for(uint64_t j = 0; j < dlen; j++)
         {
-          uint64_t d = *((uint64_t *) (dirbuffer +
-                                       (offset + 16 * s->qlen * (j / 4) +
-                                        16 * i + 4 * (j & 3)) % dirbuffersize));
-          if (d & maskup)
+          DIRWORD * d = dirbuffer +
+            (offset + 16 * s->qlen * (j / 4) +
+             16 * i + 4 * (j & 3)) % dirbuffersize;
+          if (d[0] & mask)
             {
-              if (d & maskleft)
+              if (d[1] & mask)
                 printf("+");
               else
                 printf("^");
             }
-          else if (d & maskleft)
+          else if (d[1] & mask)
             {
               printf("<");
             }
@@ -943,17 +1135,17 @@ auto backtrack16(s16info_s * s,
     {
       for(uint64_t j = 0; j < dlen; j++)
         {
-          uint64_t d = *((uint64_t *) (dirbuffer +
-                                       (offset + 16 * s->qlen * (j / 4) +
-                                        16 * i + 4 * (j & 3)) % dirbuffersize));
-          if (d & maskextup)
+          DIRWORD * d = dirbuffer +
+            (offset + 16 * s->qlen * (j / 4) +
+             16 * i + 4 * (j & 3)) % dirbuffersize;
+          if (d[2] & mask)
             {
-              if (d & maskextleft)
+              if (d[3] & mask)
                 printf("+");
               else
                 printf("^");
             }
-          else if (d & maskextleft)
+          else if (d[3] & mask)
             {
               printf("<");
             }
@@ -975,29 +1167,31 @@ auto backtrack16(s16info_s * s,
   int64_t i = qlen - 1;
   int64_t j = dlen - 1;
 
+  /* the cigar is built backwards from the end of the buffer */
   s->cigarend = s->cigar + s->qlen + s->maxdlen + 1;
+  *--s->cigarend = 0;
   s->op = 0;
-  s->opcount = 1;
+  s->opcount = 0;
 
   while ((i >= 0) && (j >= 0))
     {
       ++aligned;
 
-      uint64_t d = *((uint64_t *) (dirbuffer +
-                                   (offset + 16 * s->qlen * (j / 4) +
-                                    16 * i + 4 *(j & 3)) % dirbuffersize));
+      DIRWORD * d = dirbuffer +
+        (offset + 16 * s->qlen * (j / 4) +
+         16 * i + 4 * (j & 3)) % dirbuffersize;
 
-      if ((s->op == 'I') && (d & maskextleft))
+      if ((s->op == 'I') && (d[3] & mask))
         {
           --j;
           pushop(s, 'I');
         }
-      else if ((s->op == 'D') && (d & maskextup))
+      else if ((s->op == 'D') && (d[2] & mask))
         {
           --i;
           pushop(s, 'D');
         }
-      else if (d & maskleft)
+      else if (d[1] & mask)
         {
           if (s->op != 'I')
             {
@@ -1006,7 +1200,7 @@ auto backtrack16(s16info_s * s,
           --j;
           pushop(s, 'I');
         }
-      else if (d & maskup)
+      else if (d[0] & mask)
         {
           if (s->op != 'D')
             {
@@ -1057,7 +1251,7 @@ auto backtrack16(s16info_s * s,
 
   /* move cigar to beginning of allocated memory area */
   int cigarlen = s->cigar + s->qlen + s->maxdlen - s->cigarend;
-  memmove(s->cigar, s->cigarend, cigarlen + 1);
+  memmove(s->cigar, s->cigarend, (cigarlen + 1) * sizeof(cigar_t));
 
   * paligned = aligned;
   * pmatches = matches;
@@ -1065,6 +1259,12 @@ auto backtrack16(s16info_s * s,
   * pgaps = gaps;
 }
 
+}
+
+#if ! defined AVX2 && ! defined AVX512BW
+
+static int64_t scorematrix[16][16];
+
 auto search16_init(CELL score_match,
                    CELL score_mismatch,
                    CELL penalty_gap_open_query_left,
@@ -1087,8 +1287,22 @@ auto search16_init(CELL score_match,
   auto * s = (struct s16info_s *)
     xmalloc(sizeof(struct s16info_s));
 
-  s->dprofile = (VECTOR_SHORT *) xmalloc(2 * 4 * 8 * 16);
+  /* use the widest aligner supported by the cpu */
+  s->channels = CHANNELS;
+#ifdef __x86_64__
+  if (avx512bw_present)
+    {
+      s->channels = 32;
+    }
+  else if (avx2_present)
+    {
+      s->channels = 16;
+    }
+#endif
+
+  s->dprofile = (CELL *) xmalloc(sizeof(CELL) * 16 * CDEPTH * s->channels);
   s->qlen = 0;
+  s->qalloc = 0;
   s->qseq = nullptr;
   s->maxdlen = 0;
   s->dir = nullptr;
@@ -1098,6 +1312,7 @@ auto search16_init(CELL score_match,
   s->cigar = nullptr;
   s->cigarend = nullptr;
   s->cigaralloc = 0;
+  s->arena = nullptr;
 
   for(int i = 0; i < 16; i++)
     {
@@ -1116,7 +1331,7 @@ auto search16_init(CELL score_match,
             {
               value = opt_mismatch;
             }
-          ((CELL*) (&s->matrix))[16 * i + j] = value;
+          s->matrix[16 * i + j] = value;
           scorematrix[i][j] = value;
         }
     }
@@ -1184,38 +1399,60 @@ auto search16_qprep(s16info_s * s, char * qseq, int qlen) -> void
   s->qlen = qlen;
   s->qseq = qseq;
 
-  if (s->hearray)
-    {
-      xfree(s->hearray);
-    }
-  s->hearray = (VECTOR_SHORT *) xmalloc(2 * s->qlen * sizeof(VECTOR_SHORT));
-  memset(s->hearray, 0, 2 * s->qlen * sizeof(VECTOR_SHORT));
-
-  if (s->qtable)
+  /* keep the buffers of the longest query seen so far */
+  if (qlen > s->qalloc)
     {
-      xfree(s->qtable);
+      s->qalloc = qlen;
+      if (s->hearray)
+        {
+          xfree(s->hearray);
+        }
+      s->hearray = (CELL *)
+        xmalloc(2 * s->qalloc * s->channels * sizeof(CELL));
+      if (s->qtable)
+        {
+          xfree(s->qtable);
+        }
+      s->qtable = (CELL **) xmalloc(s->qalloc * sizeof(CELL *));
     }
-  s->qtable = (VECTOR_SHORT **) xmalloc(s->qlen * sizeof(VECTOR_SHORT*));
+  memset(s->hearray, 0, 2 * s->qlen * s->channels * sizeof(CELL));
 
   for(int i = 0; i < qlen; i++)
     {
-      s->qtable[i] = s->dprofile + 4 * chrmap_4bit[(int) (qseq[i])];
+      s->qtable[i] = s->dprofile +
+        CDEPTH * s->channels * chrmap_4bit[(int) (qseq[i])];
     }
 }
 
-auto search16(s16info_s * s,
-              unsigned int sequences,
-              unsigned int * seqnos,
-              CELL * pscores,
-              unsigned short * paligned,
-              unsigned short * pmatches,
-              unsigned short * pmismatches,
-              unsigned short * pgaps,
-              char ** pcigar) -> void
+auto search16_channels(s16info_s * s) -> int
+{
+  return s->channels;
+}
+
+auto search16_set_arena(s16info_s * s, struct arena_s * arena) -> void
+{
+  s->arena = arena;
+}
+
+#endif
+
+namespace {
+
+const cigar_t empty_cigar = 0;
+
+auto search16_run(s16info_s * s,
+                  unsigned int sequences,
+                  unsigned int * seqnos,
+                  CELL * pscores,
+                  unsigned short * paligned,
+                  unsigned short * pmatches,
+                  unsigned short * pmismatches,
+                  unsigned short * pgaps,
+                  cigar_t ** pcigar) -> void
 {
-  CELL ** q_start = (CELL**) s->qtable;
-  CELL * dprofile = (CELL*) s->dprofile;
-  CELL * hearray = (CELL*) s->hearray;
+  CELL ** q_start = s->qtable;
+  CELL * dprofile = s->dprofile;
+  CELL * hearray = s->hearray;
   uint64_t qlen = s->qlen;
 
   if (qlen == 0)
@@ -1243,21 +1480,12 @@ auto search16(s16info_s * s,
                     length * s->penalty_gap_extension_target_right);
             }
 
-          char * cigar = nullptr;
+          cigar_t cigar[2] = { 0, 0 };
           if (length > 0)
             {
-              int ret = xsprintf(&cigar, "%ldI", length);
-              if ((ret < 2) or not cigar)
-                {
-                  fatal("Unable to allocate enough memory.");
-                }
-            }
-          else
-            {
-              cigar = (char *) xmalloc(1);
-              cigar[0] = 0;
+              cigar[0] = cigar_pack('I', length);
             }
-          pcigar[cand_id] = cigar;
+          pcigar[cand_id] = search16_cigar(s, cigar);
         }
       return;
     }
@@ -1280,18 +1508,17 @@ auto search16(s16info_s * s,
   s->maxdlen = maxdlen;
   uint64_t dirbuffersize = s->qlen * s->maxdlen * 4;
 
-  if (dirbuffersize > s->diralloc)
+  if (dirbuffersize * sizeof(DIRWORD) > s->diralloc)
     {
-      s->diralloc = dirbuffersize;
+      s->diralloc = dirbuffersize * sizeof(DIRWORD);
       if (s->dir)
         {
           xfree(s->dir);
         }
-      s->dir = (unsigned short*) xmalloc(dirbuffersize *
-                                         sizeof(unsigned short));
+      s->dir = xmalloc(s->diralloc);
     }
 
-  unsigned short * dirbuffer = s->dir;
+  auto * dirbuffer = (DIRWORD *) s->dir;
 
   if (s->qlen + s->maxdlen + 1 > s->cigaralloc)
     {
@@ -1300,7 +1527,7 @@ auto search16(s16info_s * s,
         {
           xfree(s->cigar);
         }
-      s->cigar = (char *) xmalloc(s->cigaralloc);
+      s->cigar = (cigar_t *) xmalloc(s->cigaralloc * sizeof(cigar_t));
     }
 
   VECTOR_SHORT M;
@@ -1345,7 +1572,9 @@ auto search16(s16info_s * s,
   uint64_t next_id = 0;
   uint64_t done = 0;
 
-  T0 = v_init(-1, 0, 0, 0, 0, 0, 0, 0);
+  /* mask for channel 0 */
+  alignas(64) CELL T0_cells[CHANNELS] = { -1 };
+  T0 = v_load(T0_cells);
 
   R_query_left = v_dup(s->penalty_gap_extension_query_left);
 
@@ -1425,7 +1654,7 @@ auto search16(s16info_s * s,
 
   bool easy = false;
 
-  unsigned short * dir = dirbuffer;
+  DIRWORD * dir = dirbuffer;
 
   while (true)
     {
@@ -1582,7 +1811,7 @@ auto search16(s16info_s * s,
                           pmatches[cand_id] = 0;
                           pmismatches[cand_id] = 0;
                           pgaps[cand_id] = 0;
-                          pcigar[cand_id] = xstrdup("");
+                          pcigar[cand_id] = search16_cigar(s, &empty_cigar);
                         }
                       else
                         {
@@ -1592,9 +1821,7 @@ auto search16(s16info_s * s,
                                       pmatches + cand_id,
                                       pmismatches + cand_id,
                                       pgaps + cand_id);
-                          pcigar[cand_id] =
-                            (char *) xmalloc(strlen(s->cigar)+1);
-                          strcpy(pcigar[cand_id], s->cigar);
+                          pcigar[cand_id] = search16_cigar(s, s->cigar);
                         }
 
                       done++;
@@ -1615,7 +1842,7 @@ auto search16(s16info_s * s,
                           pmatches[cand_id] = 0;
                           pmismatches[cand_id] = 0;
                           pgaps[cand_id] = 0;
-                          pcigar[cand_id] = xstrdup("");
+                          pcigar[cand_id] = search16_cigar(s, &empty_cigar);
                           length = 0;
                           done++;
                         }
@@ -1798,3 +2025,70 @@ auto search16(s16info_s * s,
         }
     }
 }
+
+}
+
+#if defined AVX512BW
+
+auto search16_avx512bw(s16info_s * s,
+                       unsigned int sequences,
+                       unsigned int * seqnos,
+                       CELL * pscores,
+                       unsigned short * paligned,
+                       unsigned short * pmatches,
+                       unsigned short * pmismatches,
+                       unsigned short * pgaps,
+                       cigar_t ** pcigar) -> void
+{
+  search16_run(s, sequences, seqnos, pscores,
+               paligned, pmatches, pmismatches, pgaps, pcigar);
+}
+
+#elif defined AVX2
+
+auto search16_avx2(s16info_s * s,
+                   unsigned int sequences,
+                   unsigned int * seqnos,
+                   CELL * pscores,
+                   unsigned short * paligned,
+                   unsigned short * pmatches,
+                   unsigned short * pmismatches,
+                   unsigned short * pgaps,
+                   cigar_t ** pcigar) -> void
+{
+  search16_run(s, sequences, seqnos, pscores,
+               paligned, pmatches, pmismatches, pgaps, pcigar);
+}
+
+#else
+
+auto search16(s16info_s * s,
+              unsigned int sequences,
+              unsigned int * seqnos,
+              CELL * pscores,
+              unsigned short * paligned,
+              unsigned short * pmatches,
+              unsigned short * pmismatches,
+              unsigned short * pgaps,
+              cigar_t ** pcigar) -> void
+{
+#ifdef __x86_64__
+  if (s->channels == 32)
+    {
+      search16_avx512bw(s, sequences, seqnos, pscores,
+                        paligned, pmatches, pmismatches, pgaps, pcigar);
+      return;
+    }
+  if (s->channels == 16)
+    {
+      search16_avx2(s, sequences, seqnos, pscores,
+                    paligned, pmatches, pmismatches, pgaps, pcigar);
+      return;
+    }
+#endif
+
+  search16_run(s, sequences, seqnos, pscores,
+               paligned, pmatches, pmismatches, pgaps, pcigar);
+}
+
+#endif
@@ -94,4 +94,34 @@ auto search16(s16info_s * s,
               unsigned short * pmatches,
               unsigned short * pmismatches,
               unsigned short * pgaps,
-              char * * pcigar) -> void;
+              cigar_t * * pcigar) -> void;
+
+
+auto search16_channels(s16info_s * s) -> int;
+
+
+auto search16_set_arena(s16info_s * s, struct arena_s * arena) -> void;
+
+
+#ifdef __x86_64__
+auto search16_avx2(s16info_s * s,
+                   unsigned int sequences,
+                   unsigned int * seqnos,
+                   CELL * pscores,
+                   unsigned short * paligned,
+                   unsigned short * pmatches,
+                   unsigned short * pmismatches,
+                   unsigned short * pgaps,
+                   cigar_t * * pcigar) -> void;
+
+
+auto search16_avx512bw(s16info_s * s,
+                       unsigned int sequences,
+                       unsigned int * seqnos,
+                       CELL * pscores,
+                       unsigned short * paligned,
+                       unsigned short * pmatches,
+                       unsigned short * pmismatches,
+                       unsigned short * pgaps,
+                       cigar_t * * pcigar) -> void;
+#endif
@@ -67,9 +67,9 @@ static pthread_t * pthread;
 /* global constants/data, no need for synchronization */
 static int seqcount; /* number of database sequences */
 static pthread_attr_t attr;
+static struct scheduler_s * sched;
 
 /* global data protected by mutex */
-static pthread_mutex_t mutex_input;
 static pthread_mutex_t mutex_output;
 static int qmatches;
 static int queries;
@@ -290,8 +290,6 @@ auto allpairs_output_results(int hit_count,
 
 auto allpairs_thread_run(int64_t t) -> void
 {
-  (void) t;
-
   struct searchinfo_s sia;
 
   struct searchinfo_s * si = & sia;
@@ -301,6 +299,8 @@ auto allpairs_thread_run(int64_t t) -> void
   si->seq_alloc = 0;
   si->kmersamplecount = 0;
   si->kmers = nullptr;
+  si->kmercursor = nullptr;
+  si->kmercursor_alloc = 0;
   si->m = nullptr;
   si->finalized = 0;
 
@@ -356,190 +356,174 @@ auto allpairs_thread_run(int64_t t) -> void
     (unsigned short *) xmalloc(sizeof(unsigned short) * maxhits);
   auto * pgaps =
     (unsigned short *) xmalloc(sizeof(unsigned short) * maxhits);
-  char** pcigar = (char **) xmalloc(sizeof(char *) * maxhits);
+  auto ** pcigar = (cigar_t **) xmalloc(sizeof(cigar_t *) * maxhits);
 
   auto * finalhits
     = (struct hit *) xmalloc(sizeof(struct hit) * seqcount);
 
-  bool cont = true;
+  struct sched_query_s * * batch;
 
-  while (cont)
+  while (scheduler_next(sched, t, & batch) > 0)
     {
-      xpthread_mutex_lock(&mutex_input);
+      const int query_no = batch[0]->seqno;
 
-      int query_no = queries;
+      /* init search info */
+      si->query_no = query_no;
+      si->qsize = db_getabundance(query_no);
+      si->query_head_len = db_getheaderlen(query_no);
+      si->query_head = db_getheader(query_no);
+      si->qseqlen = db_getsequencelen(query_no);
+      si->qsequence = db_getsequence(query_no);
+      si->rejects = 0;
+      si->accepts = 0;
+      si->hit_count = 0;
 
-      if (query_no < seqcount)
+      for(int target = si->query_no + 1;
+          target < seqcount; target++)
         {
-          ++queries;
-
-          /* let other threads read input */
-          xpthread_mutex_unlock(&mutex_input);
-
-          /* init search info */
-          si->query_no = query_no;
-          si->qsize = db_getabundance(query_no);
-          si->query_head_len = db_getheaderlen(query_no);
-          si->query_head = db_getheader(query_no);
-          si->qseqlen = db_getsequencelen(query_no);
-          si->qsequence = db_getsequence(query_no);
-          si->rejects = 0;
-          si->accepts = 0;
-          si->hit_count = 0;
-
-          for(int target = si->query_no + 1;
-              target < seqcount; target++)
+          if (opt_acceptall or search_acceptable_unaligned(si, target))
             {
-              if (opt_acceptall or search_acceptable_unaligned(si, target))
-                {
-                  pseqnos[si->hit_count++] = target;
-                }
+              pseqnos[si->hit_count++] = target;
             }
+        }
 
-          if (si->hit_count)
+      if (si->hit_count)
+        {
+          /* perform alignments */
+
+          search16_qprep(si->s, si->qsequence, si->qseqlen);
+
+          search16(si->s,
+                   si->hit_count,
+                   pseqnos,
+                   pscores,
+                   paligned,
+                   pmatches,
+                   pmismatches,
+                   pgaps,
+                   pcigar);
+
+          /* convert to hit structure */
+          for (int h = 0; h < si->hit_count; h++)
             {
-              /* perform alignments */
-
-              search16_qprep(si->s, si->qsequence, si->qseqlen);
-
-              search16(si->s,
-                       si->hit_count,
-                       pseqnos,
-                       pscores,
-                       paligned,
-                       pmatches,
-                       pmismatches,
-                       pgaps,
-                       pcigar);
-
-              /* convert to hit structure */
-              for (int h = 0; h < si->hit_count; h++)
-                {
-                  struct hit * hit = si->hits + h;
+              struct hit * hit = si->hits + h;
 
-                  unsigned int target = pseqnos[h];
-                  int64_t nwscore = pscores[h];
+              unsigned int target = pseqnos[h];
+              int64_t nwscore = pscores[h];
 
-                  char * nwcigar {nullptr};
-                  int64_t nwalignmentlength {0};
-                  int64_t nwmatches {0};
-                  int64_t nwmismatches {0};
-                  int64_t nwgaps {0};
+              cigar_t * nwcigar {nullptr};
+              int64_t nwalignmentlength {0};
+              int64_t nwmatches {0};
+              int64_t nwmismatches {0};
+              int64_t nwgaps {0};
 
-                  if (nwscore == std::numeric_limits<short>::max())
-                    {
-                      /* In case the SIMD aligner cannot align,
-                         perform a new alignment with the
-                         linear memory aligner */
-
-                      char * tseq = db_getsequence(target);
-                      int64_t tseqlen = db_getsequencelen(target);
-
-                      if (pcigar[h])
-                        {
-                          xfree(pcigar[h]);
-                        }
-
-                      nwcigar = xstrdup(lma.align(si->qsequence,
-                                                  tseq,
-                                                  si->qseqlen,
-                                                  tseqlen));
-                      lma.alignstats(nwcigar,
-                                     si->qsequence,
-                                     tseq,
-                                     & nwscore,
-                                     & nwalignmentlength,
-                                     & nwmatches,
-                                     & nwmismatches,
-                                     & nwgaps);
-                    }
-                  else
-                    {
-                      nwcigar = pcigar[h];
-                      nwalignmentlength = paligned[h];
-                      nwmatches = pmatches[h];
-                      nwmismatches = pmismatches[h];
-                      nwgaps = pgaps[h];
-                    }
+              if (nwscore == std::numeric_limits<short>::max())
+                {
+                  /* In case the SIMD aligner cannot align,
+                     perform a new alignment with the
+                     linear memory aligner */
+
+                  char * tseq = db_getsequence(target);
+                  int64_t tseqlen = db_getsequencelen(target);
 
-                  hit->target = target;
-                  hit->strand = 0;
-                  hit->count = 0;
-
-                  hit->accepted = false;
-                  hit->rejected = false;
-                  hit->aligned = true;
-                  hit->weak = false;
-
-                  hit->nwscore = nwscore;
-                  hit->nwdiff = nwalignmentlength - nwmatches;
-                  hit->nwgaps = nwgaps;
-                  hit->nwindels = nwalignmentlength - nwmatches - nwmismatches;
-                  hit->nwalignmentlength = nwalignmentlength;
-                  hit->nwid = 100.0 * (nwalignmentlength - hit->nwdiff) /
-                    nwalignmentlength;
-                  hit->nwalignment = nwcigar;
-                  hit->matches = nwalignmentlength - hit->nwdiff;
-                  hit->mismatches = hit->nwdiff - hit->nwindels;
-
-                  int64_t dseqlen = db_getsequencelen(target);
-                  hit->shortest = MIN(si->qseqlen, dseqlen);
-                  hit->longest = MAX(si->qseqlen, dseqlen);
-
-                  /* trim alignment, compute numbers excluding terminal gaps */
-                  align_trim(hit);
-
-                  /* test accept/reject criteria after alignment */
-                  if (opt_acceptall or search_acceptable_aligned(si, hit))
+                  if (pcigar[h])
                     {
-                      finalhits[si->accepts++] = *hit;
+                      xfree(pcigar[h]);
                     }
+
+                  nwcigar = cigar_dup(lma.align(si->qsequence,
+                                                tseq,
+                                                si->qseqlen,
+                                                tseqlen));
+                  lma.alignstats(nwcigar,
+                                 si->qsequence,
+                                 tseq,
+                                 & nwscore,
+                                 & nwalignmentlength,
+                                 & nwmatches,
+                                 & nwmismatches,
+                                 & nwgaps);
+                }
+              else
+                {
+                  nwcigar = pcigar[h];
+                  nwalignmentlength = paligned[h];
+                  nwmatches = pmatches[h];
+                  nwmismatches = pmismatches[h];
+                  nwgaps = pgaps[h];
                 }
 
-              /* sort hits */
-              qsort(finalhits, si->accepts,
-                    sizeof(struct hit), allpairs_hit_compare);
+              hit->target = target;
+              hit->strand = 0;
+              hit->count = 0;
+
+              hit->accepted = false;
+              hit->rejected = false;
+              hit->aligned = true;
+              hit->weak = false;
+
+              hit->nwscore = nwscore;
+              hit->nwdiff = nwalignmentlength - nwmatches;
+              hit->nwgaps = nwgaps;
+              hit->nwindels = nwalignmentlength - nwmatches - nwmismatches;
+              hit->nwalignmentlength = nwalignmentlength;
+              hit->nwid = 100.0 * (nwalignmentlength - hit->nwdiff) /
+                nwalignmentlength;
+              hit->nwalignment = nwcigar;
+              hit->matches = nwalignmentlength - hit->nwdiff;
+              hit->mismatches = hit->nwdiff - hit->nwindels;
+
+              int64_t dseqlen = db_getsequencelen(target);
+              hit->shortest = MIN(si->qseqlen, dseqlen);
+              hit->longest = MAX(si->qseqlen, dseqlen);
+
+              /* trim alignment, compute numbers excluding terminal gaps */
+              align_trim(hit);
+
+              /* test accept/reject criteria after alignment */
+              if (opt_acceptall or search_acceptable_aligned(si, hit))
+                {
+                  finalhits[si->accepts++] = *hit;
+                }
             }
 
-          /* lock mutex for update of global data and output */
-          xpthread_mutex_lock(&mutex_output);
+          /* sort hits */
+          qsort(finalhits, si->accepts,
+                sizeof(struct hit), allpairs_hit_compare);
+        }
 
-          /* output results */
-          allpairs_output_results(si->accepts,
-                                  finalhits,
-                                  si->query_head,
-                                  si->qseqlen,
-                                  si->qsequence,
-                                  nullptr);
+      /* lock mutex for update of global data and output */
+      xpthread_mutex_lock(&mutex_output);
 
-          /* update stats */
-          if (si->accepts)
-            {
-              ++qmatches;
-            }
+      /* output results */
+      allpairs_output_results(si->accepts,
+                              finalhits,
+                              si->query_head,
+                              si->qseqlen,
+                              si->qsequence,
+                              nullptr);
+
+      /* update stats */
+      ++queries;
+      if (si->accepts)
+        {
+          ++qmatches;
+        }
 
-          /* show progress */
-          progress += seqcount - query_no - 1;
-          progress_update(progress);
+      /* show progress */
+      progress += seqcount - query_no - 1;
+      progress_update(progress);
 
-          xpthread_mutex_unlock(&mutex_output);
+      xpthread_mutex_unlock(&mutex_output);
 
-          /* free memory for alignment strings */
-          for(int i = 0; i < si->hit_count; i++)
+      /* free memory for alignment strings */
+      for(int i = 0; i < si->hit_count; i++)
+        {
+          if (si->hits[i].aligned)
             {
-              if (si->hits[i].aligned)
-                {
-                  xfree(si->hits[i].nwalignment);
-                }
+              xfree(si->hits[i].nwalignment);
             }
         }
-      else
-        {
-          /* let other threads read input */
-          xpthread_mutex_unlock(&mutex_input);
-
-          cont = false;
-        }
     }
 
   xfree(finalhits);
@@ -715,8 +699,8 @@ auto allpairs_global(char * cmdline, char * progheader) -> void
 
   pthread = (pthread_t *) xmalloc(opt_threads * sizeof(pthread_t));
 
-  /* init mutexes for input and output */
-  xpthread_mutex_init(&mutex_input, nullptr);
+  /* init scheduler for input and mutex for output */
+  sched = scheduler_init_db(opt_threads, 1);
   xpthread_mutex_init(&mutex_output, nullptr);
 
   progress = 0;
@@ -747,7 +731,7 @@ auto allpairs_global(char * cmdline, char * progheader) -> void
     }
 
   xpthread_mutex_destroy(&mutex_output);
-  xpthread_mutex_destroy(&mutex_input);
+  scheduler_exit(sched);
 
   xfree(pthread);
 
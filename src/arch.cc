@@ -59,11 +59,16 @@
 */
 
 #include "vsearch.h"
+#include <cerrno>  // errno, EWOULDBLOCK
 #include <cstdio>  // std::FILE
 #include <cstdint>  // uint64_t
 
+#ifndef _WIN32
+#include <sys/file.h>  // flock
+#endif
+
 
-const int memalignment = 16;
+const int memalignment = 64;  /* enough for AVX-512 vectors */
 
 auto arch_get_memused() -> uint64_t
 {
@@ -320,6 +325,112 @@ auto xopen_write(const char * path) -> int
 #endif
 }
 
+auto xshm_open_read(const char * name) -> int
+{
+  /* open an existing POSIX shared memory object, return -1 on failure */
+#ifdef _WIN32
+  (void) name;
+  return -1;
+#else
+  return shm_open(name, O_RDONLY, 0);
+#endif
+}
+
+auto xshm_open_create(const char * name) -> int
+{
+  /* create a new shared memory object, fail if it already exists */
+#ifdef _WIN32
+  (void) name;
+  return -1;
+#else
+  return shm_open(name,
+                  O_RDWR | O_CREAT | O_EXCL,
+                  S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+#endif
+}
+
+auto xshm_unlink(const char * name) -> int
+{
+#ifdef _WIN32
+  (void) name;
+  return -1;
+#else
+  return shm_unlink(name);
+#endif
+}
+
+auto xshm_trylock(int fd) -> bool
+{
+  /*
+    lock a shared memory object exclusively without waiting, the lock
+    is released when the object is closed; return false only if
+    another process holds the lock
+  */
+#ifdef _WIN32
+  (void) fd;
+  return true;
+#else
+  return (flock(fd, LOCK_EX | LOCK_NB) == 0) || (errno != EWOULDBLOCK);
+#endif
+}
+
+auto xmmap_read(int fd, uint64_t length) -> void *
+{
+  /* map a whole file read-only and shared, return nullptr on failure */
+#ifdef _WIN32
+  HANDLE fh = (HANDLE) _get_osfhandle(fd);
+  HANDLE mh = CreateFileMapping(fh, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  if (! mh)
+    {
+      return nullptr;
+    }
+  void * addr = MapViewOfFile(mh, FILE_MAP_READ, 0, 0, length);
+  CloseHandle(mh);
+  return addr;
+#else
+  void * addr = mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0);
+  if (addr == MAP_FAILED)
+    {
+      return nullptr;
+    }
+  return addr;
+#endif
+}
+
+auto xmmap_write(int fd, uint64_t length) -> void *
+{
+  /*
+    set the size of a new file or shared memory object and map it
+    writable and shared, return nullptr on failure
+  */
+#ifdef _WIN32
+  (void) fd;
+  (void) length;
+  return nullptr;
+#else
+  if (ftruncate(fd, length) != 0)
+    {
+      return nullptr;
+    }
+  void * addr = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (addr == MAP_FAILED)
+    {
+      return nullptr;
+    }
+  return addr;
+#endif
+}
+
+auto xmunmap(void * addr, uint64_t length) -> void
+{
+#ifdef _WIN32
+  (void) length;
+  UnmapViewOfFile(addr);
+#else
+  munmap(addr, length);
+#endif
+}
+
 auto xstrcasestr(const char * haystack, const char * needle) -> const char *
 {
 #ifdef _WIN32
@@ -86,6 +86,15 @@ auto xftello(std::FILE * stream) -> uint64_t;
 auto xopen_read(const char * path) -> int;
 auto xopen_write(const char * path) -> int;
 
+auto xshm_open_read(const char * name) -> int;
+auto xshm_open_create(const char * name) -> int;
+auto xshm_unlink(const char * name) -> int;
+auto xshm_trylock(int fd) -> bool;
+
+auto xmmap_read(int fd, uint64_t length) -> void *;
+auto xmmap_write(int fd, uint64_t length) -> void *;
+auto xmunmap(void * addr, uint64_t length) -> void;
+
 auto xstrcasestr(const char * haystack, const char * needle) -> const char *;
 
 #ifdef _WIN32
@@ -0,0 +1,164 @@
+/*
+
+  VSEARCH: a versatile open source tool for metagenomics
+
+  Copyright (C) 2014-2024, Torbjorn Rognes, Frederic Mahe and Tomas Flouri
+  All rights reserved.
+
+  Contact: Torbjorn Rognes <torognes@ifi.uio.no>,
+  Department of Informatics, University of Oslo,
+  PO Box 1080 Blindern, NO-0316 Oslo, Norway
+
+  This software is dual-licensed and available under a choice
+  of one of two licenses, either under the terms of the GNU
+  General Public License version 3 or the BSD 2-Clause License.
+
+
+  GNU General Public License version 3
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+  The BSD 2-Clause License
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+
+  1. Redistributions of source code must retain the above copyright
+  notice, this list of conditions and the following disclaimer.
+
+  2. Redistributions in binary form must reproduce the above copyright
+  notice, this list of conditions and the following disclaimer in the
+  documentation and/or other materials provided with the distribution.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+  COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include "vsearch.h"
+#include <cstddef>  // std::size_t
+#include <cstring>  // std::strlen, std::memcpy
+
+
+/*
+  The arena is a list of blocks. Allocations are taken from the end of
+  the current block; when it is full a new block at least twice as
+  large is added in front. When the arena is reset with more than one
+  block, the blocks are replaced by a single block of their combined
+  size, so that the next query of the same size fits in one block.
+*/
+
+struct arena_block_s
+{
+  struct arena_block_s * next;
+  std::size_t size;
+  std::size_t used;
+  alignas(16) char data[16];
+};
+
+struct arena_s
+{
+  struct arena_block_s * block;
+};
+
+constexpr std::size_t arena_align = 16;
+constexpr std::size_t arena_min_block = 65536;
+
+
+auto arena_block_alloc(std::size_t size) -> struct arena_block_s *
+{
+  auto * b = (struct arena_block_s *)
+    xmalloc(offsetof(struct arena_block_s, data) + size);
+  b->next = nullptr;
+  b->size = size;
+  b->used = 0;
+  return b;
+}
+
+
+auto arena_init() -> struct arena_s *
+{
+  auto * a = (struct arena_s *) xmalloc(sizeof(struct arena_s));
+  a->block = arena_block_alloc(arena_min_block);
+  return a;
+}
+
+
+auto arena_exit(struct arena_s * a) -> void
+{
+  while (a->block)
+    {
+      struct arena_block_s * next = a->block->next;
+      xfree(a->block);
+      a->block = next;
+    }
+  xfree(a);
+}
+
+
+auto arena_reset(struct arena_s * a) -> void
+{
+  if (a->block->next)
+    {
+      std::size_t total = 0;
+      while (a->block)
+        {
+          struct arena_block_s * next = a->block->next;
+          total += a->block->size;
+          xfree(a->block);
+          a->block = next;
+        }
+      a->block = arena_block_alloc(total);
+    }
+  a->block->used = 0;
+}
+
+
+auto arena_alloc(struct arena_s * a, std::size_t size) -> void *
+{
+  size = (size + arena_align - 1) & ~(arena_align - 1);
+
+  if (a->block->used + size > a->block->size)
+    {
+      std::size_t grow = 2 * a->block->size;
+      struct arena_block_s * b = arena_block_alloc(MAX(grow, size));
+      b->next = a->block;
+      a->block = b;
+    }
+
+  void * p = a->block->data + a->block->used;
+  a->block->used += size;
+  return p;
+}
+
+
+auto arena_strdup(struct arena_s * a, const char * s) -> char *
+{
+  std::size_t len = std::strlen(s) + 1;
+  auto * p = (char *) arena_alloc(a, len);
+  std::memcpy(p, s, len);
+  return p;
+}
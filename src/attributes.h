@@ -62,6 +62,13 @@
 #include <cstdio>  // std::FILE
 
 
+auto header_find_attribute(const char * header,
+                           int header_length,
+                           const char * attribute,
+                           int * start,
+                           int * end,
+                           bool allow_decimal) -> bool;
+
 auto header_get_size(char * header, int header_length) -> int64_t;
 
 auto header_fprint_strip(std::FILE * fp,
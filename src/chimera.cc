@@ -85,9 +85,9 @@ static int tophits;
 static pthread_attr_t attr;
 static pthread_t * pthread;
 static fastx_handle query_fasta_h;
+static struct scheduler_s * sched;
 
 /* mutexes and global data protected by mutex */
-static pthread_mutex_t mutex_input;
 static pthread_mutex_t mutex_output;
 static unsigned int seqno = 0;
 static uint64_t progress = 0;
@@ -134,7 +134,7 @@ struct chimera_info_s
   int64_t nwmatches[maxcandidates];
   int64_t nwmismatches[maxcandidates];
   int64_t nwgaps[maxcandidates];
-  char * nwcigar[maxcandidates];
+  cigar_t * nwcigar[maxcandidates];
 
   int match_size;
   int * match;
@@ -262,16 +262,12 @@ auto find_matches(struct chimera_info_s * ci) -> void
       int qpos = 0;
       int tpos = 0;
 
-      char * p = ci->nwcigar[i];
-      char * e = p + strlen(p);
+      cigar_t * p = ci->nwcigar[i];
 
-      while (p < e)
+      while (*p)
         {
-          int run = 1;
-          int scanlength = 0;
-          sscanf(p, "%d%n", &run, &scanlength);
-          p += scanlength;
-          char op = *p++;
+          int run = cigar_run(*p);
+          char op = cigar_op(*p++);
           switch (op)
             {
             case 'M':
@@ -645,16 +641,12 @@ auto find_max_alignment_length(struct chimera_info_s * ci) -> int
   for (int f = 0; f < ci->parents_found; f++)
     {
       int best_parent = ci->best_parents[f];
-      char * p = ci->nwcigar[best_parent];
-      char * e = p + strlen(p);
+      cigar_t * p = ci->nwcigar[best_parent];
       int pos = 0;
-      while (p < e)
+      while (*p)
         {
-          int run = 1;
-          int scanlength = 0;
-          sscanf(p, "%d%n", &run, &scanlength);
-          p += scanlength;
-          char op = *p++;
+          int run = cigar_run(*p);
+          char op = cigar_op(*p++);
           switch (op)
             {
             case 'M':
@@ -698,16 +690,12 @@ auto fill_alignment_parents(struct chimera_info_s * ci) -> void
       int tpos = 0;
 
       char * t = ci->paln[j];
-      char * p = ci->nwcigar[cand];
-      char * e = p + strlen(p);
+      cigar_t * p = ci->nwcigar[cand];
 
-      while (p < e)
+      while (*p)
         {
-          int run = 1;
-          int scanlength = 0;
-          sscanf(p, "%d%n", &run, &scanlength);
-          p += scanlength;
-          char op = *p++;
+          int run = cigar_run(*p);
+          char op = cigar_op(*p++);
 
           if (op == 'I')
             {
@@ -1634,7 +1622,10 @@ auto query_init(struct searchinfo_s * si) -> void
   si->qsequence = nullptr;
   si->kmers = nullptr;
   si->hits = (struct hit *) xmalloc(sizeof(struct hit) * tophits);
-  si->kmers = (count_t *) xmalloc(db_getsequencecount() * sizeof(count_t) + 32);
+  const auto kmers_count = MIN(db_getsequencecount(), search_tile_size);
+  si->kmers = (count_t *) xmalloc(kmers_count * sizeof(count_t) + 32);
+  si->kmercursor = nullptr;
+  si->kmercursor_alloc = 0;
   si->hit_count = 0;
   si->uh = unique_init();
   si->s = search16_init(opt_match,
@@ -1653,10 +1644,12 @@ auto query_init(struct searchinfo_s * si) -> void
                         opt_gap_extension_target_right);
   si->nw = nw_init();
   si->m = minheap_init(tophits);
+  search_scratch_init(si);
 }
 
 auto query_exit(struct searchinfo_s * si) -> void
 {
+  search_scratch_exit(si);
   search16_exit(si->s);
   unique_exit(si->uh);
   minheap_exit(si->m);
@@ -1677,6 +1670,11 @@ auto query_exit(struct searchinfo_s * si) -> void
       xfree(si->kmers);
       si->kmers = nullptr;
     }
+  if (si->kmercursor)
+    {
+      xfree(si->kmercursor);
+      si->kmercursor = nullptr;
+    }
 }
 
 auto partition_query(struct chimera_info_s * ci) -> void
@@ -1846,58 +1844,25 @@ auto chimera_thread_core(struct chimera_info_s * ci) -> uint64_t
                      opt_gap_extension_query_right,
                      opt_gap_extension_target_right);
 
-  while(true)
+  struct sched_query_s * * batch;
+
+  while (scheduler_next(sched, ci - cia, & batch) > 0)
     {
       /* get next sequence */
 
-      xpthread_mutex_lock(&mutex_input);
+      struct sched_query_s * query = batch[0];
 
-      if (opt_uchime_ref)
-        {
-          if (fasta_next(query_fasta_h, not opt_notrunclabels,
-                         chrmap_no_change))
-            {
-              ci->query_head_len = fasta_get_header_length(query_fasta_h);
-              ci->query_len = fasta_get_sequence_length(query_fasta_h);
-              ci->query_no = fasta_get_seqno(query_fasta_h);
-              ci->query_size = fasta_get_abundance(query_fasta_h);
+      ci->query_no = query->seqno;
+      ci->query_head_len = query->header_len;
+      ci->query_len = query->sequence_len;
+      ci->query_size = query->size;
 
-              /* if necessary expand memory for arrays based on query length */
-              realloc_arrays(ci);
-
-              /* copy the data locally (query seq, head) */
-              strcpy(ci->query_head, fasta_get_header(query_fasta_h));
-              strcpy(ci->query_seq, fasta_get_sequence(query_fasta_h));
-            }
-          else
-            {
-              xpthread_mutex_unlock(&mutex_input);
-              break; /* end while loop */
-            }
-        }
-      else
-        {
-          if (seqno < db_getsequencecount())
-            {
-              ci->query_no = seqno;
-              ci->query_head_len = db_getheaderlen(seqno);
-              ci->query_len = db_getsequencelen(seqno);
-              ci->query_size = db_getabundance(seqno);
-
-              /* if necessary expand memory for arrays based on query length */
-              realloc_arrays(ci);
-
-              strcpy(ci->query_head, db_getheader(seqno));
-              strcpy(ci->query_seq, db_getsequence(seqno));
-            }
-          else
-            {
-              xpthread_mutex_unlock(&mutex_input);
-              break; /* end while loop */
-            }
-        }
+      /* if necessary expand memory for arrays based on query length */
+      realloc_arrays(ci);
 
-      xpthread_mutex_unlock(&mutex_input);
+      /* copy the data locally (query seq, head) */
+      strcpy(ci->query_head, query->header);
+      strcpy(ci->query_seq, query->sequence);
 
 
 
@@ -1925,7 +1890,6 @@ auto chimera_thread_core(struct chimera_info_s * ci) -> uint64_t
                       allhits_list[allhits_count++] = hits[j];
                     }
                 }
-              xfree(hits);
             }
         }
 
@@ -1947,13 +1911,6 @@ auto chimera_thread_core(struct chimera_info_s * ci) -> uint64_t
             {
               ci->cand_list[ci->cand_count++] = target;
             }
-
-          /* deallocate cigar */
-          if (allhits_list[i].nwalignment)
-            {
-              xfree(allhits_list[i].nwalignment);
-              allhits_list[i].nwalignment = nullptr;
-            }
         }
 
 
@@ -1975,7 +1932,7 @@ auto chimera_thread_core(struct chimera_info_s * ci) -> uint64_t
         {
           int64_t target = ci->cand_list[i];
           int64_t nwscore = ci->snwscore[i];
-          char * nwcigar;
+          cigar_t * nwcigar;
           int64_t nwalignmentlength;
           int64_t nwmatches;
           int64_t nwmismatches;
@@ -1995,10 +1952,10 @@ auto chimera_thread_core(struct chimera_info_s * ci) -> uint64_t
                   xfree(ci->nwcigar[i]);
                 }
 
-              nwcigar = xstrdup(lma.align(ci->query_seq,
-                                          tseq,
-                                          ci->query_len,
-                                          tseqlen));
+              nwcigar = cigar_dup(lma.align(ci->query_seq,
+                                            tseq,
+                                            ci->query_len,
+                                            tseqlen));
               lma.alignstats(nwcigar,
                              ci->query_seq,
                              tseq,
@@ -2179,7 +2136,7 @@ auto chimera_thread_core(struct chimera_info_s * ci) -> uint64_t
 
       if (opt_uchime_ref)
         {
-          progress = fasta_get_position(query_fasta_h);
+          progress = query->progress;
         }
       else
         {
@@ -2304,8 +2261,7 @@ auto chimera() -> void
   cia = (struct chimera_info_s *) xmalloc(opt_threads *
                                           sizeof(struct chimera_info_s));
 
-  /* init mutexes for input and output */
-  xpthread_mutex_init(&mutex_input, nullptr);
+  /* init mutex for output */
   xpthread_mutex_init(&mutex_output, nullptr);
 
   char * denovo_dbname = nullptr;
@@ -2321,7 +2277,7 @@ auto chimera() -> void
         {
           udb_read(opt_db, true, true);
         }
-      else
+      else if (not udb_cache_lookup(opt_db, true))
         {
           db_read(opt_db, 0);
           if (opt_dbmask == MASK_DUST)
@@ -2332,8 +2288,21 @@ auto chimera() -> void
             {
               hardmask_all();
             }
-          dbindex_prepare(1, opt_dbmask);
-          dbindex_addallsequences(opt_dbmask);
+          if (opt_index_compress and not udb_cache_pending())
+            {
+              dbindex_prepare_packed(1, opt_dbmask);
+            }
+          else
+            {
+              dbindex_prepare(1, opt_dbmask);
+              dbindex_addallsequences(opt_dbmask);
+              udb_cache_store();
+            }
+        }
+
+      if (opt_index_compress)
+        {
+          dbindex_pack();
         }
 
       query_fasta_h = fasta_open(opt_uchime_ref);
@@ -2373,7 +2342,7 @@ auto chimera() -> void
         }
 
       db_sortbyabundance();
-      dbindex_prepare(1, opt_qmask);
+      dbindex_prepare_growable(1);
       progress_total = db_getnucleotidecount();
     }
 
@@ -2415,8 +2384,20 @@ auto chimera() -> void
 
   progress_init("Detecting chimeras", progress_total);
 
+  /* queries are read from the file or taken from the database in order */
+  if (opt_uchime_ref)
+    {
+      sched = scheduler_init_fastx(query_fasta_h, opt_threads, 1);
+    }
+  else
+    {
+      sched = scheduler_init_db(opt_threads, 1);
+    }
+
   chimera_threads_run();
 
+  scheduler_exit(sched);
+
   progress_done();
 
   if (not opt_quiet)
@@ -2578,7 +2559,6 @@ auto chimera() -> void
   db_free();
 
   xpthread_mutex_destroy(&mutex_output);
-  xpthread_mutex_destroy(&mutex_input);
 
   xfree(cia);
   xfree(pthread);
@@ -0,0 +1,117 @@
+/*
+
+  VSEARCH: a versatile open source tool for metagenomics
+
+  Copyright (C) 2014-2024, Torbjorn Rognes, Frederic Mahe and Tomas Flouri
+  All rights reserved.
+
+  Contact: Torbjorn Rognes <torognes@ifi.uio.no>,
+  Department of Informatics, University of Oslo,
+  PO Box 1080 Blindern, NO-0316 Oslo, Norway
+
+  This software is dual-licensed and available under a choice
+  of one of two licenses, either under the terms of the GNU
+  General Public License version 3 or the BSD 2-Clause License.
+
+
+  GNU General Public License version 3
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+  The BSD 2-Clause License
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+
+  1. Redistributions of source code must retain the above copyright
+  notice, this list of conditions and the following disclaimer.
+
+  2. Redistributions in binary form must reproduce the above copyright
+  notice, this list of conditions and the following disclaimer in the
+  documentation and/or other materials provided with the distribution.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+  COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include "vsearch.h"
+#include <cinttypes>  // macros PRId64
+#include <cstdio>  // std::FILE, std::fprintf, std::fputc
+#include <cstring>  // std::memcpy
+
+
+auto cigar_count(const cigar_t * cigar) -> int64_t
+{
+  /* number of words, excluding the terminating zero word */
+  const cigar_t * p = cigar;
+  while (*p)
+    {
+      ++p;
+    }
+  return p - cigar;
+}
+
+
+auto cigar_dup(const cigar_t * cigar) -> cigar_t *
+{
+  const std::size_t size = (cigar_count(cigar) + 1) * sizeof(cigar_t);
+  auto * copy = (cigar_t *) xmalloc(size);
+  std::memcpy(copy, cigar, size);
+  return copy;
+}
+
+
+auto cigar_arena_dup(struct arena_s * a, const cigar_t * cigar) -> cigar_t *
+{
+  const std::size_t size = (cigar_count(cigar) + 1) * sizeof(cigar_t);
+  auto * copy = (cigar_t *) arena_alloc(a, size);
+  std::memcpy(copy, cigar, size);
+  return copy;
+}
+
+
+auto cigar_fprint(std::FILE * fp, const cigar_t * cigar) -> void
+{
+  /* write the cigar in text form, joining runs split over words */
+  const cigar_t * p = cigar;
+  while (*p)
+    {
+      const char op = cigar_op(*p);
+      int64_t run = 0;
+      while (*p and (cigar_op(*p) == op))
+        {
+          run += cigar_run(*p);
+          ++p;
+        }
+      if (run > 1)
+        {
+          fprintf(fp, "%" PRId64, run);
+        }
+      fputc(op, fp);
+    }
+}
+
@@ -0,0 +1,101 @@
+/*
+
+  VSEARCH: a versatile open source tool for metagenomics
+
+  Copyright (C) 2014-2024, Torbjorn Rognes, Frederic Mahe and Tomas Flouri
+  All rights reserved.
+
+  Contact: Torbjorn Rognes <torognes@ifi.uio.no>,
+  Department of Informatics, University of Oslo,
+  PO Box 1080 Blindern, NO-0316 Oslo, Norway
+
+  This software is dual-licensed and available under a choice
+  of one of two licenses, either under the terms of the GNU
+  General Public License version 3 or the BSD 2-Clause License.
+
+
+  GNU General Public License version 3
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+  The BSD 2-Clause License
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+
+  1. Redistributions of source code must retain the above copyright
+  notice, this list of conditions and the following disclaimer.
+
+  2. Redistributions in binary form must reproduce the above copyright
+  notice, this list of conditions and the following disclaimer in the
+  documentation and/or other materials provided with the distribution.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+  COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include <cstdint>  // uint32_t, int64_t
+#include <cstdio>  // std::FILE
+
+
+/*
+  Packed alignment (cigar): an array of 32-bit words, one for each run
+  of identical operations, terminated by a zero word. The run length
+  is stored in the upper 28 bits and the operation (M, I or D) in the
+  lower 4 bits. Runs longer than cigar_run_max are split over several
+  words with the same operation.
+
+  The text form (e.g. "5MD3M"), with the run length omitted when it
+  is 1, is only produced when an alignment is written out.
+*/
+
+using cigar_t = uint32_t;
+
+constexpr int cigar_op_bits = 4;
+constexpr cigar_t cigar_op_mask = (1U << cigar_op_bits) - 1;
+constexpr int64_t cigar_run_max = (1LL << (32 - cigar_op_bits)) - 1;
+
+inline auto cigar_pack(char op, int64_t run) -> cigar_t
+{
+  cigar_t code = (op == 'M') ? 0 : ((op == 'I') ? 1 : 2);
+  return ((cigar_t) run << cigar_op_bits) | code;
+}
+
+inline auto cigar_op(cigar_t word) -> char
+{
+  return "MID"[word & cigar_op_mask];
+}
+
+inline auto cigar_run(cigar_t word) -> int64_t
+{
+  return word >> cigar_op_bits;
+}
+
+auto cigar_count(const cigar_t * cigar) -> int64_t;
+auto cigar_dup(const cigar_t * cigar) -> cigar_t *;
+auto cigar_arena_dup(struct arena_s * a, const cigar_t * cigar) -> cigar_t *;
+auto cigar_fprint(std::FILE * fp, const cigar_t * cigar) -> void;
@@ -72,7 +72,7 @@ typedef struct clusterinfo_s
 {
   int seqno;
   int clusterno;
-  char * cigar;
+  cigar_t * cigar;
   int strand;
 } clusterinfo_t;
 
@@ -112,10 +112,23 @@ typedef struct thread_info_s
   int work;
   int query_first;
   int query_count;
+  LinearMemoryAligner * lma;
+  int64_t * scorematrix;
 } thread_info_t;
 
 static thread_info_t * ti;
 
+/* work given to the threads: search the queries of the round, or
+   check the remaining queries of the round against a new centroid */
+enum cluster_task_e
+  {
+    cluster_task_search,
+    cluster_task_check
+  };
+
+static cluster_task_e cluster_task = cluster_task_search;
+static int cluster_centroid = 0;
+
 inline int compare_byclusterno(const void * a, const void * b)
 {
   auto * x = (clusterinfo_t *) a;
@@ -200,15 +213,271 @@ inline void cluster_query_core(struct searchinfo_s * si)
   search_onequery(si, opt_qmask);
 }
 
+void cluster_check_centroid(struct searchinfo_s * si,
+                            struct searchinfo_s * sic,
+                            LinearMemoryAligner * lma)
+{
+  /* Check if there is a hit with the new centroid sic, a non-matching
+     query analysed earlier in the same round, that was not yet in the
+     index when query si was searched */
+
+  int added = 0;
+
+  /* find the number of shared unique kmers */
+  unsigned int shared
+    = unique_count_shared(si->uh,
+                          opt_wordlength,
+                          sic->kmersamplecount,
+                          sic->kmersample);
+
+  /* check if min number of shared kmers is satisfied */
+  if (search_enough_kmers(si, shared))
+    {
+      unsigned int length = sic->qseqlen;
+
+      /* Go through the list of hits and see if the current
+         match is better than any on the list in terms of
+         more shared kmers (or shorter length if equal
+         no of kmers). Determine insertion point (x). */
+
+      int x = si->hit_count;
+      while ((x > 0) and
+             ((si->hits[x - 1].count < shared) or
+              ((si->hits[x - 1].count == shared) and
+               (db_getsequencelen(si->hits[x - 1].target)
+                > length))))
+        {
+          --x;
+        }
+
+      if (x < opt_maxaccepts + opt_maxrejects - 1)
+        {
+          /* insert into list at position x */
+
+          /* trash bottom element if no more space */
+          if (si->hit_count >= opt_maxaccepts + opt_maxrejects - 1)
+            {
+              si->hit_count--;
+            }
+
+          /* move the rest down */
+          for(int z = si->hit_count; z > x; z--)
+            {
+              si->hits[z] = si->hits[z - 1];
+            }
+
+          /* init new hit */
+          struct hit * hit = si->hits + x;
+          si->hit_count++;
+
+          hit->target = sic->query_no;
+          hit->strand = si->strand;
+          hit->count = shared;
+          hit->accepted = false;
+          hit->rejected = false;
+          hit->aligned = false;
+          hit->weak = false;
+          hit->nwalignment = nullptr;
+
+          ++added;
+        }
+    }
+
+  /* now go through the hits and determine final status of each */
+
+  if (added)
+    {
+      si->rejects = 0;
+      si->accepts = 0;
+
+      /* set all statuses to undetermined */
+
+      for(int t = 0; t < si->hit_count; t++)
+        {
+          si->hits[t].accepted = false;
+          si->hits[t].rejected = false;
+        }
+
+      for(int t = 0;
+          (si->accepts < opt_maxaccepts) and
+            (si->rejects < opt_maxrejects) and
+            (t < si->hit_count);
+          ++t)
+        {
+          struct hit * hit = si->hits + t;
+
+          if (not hit->aligned)
+            {
+              /* Test accept/reject criteria before alignment */
+              unsigned int target = hit->target;
+              if (search_acceptable_unaligned(si, target))
+                {
+                  /* perform vectorized alignment */
+                  /* but only using 1 sequence ! */
+
+                  unsigned int nwtarget = target;
+
+                  int64_t nwscore;
+                  int64_t nwalignmentlength;
+                  int64_t nwmatches;
+                  int64_t nwmismatches;
+                  int64_t nwgaps;
+                  cigar_t * nwcigar = nullptr;
+
+                  /* short variants for simd aligner */
+                  CELL snwscore;
+                  unsigned short snwalignmentlength;
+                  unsigned short snwmatches;
+                  unsigned short snwmismatches;
+                  unsigned short snwgaps;
+
+                  search16(si->s,
+                           1,
+                           & nwtarget,
+                           & snwscore,
+                           & snwalignmentlength,
+                           & snwmatches,
+                           & snwmismatches,
+                           & snwgaps,
+                           & nwcigar);
+
+                  int64_t tseqlen = db_getsequencelen(target);
+
+                  if (snwscore == std::numeric_limits<short>::max())
+                    {
+                      /* In case the SIMD aligner cannot align,
+                         perform a new alignment with the
+                         linear memory aligner */
+
+                      char * tseq = db_getsequence(target);
+
+                      nwcigar = cigar_arena_dup(si->arena,
+                                                lma->align(si->qsequence,
+                                                           tseq,
+                                                           si->qseqlen,
+                                                           tseqlen));
+
+                      lma->alignstats(nwcigar,
+                                      si->qsequence,
+                                      tseq,
+                                      & nwscore,
+                                      & nwalignmentlength,
+                                      & nwmatches,
+                                      & nwmismatches,
+                                      & nwgaps);
+                    }
+                  else
+                    {
+                      nwscore = snwscore;
+                      nwalignmentlength = snwalignmentlength;
+                      nwmatches = snwmatches;
+                      nwmismatches = snwmismatches;
+                      nwgaps = snwgaps;
+                    }
+
+
+                  int64_t nwdiff = nwalignmentlength - nwmatches;
+                  int64_t nwindels = nwdiff - nwmismatches;
+
+                  hit->aligned = true;
+                  hit->nwalignment = nwcigar;
+                  hit->nwscore = nwscore;
+                  hit->nwdiff = nwdiff;
+                  hit->nwgaps = nwgaps;
+                  hit->nwindels = nwindels;
+                  hit->nwalignmentlength = nwalignmentlength;
+                  hit->matches = nwmatches;
+                  hit->mismatches = nwmismatches;
+
+                  hit->nwid = 100.0 *
+                    (nwalignmentlength - hit->nwdiff) /
+                    nwalignmentlength;
+
+                  hit->shortest = MIN(si->qseqlen, tseqlen);
+                  hit->longest = MAX(si->qseqlen, tseqlen);
+
+                  /* trim alignment and compute numbers
+                     excluding terminal gaps */
+                  align_trim(hit);
+                }
+              else
+                {
+                  /* rejection without alignment */
+                  hit->rejected = true;
+                  si->rejects++;
+                }
+            }
+
+          if (not hit->rejected)
+            {
+              /* test accept/reject criteria after alignment */
+              if (search_acceptable_aligned(si, hit))
+                {
+                  si->accepts++;
+                }
+              else
+                {
+                  si->rejects++;
+                }
+            }
+        }
+
+      /* delete all undetermined hits */
+
+      int new_hit_count = si->hit_count;
+      for(int t = si->hit_count - 1; t >= 0; t--)
+        {
+          struct hit * hit = si->hits + t;
+          if (not hit->accepted and not hit->rejected)
+            {
+              new_hit_count = t;
+            }
+        }
+      si->hit_count = new_hit_count;
+    }
+}
+
+auto cluster_lma_init(LinearMemoryAligner * lma) -> int64_t *
+{
+  int64_t * scorematrix = lma->scorematrix_create(opt_match, opt_mismatch);
+  lma->set_parameters(scorematrix,
+                      opt_gap_open_query_left,
+                      opt_gap_open_target_left,
+                      opt_gap_open_query_interior,
+                      opt_gap_open_target_interior,
+                      opt_gap_open_query_right,
+                      opt_gap_open_target_right,
+                      opt_gap_extension_query_left,
+                      opt_gap_extension_target_left,
+                      opt_gap_extension_query_interior,
+                      opt_gap_extension_target_interior,
+                      opt_gap_extension_query_right,
+                      opt_gap_extension_target_right);
+  return scorematrix;
+}
+
 inline void cluster_worker(int64_t t)
 {
   /* wrapper for the main threaded core function for clustering */
   for (int q = 0; q < ti[t].query_count; q++)
     {
-      cluster_query_core(si_plus + ti[t].query_first + q);
-      if (opt_strand > 1)
+      const int i = ti[t].query_first + q;
+      if (cluster_task == cluster_task_search)
+        {
+          cluster_query_core(si_plus + i);
+          if (opt_strand > 1)
+            {
+              cluster_query_core(si_minus + i);
+            }
+        }
+      else
         {
-          cluster_query_core(si_minus + ti[t].query_first + q);
+          struct searchinfo_s * sic = si_plus + cluster_centroid;
+          cluster_check_centroid(si_plus + i, sic, ti[t].lma);
+          if (opt_strand > 1)
+            {
+              cluster_check_centroid(si_minus + i, sic, ti[t].lma);
+            }
         }
     }
 }
@@ -237,12 +506,11 @@ void * threads_worker(void * vp)
   return nullptr;
 }
 
-void threads_wakeup(int queries)
+void threads_wakeup(int query_first, int queries, int threads)
 {
-  int threads = queries > opt_threads ? opt_threads : queries;
   int queries_rest = queries;
   int threads_rest = threads;
-  int query_next = 0;
+  int query_next = query_first;
 
   /* tell the threads that there is work to do */
   for(int t = 0; t < threads; t++)
@@ -287,6 +555,8 @@ void threads_init()
     {
       thread_info_t * tip = ti + t;
       tip->work = 0;
+      tip->lma = new LinearMemoryAligner;
+      tip->scorematrix = cluster_lma_init(tip->lma);
       xpthread_mutex_init(&tip->mutex, nullptr);
       xpthread_cond_init(&tip->cond, nullptr);
       xpthread_create(&tip->thread, &attr, threads_worker, (void*)(int64_t)t);
@@ -311,6 +581,9 @@ void threads_exit()
 
       xpthread_cond_destroy(&tip->cond);
       xpthread_mutex_destroy(&tip->mutex);
+
+      delete tip->lma;
+      xfree(tip->scorematrix);
     }
   xfree(ti);
   xpthread_attr_destroy(&attr);
@@ -330,7 +603,10 @@ void cluster_query_init(struct searchinfo_s * si)
   si->seq_alloc = db_getlongestsequence() + 1;
   si->qsequence = (char *) xmalloc(si->seq_alloc);
 
-  si->kmers = (count_t *) xmalloc(seqcount * sizeof(count_t) + 32);
+  const auto kmers_count = MIN((unsigned int) seqcount, search_tile_size);
+  si->kmers = (count_t *) xmalloc(kmers_count * sizeof(count_t) + 32);
+  si->kmercursor = nullptr;
+  si->kmercursor_alloc = 0;
   si->hits = (struct hit *) xmalloc(sizeof(struct hit) * tophits);
 
   si->uh = unique_init();
@@ -350,12 +626,14 @@ void cluster_query_init(struct searchinfo_s * si)
                         opt_gap_extension_query_right,
                         opt_gap_extension_target_right);
   si->nw = nw_init();
+  search_scratch_init(si);
 }
 
 void cluster_query_exit(struct searchinfo_s * si)
 {
   /* clean up after thread execution; called once per thread */
 
+  search_scratch_exit(si);
   search16_exit(si->s);
   unique_exit(si->uh);
   minheap_exit(si->m);
@@ -373,6 +651,10 @@ void cluster_query_exit(struct searchinfo_s * si)
     {
       xfree(si->kmers);
     }
+  if (si->kmercursor)
+    {
+      xfree(si->kmercursor);
+    }
 }
 
 char * relabel_otu(int clusterno, char * sequence, int seqlen)
@@ -594,11 +876,34 @@ void cluster_core_parallel()
   /* create threads and set them in stand-by mode */
   threads_init();
 
-  constexpr static int queries_per_thread = 1;
-  const int max_queries = queries_per_thread * opt_threads;
-
-  /* allocate memory for the search information for each query;
-     and initialize it */
+  /*
+    Queries are searched speculatively in rounds, in parallel, against
+    the centroids already in the index. The results are then committed
+    in input order by the master thread. When a query becomes a new
+    centroid, the remaining queries of the round are checked against
+    it by the threads before they are committed.
+
+    The number of queries in a round (window) adapts to the fraction
+    of queries becoming new centroids, as each of them requires an
+    extra pass over the rest of the round.
+  */
+
+  constexpr static int queries_per_thread = 16;
+  constexpr static int checks_per_thread = 4;
+
+  /* the hit lists of the queries in a round are limited to this
+     much memory, but a round holds at least one query per thread */
+  constexpr static uint64_t hits_maxmem = 256 * 1024 * 1024;
+  const uint64_t hits_per_query = (opt_strand > 1 ? 2 : 1) * (uint64_t) tophits
+    * (sizeof(struct hit) + sizeof(elem_t));
+  const int max_queries
+    = (int) MAX((uint64_t) opt_threads,
+                MIN((uint64_t) queries_per_thread * opt_threads,
+                    hits_maxmem / hits_per_query));
+  int window = opt_threads;
+
+  /* allocate memory for the search information for each query; it is
+     initialized as the window grows */
   si_plus  = (struct searchinfo_s *) xmalloc(max_queries *
                                              sizeof(struct searchinfo_s));
   if (opt_strand > 1)
@@ -606,34 +911,10 @@ void cluster_core_parallel()
       si_minus = (struct searchinfo_s *) xmalloc(max_queries *
                                                  sizeof(struct searchinfo_s));
     }
-  for(int i = 0; i < max_queries; i++)
-    {
-      cluster_query_init(si_plus+i);
-      si_plus[i].strand = 0;
-      if (opt_strand > 1)
-        {
-          cluster_query_init(si_minus + i);
-          si_minus[i].strand = 1;
-        }
-    }
-
-  int * extra_list = (int *) xmalloc(max_queries * sizeof(int));
+  int initialized = 0;
 
   LinearMemoryAligner lma;
-  int64_t * scorematrix = lma.scorematrix_create(opt_match, opt_mismatch);
-  lma.set_parameters(scorematrix,
-                     opt_gap_open_query_left,
-                     opt_gap_open_target_left,
-                     opt_gap_open_query_interior,
-                     opt_gap_open_target_interior,
-                     opt_gap_open_query_right,
-                     opt_gap_open_target_right,
-                     opt_gap_extension_query_left,
-                     opt_gap_extension_target_left,
-                     opt_gap_extension_query_interior,
-                     opt_gap_extension_target_interior,
-                     opt_gap_extension_query_right,
-                     opt_gap_extension_target_right);
+  int64_t * scorematrix = cluster_lma_init(& lma);
 
   int lastlength = INT_MAX;
 
@@ -645,12 +926,23 @@ void cluster_core_parallel()
 
   while(seqno < seqcount)
     {
+      for(; initialized < window; initialized++)
+        {
+          cluster_query_init(si_plus + initialized);
+          si_plus[initialized].strand = 0;
+          if (opt_strand > 1)
+            {
+              cluster_query_init(si_minus + initialized);
+              si_minus[initialized].strand = 1;
+            }
+        }
+
       /* prepare work for the threads in sia[i] */
       /* read query sequences into the search info (si) for each thread */
 
       int queries = 0;
 
-      for(int i = 0; i < max_queries; i++)
+      for(int i = 0; i < window; i++)
         {
           if (seqno < seqcount)
             {
@@ -680,259 +972,17 @@ void cluster_core_parallel()
         }
 
       /* perform work in threads */
-      threads_wakeup(queries);
+      cluster_task = cluster_task_search;
+      threads_wakeup(0, queries, MIN(queries, opt_threads));
 
       /* analyse results */
-      int extra_count = 0;
+      int centroids_new = 0;
 
       for(int i = 0; i < queries; i++)
         {
           struct searchinfo_s * si_p = si_plus + i;
           struct searchinfo_s * si_m = opt_strand > 1 ? si_minus + i : nullptr;
 
-          for(int s = 0; s < opt_strand; s++)
-            {
-              struct searchinfo_s * si = s ? si_m : si_p;
-
-              int added = 0;
-
-              if (extra_count)
-                {
-                  /* Check if there is a hit with one of the non-matching
-                     extra sequences just analysed in this round */
-
-                  for (int j = 0; j < extra_count; j++)
-                    {
-                      struct searchinfo_s * sic = si_plus + extra_list[j];
-
-                      /* find the number of shared unique kmers */
-                      unsigned int shared
-                        = unique_count_shared(si->uh,
-                                              opt_wordlength,
-                                              sic->kmersamplecount,
-                                              sic->kmersample);
-
-                      /* check if min number of shared kmers is satisfied */
-                      if (search_enough_kmers(si, shared))
-                        {
-                          unsigned int length = sic->qseqlen;
-
-                          /* Go through the list of hits and see if the current
-                             match is better than any on the list in terms of
-                             more shared kmers (or shorter length if equal
-                             no of kmers). Determine insertion point (x). */
-
-                          int x = si->hit_count;
-                          while ((x > 0) and
-                                 ((si->hits[x - 1].count < shared) or
-                                  ((si->hits[x - 1].count == shared) and
-                                   (db_getsequencelen(si->hits[x - 1].target)
-                                    > length))))
-                            {
-                              --x;
-                            }
-
-                          if (x < opt_maxaccepts + opt_maxrejects - 1)
-                            {
-                              /* insert into list at position x */
-
-                              /* trash bottom element if no more space */
-                              if (si->hit_count >= opt_maxaccepts + opt_maxrejects - 1)
-                                {
-                                  if (si->hits[si->hit_count-1].aligned)
-                                    {
-                                      xfree(si->hits[si->hit_count - 1].nwalignment);
-                                    }
-                                  si->hit_count--;
-                                }
-
-                              /* move the rest down */
-                              for(int z = si->hit_count; z > x; z--)
-                                {
-                                  si->hits[z] = si->hits[z - 1];
-                                }
-
-                              /* init new hit */
-                              struct hit * hit = si->hits + x;
-                              si->hit_count++;
-
-                              hit->target = sic->query_no;
-                              hit->strand = si->strand;
-                              hit->count = shared;
-                              hit->accepted = false;
-                              hit->rejected = false;
-                              hit->aligned = false;
-                              hit->weak = false;
-                              hit->nwalignment = nullptr;
-
-                              ++added;
-                            }
-                        }
-                    }
-                }
-
-              /* now go through the hits and determine final status of each */
-
-              if (added)
-                {
-                  si->rejects = 0;
-                  si->accepts = 0;
-
-                  /* set all statuses to undetermined */
-
-                  for(int t = 0; t < si->hit_count; t++)
-                    {
-                      si->hits[t].accepted = false;
-                      si->hits[t].rejected = false;
-                    }
-
-                  for(int t = 0;
-                      (si->accepts < opt_maxaccepts) and
-                        (si->rejects < opt_maxrejects) and
-                        (t < si->hit_count);
-                      ++t)
-                    {
-                      struct hit * hit = si->hits + t;
-
-                      if (not hit->aligned)
-                        {
-                          /* Test accept/reject criteria before alignment */
-                          unsigned int target = hit->target;
-                          if (search_acceptable_unaligned(si, target))
-                            {
-                              /* perform vectorized alignment */
-                              /* but only using 1 sequence ! */
-
-                              unsigned int nwtarget = target;
-
-                              int64_t nwscore;
-                              int64_t nwalignmentlength;
-                              int64_t nwmatches;
-                              int64_t nwmismatches;
-                              int64_t nwgaps;
-                              char * nwcigar = nullptr;
-
-                              /* short variants for simd aligner */
-                              CELL snwscore;
-                              unsigned short snwalignmentlength;
-                              unsigned short snwmatches;
-                              unsigned short snwmismatches;
-                              unsigned short snwgaps;
-
-                              search16(si->s,
-                                       1,
-                                       & nwtarget,
-                                       & snwscore,
-                                       & snwalignmentlength,
-                                       & snwmatches,
-                                       & snwmismatches,
-                                       & snwgaps,
-                                       & nwcigar);
-
-                              int64_t tseqlen = db_getsequencelen(target);
-
-                              if (snwscore == std::numeric_limits<short>::max())
-                                {
-                                  /* In case the SIMD aligner cannot align,
-                                     perform a new alignment with the
-                                     linear memory aligner */
-
-                                  char * tseq = db_getsequence(target);
-
-                                  if (nwcigar)
-                                    {
-                                      xfree(nwcigar);
-                                    }
-
-                                  nwcigar = xstrdup(lma.align(si->qsequence,
-                                                              tseq,
-                                                              si->qseqlen,
-                                                              tseqlen));
-
-                                  lma.alignstats(nwcigar,
-                                                 si->qsequence,
-                                                 tseq,
-                                                 & nwscore,
-                                                 & nwalignmentlength,
-                                                 & nwmatches,
-                                                 & nwmismatches,
-                                                 & nwgaps);
-                                }
-                              else
-                                {
-                                  nwscore = snwscore;
-                                  nwalignmentlength = snwalignmentlength;
-                                  nwmatches = snwmatches;
-                                  nwmismatches = snwmismatches;
-                                  nwgaps = snwgaps;
-                                }
-
-
-                              int64_t nwdiff = nwalignmentlength - nwmatches;
-                              int64_t nwindels = nwdiff - nwmismatches;
-
-                              hit->aligned = true;
-                              hit->nwalignment = nwcigar;
-                              hit->nwscore = nwscore;
-                              hit->nwdiff = nwdiff;
-                              hit->nwgaps = nwgaps;
-                              hit->nwindels = nwindels;
-                              hit->nwalignmentlength = nwalignmentlength;
-                              hit->matches = nwmatches;
-                              hit->mismatches = nwmismatches;
-
-                              hit->nwid = 100.0 *
-                                (nwalignmentlength - hit->nwdiff) /
-                                nwalignmentlength;
-
-                              hit->shortest = MIN(si->qseqlen, tseqlen);
-                              hit->longest = MAX(si->qseqlen, tseqlen);
-
-                              /* trim alignment and compute numbers
-                                 excluding terminal gaps */
-                              align_trim(hit);
-                            }
-                          else
-                            {
-                              /* rejection without alignment */
-                              hit->rejected = true;
-                              si->rejects++;
-                            }
-                        }
-
-                      if (not hit->rejected)
-                        {
-                          /* test accept/reject criteria after alignment */
-                          if (search_acceptable_aligned(si, hit))
-                            {
-                              si->accepts++;
-                            }
-                          else
-                            {
-                              si->rejects++;
-                            }
-                        }
-                    }
-
-                  /* delete all undetermined hits */
-
-                  int new_hit_count = si->hit_count;
-                  for(int t = si->hit_count - 1; t >= 0; t--)
-                    {
-                      struct hit * hit = si->hits + t;
-                      if (not hit->accepted and not hit->rejected)
-                        {
-                          new_hit_count = t;
-                          if (hit->aligned)
-                            {
-                              xfree(hit->nwalignment);
-                            }
-                        }
-                    }
-                  si->hit_count = new_hit_count;
-                }
-            }
-
           /* find best hit */
           struct hit * best = nullptr;
           if (opt_sizeorder)
@@ -963,17 +1013,11 @@ void cluster_core_parallel()
               /* update cluster info about this sequence */
               clusterinfo[myseqno].seqno = myseqno;
               clusterinfo[myseqno].clusterno = clusterinfo[target].clusterno;
-              clusterinfo[myseqno].cigar = best->nwalignment;
+              clusterinfo[myseqno].cigar = cigar_dup(best->nwalignment);
               clusterinfo[myseqno].strand = best->strand;
-              best->nwalignment = nullptr;
             }
           else
             {
-              /* no hit found; add it to the list of extra sequences
-                 that must be considered by the coming queries in this
-                 round */
-              extra_list[extra_count++] = i;
-
               /* update cluster info about this sequence */
               clusterinfo[myseqno].seqno = myseqno;
               clusterinfo[myseqno].clusterno = clusters;
@@ -991,19 +1035,27 @@ void cluster_core_parallel()
                                          nullptr,
                                          si_p->qsize);
               ++clusters;
-            }
-
-          /* free alignments */
-          for (int s = 0; s < opt_strand; s++)
-            {
-              struct searchinfo_s * si = s ? si_m : si_p;
-              for(int j = 0; j < si->hit_count; j++)
+              ++centroids_new;
+
+              /* the coming queries in this round must consider the
+                 new centroid; check them in parallel if there are
+                 enough of them */
+              const int rest = queries - i - 1;
+              const int threads = MIN(opt_threads, rest / checks_per_thread);
+              if (threads > 1)
+                {
+                  cluster_task = cluster_task_check;
+                  cluster_centroid = i;
+                  threads_wakeup(i + 1, rest, threads);
+                }
+              else
                 {
-                  if (si->hits[j].aligned)
+                  for(int j = i + 1; j < queries; j++)
                     {
-                      if (si->hits[j].nwalignment)
+                      cluster_check_centroid(si_plus + j, si_p, & lma);
+                      if (opt_strand > 1)
                         {
-                          xfree(si->hits[j].nwalignment);
+                          cluster_check_centroid(si_minus + j, si_p, & lma);
                         }
                     }
                 }
@@ -1012,12 +1064,23 @@ void cluster_core_parallel()
           sum_nucleotides += si_p->qseqlen;
         }
 
+      /* shrink the window when many queries became new centroids,
+         grow it when few did */
+      if (4 * centroids_new > queries)
+        {
+          window = MAX(opt_threads, window / 2);
+        }
+      else if (16 * centroids_new < queries)
+        {
+          window = MIN(max_queries, 2 * window);
+        }
+
       progress_update(sum_nucleotides);
     }
   progress_done();
 
   /* clean up search info */
-  for(int i = 0; i < max_queries; i++)
+  for(int i = 0; i < initialized; i++)
     {
       cluster_query_exit(si_plus+i);
       if (opt_strand > 1)
@@ -1026,8 +1089,6 @@ void cluster_core_parallel()
         }
     }
 
-  xfree(extra_list);
-
   xfree(si_plus);
   if (opt_strand>1)
     {
@@ -1100,9 +1161,8 @@ void cluster_core_serial()
                                    si_p->qsize);
           clusterinfo[seqno].seqno = seqno;
           clusterinfo[seqno].clusterno = clusterinfo[target].clusterno;
-          clusterinfo[seqno].cigar = best->nwalignment;
+          clusterinfo[seqno].cigar = cigar_dup(best->nwalignment);
           clusterinfo[seqno].strand = best->strand;
-          best->nwalignment = nullptr;
         }
       else
         {
@@ -1120,22 +1180,6 @@ void cluster_core_serial()
           ++clusters;
         }
 
-      /* free alignments */
-      for (int s = 0; s < opt_strand; s++)
-        {
-          struct searchinfo_s * si = s ? si_m : si_p;
-          for(int i = 0; i < si->hit_count; i++)
-            {
-              if (si->hits[i].aligned)
-                {
-                  if (si->hits[i].nwalignment)
-                    {
-                      xfree(si->hits[i].nwalignment);
-                    }
-                }
-            }
-        }
-
       progress_update(seqno);
     }
   progress_done();
@@ -1309,7 +1353,7 @@ void cluster(char * dbname,
       db_sortbyabundance();
     }
 
-  dbindex_prepare(1, opt_qmask);
+  dbindex_prepare_growable(1);
 
   /* tophits = the maximum number of hits we need to store */
 
@@ -1374,6 +1418,42 @@ void cluster(char * dbname,
       cluster_size[clusterno]++;
     }
 
+  /* merging shards: assign the members of the shard clusters to the
+     clusters of their shard centroids, they count as clustered
+     sequences in the summary */
+
+  int64_t clustered = seqcount;
+
+  if (opt_shard_uc)
+    {
+      /* clusterinfo is still indexed by sequence number here */
+      int * seq_cluster = (int *) xmalloc(MAX(seqcount, 1) * sizeof(int));
+      int * seq_strand = (int *) xmalloc(MAX(seqcount, 1) * sizeof(int));
+      int * cluster_centroid = (int *) xmalloc(MAX(clusters, 1) * sizeof(int));
+      for(int z = 0; z < clusters; z++)
+        {
+          cluster_centroid[z] = -1;
+        }
+      for(int i = 0; i < seqcount; i++)
+        {
+          int clusterno = clusterinfo[i].clusterno;
+          seq_cluster[i] = clusterno;
+          seq_strand[i] = clusterinfo[i].strand;
+          if (cluster_centroid[clusterno] < 0)
+            {
+              cluster_centroid[clusterno] = i;
+            }
+        }
+
+      clustered += shard_merge_uc(fp_uc, seq_cluster, seq_strand,
+                                  cluster_centroid, cluster_abundance,
+                                  cluster_size);
+
+      xfree(cluster_centroid);
+      xfree(seq_strand);
+      xfree(seq_cluster);
+    }
+
   int64_t abundance_min = LONG_MAX;
   int64_t abundance_max = 0;
   int size_max = 0;
@@ -1549,11 +1629,11 @@ void cluster(char * dbname,
                   clusters,
                   abundance_min,
                   abundance_max,
-                  1.0 * seqcount / clusters);
+                  1.0 * clustered / clusters);
           fprintf(stderr,
                   "Singletons: %d, %.1f%% of seqs, %.1f%% of clusters\n",
                   singletons,
-                  100.0 * singletons / seqcount,
+                  100.0 * singletons / clustered,
                   100.0 * singletons / clusters);
         }
 
@@ -1564,11 +1644,11 @@ void cluster(char * dbname,
                   clusters,
                   abundance_min,
                   abundance_max,
-                  1.0 * seqcount / clusters);
+                  1.0 * clustered / clusters);
           fprintf(fp_log,
                   "Singletons: %d, %.1f%% of seqs, %.1f%% of clusters\n",
                   singletons,
-                  100.0 * singletons / seqcount,
+                  100.0 * singletons / clustered,
                   100.0 * singletons / clusters);
           fprintf(fp_log, "\n");
         }
@@ -1617,7 +1697,7 @@ void cluster(char * dbname,
         {
           int clusterno = clusterinfo[i].clusterno;
           int seqno = clusterinfo[i].seqno;
-          char * cigar = clusterinfo[i].cigar;
+          cigar_t * cigar = clusterinfo[i].cigar;
           int strand = clusterinfo[i].strand;
 
           if (clusterno != lastcluster)
@@ -1675,7 +1755,7 @@ void cluster(char * dbname,
   xfree(cluster_abundance);
   xfree(cluster_size);
 
-  /* free cigar strings for all aligned sequences */
+  /* free cigars for all aligned sequences */
 
   for(int i = 0; i < seqcount; i++)
     {
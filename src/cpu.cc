@@ -113,6 +113,90 @@ void increment_counters_from_bitmap(count_t * counters,
     }
 }
 
+auto span_quality_chars(char * seq, uint64_t len) -> uint64_t
+{
+  const uint8x16_t lo = vdupq_n_u8(33);
+  const uint8x16_t hi = vdupq_n_u8(126);
+  auto * p = (unsigned char *) seq;
+  uint64_t i = 0;
+
+  while ((i + 16 <= len) &&
+         (vminvq_u8(vandq_u8(vcgeq_u8(vld1q_u8(p + i), lo),
+                             vcleq_u8(vld1q_u8(p + i), hi))) == 0xff))
+    {
+      i += 16;
+    }
+  while ((i < len) && (p[i] >= 33) && (p[i] <= 126))
+    {
+      ++i;
+    }
+  return i;
+}
+
+auto span_nucleotides(char * seq, uint64_t len) -> uint64_t
+{
+  auto * p = (unsigned char *) seq;
+  uint64_t i = 0;
+
+  while (i + 16 <= len)
+    {
+      const uint8x16_t x = vld1q_u8(p + i);
+      const uint8x16_t m = vorrq_u8(vorrq_u8(vceqq_u8(x, vdupq_n_u8('A')),
+                                             vceqq_u8(x, vdupq_n_u8('C'))),
+                                    vorrq_u8(vceqq_u8(x, vdupq_n_u8('G')),
+                                             vceqq_u8(x, vdupq_n_u8('T'))));
+      if (vminvq_u8(m) != 0xff)
+        {
+          break;
+        }
+      i += 16;
+    }
+  while ((i < len) &&
+         ((p[i] == 'A') || (p[i] == 'C') || (p[i] == 'G') || (p[i] == 'T')))
+    {
+      ++i;
+    }
+  return i;
+}
+
+auto normalize_nucleotides(char * dst, char * seq, uint64_t len) -> uint64_t
+{
+  auto * p = (unsigned char *) seq;
+  auto * q = (unsigned char *) dst;
+  uint64_t i = 0;
+
+  while (i + 16 <= len)
+    {
+      const uint8x16_t x = vld1q_u8(p + i);
+      const uint8x16_t lower = vandq_u8(vcgeq_u8(x, vdupq_n_u8('a')),
+                                        vcleq_u8(x, vdupq_n_u8('z')));
+      uint8x16_t y = vsubq_u8(x, vandq_u8(lower, vdupq_n_u8(32)));
+      y = vsubq_u8(y, vandq_u8(vceqq_u8(y, vdupq_n_u8('U')), vdupq_n_u8(1)));
+      const uint8x16_t m = vorrq_u8(vorrq_u8(vceqq_u8(y, vdupq_n_u8('A')),
+                                             vceqq_u8(y, vdupq_n_u8('C'))),
+                                    vorrq_u8(vceqq_u8(y, vdupq_n_u8('G')),
+                                             vceqq_u8(y, vdupq_n_u8('T'))));
+      if (vminvq_u8(m) != 0xff)
+        {
+          break;
+        }
+      vst1q_u8(q + i, y);
+      i += 16;
+    }
+
+  while (i < len)
+    {
+      const unsigned char m = chrmap_normalize[p[i]];
+      if ((m != 'A') && (m != 'C') && (m != 'G') && (m != 'T'))
+        {
+          break;
+        }
+      dst[i] = m;
+      ++i;
+    }
+  return i;
+}
+
 #elif defined __PPC__
 
 void increment_counters_from_bitmap(count_t * counters,
@@ -150,10 +234,246 @@ void increment_counters_from_bitmap(count_t * counters,
     }
 }
 
+auto span_quality_chars(char * seq, uint64_t len) -> uint64_t
+{
+  auto * p = (unsigned char *) seq;
+  uint64_t i = 0;
+  while ((i < len) && (p[i] >= 33) && (p[i] <= 126))
+    {
+      ++i;
+    }
+  return i;
+}
+
+auto span_nucleotides(char * seq, uint64_t len) -> uint64_t
+{
+  auto * p = (unsigned char *) seq;
+  uint64_t i = 0;
+  while ((i < len) &&
+         ((p[i] == 'A') || (p[i] == 'C') || (p[i] == 'G') || (p[i] == 'T')))
+    {
+      ++i;
+    }
+  return i;
+}
+
+auto normalize_nucleotides(char * dst, char * seq, uint64_t len) -> uint64_t
+{
+  uint64_t i = 0;
+
+  auto * p = (unsigned char *) seq;
+  while (i < len)
+    {
+      const unsigned char m = chrmap_normalize[p[i]];
+      if ((m != 'A') && (m != 'C') && (m != 'G') && (m != 'T'))
+        {
+          break;
+        }
+      dst[i] = m;
+      ++i;
+    }
+  return i;
+}
+
 #elif __x86_64__
 
 #include <emmintrin.h>
 
+#ifdef AVX2
+
+void increment_counters_from_bitmap_avx2(count_t * counters,
+                                         unsigned char * bitmap,
+                                         unsigned int totalbits)
+{
+  /*
+    Increment selected elements in an array of 16 bit counters, as
+    in the SSE2 and SSSE3 versions below, but 16 counters at a time.
+    Each bitmap word is broadcast to all 16 words of a register and
+    word i is compared to bit i to get 0x0000 or 0xFFFF.
+  */
+
+  const auto bits = _mm256_set_epi16(static_cast<short>(0x8000), 0x4000,
+                                     0x2000, 0x1000, 0x0800, 0x0400,
+                                     0x0200, 0x0100, 0x0080, 0x0040,
+                                     0x0020, 0x0010, 0x0008, 0x0004,
+                                     0x0002, 0x0001);
+
+  auto * p = (unsigned short *) (bitmap);
+  auto * q = (__m256i *) (counters);
+  const auto r = (totalbits + 15) / 16;
+
+  for(auto j = 0U; j < r; j++)
+    {
+      const auto ymm0 = _mm256_set1_epi16(static_cast<short>(*p++));
+      const auto ymm1 = _mm256_and_si256(ymm0, bits);
+      const auto ymm2 = _mm256_cmpeq_epi16(ymm1, bits);
+      const auto ymm3 = _mm256_loadu_si256(q);
+      _mm256_storeu_si256(q, _mm256_subs_epi16(ymm3, ymm2));
+      ++q;
+    }
+}
+
+void reverse_complement_avx2(char * rc, char * seq, int64_t len)
+{
+  /*
+    Same as reverse_complement_ssse3 below, 32 characters at a time.
+    The lanes are swapped after the byte reversal within each lane.
+  */
+
+  auto * map = chrmap_complement;
+  const auto t4 = _mm256_broadcastsi128_si256
+    (_mm_loadu_si128((const __m128i *) (map + 0x40)));
+  const auto t5 = _mm256_broadcastsi128_si256
+    (_mm_loadu_si128((const __m128i *) (map + 0x50)));
+  const auto t6 = _mm256_broadcastsi128_si256
+    (_mm_loadu_si128((const __m128i *) (map + 0x60)));
+  const auto t7 = _mm256_broadcastsi128_si256
+    (_mm_loadu_si128((const __m128i *) (map + 0x70)));
+  const auto reverse = _mm256_set_epi8(0, 1, 2, 3, 4, 5, 6, 7,
+                                       8, 9, 10, 11, 12, 13, 14, 15,
+                                       0, 1, 2, 3, 4, 5, 6, 7,
+                                       8, 9, 10, 11, 12, 13, 14, 15);
+  const auto nibble = _mm256_set1_epi8(0x0f);
+  const auto n = _mm256_set1_epi8('N');
+
+  int64_t i = 0;
+  for(; i + 32 <= len; i += 32)
+    {
+      const auto x = _mm256_loadu_si256((__m256i *) (seq + len - 32 - i));
+      const auto lo = _mm256_and_si256(x, nibble);
+      const auto hi = _mm256_and_si256(_mm256_srli_epi16(x, 4), nibble);
+      auto y = n;
+      y = _mm256_blendv_epi8(y, _mm256_shuffle_epi8(t4, lo),
+                             _mm256_cmpeq_epi8(hi, _mm256_set1_epi8(4)));
+      y = _mm256_blendv_epi8(y, _mm256_shuffle_epi8(t5, lo),
+                             _mm256_cmpeq_epi8(hi, _mm256_set1_epi8(5)));
+      y = _mm256_blendv_epi8(y, _mm256_shuffle_epi8(t6, lo),
+                             _mm256_cmpeq_epi8(hi, _mm256_set1_epi8(6)));
+      y = _mm256_blendv_epi8(y, _mm256_shuffle_epi8(t7, lo),
+                             _mm256_cmpeq_epi8(hi, _mm256_set1_epi8(7)));
+      y = _mm256_shuffle_epi8(y, reverse);
+      y = _mm256_permute4x64_epi64(y, 0x4e);
+      _mm256_storeu_si256((__m256i *) (rc + i), y);
+    }
+
+  for(; i < len; i++)
+    {
+      rc[i] = map[(unsigned char) (seq[len - 1 - i])];
+    }
+  rc[len] = 0;
+}
+
+auto span_quality_chars_avx2(char * seq, uint64_t len) -> uint64_t
+{
+  const auto lo = _mm256_set1_epi8(32);
+  const auto hi = _mm256_set1_epi8(127);
+  uint64_t i = 0;
+
+  for(; i + 32 <= len; i += 32)
+    {
+      const auto x = _mm256_loadu_si256((__m256i *) (seq + i));
+      const auto ok = _mm256_and_si256(_mm256_cmpgt_epi8(x, lo),
+                                       _mm256_cmpgt_epi8(hi, x));
+      const auto mask = (unsigned int) _mm256_movemask_epi8(ok);
+      if (mask != 0xffffffff)
+        {
+          return i + __builtin_ctz(~mask);
+        }
+    }
+
+  auto * p = (unsigned char *) seq;
+  while ((i < len) && (p[i] >= 33) && (p[i] <= 126))
+    {
+      ++i;
+    }
+  return i;
+}
+
+auto span_nucleotides_avx2(char * seq, uint64_t len) -> uint64_t
+{
+  const auto a = _mm256_set1_epi8('A');
+  const auto c = _mm256_set1_epi8('C');
+  const auto g = _mm256_set1_epi8('G');
+  const auto t = _mm256_set1_epi8('T');
+  uint64_t i = 0;
+
+  for(; i + 32 <= len; i += 32)
+    {
+      const auto x = _mm256_loadu_si256((__m256i *) (seq + i));
+      const auto ok =
+        _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(x, a),
+                                        _mm256_cmpeq_epi8(x, c)),
+                        _mm256_or_si256(_mm256_cmpeq_epi8(x, g),
+                                        _mm256_cmpeq_epi8(x, t)));
+      const auto mask = (unsigned int) _mm256_movemask_epi8(ok);
+      if (mask != 0xffffffff)
+        {
+          return i + __builtin_ctz(~mask);
+        }
+    }
+
+  auto * p = (unsigned char *) seq;
+  while ((i < len) &&
+         ((p[i] == 'A') || (p[i] == 'C') || (p[i] == 'G') || (p[i] == 'T')))
+    {
+      ++i;
+    }
+  return i;
+}
+
+auto normalize_nucleotides_avx2(char * dst, char * seq, uint64_t len)
+  -> uint64_t
+{
+  /*
+    Same as normalize_nucleotides_sse2 below, 32 characters at a time.
+  */
+
+  const auto a = _mm256_set1_epi8('A');
+  const auto c = _mm256_set1_epi8('C');
+  const auto g = _mm256_set1_epi8('G');
+  const auto t = _mm256_set1_epi8('T');
+  const auto u = _mm256_set1_epi8('U');
+  const auto before_a = _mm256_set1_epi8('a' - 1);
+  const auto after_z = _mm256_set1_epi8('z' + 1);
+  const auto case_bit = _mm256_set1_epi8(32);
+  const auto one = _mm256_set1_epi8(1);
+  uint64_t i = 0;
+
+  for(; i + 32 <= len; i += 32)
+    {
+      const auto x = _mm256_loadu_si256((__m256i *) (seq + i));
+      const auto lower = _mm256_and_si256(_mm256_cmpgt_epi8(x, before_a),
+                                          _mm256_cmpgt_epi8(after_z, x));
+      auto y = _mm256_sub_epi8(x, _mm256_and_si256(lower, case_bit));
+      y = _mm256_sub_epi8(y, _mm256_and_si256(_mm256_cmpeq_epi8(y, u), one));
+      const auto ok =
+        _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(y, a),
+                                        _mm256_cmpeq_epi8(y, c)),
+                        _mm256_or_si256(_mm256_cmpeq_epi8(y, g),
+                                        _mm256_cmpeq_epi8(y, t)));
+      if ((unsigned int) _mm256_movemask_epi8(ok) != 0xffffffff)
+        {
+          break;
+        }
+      _mm256_storeu_si256((__m256i *) (dst + i), y);
+    }
+
+  auto * p = (unsigned char *) seq;
+  while (i < len)
+    {
+      const unsigned char m = chrmap_normalize[p[i]];
+      if ((m != 'A') && (m != 'C') && (m != 'G') && (m != 'T'))
+        {
+          break;
+        }
+      dst[i] = m;
+      ++i;
+    }
+  return i;
+}
+
+#else
+
 #ifdef SSSE3
 void increment_counters_from_bitmap_ssse3(count_t * counters,
                                           unsigned char * bitmap,
@@ -220,6 +540,305 @@ void increment_counters_from_bitmap_sse2(count_t * counters,
     }
 }
 
+#ifdef SSSE3
+
+struct packed_masks_s
+{
+  unsigned char shuffle[256][16];
+  unsigned char length[256];
+};
+
+static packed_masks_s packed_masks_init()
+{
+  /*
+    For each control byte, make the shuffle mask that expands the
+    following 8 to 16 bytes into 8 words, as well as the number of
+    bytes used. Bit i of the control byte is set if delta i is
+    stored in two bytes, otherwise it is stored in one byte.
+  */
+
+  packed_masks_s masks;
+
+  for(auto control = 0U; control < 256; control++)
+    {
+      unsigned char pos = 0;
+      for(auto i = 0U; i < 8; i++)
+        {
+          masks.shuffle[control][2 * i] = pos++;
+          if (control & (1U << i))
+            {
+              masks.shuffle[control][2 * i + 1] = pos++;
+            }
+          else
+            {
+              masks.shuffle[control][2 * i + 1] = 0x80;
+            }
+        }
+      masks.length[control] = pos;
+    }
+  return masks;
+}
+
+unsigned char * increment_counters_from_packed_ssse3(count_t * counters,
+                                                     unsigned char * packed,
+                                                     unsigned int count)
+{
+  /*
+    Increment the counters given by a list of count delta encoded
+    16 bit offsets, in groups of 8 with a control byte in front.
+    Each group is expanded to 8 words with a single PSHUFB and the
+    deltas are turned into offsets with a prefix sum in the register,
+    so the list is never stored in uncompressed form.
+    Returns a pointer to the byte after the list.
+    The last group may be read up to 16 bytes beyond its end.
+  */
+
+  static const auto masks = packed_masks_init();
+
+  // broadcast the last word of a register
+  const auto c1 = _mm_set1_epi16(0x0f0e);
+
+  auto * p = packed;
+  auto last = _mm_setzero_si128();
+  alignas(16) unsigned short offsets[8];
+
+  for(auto i = 0U; i < count; i += 8)
+    {
+      const auto control = *p++;
+      const auto xmm0 = _mm_loadu_si128((__m128i *) p);
+      const auto xmm1 =
+        _mm_loadu_si128((const __m128i *) masks.shuffle[control]);
+      auto xmm2 = _mm_shuffle_epi8(xmm0, xmm1);
+      xmm2 = _mm_add_epi16(xmm2, _mm_slli_si128(xmm2, 2));
+      xmm2 = _mm_add_epi16(xmm2, _mm_slli_si128(xmm2, 4));
+      xmm2 = _mm_add_epi16(xmm2, _mm_slli_si128(xmm2, 8));
+      xmm2 = _mm_add_epi16(xmm2, last);
+      last = _mm_shuffle_epi8(xmm2, c1);
+      _mm_store_si128((__m128i *) offsets, xmm2);
+      p += masks.length[control];
+
+      const auto n = MIN(8U, count - i);
+      for(auto j = 0U; j < n; j++)
+        {
+          counters[offsets[j]]++;
+        }
+    }
+
+  return p;
+}
+
+void reverse_complement_ssse3(char * rc, char * seq, int64_t len)
+{
+  /*
+    Write the reverse complement of seq to rc, 16 characters at a
+    time. The complement is looked up with PSHUFB on the low nibble in
+    the parts of chrmap_complement for ascii 0x40-0x7f, selected by the
+    high nibble. All other characters map to N, as in the table.
+  */
+
+  auto * map = chrmap_complement;
+  const auto t4 = _mm_loadu_si128((const __m128i *) (map + 0x40));
+  const auto t5 = _mm_loadu_si128((const __m128i *) (map + 0x50));
+  const auto t6 = _mm_loadu_si128((const __m128i *) (map + 0x60));
+  const auto t7 = _mm_loadu_si128((const __m128i *) (map + 0x70));
+  const auto reverse = _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7,
+                                    8, 9, 10, 11, 12, 13, 14, 15);
+  const auto nibble = _mm_set1_epi8(0x0f);
+  const auto n = _mm_set1_epi8('N');
+
+  int64_t i = 0;
+  for(; i + 16 <= len; i += 16)
+    {
+      const auto x = _mm_loadu_si128((__m128i *) (seq + len - 16 - i));
+      const auto lo = _mm_and_si128(x, nibble);
+      const auto hi = _mm_and_si128(_mm_srli_epi16(x, 4), nibble);
+      const auto m4 = _mm_cmpeq_epi8(hi, _mm_set1_epi8(4));
+      const auto m5 = _mm_cmpeq_epi8(hi, _mm_set1_epi8(5));
+      const auto m6 = _mm_cmpeq_epi8(hi, _mm_set1_epi8(6));
+      const auto m7 = _mm_cmpeq_epi8(hi, _mm_set1_epi8(7));
+      const auto any = _mm_or_si128(_mm_or_si128(m4, m5),
+                                    _mm_or_si128(m6, m7));
+      auto y = _mm_andnot_si128(any, n);
+      y = _mm_or_si128(y, _mm_and_si128(m4, _mm_shuffle_epi8(t4, lo)));
+      y = _mm_or_si128(y, _mm_and_si128(m5, _mm_shuffle_epi8(t5, lo)));
+      y = _mm_or_si128(y, _mm_and_si128(m6, _mm_shuffle_epi8(t6, lo)));
+      y = _mm_or_si128(y, _mm_and_si128(m7, _mm_shuffle_epi8(t7, lo)));
+      _mm_storeu_si128((__m128i *) (rc + i), _mm_shuffle_epi8(y, reverse));
+    }
+
+  for(; i < len; i++)
+    {
+      rc[i] = map[(unsigned char) (seq[len - 1 - i])];
+    }
+  rc[len] = 0;
+}
+
+#else
+
+auto span_quality_chars_sse2(char * seq, uint64_t len) -> uint64_t
+{
+  const auto lo = _mm_set1_epi8(32);
+  const auto hi = _mm_set1_epi8(127);
+  uint64_t i = 0;
+
+  for(; i + 16 <= len; i += 16)
+    {
+      const auto x = _mm_loadu_si128((__m128i *) (seq + i));
+      const auto ok = _mm_and_si128(_mm_cmpgt_epi8(x, lo),
+                                    _mm_cmplt_epi8(x, hi));
+      const auto mask = (unsigned int) _mm_movemask_epi8(ok);
+      if (mask != 0xffff)
+        {
+          return i + __builtin_ctz(~mask);
+        }
+    }
+
+  auto * p = (unsigned char *) seq;
+  while ((i < len) && (p[i] >= 33) && (p[i] <= 126))
+    {
+      ++i;
+    }
+  return i;
+}
+
+auto span_nucleotides_sse2(char * seq, uint64_t len) -> uint64_t
+{
+  const auto a = _mm_set1_epi8('A');
+  const auto c = _mm_set1_epi8('C');
+  const auto g = _mm_set1_epi8('G');
+  const auto t = _mm_set1_epi8('T');
+  uint64_t i = 0;
+
+  for(; i + 16 <= len; i += 16)
+    {
+      const auto x = _mm_loadu_si128((__m128i *) (seq + i));
+      const auto ok = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(x, a),
+                                                _mm_cmpeq_epi8(x, c)),
+                                   _mm_or_si128(_mm_cmpeq_epi8(x, g),
+                                                _mm_cmpeq_epi8(x, t)));
+      const auto mask = (unsigned int) _mm_movemask_epi8(ok);
+      if (mask != 0xffff)
+        {
+          return i + __builtin_ctz(~mask);
+        }
+    }
+
+  auto * p = (unsigned char *) seq;
+  while ((i < len) &&
+         ((p[i] == 'A') || (p[i] == 'C') || (p[i] == 'G') || (p[i] == 'T')))
+    {
+      ++i;
+    }
+  return i;
+}
+
+auto normalize_nucleotides_sse2(char * dst, char * seq, uint64_t len)
+  -> uint64_t
+{
+  /*
+    Normalize 16 characters at a time as long as they are all A, C, G,
+    T or U in upper or lower case. Lower case letters are found with
+    two signed comparisons (bytes above 127 are negative) and 32 is
+    subtracted from them, then one is subtracted from U to get T.
+  */
+
+  const auto a = _mm_set1_epi8('A');
+  const auto c = _mm_set1_epi8('C');
+  const auto g = _mm_set1_epi8('G');
+  const auto t = _mm_set1_epi8('T');
+  const auto u = _mm_set1_epi8('U');
+  const auto before_a = _mm_set1_epi8('a' - 1);
+  const auto after_z = _mm_set1_epi8('z' + 1);
+  const auto case_bit = _mm_set1_epi8(32);
+  const auto one = _mm_set1_epi8(1);
+  uint64_t i = 0;
+
+  for(; i + 16 <= len; i += 16)
+    {
+      const auto x = _mm_loadu_si128((__m128i *) (seq + i));
+      const auto lower = _mm_and_si128(_mm_cmpgt_epi8(x, before_a),
+                                       _mm_cmpgt_epi8(after_z, x));
+      auto y = _mm_sub_epi8(x, _mm_and_si128(lower, case_bit));
+      y = _mm_sub_epi8(y, _mm_and_si128(_mm_cmpeq_epi8(y, u), one));
+      const auto ok = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(y, a),
+                                                _mm_cmpeq_epi8(y, c)),
+                                   _mm_or_si128(_mm_cmpeq_epi8(y, g),
+                                                _mm_cmpeq_epi8(y, t)));
+      if ((unsigned int) _mm_movemask_epi8(ok) != 0xffff)
+        {
+          break;
+        }
+      _mm_storeu_si128((__m128i *) (dst + i), y);
+    }
+
+  auto * p = (unsigned char *) seq;
+  while (i < len)
+    {
+      const unsigned char m = chrmap_normalize[p[i]];
+      if ((m != 'A') && (m != 'C') && (m != 'G') && (m != 'T'))
+        {
+          break;
+        }
+      dst[i] = m;
+      ++i;
+    }
+  return i;
+}
+
+/*
+  The functions below select the best version of each kernel for the
+  cpu at runtime. The *_present flags may have been lowered by --simd.
+*/
+
+void increment_counters_from_bitmap(count_t * counters,
+                                    unsigned char * bitmap,
+                                    unsigned int totalbits)
+{
+  if (avx2_present)
+    {
+      increment_counters_from_bitmap_avx2(counters, bitmap, totalbits);
+    }
+  else if (ssse3_present)
+    {
+      increment_counters_from_bitmap_ssse3(counters, bitmap, totalbits);
+    }
+  else
+    {
+      increment_counters_from_bitmap_sse2(counters, bitmap, totalbits);
+    }
+}
+
+auto span_quality_chars(char * seq, uint64_t len) -> uint64_t
+{
+  if (avx2_present)
+    {
+      return span_quality_chars_avx2(seq, len);
+    }
+  return span_quality_chars_sse2(seq, len);
+}
+
+auto span_nucleotides(char * seq, uint64_t len) -> uint64_t
+{
+  if (avx2_present)
+    {
+      return span_nucleotides_avx2(seq, len);
+    }
+  return span_nucleotides_sse2(seq, len);
+}
+
+auto normalize_nucleotides(char * dst, char * seq, uint64_t len) -> uint64_t
+{
+  if (avx2_present)
+    {
+      return normalize_nucleotides_avx2(dst, seq, len);
+    }
+  return normalize_nucleotides_sse2(dst, seq, len);
+}
+
+#endif
+
+#endif
+
 #else
 
 #error Unknown architecture
@@ -68,8 +68,37 @@ auto increment_counters_from_bitmap_sse2(count_t * counters,
 auto increment_counters_from_bitmap_ssse3(count_t * counters,
                                           unsigned char * bitmap,
                                           unsigned int totalbits) -> void;
-#else
+auto increment_counters_from_bitmap_avx2(count_t * counters,
+                                         unsigned char * bitmap,
+                                         unsigned int totalbits) -> void;
+auto increment_counters_from_packed_ssse3(count_t * counters,
+                                          unsigned char * packed,
+                                          unsigned int count)
+  -> unsigned char *;
+auto reverse_complement_ssse3(char * rc, char * seq, int64_t len) -> void;
+auto reverse_complement_avx2(char * rc, char * seq, int64_t len) -> void;
+auto span_quality_chars_sse2(char * seq, uint64_t len) -> uint64_t;
+auto span_quality_chars_avx2(char * seq, uint64_t len) -> uint64_t;
+auto span_nucleotides_sse2(char * seq, uint64_t len) -> uint64_t;
+auto span_nucleotides_avx2(char * seq, uint64_t len) -> uint64_t;
+auto normalize_nucleotides_sse2(char * dst, char * seq, uint64_t len)
+  -> uint64_t;
+auto normalize_nucleotides_avx2(char * dst, char * seq, uint64_t len)
+  -> uint64_t;
+#endif
+
+/* on x86_64 these select one of the versions above at runtime */
+
 auto increment_counters_from_bitmap(count_t * counters,
                                     unsigned char * bitmap,
                                     unsigned int totalbits) -> void;
-#endif
+
+/* length of the prefix of seq with quality characters (33 to 126) */
+auto span_quality_chars(char * seq, uint64_t len) -> uint64_t;
+
+/* length of the prefix of seq with upper case A, C, G or T only */
+auto span_nucleotides(char * seq, uint64_t len) -> uint64_t;
+
+/* normalize the prefix of seq with A, C, G, T or U in any case to dst,
+   as string_normalize does, and return its length */
+auto normalize_nucleotides(char * dst, char * seq, uint64_t len) -> uint64_t;
@@ -229,6 +229,7 @@ void db_read(const char * filename, int upcase)
   int64_t discarded_short = 0;
   int64_t discarded_long = 0;
   int64_t discarded_unoise = 0;
+  int64_t discarded_shard = 0;
 
   /* allocate space for data */
   dataalloc = 0;
@@ -258,6 +259,11 @@ void db_read(const char * filename, int upcase)
         {
           ++discarded_unoise;
         }
+      else if (opt_shards && not shard_select(fastx_get_sequence(h),
+                                              sequencelength))
+        {
+          ++discarded_shard;
+        }
       else
         {
           db_add(is_fastq,
@@ -375,6 +381,29 @@ void db_read(const char * filename, int upcase)
         }
     }
 
+  if (discarded_shard)
+    {
+      if (not opt_quiet)
+        {
+          fprintf(stderr,
+                  "shard %" PRId64 " of %" PRId64 ": %" PRId64 " %s in other shards.\n",
+                  opt_shard,
+                  opt_shards,
+                  discarded_shard,
+                  (discarded_shard == 1 ? "sequence" : "sequences"));
+        }
+
+      if (opt_log)
+        {
+          fprintf(fp_log,
+                  "shard %" PRId64 " of %" PRId64 ": %" PRId64 " %s in other shards.\n",
+                  opt_shard,
+                  opt_shards,
+                  discarded_shard,
+                  (discarded_shard == 1 ? "sequence" : "sequences"));
+        }
+    }
+
   show_rusage();
 }
 
@@ -405,6 +434,14 @@ uint64_t db_getshortestsequence()
 
 void db_free()
 {
+  if (udb_is_mapped())
+    {
+      udb_unmap();
+      datap = nullptr;
+      seqindex = nullptr;
+      return;
+    }
+
   if (datap)
     {
       xfree(datap);
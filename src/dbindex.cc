@@ -59,6 +59,11 @@
 */
 
 #include "vsearch.h"
+#include <algorithm>  // std::sort
+#include <functional>  // std::greater
+#include <queue>  // std::priority_queue
+#include <utility>  // std::pair
+#include <vector>  // std::vector
 
 unsigned int * kmercount;
 uint64_t * kmerhash;
@@ -69,11 +74,60 @@ unsigned int kmerhashsize;
 uint64_t kmerindexsize;
 unsigned int dbindex_count;
 uhandle_s * dbindex_uh;
+unsigned char * kmerpack = nullptr;
+uint64_t * kmerpack_offset = nullptr;
 
 #define BITMAP_THRESHOLD 8
 
 static unsigned int bitmap_mincount;
 
+/*
+  Growable index
+
+  When clustering or detecting chimeras de novo, the index starts out
+  empty and sequences are added one at a time as they become centroids
+  or parents, so usually only a small part of the input is ever
+  indexed. Instead of sizing the posting lists from a counting pass
+  over all sequences, each kmer then gets a range of kmerindex with
+  room for a power of two number of entries. A full list is moved to a
+  range of twice the size at the end of kmerindex. When kmerindex is
+  full, the lists are compacted into a new array twice the size of the
+  ranges in use, leaving out the space of moved lists. The lists stay
+  contiguous and sorted, so searching is unchanged. A list is replaced
+  by a bitmap when it reaches the same size as a bitmap kmer in a full
+  build, giving the same search results.
+*/
+
+constexpr unsigned int dbindex_list_min = 4;
+constexpr uint64_t dbindex_index_min = 65536;
+
+static bool dbindex_growable = false;
+static unsigned int * kmercapacity = nullptr;
+static uint64_t kmerindex_alloc = 0;
+static unsigned int dbindex_map_alloc = 0;
+
+/*
+  Parallel index construction
+
+  The sequences are split into one contiguous block per thread, with
+  block boundaries at multiples of 8 so that no two threads update the
+  same byte of a bitmap. During counting each block keeps its own
+  k-mer counts. Before filling, these are turned into a prefix sum
+  giving the first free slot of each block in every posting list, so
+  each thread writes its own part of the lists without locking and the
+  sequence numbers end up in the same order as with a serial build.
+  The number of blocks is limited by the memory used for the counts.
+*/
+
+constexpr uint64_t dbindex_blockcounts_maxmem = 512 * 1024 * 1024;
+constexpr unsigned int dbindex_progress_interval = 1024;
+
+static unsigned int dbindex_blocks = 0;
+static unsigned int * dbindex_blockcounts = nullptr;
+static int dbindex_seqmask = 0;
+static uint64_t dbindex_progress = 0;
+static pthread_mutex_t dbindex_mutex;
+
 void fprint_kmer(FILE * f, unsigned int kk, uint64_t kmer)
 {
   uint64_t x = kmer;
@@ -83,12 +137,253 @@ void fprint_kmer(FILE * f, unsigned int kk, uint64_t kmer)
     }
 }
 
+auto dbindex_block_first(unsigned int block) -> unsigned int
+{
+  uint64_t seqcount = db_getsequencecount();
+  if (block >= dbindex_blocks)
+    {
+      return seqcount;
+    }
+  return (seqcount * block / dbindex_blocks) & ~ UINT64_C(7);
+}
+
+auto dbindex_progress_add(unsigned int count) -> void
+{
+  xpthread_mutex_lock(& dbindex_mutex);
+  dbindex_progress += count;
+  progress_update(dbindex_progress);
+  xpthread_mutex_unlock(& dbindex_mutex);
+}
+
+auto dbindex_count_worker(void * vp) -> void *
+{
+  auto block = (unsigned int) (int64_t) vp;
+  unsigned int * counts = dbindex_blockcounts + (uint64_t) block * kmerhashsize;
+  struct uhandle_s * uh = unique_init();
+
+  unsigned int first = dbindex_block_first(block);
+  unsigned int last = dbindex_block_first(block + 1);
+  for(unsigned int seqno = first; seqno < last; seqno++)
+    {
+      unsigned int uniquecount;
+      unsigned int * uniquelist;
+      unique_count(uh, opt_wordlength,
+                   db_getsequencelen(seqno), db_getsequence(seqno),
+                   & uniquecount, & uniquelist, dbindex_seqmask);
+      for(unsigned int i = 0; i < uniquecount; i++)
+        {
+          counts[uniquelist[i]]++;
+        }
+      if (((seqno - first + 1) % dbindex_progress_interval) == 0)
+        {
+          dbindex_progress_add(dbindex_progress_interval);
+        }
+    }
+  dbindex_progress_add((last - first) % dbindex_progress_interval);
+
+  unique_exit(uh);
+  return nullptr;
+}
+
+auto dbindex_fill_worker(void * vp) -> void *
+{
+  auto block = (unsigned int) (int64_t) vp;
+  unsigned int * next = dbindex_blockcounts + (uint64_t) block * kmerhashsize;
+  struct uhandle_s * uh = unique_init();
+
+  unsigned int first = dbindex_block_first(block);
+  unsigned int last = dbindex_block_first(block + 1);
+  for(unsigned int seqno = first; seqno < last; seqno++)
+    {
+      unsigned int uniquecount;
+      unsigned int * uniquelist;
+      unique_count(uh, opt_wordlength,
+                   db_getsequencelen(seqno), db_getsequence(seqno),
+                   & uniquecount, & uniquelist, dbindex_seqmask);
+      dbindex_map[seqno] = seqno;
+      for(unsigned int i = 0; i < uniquecount; i++)
+        {
+          unsigned int kmer = uniquelist[i];
+          if (kmerbitmap[kmer])
+            {
+              bitmap_set(kmerbitmap[kmer], seqno);
+            }
+          else
+            {
+              kmerindex[next[kmer]++] = seqno;
+            }
+        }
+      if (((seqno - first + 1) % dbindex_progress_interval) == 0)
+        {
+          dbindex_progress_add(dbindex_progress_interval);
+        }
+    }
+  dbindex_progress_add((last - first) % dbindex_progress_interval);
+
+  unique_exit(uh);
+  return nullptr;
+}
+
+auto dbindex_run_workers(void * (*worker) (void *)) -> void
+{
+  pthread_attr_t attr;
+  xpthread_attr_init(& attr);
+  xpthread_attr_setdetachstate(& attr, PTHREAD_CREATE_JOINABLE);
+  xpthread_mutex_init(& dbindex_mutex, nullptr);
+
+  auto * threads = (pthread_t *) xmalloc(dbindex_blocks * sizeof(pthread_t));
+
+  dbindex_progress = 0;
+  for(unsigned int t = 0; t < dbindex_blocks; t++)
+    {
+      xpthread_create(threads + t, & attr, worker, (void *) (int64_t) t);
+    }
+
+  for(unsigned int t = 0; t < dbindex_blocks; t++)
+    {
+      xpthread_join(threads[t], nullptr);
+    }
+
+  xfree(threads);
+  xpthread_mutex_destroy(& dbindex_mutex);
+  xpthread_attr_destroy(& attr);
+}
+
+auto dbindex_free_blockcounts() -> void
+{
+  if (dbindex_blockcounts)
+    {
+      xfree(dbindex_blockcounts);
+      dbindex_blockcounts = nullptr;
+    }
+  dbindex_blocks = 0;
+}
+
+auto dbindex_compact(uint64_t extra) -> void
+{
+  /* move the lists in use to a new array, with room for extra entries */
+  uint64_t live = 0;
+  for(unsigned int kmer = 0; kmer < kmerhashsize; kmer++)
+    {
+      live += kmercapacity[kmer];
+    }
+
+  uint64_t alloc = MAX(2 * (live + extra), dbindex_index_min);
+  auto * index = (unsigned int *) xmalloc(alloc * sizeof(unsigned int));
+  uint64_t next = 0;
+  for(unsigned int kmer = 0; kmer < kmerhashsize; kmer++)
+    {
+      if (kmercapacity[kmer])
+        {
+          memcpy(index + next,
+                 kmerindex + kmerhash[kmer],
+                 kmercount[kmer] * sizeof(unsigned int));
+          kmerhash[kmer] = next;
+          next += kmercapacity[kmer];
+        }
+    }
+
+  if (kmerindex)
+    {
+      xfree(kmerindex);
+    }
+  kmerindex = index;
+  kmerindexsize = next;
+  kmerindex_alloc = alloc;
+}
+
+auto dbindex_grow_list(unsigned int kmer) -> void
+{
+  unsigned int capacity = MAX(2 * kmercapacity[kmer], dbindex_list_min);
+  if (kmerindexsize + capacity > kmerindex_alloc)
+    {
+      dbindex_compact(capacity);
+    }
+
+  if (kmercount[kmer])
+    {
+      memcpy(kmerindex + kmerindexsize,
+             kmerindex + kmerhash[kmer],
+             kmercount[kmer] * sizeof(unsigned int));
+    }
+  kmerhash[kmer] = kmerindexsize;
+  kmerindexsize += capacity;
+  kmercapacity[kmer] = capacity;
+}
+
+auto dbindex_list_to_bitmap(unsigned int kmer) -> void
+{
+  kmerbitmap[kmer] = bitmap_init(db_getsequencecount() + 127); // pad for xmm
+  bitmap_reset_all(kmerbitmap[kmer]);
+  unsigned int * list = kmerindex + kmerhash[kmer];
+  for(unsigned int i = 0; i < kmercount[kmer]; i++)
+    {
+      bitmap_set(kmerbitmap[kmer], list[i]);
+    }
+
+  /* the space of the list is reclaimed when compacting */
+  kmercapacity[kmer] = 0;
+}
+
+auto dbindex_addsequence_growable(unsigned int seqno, int seqmask) -> void
+{
+  unsigned int uniquecount;
+  unsigned int * uniquelist;
+  unique_count(dbindex_uh, opt_wordlength,
+               db_getsequencelen(seqno), db_getsequence(seqno),
+               & uniquecount, & uniquelist, seqmask);
+
+  if (dbindex_count == dbindex_map_alloc)
+    {
+      dbindex_map_alloc = MAX(2 * dbindex_map_alloc, dbindex_list_min);
+      dbindex_map = (unsigned int *) xrealloc(dbindex_map,
+                                              dbindex_map_alloc
+                                              * sizeof(unsigned int));
+    }
+  dbindex_map[dbindex_count] = seqno;
+
+  for(unsigned int i = 0; i < uniquecount; i++)
+    {
+      unsigned int kmer = uniquelist[i];
+      if (kmerbitmap[kmer])
+        {
+          kmercount[kmer]++;
+          bitmap_set(kmerbitmap[kmer], dbindex_count);
+        }
+      else
+        {
+          if (kmercount[kmer] == kmercapacity[kmer])
+            {
+              dbindex_grow_list(kmer);
+            }
+          kmerindex[kmerhash[kmer] + (kmercount[kmer]++)] = dbindex_count;
+          if (kmercount[kmer] >= bitmap_mincount)
+            {
+              dbindex_list_to_bitmap(kmer);
+            }
+        }
+    }
+  ++dbindex_count;
+}
+
 void dbindex_addsequence(unsigned int seqno, int seqmask)
 {
 #if 0
   printf("Adding seqno %d as index element no %d\n", seqno, dbindex_count);
 #endif
 
+  /* the block counts are only needed for adding all sequences at once */
+  if (dbindex_blockcounts)
+    {
+      dbindex_free_blockcounts();
+    }
+
+  if (dbindex_growable)
+    {
+      dbindex_addsequence_growable(seqno, seqmask);
+      return;
+    }
+
   unsigned int uniquecount;
   unsigned int * uniquelist;
   unique_count(dbindex_uh, opt_wordlength,
@@ -114,6 +409,36 @@ void dbindex_addsequence(unsigned int seqno, int seqmask)
 void dbindex_addallsequences(int seqmask)
 {
   unsigned int seqcount = db_getsequencecount();
+
+  if (dbindex_blockcounts && (dbindex_count == 0))
+    {
+      /* turn the block counts into the next free slot for each block */
+      for(unsigned int kmer = 0; kmer < kmerhashsize; kmer++)
+        {
+          uint64_t next = kmerhash[kmer];
+          unsigned int total = 0;
+          for(unsigned int b = 0; b < dbindex_blocks; b++)
+            {
+              unsigned int * counts = dbindex_blockcounts
+                + (uint64_t) b * kmerhashsize + kmer;
+              unsigned int count = * counts;
+              * counts = next;
+              next += count;
+              total += count;
+            }
+          kmercount[kmer] = total;
+        }
+
+      dbindex_seqmask = seqmask;
+      progress_init("Creating k-mer index", seqcount);
+      dbindex_run_workers(dbindex_fill_worker);
+      progress_done();
+
+      dbindex_count = seqcount;
+      dbindex_free_blockcounts();
+      return;
+    }
+
   progress_init("Creating k-mer index", seqcount);
   for(unsigned int seqno = 0; seqno < seqcount ; seqno++)
     {
@@ -135,19 +460,46 @@ void dbindex_prepare(int use_bitmap, int seqmask)
   memset(kmercount, 0, kmerhashsize * sizeof(unsigned int));
 
   /* first scan, just count occurences */
+  dbindex_free_blockcounts();
+  dbindex_blocks = MIN(opt_threads, (seqcount + 7) / 8);
+  dbindex_blocks = MIN(dbindex_blocks,
+                       dbindex_blockcounts_maxmem
+                       / (kmerhashsize * sizeof(unsigned int)));
+
   progress_init("Counting k-mers", seqcount);
-  for(unsigned int seqno = 0; seqno < seqcount ; seqno++)
+  if (dbindex_blocks > 1)
     {
-      unsigned int uniquecount;
-      unsigned int * uniquelist;
-      unique_count(dbindex_uh, opt_wordlength,
-                   db_getsequencelen(seqno), db_getsequence(seqno),
-                   & uniquecount, & uniquelist, seqmask);
-      for(unsigned int i = 0; i < uniquecount; i++)
+      uint64_t countsize = (uint64_t) dbindex_blocks * kmerhashsize
+        * sizeof(unsigned int);
+      dbindex_blockcounts = (unsigned int *) xmalloc(countsize);
+      memset(dbindex_blockcounts, 0, countsize);
+      dbindex_seqmask = seqmask;
+      dbindex_run_workers(dbindex_count_worker);
+      for(unsigned int b = 0; b < dbindex_blocks; b++)
         {
-          kmercount[uniquelist[i]]++;
+          unsigned int * counts = dbindex_blockcounts
+            + (uint64_t) b * kmerhashsize;
+          for(unsigned int kmer = 0; kmer < kmerhashsize; kmer++)
+            {
+              kmercount[kmer] += counts[kmer];
+            }
+        }
+    }
+  else
+    {
+      for(unsigned int seqno = 0; seqno < seqcount ; seqno++)
+        {
+          unsigned int uniquecount;
+          unsigned int * uniquelist;
+          unique_count(dbindex_uh, opt_wordlength,
+                       db_getsequencelen(seqno), db_getsequence(seqno),
+                       & uniquecount, & uniquelist, seqmask);
+          for(unsigned int i = 0; i < uniquecount; i++)
+            {
+              kmercount[uniquelist[i]]++;
+            }
+          progress_update(seqno);
         }
-      progress_update(seqno);
     }
   progress_done();
 
@@ -215,12 +567,629 @@ void dbindex_prepare(int use_bitmap, int seqmask)
   show_rusage();
 }
 
-void dbindex_free()
+void dbindex_prepare_growable(int use_bitmap)
 {
-  xfree(kmerhash);
+  dbindex_uh = unique_init();
+
+  unsigned int seqcount = db_getsequencecount();
+  kmerhashsize = 1 << (2 * opt_wordlength);
+
+  kmercount = (unsigned int *) xmalloc(kmerhashsize * sizeof(unsigned int));
+  memset(kmercount, 0, kmerhashsize * sizeof(unsigned int));
+  kmercapacity = (unsigned int *) xmalloc(kmerhashsize * sizeof(unsigned int));
+  memset(kmercapacity, 0, kmerhashsize * sizeof(unsigned int));
+  kmerhash = (uint64_t *) xmalloc((kmerhashsize + 1) * sizeof(uint64_t));
+  memset(kmerhash, 0, (kmerhashsize + 1) * sizeof(uint64_t));
+  kmerbitmap = (bitmap_t **) xmalloc(kmerhashsize * sizeof(bitmap_t *));
+  memset(kmerbitmap, 0, kmerhashsize * sizeof(bitmap_t *));
+
+  /* same threshold as for a full build, but at least one entry */
+  if (use_bitmap)
+    {
+      bitmap_mincount = MAX(seqcount / BITMAP_THRESHOLD, 1);
+    }
+  else
+    {
+      bitmap_mincount = seqcount + 1;
+    }
+
+  kmerindex = nullptr;
+  kmerindexsize = 0;
+  kmerindex_alloc = 0;
+  dbindex_map = nullptr;
+  dbindex_map_alloc = 0;
+  dbindex_count = 0;
+  dbindex_growable = true;
+}
+
+/*
+  Compressed index
+
+  With --index_compress the posting lists and bitmaps are replaced by
+  a single packed byte array after the index has been built. The list
+  of each kmer is split into containers of index numbers sharing the
+  same upper 16 bits. Each container starts with a 4 byte header
+  holding these upper bits and the number of entries minus one.
+  Containers with more than 4096 entries are stored as a bitmap of
+  65536 bits, the others as delta encoded 16 bit offsets in groups of
+  8, with a control byte in front of each group telling which deltas
+  need two bytes. The kmer counts are decoded directly into the
+  counters of the search without expanding the lists.
+*/
+
+constexpr unsigned int dbindex_pack_array_max = 4096;
+constexpr unsigned int dbindex_pack_padding = 16;
+
+static uint64_t kmerpack_size = 0;
+
+struct dbindex_packbuf_s
+{
+  unsigned char * data;
+  uint64_t size;
+  uint64_t alloc;
+};
+
+auto dbindex_pack_reserve(struct dbindex_packbuf_s * b,
+                          uint64_t length) -> unsigned char *
+{
+  if (b->size + length + dbindex_pack_padding > b->alloc)
+    {
+      b->alloc = MAX(2 * b->alloc, b->size + length + dbindex_pack_padding);
+      b->data = (unsigned char *) xrealloc(b->data, b->alloc);
+    }
+  return b->data + b->size;
+}
+
+auto dbindex_pack_container(struct dbindex_packbuf_s * b,
+                            unsigned int * list,
+                            unsigned int count) -> void
+{
+  /* header, offsets in groups of 8 and at most 2 bytes per offset */
+  unsigned char * p = dbindex_pack_reserve(b, 4 + 17 * ((count + 7) / 8)
+                                           + dbindex_pack_chunk / 8);
+  unsigned char * start = p;
+  unsigned int key = list[0] / dbindex_pack_chunk;
+
+  *p++ = key & 0xff;
+  *p++ = key >> 8;
+  *p++ = (count - 1) & 0xff;
+  *p++ = (count - 1) >> 8;
+
+  if (count > dbindex_pack_array_max)
+    {
+      memset(p, 0, dbindex_pack_chunk / 8);
+      for(unsigned int i = 0; i < count; i++)
+        {
+          unsigned int x = list[i] % dbindex_pack_chunk;
+          p[x / 8] |= 1 << (x % 8);
+        }
+      p += dbindex_pack_chunk / 8;
+    }
+  else
+    {
+      unsigned int prev = 0;
+      for(unsigned int i = 0; i < count; i += 8)
+        {
+          unsigned char * control = p++;
+          *control = 0;
+          for(unsigned int j = 0; j < 8; j++)
+            {
+              unsigned int delta = 0;
+              if (i + j < count)
+                {
+                  unsigned int x = list[i + j] % dbindex_pack_chunk;
+                  delta = x - prev;
+                  prev = x;
+                }
+              *p++ = delta & 0xff;
+              if (delta > 0xff)
+                {
+                  *control |= 1 << j;
+                  *p++ = delta >> 8;
+                }
+            }
+        }
+    }
+
+  b->size += p - start;
+}
+
+auto dbindex_pack_finish(struct dbindex_packbuf_s * b,
+                         uint64_t unpacked_size) -> void
+{
+  /* padding for reads beyond the last container */
+  memset(dbindex_pack_reserve(b, 0), 0, dbindex_pack_padding);
+  kmerpack = (unsigned char *) xrealloc(b->data,
+                                        b->size + dbindex_pack_padding);
+  kmerpack_size = b->size;
+
+  if (! opt_quiet)
+    {
+      fprintf(stderr,
+              "Compressed k-mer index from %" PRIu64 " to %" PRIu64 " bytes\n",
+              unpacked_size, kmerpack_size);
+    }
+
+  if (opt_log)
+    {
+      fprintf(fp_log,
+              "Compressed k-mer index from %" PRIu64 " to %" PRIu64 " bytes\n",
+              unpacked_size, kmerpack_size);
+    }
+
+  show_rusage();
+}
+
+void dbindex_pack()
+{
+  /* the mapped index is used as it is */
+  if (udb_is_mapped() || kmerpack)
+    {
+      return;
+    }
+
+  uint64_t unpacked_size = kmerindexsize * sizeof(unsigned int);
+  auto * buffer = (unsigned int *) xmalloc(MAX(dbindex_count, 1)
+                                           * sizeof(unsigned int));
+  kmerpack_offset = (uint64_t *) xmalloc((kmerhashsize + 1)
+                                         * sizeof(uint64_t));
+  struct dbindex_packbuf_s pack = { nullptr, 0, 0 };
+
+  progress_init("Compressing k-mer index", kmerhashsize);
+  for(unsigned int kmer = 0; kmer < kmerhashsize; kmer++)
+    {
+      kmerpack_offset[kmer] = pack.size;
+
+      unsigned int count = kmercount[kmer];
+      unsigned int * list;
+      if (kmerbitmap[kmer])
+        {
+          unpacked_size += (kmerbitmap[kmer]->size + 7) / 8;
+          count = 0;
+          for(unsigned int i = 0; i < dbindex_count; i++)
+            {
+              if (bitmap_get(kmerbitmap[kmer], i))
+                {
+                  buffer[count++] = i;
+                }
+            }
+          bitmap_free(kmerbitmap[kmer]);
+          kmerbitmap[kmer] = nullptr;
+          list = buffer;
+        }
+      else
+        {
+          list = kmerindex + kmerhash[kmer];
+        }
+
+      unsigned int i = 0;
+      while (i < count)
+        {
+          unsigned int key = list[i] / dbindex_pack_chunk;
+          unsigned int j = i + 1;
+          while ((j < count) && (list[j] / dbindex_pack_chunk == key))
+            {
+              j++;
+            }
+          dbindex_pack_container(& pack, list + i, j - i);
+          i = j;
+        }
+      progress_update(kmer);
+    }
+  progress_done();
+  kmerpack_offset[kmerhashsize] = pack.size;
+
+  xfree(buffer);
   xfree(kmerindex);
+  kmerindex = nullptr;
+  xfree(kmerhash);
+  kmerhash = nullptr;
+  kmerindexsize = 0;
+
+  dbindex_pack_finish(& pack, unpacked_size);
+}
+
+/*
+  Building the compressed index directly
+
+  When the uncompressed index is not needed, e.g. for a cache, the
+  compressed index is built without it. Each chunk of consecutive
+  sequences gives at most one container per kmer. A thread collects
+  the (kmer, seqno) pairs of a chunk, groups them into the lists of
+  the kmers present and packs these into a stream of containers, each
+  preceded by its kmer and length. The pairs are grouped with counts
+  over all kmers when the chunk has about as many pairs as there are
+  kmers and the count arrays of the threads fit in the same memory as
+  the block counts, and by sorting otherwise, so that long words do
+  not cost 4^k work and memory per chunk. The streams of the chunks
+  are then merged kmer by kmer into the final array, in the same
+  layout as dbindex_pack gives.
+*/
+
+static unsigned int dbindex_chunks = 0;
+static unsigned int dbindex_next_chunk = 0;
+static struct dbindex_packbuf_s * dbindex_chunk_streams = nullptr;
+
+auto dbindex_pack_worker(void * vp) -> void *
+{
+  (void) vp;
+  struct uhandle_s * uh = unique_init();
+  const bool dense_fits = (uint64_t) kmerhashsize * sizeof(unsigned int)
+    * dbindex_blocks <= dbindex_blockcounts_maxmem;
+  unsigned int * next = nullptr;
+  std::vector<uint64_t> pairs;
+  std::vector<std::pair<unsigned int, uint64_t>> runs; /* kmer, list end */
+  unsigned int * list = nullptr;
+  uint64_t list_alloc = 0;
+  unsigned int seqcount = db_getsequencecount();
+
+  while (true)
+    {
+      xpthread_mutex_lock(& dbindex_mutex);
+      unsigned int chunk = dbindex_next_chunk;
+      if (chunk < dbindex_chunks)
+        {
+          ++dbindex_next_chunk;
+        }
+      xpthread_mutex_unlock(& dbindex_mutex);
+
+      if (chunk >= dbindex_chunks)
+        {
+          break;
+        }
+
+      unsigned int first = chunk * dbindex_pack_chunk;
+      unsigned int last = MIN((uint64_t) first + dbindex_pack_chunk, seqcount);
+      unsigned int uniquecount;
+      unsigned int * uniquelist;
+
+      /* the pairs are in the order of seqno */
+
+      pairs.clear();
+      for(unsigned int seqno = first; seqno < last; seqno++)
+        {
+          dbindex_map[seqno] = seqno;
+          unique_count(uh, opt_wordlength,
+                       db_getsequencelen(seqno), db_getsequence(seqno),
+                       & uniquecount, & uniquelist, dbindex_seqmask);
+          for(unsigned int i = 0; i < uniquecount; i++)
+            {
+              pairs.push_back(((uint64_t) uniquelist[i] << 32) | seqno);
+            }
+        }
+
+      uint64_t total = pairs.size();
+      if (total > list_alloc)
+        {
+          list_alloc = total;
+          list = (unsigned int *) xrealloc(list,
+                                           list_alloc * sizeof(unsigned int));
+        }
+
+      runs.clear();
+      if (dense_fits && (total >= kmerhashsize / 4))
+        {
+          /* count, and turn the counts into the start of each list */
+
+          if (! next)
+            {
+              next = (unsigned int *) xmalloc(kmerhashsize
+                                              * sizeof(unsigned int));
+            }
+          memset(next, 0, kmerhashsize * sizeof(unsigned int));
+          for(auto pair : pairs)
+            {
+              next[pair >> 32]++;
+            }
+
+          unsigned int start = 0;
+          for(unsigned int kmer = 0; kmer < kmerhashsize; kmer++)
+            {
+              unsigned int count = next[kmer];
+              next[kmer] = start;
+              start += count;
+            }
+
+          for(auto pair : pairs)
+            {
+              list[next[pair >> 32]++] = (unsigned int) pair;
+            }
+
+          /* next[kmer] is now the end of its list */
+
+          start = 0;
+          for(unsigned int kmer = 0; kmer < kmerhashsize; kmer++)
+            {
+              if (next[kmer] > start)
+                {
+                  runs.emplace_back(kmer, next[kmer]);
+                }
+              start = next[kmer];
+            }
+        }
+      else
+        {
+          /* sorting keeps each list in the order of seqno */
+
+          std::sort(pairs.begin(), pairs.end());
+          for(uint64_t i = 0; i < total; i++)
+            {
+              list[i] = (unsigned int) pairs[i];
+              if ((i + 1 == total) || ((pairs[i + 1] >> 32) != (pairs[i] >> 32)))
+                {
+                  runs.emplace_back((unsigned int) (pairs[i] >> 32), i + 1);
+                }
+            }
+        }
+
+      struct dbindex_packbuf_s * stream = dbindex_chunk_streams + chunk;
+      uint64_t start = 0;
+      for(auto const & run : runs)
+        {
+          unsigned int kmer = run.first;
+          uint64_t end = run.second;
+          dbindex_pack_reserve(stream, 8);
+          uint64_t size = stream->size;
+          stream->size += 8;
+          dbindex_pack_container(stream, list + start, end - start);
+          unsigned char * p = stream->data + size;
+          auto length = (unsigned int) (stream->size - size - 8);
+          memcpy(p, & kmer, sizeof(unsigned int));
+          memcpy(p + 4, & length, sizeof(unsigned int));
+          start = end;
+        }
+
+      dbindex_progress_add(last - first);
+    }
+
+  if (list)
+    {
+      xfree(list);
+    }
+  if (next)
+    {
+      xfree(next);
+    }
+  unique_exit(uh);
+  return nullptr;
+}
+
+void dbindex_prepare_packed(int use_bitmap, int seqmask)
+{
+  dbindex_uh = unique_init();
+
+  unsigned int seqcount = db_getsequencecount();
+  kmerhashsize = 1 << (2 * opt_wordlength);
+
+  kmercount = (unsigned int *) xmalloc(kmerhashsize * sizeof(unsigned int));
+  memset(kmercount, 0, kmerhashsize * sizeof(unsigned int));
+  kmerbitmap = (bitmap_t **) xmalloc(kmerhashsize * sizeof(bitmap_t *));
+  memset(kmerbitmap, 0, kmerhashsize * sizeof(bitmap_t *));
+  kmerhash = nullptr;
+  kmerindex = nullptr;
+  kmerindexsize = 0;
+  dbindex_map = (unsigned int *) xmalloc(MAX(seqcount, 1)
+                                         * sizeof(unsigned int));
+
+  dbindex_chunks = (seqcount + dbindex_pack_chunk - 1) / dbindex_pack_chunk;
+  dbindex_next_chunk = 0;
+  dbindex_chunk_streams = (struct dbindex_packbuf_s *)
+    xmalloc(MAX(dbindex_chunks, 1) * sizeof(struct dbindex_packbuf_s));
+  for(unsigned int c = 0; c < dbindex_chunks; c++)
+    {
+      dbindex_chunk_streams[c] = { nullptr, 0, 0 };
+    }
+
+  dbindex_free_blockcounts();
+  dbindex_blocks = MAX(MIN((unsigned int) opt_threads, dbindex_chunks), 1);
+  dbindex_seqmask = seqmask;
+  progress_init("Creating compressed k-mer index", seqcount);
+  dbindex_run_workers(dbindex_pack_worker);
+  progress_done();
+  dbindex_blocks = 0;
+
+  /* copy the containers kmer by kmer */
+
+  uint64_t total = 0;
+  for(unsigned int c = 0; c < dbindex_chunks; c++)
+    {
+      total += dbindex_chunk_streams[c].size;
+    }
+
+  struct dbindex_packbuf_s pack = { nullptr, 0, 0 };
+  dbindex_pack_reserve(& pack, total);
+  kmerpack_offset = (uint64_t *) xmalloc((kmerhashsize + 1)
+                                         * sizeof(uint64_t));
+  auto * cursor = (uint64_t *) xmalloc(MAX(dbindex_chunks, 1)
+                                       * sizeof(uint64_t));
+  memset(cursor, 0, MAX(dbindex_chunks, 1) * sizeof(uint64_t));
+
+  /* the next kmer of each stream, lowest first and then by chunk */
+
+  std::priority_queue<std::pair<unsigned int, unsigned int>,
+                      std::vector<std::pair<unsigned int, unsigned int>>,
+                      std::greater<std::pair<unsigned int, unsigned int>>> heap;
+  for(unsigned int c = 0; c < dbindex_chunks; c++)
+    {
+      if (dbindex_chunk_streams[c].size)
+        {
+          unsigned int stream_kmer = 0;
+          memcpy(& stream_kmer, dbindex_chunk_streams[c].data,
+                 sizeof(unsigned int));
+          heap.emplace(stream_kmer, c);
+        }
+    }
+
+  for(unsigned int kmer = 0; kmer < kmerhashsize; kmer++)
+    {
+      kmerpack_offset[kmer] = pack.size;
+      while ((! heap.empty()) && (heap.top().first == kmer))
+        {
+          unsigned int c = heap.top().second;
+          heap.pop();
+          struct dbindex_packbuf_s * stream = dbindex_chunk_streams + c;
+          unsigned char * p = stream->data + cursor[c];
+          unsigned int length = 0;
+          memcpy(& length, p + 4, sizeof(unsigned int));
+          kmercount[kmer] += (p[10] | (p[11] << 8)) + 1;
+          memcpy(pack.data + pack.size, p + 8, length);
+          pack.size += length;
+          cursor[c] += 8 + length;
+          if (cursor[c] < stream->size)
+            {
+              unsigned int stream_kmer = 0;
+              memcpy(& stream_kmer, stream->data + cursor[c],
+                     sizeof(unsigned int));
+              heap.emplace(stream_kmer, c);
+            }
+        }
+    }
+  kmerpack_offset[kmerhashsize] = pack.size;
+
+  for(unsigned int c = 0; c < dbindex_chunks; c++)
+    {
+      if (dbindex_chunk_streams[c].data)
+        {
+          xfree(dbindex_chunk_streams[c].data);
+        }
+    }
+  xfree(dbindex_chunk_streams);
+  dbindex_chunk_streams = nullptr;
+  xfree(cursor);
+
+  /* same threshold for bitmaps as for the uncompressed index */
+  bitmap_mincount = use_bitmap ? seqcount / BITMAP_THRESHOLD : seqcount + 1;
+
+  uint64_t unpacked_size = 0;
+  for(unsigned int kmer = 0; kmer < kmerhashsize; kmer++)
+    {
+      if (kmercount[kmer] >= bitmap_mincount)
+        {
+          unpacked_size += (seqcount + 127 + 7) / 8;
+        }
+      else
+        {
+          unpacked_size += kmercount[kmer] * sizeof(unsigned int);
+        }
+    }
+
+  dbindex_count = seqcount;
+  dbindex_pack_finish(& pack, unpacked_size);
+}
+
+auto dbindex_count_packed_array(count_t * counters,
+                                unsigned char * p,
+                                unsigned int count) -> unsigned char *
+{
+  unsigned int offset = 0;
+  for(unsigned int i = 0; i < count; i += 8)
+    {
+      unsigned char control = *p++;
+      for(unsigned int j = 0; j < 8; j++)
+        {
+          unsigned int delta = *p++;
+          if (control & (1 << j))
+            {
+              delta |= *p++ << 8;
+            }
+          offset += delta;
+          if (i + j < count)
+            {
+              counters[offset]++;
+            }
+        }
+    }
+  return p;
+}
+
+auto dbindex_count_container(count_t * counters,
+                             unsigned char * p) -> unsigned char *
+{
+  /* counters point to the counter of the first index in the chunk */
+
+  unsigned int key = dbindex_packed_key(p);
+  unsigned int count = (p[2] | (p[3] << 8)) + 1;
+  p += 4;
+
+  if (count > dbindex_pack_array_max)
+    {
+      uint64_t first = (uint64_t) key * dbindex_pack_chunk;
+      auto bits = (unsigned int) MIN(dbindex_pack_chunk,
+                                     dbindex_count - first);
+      increment_counters_from_bitmap(counters, p, bits);
+      return p + dbindex_pack_chunk / 8;
+    }
+  else
+    {
+#ifdef __x86_64__
+      if (ssse3_present)
+        {
+          return increment_counters_from_packed_ssse3(counters, p, count);
+        }
+      else
+        {
+          return dbindex_count_packed_array(counters, p, count);
+        }
+#else
+      return dbindex_count_packed_array(counters, p, count);
+#endif
+    }
+}
+
+void dbindex_count_packed(count_t * counters, unsigned int kmer)
+{
+  unsigned char * p = kmerpack + kmerpack_offset[kmer];
+  unsigned char * end = kmerpack + kmerpack_offset[kmer + 1];
+
+  while (p < end)
+    {
+      uint64_t first = (uint64_t) dbindex_packed_key(p) * dbindex_pack_chunk;
+      p = dbindex_count_container(counters + first, p);
+    }
+}
+
+void dbindex_free()
+{
+  dbindex_free_blockcounts();
+
+  if (udb_is_mapped())
+    {
+      /* the index itself lives in the mapped UDB file */
+      xfree(kmerbitmap);
+      unique_exit(dbindex_uh);
+      return;
+    }
+
+  if (kmerpack)
+    {
+      xfree(kmerpack);
+      kmerpack = nullptr;
+      xfree(kmerpack_offset);
+      kmerpack_offset = nullptr;
+      kmerpack_size = 0;
+    }
+  else
+    {
+      xfree(kmerhash);
+      if (kmerindex)
+        {
+          xfree(kmerindex);
+        }
+    }
   xfree(kmercount);
-  xfree(dbindex_map);
+  if (dbindex_map)
+    {
+      xfree(dbindex_map);
+    }
+
+  if (dbindex_growable)
+    {
+      xfree(kmercapacity);
+      kmercapacity = nullptr;
+      kmerindex_alloc = 0;
+      dbindex_map_alloc = 0;
+      dbindex_growable = false;
+    }
 
   for(unsigned int kmer = 0; kmer < kmerhashsize; kmer++)
     {
@@ -66,6 +66,8 @@ extern unsigned int * kmercount; /* number of matching seqnos for each kmer */
 extern uint64_t * kmerhash;  /* index into the list below for each kmer */
 extern unsigned int * kmerindex; /* the list of matching seqnos for kmers */
 extern bitmap_t * * kmerbitmap;
+extern unsigned char * kmerpack; /* compressed lists, if any */
+extern uint64_t * kmerpack_offset; /* start of each kmer in the above */
 extern unsigned int * dbindex_map;
 extern unsigned int dbindex_count;
 extern unsigned int kmerhashsize;
@@ -75,10 +77,25 @@ extern uhandle_s * dbindex_uh;
 auto fprint_kmer(std::FILE * f, unsigned int k, uint64_t kmer) -> void;
 
 auto dbindex_prepare(int use_bitmap, int seqmask) -> void;
+auto dbindex_prepare_growable(int use_bitmap) -> void;
 auto dbindex_addallsequences(int seqmask) -> void;
 auto dbindex_addsequence(unsigned int seqno, int seqmask) -> void;
 auto dbindex_free() -> void;
 auto dbindex_udb_write() -> void;
+auto dbindex_pack() -> void;
+auto dbindex_prepare_packed(int use_bitmap, int seqmask) -> void;
+auto dbindex_count_packed(count_t * counters,
+                          unsigned int kmer) -> void;
+auto dbindex_count_container(count_t * counters,
+                             unsigned char * p) -> unsigned char *;
+
+/* number of index entries covered by each compressed container */
+constexpr unsigned int dbindex_pack_chunk = 65536;
+
+inline auto dbindex_packed_key(unsigned char * p) -> unsigned int
+{
+  return p[0] | (p[1] << 8);
+}
 
 inline auto dbindex_getbitmap(unsigned int kmer) -> unsigned char *
 {
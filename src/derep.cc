@@ -59,6 +59,8 @@
 */
 
 #include "vsearch.h"
+#include <utility>
+#include <vector>
 
 
 #define HASH hash_cityhash64
@@ -193,6 +195,22 @@ int seqcmp(char * a, char * b, int n)
       return 0;
     }
 
+  /*
+    skip the part that is identical byte by byte, usually all of it for
+    upper case sequences, and compare the rest ignoring case and U/T
+  */
+  while ((n > 0) and (*p == *q) and (*p != 0))
+    {
+      ++p;
+      ++q;
+      --n;
+    }
+
+  if (n == 0)
+    {
+      return 0;
+    }
+
   while ((n-- > 0) and (chrmap_4bit[(int) (*p)] == chrmap_4bit[(int) (*q)]))
     {
       if ((n == 0) or (*p == 0) or (*q == 0))
@@ -269,6 +287,689 @@ inline int convert_p_to_q(double p)
   return opt_fastq_asciiout + q;
 }
 
+/*
+  Parallel dereplication. Sequences are read in batches by the main
+  thread. All threads normalize and hash the sequences of a batch,
+  then insert them into hash table shards. The shard is chosen from
+  the hash (the smaller of the hashes of both strands with --strand
+  both), so identical sequences always end up in the same shard. Each
+  shard is owned by a single thread that inserts its sequences in
+  input order, so no locking is needed and the clusters, abundances
+  and quality scores are the same as with a single table. Finally the
+  shards are sorted in parallel and merged.
+*/
+
+static const uint64_t derep_batch_size = 16384;
+
+struct derep_record_s
+{
+  char * header;
+  char * seq;
+  char * seq_up;
+  char * rc_seq_up;
+  char * qual;
+  int64_t headerlen;
+  int64_t seqlen;
+  int64_t abundance;
+  int64_t count;
+  uint64_t seqno;
+  uint64_t hash;
+  uint64_t rc_hash;
+  int shard;
+  int64_t header_alloc;
+  int64_t seq_alloc;
+};
+
+struct derep_shard_s
+{
+  struct bucket * hashtable;
+  uint64_t alloc_clusters;
+  uint64_t clusters;
+};
+
+static const auto terminal = (unsigned int) (-1);
+static unsigned int * nextseqtab = nullptr;
+static char ** headertab = nullptr;
+static char * match_strand = nullptr;
+
+static bool derep_use_header = false;
+static bool derep_extra_info = false;
+static int derep_shard_count = 1;
+static struct derep_shard_s * derep_shards = nullptr;
+static struct derep_record_s * derep_batch = nullptr;
+static uint64_t derep_batch_count = 0;
+static pthread_t * derep_pthread = nullptr;
+static uint64_t derep_alloc_seqs = 0;
+
+/* binary snapshot of a dereplication result, see --snapshotout */
+
+static const char derep_snapshot_magic[16] = "VSEARCH_DEREP01";
+static const uint64_t derep_snapshot_use_header = 1;
+static const uint64_t derep_snapshot_fastq = 2;
+
+struct derep_snapshot_header_s
+{
+  char magic[16];
+  uint64_t flags;
+  uint64_t clusters;
+};
+
+struct derep_snapshot_record_s
+{
+  uint64_t size;
+  uint64_t count;
+  uint64_t headerlen;
+  uint64_t seqlen;
+};
+
+void derep_record_alloc(struct derep_record_s * r,
+                        int64_t headerlen,
+                        int64_t seqlen)
+{
+  r->headerlen = headerlen;
+  r->seqlen = seqlen;
+  r->count = 1;
+
+  if (r->headerlen + 1 > r->header_alloc)
+    {
+      r->header_alloc = r->headerlen + 1;
+      r->header = (char *) xrealloc(r->header, r->header_alloc);
+    }
+
+  if (r->seqlen + 1 > r->seq_alloc)
+    {
+      r->seq_alloc = r->seqlen + 1;
+      r->seq = (char *) xrealloc(r->seq, r->seq_alloc);
+      r->seq_up = (char *) xrealloc(r->seq_up, r->seq_alloc);
+      r->rc_seq_up = (char *) xrealloc(r->rc_seq_up, r->seq_alloc);
+      r->qual = (char *) xrealloc(r->qual, r->seq_alloc);
+    }
+}
+
+void derep_record_copy(struct derep_record_s * r, fastx_handle h)
+{
+  derep_record_alloc(r,
+                     fastx_get_header_length(h),
+                     fastx_get_sequence_length(h));
+
+  memcpy(r->header, fastx_get_header(h), r->headerlen + 1);
+  memcpy(r->seq, fastx_get_sequence(h), r->seqlen + 1);
+
+  char * qual = fastx_get_quality(h); // nullptr if FASTA
+  if (qual)
+    {
+      memcpy(r->qual, qual, r->seqlen + 1);
+    }
+  else
+    {
+      r->qual[0] = 0;
+    }
+}
+
+void derep_record_free(struct derep_record_s * r)
+{
+  if (r->header_alloc)
+    {
+      xfree(r->header);
+    }
+  if (r->seq_alloc)
+    {
+      xfree(r->seq);
+      xfree(r->seq_up);
+      xfree(r->rc_seq_up);
+      xfree(r->qual);
+    }
+}
+
+void * derep_hash_worker(void * vp)
+{
+  /* normalize and hash a slice of the batch, choose the shard */
+
+  auto t = (int64_t) vp;
+  const uint64_t first = derep_batch_count * t / derep_shard_count;
+  const uint64_t last = derep_batch_count * (t + 1) / derep_shard_count;
+
+  for (uint64_t i = first; i < last; i++)
+    {
+      struct derep_record_s * r = derep_batch + i;
+
+      /* normalize sequence: uppercase and replace U by T  */
+      string_normalize(r->seq_up, r->seq, r->seqlen);
+
+      uint64_t hash_header = 0;
+      if (derep_use_header)
+        {
+          hash_header = HASH(r->header, r->headerlen);
+        }
+
+      r->hash = HASH(r->seq_up, r->seqlen) ^ hash_header;
+      uint64_t canonical = r->hash;
+
+      /* reverse complement if necessary */
+      if (opt_strand > 1)
+        {
+          reverse_complement(r->rc_seq_up, r->seq_up, r->seqlen);
+          r->rc_hash = HASH(r->rc_seq_up, r->seqlen) ^ hash_header;
+          canonical = MIN(canonical, r->rc_hash);
+        }
+
+      /* the low bits select the bucket, use the high bits here */
+      r->shard = (canonical >> 32) % derep_shard_count;
+    }
+
+  return nullptr;
+}
+
+void derep_insert(struct derep_shard_s * shard, struct derep_record_s * r)
+{
+  if (shard->clusters + 1 > shard->alloc_clusters)
+    {
+      rehash(& shard->hashtable, shard->alloc_clusters);
+      shard->alloc_clusters *= 2;
+    }
+
+  const uint64_t hash_mask = 2 * shard->alloc_clusters - 1;
+  struct bucket * hashtable = shard->hashtable;
+  char * header = r->header;
+  const int64_t seqlen = r->seqlen;
+  const uint64_t seqno = r->seqno;
+
+  /*
+    Find free bucket or bucket for identical sequence.
+    Make sure sequences are exactly identical
+    in case of any hash collision.
+    With 64-bit hashes, there is about 50% chance of a
+    collision when the number of sequences is about 5e9.
+  */
+
+  uint64_t hash = r->hash;
+  uint64_t j = hash & hash_mask;
+  struct bucket * bp = hashtable + j;
+
+  while ((bp->size)
+         and
+         ((hash != bp->hash) or
+          (seqcmp(r->seq_up, bp->seq, seqlen)) or
+          (derep_use_header and strcmp(header, bp->header))))
+    {
+      j = (j + 1) & hash_mask;
+      bp = hashtable + j;
+    }
+
+  if ((opt_strand > 1) and not bp->size)
+    {
+      /* no match on plus strand */
+      /* check minus strand as well */
+
+      uint64_t rc_hash = r->rc_hash;
+      uint64_t k = rc_hash & hash_mask;
+      struct bucket * rc_bp = hashtable + k;
+
+      while ((rc_bp->size)
+             and
+             ((rc_hash != rc_bp->hash) or
+              (seqcmp(r->rc_seq_up, rc_bp->seq, seqlen)) or
+              (derep_use_header and strcmp(header, bp->header))))
+        {
+          k = (k + 1) & hash_mask;
+          rc_bp = hashtable + k;
+        }
+
+      if (rc_bp->size)
+        {
+          bp = rc_bp;
+          if (derep_extra_info)
+            {
+              match_strand[seqno] = 1;
+            }
+        }
+    }
+
+  int64_t ab = r->abundance;
+
+  if (bp->size)
+    {
+      /* at least one identical sequence already */
+      if (derep_extra_info)
+        {
+          unsigned int last = bp->seqno_last;
+          nextseqtab[last] = seqno;
+          bp->seqno_last = seqno;
+          headertab[seqno] = xstrdup(header);
+        }
+
+      int64_t s1 = bp->size;
+      int64_t s2 = ab;
+      int64_t s3 = s1 + s2;
+
+      if (opt_fastqout)
+        {
+          /* update quality scores */
+          for (int i = 0; i < seqlen; i++)
+            {
+              int q1 = bp->qual[i];
+              int q2 = r->qual[i];
+              double p1 = convert_q_to_p(q1);
+              double p2 = convert_q_to_p(q2);
+              double p3;
+
+              /* how to compute the new quality score? */
+
+              if (opt_fastq_qout_max)
+                {
+                  // fastq_qout_max
+                  /* min error prob, highest quality */
+                  p3 = MIN(p1, p2);
+                }
+              else
+                {
+                  // fastq_qout_avg
+                  /* average, as in USEARCH */
+                  p3 = (p1 * s1 + p2 * s2) / s3;
+                }
+
+              // fastq_qout_min
+              /* max error prob, lowest quality */
+              // p3 = MAX(p1, p2);
+
+              // fastq_qout_first
+              /* keep first */
+              // p3 = p1;
+
+              // fastq_qout_last
+              /* keep last */
+              // p3 = p2;
+
+              // fastq_qout_ef
+              /* Compute as multiple independent observations
+                 Edgar & Flyvbjerg (2015)
+                 But what about s1 and s2? */
+              // p3 = p1 * p2 / 3.0 / (1.0 - p1 - p2 + (4.0 * p1 * p2 / 3.0));
+
+              /* always worst quality possible, certain error */
+              // p3 = 1.0;
+
+              // always best quality possible, perfect, no errors */
+              // p3 = 0.0;
+
+              int q3 = convert_p_to_q(p3);
+              bp->qual[i] = q3;
+            }
+        }
+
+      bp->size = s3;
+      bp->count += r->count;
+    }
+  else
+    {
+      /* no identical sequences yet */
+      bp->size = ab;
+      bp->hash = hash;
+      bp->seqno_first = seqno;
+      bp->seqno_last = seqno;
+      bp->seq = xstrdup(r->seq);
+      bp->header = xstrdup(header);
+      bp->count = r->count;
+      if (r->qual[0] or (seqlen == 0 and opt_fastqout))
+        bp->qual = xstrdup(r->qual);
+      else
+        bp->qual = nullptr;
+      ++shard->clusters;
+    }
+}
+
+void * derep_insert_worker(void * vp)
+{
+  /* insert the sequences of the batch that belong to this shard */
+
+  auto t = (int64_t) vp;
+  struct derep_shard_s * shard = derep_shards + t;
+
+  for (uint64_t i = 0; i < derep_batch_count; i++)
+    {
+      if (derep_batch[i].shard == t)
+        {
+          derep_insert(shard, derep_batch + i);
+        }
+    }
+
+  return nullptr;
+}
+
+void * derep_sort_worker(void * vp)
+{
+  /* move the clusters of this shard to the front and sort them */
+
+  auto t = (int64_t) vp;
+  struct derep_shard_s * shard = derep_shards + t;
+  const uint64_t hashtablesize = 2 * shard->alloc_clusters;
+
+  uint64_t n = 0;
+  for (uint64_t i = 0; i < hashtablesize; i++)
+    {
+      if (shard->hashtable[i].size)
+        {
+          shard->hashtable[n++] = shard->hashtable[i];
+        }
+    }
+
+  qsort(shard->hashtable, n, sizeof(struct bucket), derep_compare_full);
+
+  return nullptr;
+}
+
+void derep_threads_start(void * (*worker)(void *))
+{
+  for (int t = 0; t < derep_shard_count; t++)
+    {
+      xpthread_create(derep_pthread + t, nullptr, worker, (void *) (int64_t) t);
+    }
+}
+
+void derep_threads_join()
+{
+  for (int t = 0; t < derep_shard_count; t++)
+    {
+      xpthread_join(derep_pthread[t], nullptr);
+    }
+}
+
+auto derep_merge_shards(uint64_t clusters) -> struct bucket *
+{
+  /*
+    Merge the sorted shards into one array, in the order given by
+    derep_compare_full, merging pairs of runs until one is left.
+  */
+
+  auto * a = (struct bucket *) xmalloc(sizeof(struct bucket) * (clusters + 1));
+  auto * b = (struct bucket *) xmalloc(sizeof(struct bucket) * (clusters + 1));
+
+  std::vector<uint64_t> bounds(1, 0);
+  for (int t = 0; t < derep_shard_count; t++)
+    {
+      const uint64_t n = derep_shards[t].clusters;
+      memcpy(a + bounds.back(), derep_shards[t].hashtable, n * sizeof(struct bucket));
+      bounds.push_back(bounds.back() + n);
+    }
+
+  while (bounds.size() > 2)
+    {
+      std::vector<uint64_t> merged(1, 0);
+      for (size_t r = 0; r + 1 < bounds.size(); r += 2)
+        {
+          const uint64_t lo = bounds[r];
+          const uint64_t mid = bounds[r + 1];
+          const uint64_t hi = (r + 2 < bounds.size()) ? bounds[r + 2] : mid;
+          uint64_t x = lo;
+          uint64_t y = mid;
+          uint64_t z = lo;
+          while ((x < mid) and (y < hi))
+            {
+              if (derep_compare_full(a + y, a + x) < 0)
+                {
+                  b[z++] = a[y++];
+                }
+              else
+                {
+                  b[z++] = a[x++];
+                }
+            }
+          while (x < mid)
+            {
+              b[z++] = a[x++];
+            }
+          while (y < hi)
+            {
+              b[z++] = a[y++];
+            }
+          merged.push_back(hi);
+        }
+      bounds.swap(merged);
+      std::swap(a, b);
+    }
+
+  xfree(b);
+  return a;
+}
+
+void derep_extra_info_grow(uint64_t sequencecount)
+{
+  /* make room for sequencecount sequences in the extra info tables */
+
+  if (sequencecount <= derep_alloc_seqs)
+    {
+      return;
+    }
+
+  uint64_t new_alloc_seqs = derep_alloc_seqs;
+  while (sequencecount > new_alloc_seqs)
+    {
+      new_alloc_seqs *= 2;
+    }
+
+  nextseqtab =
+    (unsigned int *) xrealloc(nextseqtab,
+                              sizeof(unsigned int) * new_alloc_seqs);
+  memset(nextseqtab + derep_alloc_seqs,
+         terminal,
+         sizeof(unsigned int) * (new_alloc_seqs - derep_alloc_seqs));
+
+  headertab = (char **) xrealloc(headertab,
+                                 sizeof(char*) * new_alloc_seqs);
+  memset(headertab + derep_alloc_seqs, 0,
+         sizeof(char *) * (new_alloc_seqs - derep_alloc_seqs));
+
+  match_strand = (char *) xrealloc(match_strand, new_alloc_seqs);
+  memset(match_strand + derep_alloc_seqs, 0,
+         new_alloc_seqs - derep_alloc_seqs);
+
+  derep_alloc_seqs = new_alloc_seqs;
+
+  show_rusage();
+}
+
+void derep_snapshot_read(FILE * fp, void * data, uint64_t length)
+{
+  if (length and (fread(data, 1, length, fp) != length))
+    {
+      fatal("Unable to read dereplication snapshot file");
+    }
+}
+
+void derep_snapshot_write(FILE * fp, const void * data, uint64_t length)
+{
+  if (length and (fwrite(data, 1, length, fp) != length))
+    {
+      fatal("Unable to write dereplication snapshot file");
+    }
+}
+
+void derep_snapshot_save(FILE * fp, struct bucket * hashtable, uint64_t clusters)
+{
+  /* write all clusters, also those not selected for output */
+
+  struct derep_snapshot_header_s sh;
+  memcpy(sh.magic, derep_snapshot_magic, sizeof(sh.magic));
+  sh.flags = (derep_use_header ? derep_snapshot_use_header : 0) |
+    (opt_fastqout ? derep_snapshot_fastq : 0);
+  sh.clusters = clusters;
+  derep_snapshot_write(fp, & sh, sizeof(sh));
+
+  for (uint64_t i = 0; i < clusters; i++)
+    {
+      struct bucket * bp = hashtable + i;
+      struct derep_snapshot_record_s sr;
+      sr.size = bp->size;
+      sr.count = bp->count;
+      sr.headerlen = strlen(bp->header);
+      sr.seqlen = strlen(bp->seq);
+      derep_snapshot_write(fp, & sr, sizeof(sr));
+      derep_snapshot_write(fp, bp->header, sr.headerlen);
+      derep_snapshot_write(fp, bp->seq, sr.seqlen);
+      if (opt_fastqout)
+        {
+          derep_snapshot_write(fp, bp->qual, sr.seqlen);
+        }
+    }
+
+  fclose(fp);
+}
+
+void derep_process_batch(struct derep_record_s * batch, uint64_t count)
+{
+  /* hash and insert a batch with all threads */
+
+  if (derep_extra_info and (count > 0))
+    {
+      derep_extra_info_grow(batch[count - 1].seqno + 1);
+    }
+
+  derep_batch = batch;
+  derep_batch_count = count;
+  derep_threads_start(derep_hash_worker);
+  derep_threads_join();
+  derep_threads_start(derep_insert_worker);
+  derep_threads_join();
+}
+
+auto derep_load_previous(struct derep_record_s * batch,
+                         int64_t * sumsize) -> uint64_t
+{
+  /*
+    Insert the clusters of a previous dereplication, from a FASTA or
+    FASTQ file with abundance annotations or from a snapshot file,
+    before the new sequences. Returns the number of clusters loaded.
+  */
+
+  FILE * fp = fopen_input(opt_previous);
+  if (not fp)
+    {
+      fatal("Unable to open previous dereplication file for reading");
+    }
+
+  struct derep_snapshot_header_s sh;
+  bool snapshot =
+    (fread(& sh, sizeof(sh), 1, fp) == 1) and
+    (memcmp(sh.magic, derep_snapshot_magic, sizeof(sh.magic)) == 0);
+
+  fastx_handle h = nullptr;
+  uint64_t filesize = 0;
+
+  if (snapshot)
+    {
+      if (((sh.flags & derep_snapshot_use_header) != 0) != derep_use_header)
+        {
+          fatal("The previous snapshot file was made with another dereplication command");
+        }
+      if (opt_fastqout and not (sh.flags & derep_snapshot_fastq))
+        {
+          fatal("Cannot write FASTQ output when previous snapshot file has no quality scores");
+        }
+      filesize = sh.clusters;
+    }
+  else
+    {
+      fclose(fp);
+      fp = nullptr;
+      h = fastx_open(opt_previous);
+      if (not h)
+        {
+          fatal("Unrecognized previous file type (not proper FASTA or FASTQ format)");
+        }
+      if (opt_fastqout and not fastx_is_empty(h) and not fastx_is_fastq(h))
+        {
+          fatal("Cannot write FASTQ output when previous file is not in FASTQ format");
+        }
+      filesize = fastx_get_size(h);
+    }
+
+  progress_init("Reading previous dereplication", filesize);
+
+  uint64_t loaded = 0;
+  bool more = true;
+
+  while (more)
+    {
+      uint64_t count = 0;
+
+      while (count < derep_batch_size)
+        {
+          struct derep_record_s * r = batch + count;
+
+          if (snapshot)
+            {
+              if (loaded + count == sh.clusters)
+                {
+                  more = false;
+                  break;
+                }
+
+              struct derep_snapshot_record_s sr;
+              derep_snapshot_read(fp, & sr, sizeof(sr));
+              derep_record_alloc(r, sr.headerlen, sr.seqlen);
+              derep_snapshot_read(fp, r->header, sr.headerlen);
+              derep_snapshot_read(fp, r->seq, sr.seqlen);
+              r->header[sr.headerlen] = 0;
+              r->seq[sr.seqlen] = 0;
+              r->qual[0] = 0;
+              if (sh.flags & derep_snapshot_fastq)
+                {
+                  derep_snapshot_read(fp, r->qual, sr.seqlen);
+                  r->qual[sr.seqlen] = 0;
+                }
+              r->abundance = sr.size;
+              r->count = sr.count;
+            }
+          else
+            {
+              if (not fastx_next(h, not opt_notrunclabels, chrmap_no_change))
+                {
+                  more = false;
+                  break;
+                }
+
+              derep_record_copy(r, h);
+              r->abundance = fastx_get_abundance(h);
+            }
+
+          r->seqno = loaded + count;
+          * sumsize += r->abundance;
+          ++count;
+        }
+
+      derep_process_batch(batch, count);
+      loaded += count;
+      progress_update(snapshot ? loaded : fastx_get_position(h));
+    }
+
+  progress_done();
+
+  if (snapshot)
+    {
+      fclose(fp);
+    }
+  else
+    {
+      fastx_close(h);
+    }
+
+  if (not opt_quiet)
+    {
+      fprintf(stderr,
+              "%" PRIu64 " unique sequences loaded from previous dereplication\n",
+              loaded);
+    }
+
+  if (opt_log)
+    {
+      fprintf(fp_log,
+              "%" PRIu64 " unique sequences loaded from previous dereplication\n\n",
+              loaded);
+    }
+
+  return loaded;
+}
+
 void derep(char * input_filename, bool use_header)
 {
   /* dereplicate full length sequences, optionally require identical headers */
@@ -307,16 +1008,17 @@ void derep(char * input_filename, bool use_header)
   FILE * fp_fastqout = nullptr;
   FILE * fp_uc = nullptr;
   FILE * fp_tabbedout = nullptr;
+  FILE * fp_snapshotout = nullptr;
 
   if (opt_fastx_uniques)
     {
-      if ((not opt_uc) and (not opt_fastaout) and (not opt_fastqout) and (not opt_tabbedout))
-        fatal("Output file for dereplication with fastx_uniques must be specified with --fastaout, --fastqout, --tabbedout, or --uc");
+      if ((not opt_uc) and (not opt_fastaout) and (not opt_fastqout) and (not opt_tabbedout) and (not opt_snapshotout))
+        fatal("Output file for dereplication with fastx_uniques must be specified with --fastaout, --fastqout, --tabbedout, --snapshotout, or --uc");
     }
   else
     {
-      if ((not opt_output) and (not opt_uc))
-        fatal("Output file for dereplication must be specified with --output or --uc");
+      if ((not opt_output) and (not opt_uc) and (not opt_snapshotout))
+        fatal("Output file for dereplication must be specified with --output, --snapshotout, or --uc");
     }
 
   if (opt_fastx_uniques)
@@ -369,30 +1071,54 @@ void derep(char * input_filename, bool use_header)
         }
     }
 
+  if (opt_snapshotout)
+    {
+      fp_snapshotout = fopen_output(opt_snapshotout);
+      if (not fp_snapshotout)
+        {
+          fatal("Unable to open dereplication snapshot file for writing");
+        }
+    }
+
   uint64_t filesize = fastx_get_size(h);
 
 
-  /* allocate initial memory for 1024 clusters
-     with sequences of length 1023 */
+  derep_alloc_seqs = 1024;
 
-  uint64_t alloc_clusters = 1024;
-  uint64_t alloc_seqs = 1024;
-  int64_t alloc_seqlen = 1023;
+  derep_use_header = use_header;
+  derep_shard_count = opt_threads;
+  derep_pthread =
+    (pthread_t *) xmalloc(derep_shard_count * sizeof(pthread_t));
 
-  uint64_t hashtablesize = 2 * alloc_clusters;
-  uint64_t hash_mask = hashtablesize - 1;
-  auto * hashtable =
-    (struct bucket *) xmalloc(sizeof(struct bucket) * hashtablesize);
-  memset(hashtable, 0, sizeof(struct bucket) * hashtablesize);
+  /* allocate initial memory for 1024 clusters in each shard */
 
-  show_rusage();
+  derep_shards = (struct derep_shard_s *)
+    xmalloc(derep_shard_count * sizeof(struct derep_shard_s));
+  for (int t = 0; t < derep_shard_count; t++)
+    {
+      struct derep_shard_s * shard = derep_shards + t;
+      shard->alloc_clusters = 1024;
+      shard->clusters = 0;
+      shard->hashtable = (struct bucket *)
+        xmalloc(sizeof(struct bucket) * 2 * shard->alloc_clusters);
+      memset(shard->hashtable, 0,
+             sizeof(struct bucket) * 2 * shard->alloc_clusters);
+    }
 
-  unsigned int * nextseqtab = nullptr;
-  const auto terminal = (unsigned int) (-1);
-  char ** headertab = nullptr;
-  char * match_strand = nullptr;
+  /* two batches: one is read while the other is inserted */
+
+  struct derep_record_s * batches[2];
+  for (auto & batch : batches)
+    {
+      batch = (struct derep_record_s *)
+        xmalloc(derep_batch_size * sizeof(struct derep_record_s));
+      memset(batch, 0, derep_batch_size * sizeof(struct derep_record_s));
+    }
+
+  show_rusage();
 
   bool extra_info = opt_uc or opt_tabbedout;
+  derep_extra_info = extra_info;
 
   if (extra_info)
     {
@@ -402,31 +1128,20 @@ void derep(char * input_filename, bool use_header)
 
       /* Links to other sequences in cluster */
       nextseqtab =
-        (unsigned int*) xmalloc(sizeof(unsigned int) * alloc_seqs);
-      memset(nextseqtab, terminal, sizeof(unsigned int) * alloc_seqs);
+        (unsigned int*) xmalloc(sizeof(unsigned int) * derep_alloc_seqs);
+      memset(nextseqtab, terminal, sizeof(unsigned int) * derep_alloc_seqs);
 
       /* Pointers to the header strings */
-      headertab = (char **) xmalloc(sizeof(char*) * alloc_seqs);
-      memset(headertab, 0, sizeof(char*) * alloc_seqs);
+      headertab = (char **) xmalloc(sizeof(char*) * derep_alloc_seqs);
+      memset(headertab, 0, sizeof(char*) * derep_alloc_seqs);
 
       /* Matching strand */
-      match_strand = (char *) xmalloc(alloc_seqs);
-      memset(match_strand, 0, alloc_seqs);
+      match_strand = (char *) xmalloc(derep_alloc_seqs);
+      memset(match_strand, 0, derep_alloc_seqs);
     }
 
   show_rusage();
 
-  char * seq_up = (char *) xmalloc(alloc_seqlen + 1);
-  char * rc_seq_up = (char *) xmalloc(alloc_seqlen + 1);
-
-  char * prompt = nullptr;
-  if (xsprintf(& prompt, "Dereplicating file %s", input_filename) == -1)
-    {
-      fatal("Out of memory");
-    }
-
-  progress_init(prompt, filesize);
-
   uint64_t sequencecount = 0;
   uint64_t nucleotidecount = 0;
   int64_t shortest = INT64_MAX;
@@ -439,262 +1154,121 @@ void derep(char * input_filename, bool use_header)
   double median = 0.0;
   double average = 0.0;
 
-  while(fastx_next(h, not opt_notrunclabels, chrmap_no_change))
+  /* sequences of the new input are numbered after the previous ones */
+  uint64_t previous_count = 0;
+  if (opt_previous)
     {
-      int64_t seqlen = fastx_get_sequence_length(h);
-
-      if (seqlen < opt_minseqlength)
-        {
-          ++discarded_short;
-          continue;
-        }
-
-      if (seqlen > opt_maxseqlength)
-        {
-          ++discarded_long;
-          continue;
-        }
-
-      nucleotidecount += seqlen;
-      if (seqlen > longest)
-        {
-          longest = seqlen;
-        }
-      if (seqlen < shortest)
-        {
-          shortest = seqlen;
-        }
-
-      /* check allocations */
-
-      if (seqlen > alloc_seqlen)
-        {
-          alloc_seqlen = seqlen;
-          seq_up = (char *) xrealloc(seq_up, alloc_seqlen + 1);
-          rc_seq_up = (char *) xrealloc(rc_seq_up, alloc_seqlen + 1);
-
-          show_rusage();
-        }
-
-      if (extra_info and (sequencecount + 1 > alloc_seqs))
-        {
-          uint64_t new_alloc_seqs = 2 * alloc_seqs;
-
-          nextseqtab =
-            (unsigned int *) xrealloc(nextseqtab,
-                                      sizeof(unsigned int) * new_alloc_seqs);
-          memset(nextseqtab + alloc_seqs,
-                 terminal,
-                 sizeof(unsigned int) * alloc_seqs);
-
-          headertab = (char **) xrealloc(headertab,
-                                         sizeof(char*) * new_alloc_seqs);
-          memset(headertab + alloc_seqs, 0, sizeof(char *) * alloc_seqs);
-
-          match_strand = (char *) xrealloc(match_strand, new_alloc_seqs);
-          memset(match_strand + alloc_seqs, 0, alloc_seqs);
-
-          alloc_seqs = new_alloc_seqs;
-
-          show_rusage();
-        }
-
-      if (clusters + 1 > alloc_clusters)
-        {
-          uint64_t new_alloc_clusters = 2 * alloc_clusters;
-
-          rehash(& hashtable, alloc_clusters);
-
-          alloc_clusters = new_alloc_clusters;
-          hashtablesize = 2 * alloc_clusters;
-          hash_mask = hashtablesize - 1;
-
-          show_rusage();
-        }
+      previous_count = derep_load_previous(batches[0], & sumsize);
+    }
 
-      char * seq = fastx_get_sequence(h);
-      char * header = fastx_get_header(h);
-      int64_t headerlen = fastx_get_header_length(h);
-      char * qual = fastx_get_quality(h); // nullptr if FASTA
+  char * prompt = nullptr;
+  if (xsprintf(& prompt, "Dereplicating file %s", input_filename) == -1)
+    {
+      fatal("Out of memory");
+    }
 
-      /* normalize sequence: uppercase and replace U by T  */
-      string_normalize(seq_up, seq, seqlen);
+  progress_init(prompt, filesize);
 
-      /* reverse complement if necessary */
-      if (opt_strand > 1)
-        {
-          reverse_complement(rc_seq_up, seq_up, seqlen);
-        }
+  int current = 0;
+  uint64_t current_count = 0;
+  bool more = true;
 
-      /*
-        Find free bucket or bucket for identical sequence.
-        Make sure sequences are exactly identical
-        in case of any hash collision.
-        With 64-bit hashes, there is about 50% chance of a
-        collision when the number of sequences is about 5e9.
-      */
+  while (true)
+    {
+      /* insert the current batch while the next one is read */
 
-      uint64_t hash_header;
-      if (use_header)
+      if (current_count > 0)
         {
-          hash_header = HASH(header, headerlen);
+          derep_threads_start(derep_insert_worker);
         }
-      else
-        {
-          hash_header = 0;
-        }
-
-      uint64_t hash = HASH(seq_up, seqlen) ^ hash_header;
-      uint64_t j = hash & hash_mask;
-      struct bucket * bp = hashtable + j;
 
-      while ((bp->size)
-             and
-             ((hash != bp->hash) or
-              (seqcmp(seq_up, bp->seq, seqlen)) or
-              (use_header and strcmp(header, bp->header))))
-        {
-          j = (j + 1) & hash_mask;
-          bp = hashtable + j;
-        }
+      struct derep_record_s * next_batch = batches[1 - current];
+      uint64_t next_count = 0;
 
-      if ((opt_strand > 1) and not bp->size)
+      while (more and (next_count < derep_batch_size))
         {
-          /* no match on plus strand */
-          /* check minus strand as well */
+          more = fastx_next(h, not opt_notrunclabels, chrmap_no_change);
+          if (not more)
+            {
+              break;
+            }
 
-          uint64_t rc_hash = HASH(rc_seq_up, seqlen) ^ hash_header;
-          uint64_t k = rc_hash & hash_mask;
-          struct bucket * rc_bp = hashtable + k;
+          int64_t seqlen = fastx_get_sequence_length(h);
 
-          while ((rc_bp->size)
-                 and
-                 ((rc_hash != rc_bp->hash) or
-                  (seqcmp(rc_seq_up, rc_bp->seq, seqlen)) or
-                  (use_header and strcmp(header, bp->header))))
+          if (seqlen < opt_minseqlength)
             {
-              k = (k + 1) & hash_mask;
-              rc_bp = hashtable + k;
+              ++discarded_short;
+              continue;
             }
 
-          if (rc_bp->size)
+          if (seqlen > opt_maxseqlength)
             {
-              bp = rc_bp;
-              j = k;
-              if (extra_info)
-                {
-                  match_strand[sequencecount] = 1;
-                }
+              ++discarded_long;
+              continue;
             }
-        }
-
-      int abundance = fastx_get_abundance(h);
-      int64_t ab = opt_sizein ? abundance : 1;
-      sumsize += ab;
 
-      if (bp->size)
-        {
-          /* at least one identical sequence already */
-          if (extra_info)
+          nucleotidecount += seqlen;
+          if (seqlen > longest)
             {
-              unsigned int last = bp->seqno_last;
-              nextseqtab[last] = sequencecount;
-              bp->seqno_last = sequencecount;
-              headertab[sequencecount] = xstrdup(header);
+              longest = seqlen;
             }
-
-          int64_t s1 = bp->size;
-          int64_t s2 = ab;
-          int64_t s3 = s1 + s2;
-
-          if (opt_fastqout)
+          if (seqlen < shortest)
             {
-              /* update quality scores */
-              for (int i = 0; i < seqlen; i++)
-                {
-                  int q1 = bp->qual[i];
-                  int q2 = qual[i];
-                  double p1 = convert_q_to_p(q1);
-                  double p2 = convert_q_to_p(q2);
-                  double p3;
-
-                  /* how to compute the new quality score? */
-
-                  if (opt_fastq_qout_max)
-                    {
-                      // fastq_qout_max
-                      /* min error prob, highest quality */
-                      p3 = MIN(p1, p2);
-                    }
-                  else
-                    {
-                      // fastq_qout_avg
-                      /* average, as in USEARCH */
-                      p3 = (p1 * s1 + p2 * s2) / s3;
-                    }
-
-                  // fastq_qout_min
-                  /* max error prob, lowest quality */
-                  // p3 = MAX(p1, p2);
-
-                  // fastq_qout_first
-                  /* keep first */
-                  // p3 = p1;
-
-                  // fastq_qout_last
-                  /* keep last */
-                  // p3 = p2;
-
-                  // fastq_qout_ef
-                  /* Compute as multiple independent observations
-                     Edgar & Flyvbjerg (2015)
-                     But what about s1 and s2? */
-                  // p3 = p1 * p2 / 3.0 / (1.0 - p1 - p2 + (4.0 * p1 * p2 / 3.0));
+              shortest = seqlen;
+            }
 
-                  /* always worst quality possible, certain error */
-                  // p3 = 1.0;
+          struct derep_record_s * r = next_batch + next_count;
+          derep_record_copy(r, h);
+          int abundance = fastx_get_abundance(h);
+          r->abundance = opt_sizein ? abundance : 1;
+          r->seqno = previous_count + sequencecount;
+          sumsize += r->abundance;
 
-                  // always best quality possible, perfect, no errors */
-                  // p3 = 0.0;
+          ++next_count;
+          ++sequencecount;
+        }
 
-                  int q3 = convert_p_to_q(p3);
-                  bp->qual[i] = q3;
-                }
-            }
+      progress_update(fastx_get_position(h));
 
-          bp->size = s3;
-          bp->count++;
+      if (current_count > 0)
+        {
+          derep_threads_join();
         }
-      else
+
+      if (next_count == 0)
         {
-          /* no identical sequences yet */
-          bp->size = ab;
-          bp->hash = hash;
-          bp->seqno_first = sequencecount;
-          bp->seqno_last = sequencecount;
-          bp->seq = xstrdup(seq);
-          bp->header = xstrdup(header);
-          bp->count = 1;
-          if (qual)
-            bp->qual = xstrdup(qual);
-          else
-            bp->qual = nullptr;
-          ++clusters;
+          break;
         }
 
-      if (bp->size > maxsize)
+      /* check allocations, no threads are running now */
+
+      if (extra_info)
         {
-          maxsize = bp->size;
+          derep_extra_info_grow(previous_count + sequencecount);
         }
 
-      ++sequencecount;
+      /* hash the new batch with all threads */
 
-      progress_update(fastx_get_position(h));
+      current = 1 - current;
+      current_count = next_count;
+      derep_batch = batches[current];
+      derep_batch_count = current_count;
+      derep_threads_start(derep_hash_worker);
+      derep_threads_join();
     }
   progress_done();
   xfree(prompt);
   fastx_close(h);
 
+  for (auto & batch : batches)
+    {
+      for (uint64_t i = 0; i < derep_batch_size; i++)
+        {
+          derep_record_free(batch + i);
+        }
+      xfree(batch);
+    }
+
   show_rusage();
 
   if (not opt_quiet)
@@ -777,15 +1351,37 @@ void derep(char * input_filename, bool use_header)
         }
     }
 
-  xfree(seq_up);
-  xfree(rc_seq_up);
-
-  show_rusage();
-
   progress_init("Sorting", 1);
-  qsort(hashtable, hashtablesize, sizeof(struct bucket), derep_compare_full);
+  derep_threads_start(derep_sort_worker);
+  derep_threads_join();
+  for (int t = 0; t < derep_shard_count; t++)
+    {
+      clusters += derep_shards[t].clusters;
+    }
+  struct bucket * hashtable = derep_merge_shards(clusters);
+  for (int t = 0; t < derep_shard_count; t++)
+    {
+      xfree(derep_shards[t].hashtable);
+    }
+  xfree(derep_shards);
+  derep_shards = nullptr;
+  xfree(derep_pthread);
+  derep_pthread = nullptr;
   progress_done();
 
+  for (uint64_t i = 0; i < clusters; i++)
+    {
+      if (hashtable[i].size > maxsize)
+        {
+          maxsize = hashtable[i].size;
+        }
+    }
+
+  if (opt_snapshotout)
+    {
+      derep_snapshot_save(fp_snapshotout, hashtable, clusters);
+    }
+
   show_rusage();
 
   if (clusters > 0)
@@ -1046,7 +1642,7 @@ void derep(char * input_filename, bool use_header)
 
   if (opt_uc)
     {
-      for (uint64_t i = 0; i < alloc_seqs; i++)
+      for (uint64_t i = 0; i < derep_alloc_seqs; i++)
         {
           if (headertab[i])
             {
@@ -59,6 +59,11 @@
 */
 
 #include "vsearch.h"
+#include <cerrno>  // errno, EMFILE, ENFILE
+#include <functional>
+#include <queue>
+#include <utility>
+#include <vector>
 
 #define HASH hash_cityhash128
 
@@ -210,6 +215,985 @@ void rehash_smallmem()
   hashtablesize = new_hashtablesize;
 }
 
+void smallmem_report_input(uint64_t sequencecount,
+                           uint64_t nucleotidecount,
+                           int64_t shortest,
+                           int64_t longest,
+                           uint64_t discarded_short,
+                           uint64_t discarded_long)
+{
+  if (not opt_quiet)
+    {
+      if (sequencecount > 0)
+        {
+          fprintf(stderr,
+                  "%" PRIu64 " nt in %" PRIu64 " seqs, min %" PRIu64
+                  ", max %" PRIu64 ", avg %.0f\n",
+                  nucleotidecount,
+                  sequencecount,
+                  shortest,
+                  longest,
+                  nucleotidecount * 1.0 / sequencecount);
+        }
+      else
+        {
+          fprintf(stderr,
+                  "%" PRIu64 " nt in %" PRIu64 " seqs\n",
+                  nucleotidecount,
+                  sequencecount);
+        }
+    }
+
+  if (opt_log)
+    {
+      if (sequencecount > 0)
+        {
+          fprintf(fp_log,
+                  "%" PRIu64 " nt in %" PRIu64 " seqs, min %" PRIu64
+                  ", max %" PRIu64 ", avg %.0f\n",
+                  nucleotidecount,
+                  sequencecount,
+                  shortest,
+                  longest,
+                  nucleotidecount * 1.0 / sequencecount);
+        }
+      else
+        {
+          fprintf(fp_log,
+                  "%" PRIu64 " nt in %" PRIu64 " seqs\n",
+                  nucleotidecount,
+                  sequencecount);
+        }
+    }
+
+  if (discarded_short)
+    {
+      fprintf(stderr,
+              "minseqlength %" PRId64 ": %" PRId64 " %s discarded.\n",
+              opt_minseqlength,
+              discarded_short,
+              (discarded_short == 1 ? "sequence" : "sequences"));
+
+      if (opt_log)
+        {
+          fprintf(fp_log,
+                  "minseqlength %" PRId64 ": %" PRId64 " %s discarded.\n\n",
+                  opt_minseqlength,
+                  discarded_short,
+                  (discarded_short == 1 ? "sequence" : "sequences"));
+        }
+    }
+
+  if (discarded_long)
+    {
+      fprintf(stderr,
+              "maxseqlength %" PRId64 ": %" PRId64 " %s discarded.\n",
+              opt_maxseqlength,
+              discarded_long,
+              (discarded_long == 1 ? "sequence" : "sequences"));
+
+      if (opt_log)
+        {
+          fprintf(fp_log,
+                  "maxseqlength %" PRId64 ": %" PRId64 " %s discarded.\n\n",
+                  opt_maxseqlength,
+                  discarded_long,
+                  (discarded_long == 1 ? "sequence" : "sequences"));
+        }
+    }
+}
+
+void smallmem_report_clusters(uint64_t clusters,
+                              int64_t sumsize,
+                              double median,
+                              uint64_t maxsize)
+{
+  if (clusters < 1)
+    {
+      if (not opt_quiet)
+        {
+          fprintf(stderr,
+                  "0 unique sequences\n");
+        }
+      if (opt_log)
+        {
+          fprintf(fp_log,
+                  "0 unique sequences\n\n");
+        }
+    }
+  else
+    {
+      const double average = 1.0 * sumsize / clusters;
+      if (not opt_quiet)
+        {
+          fprintf(stderr,
+                  "%" PRId64
+                  " unique sequences, avg cluster %.1lf, median %.0f, max %"
+                  PRIu64 "\n",
+                  clusters, average, median, maxsize);
+        }
+      if (opt_log)
+        {
+          fprintf(fp_log,
+                  "%" PRId64
+                  " unique sequences, avg cluster %.1lf, median %.0f, max %"
+                  PRIu64 "\n\n",
+                  clusters, average, median, maxsize);
+        }
+    }
+}
+
+void smallmem_report_selected(uint64_t selected, uint64_t clusters)
+{
+  if (selected < clusters)
+    {
+      if (not opt_quiet)
+        {
+          fprintf(stderr,
+                  "%" PRId64 " uniques written, %"
+                  PRId64 " clusters discarded (%.1f%%)\n",
+                  selected, clusters - selected,
+                  100.0 * (clusters - selected) / clusters);
+        }
+
+      if (opt_log)
+        {
+          fprintf(fp_log,
+                  "%" PRId64 " uniques written, %"
+                  PRId64 " clusters discarded (%.1f%%)\n\n",
+                  selected, clusters - selected,
+                  100.0 * (clusters - selected) / clusters);
+        }
+    }
+}
+
+/*
+  Out-of-core dereplication, used when the input is a pipe or when
+  --memory_limit is specified.
+
+  The input is read once. Sequences are counted in a hash table of
+  limited size. The first time a sequence is seen after the table has
+  been emptied, its header and sequence are written to a temporary
+  partition file, selected by some bits of the hash. When the table is
+  full, the counts are written to the partition files as well and the
+  table is emptied.
+
+  The partitions are then merged independently by several threads. The
+  counts of a partition are summed in a hash table, and the first
+  occurrence of each sequence is written, with its total abundance, to
+  a run file in input order. A partition with too many unique
+  sequences for the memory limit is split further, using the next bits
+  of the hash, and the runs of its parts are merged back into a single
+  run. Finally, the run files are merged in input order and written to
+  the output file.
+*/
+
+static const int ext_bits = 6;
+static const int ext_fanout = 1 << ext_bits;
+static const int ext_maxlevel = 64 / ext_bits;
+static const int ext_group = 8;  /* sub-partitions split off per pass */
+static const int64_t ext_default_limit = 1024; /* MB, for pipe input */
+
+struct ext_record_s
+{
+  uint128 hash;
+  uint64_t ordinal;    /* input order of the (first) occurrence */
+  uint64_t size;       /* abundance, or zero for a sequence record */
+  uint64_t headerlen;
+  uint64_t seqlen;
+};
+
+struct ext_table_s
+{
+  struct ext_record_s * buckets;
+  uint64_t size;
+  uint64_t count;
+  uint64_t limit;      /* maximum number of buckets */
+};
+
+struct ext_reader_s
+{
+  FILE * fp;
+  bool run;            /* run file with only sequence records */
+  struct ext_record_s record;
+  char * header;
+  char * seq;
+  uint64_t header_alloc;
+  uint64_t seq_alloc;
+};
+
+static pthread_mutex_t ext_mutex;
+static FILE ** ext_partitions = nullptr;
+static int ext_next_partition = 0;
+static std::vector<FILE *> ext_runs;
+static std::map<uint64_t, uint64_t> ext_size_histogram;
+static uint64_t ext_clusters = 0;
+static uint64_t ext_selected = 0;
+static uint64_t ext_maxsize = 0;
+static uint64_t ext_thread_limit = 0;
+
+auto ext_tmpfile() -> FILE *
+{
+#ifdef _WIN32
+  FILE * fp = tmpfile();
+#else
+  const char * dir = opt_tmpdir;
+  if (not dir)
+    {
+      dir = getenv("TMPDIR");
+    }
+  if (not dir)
+    {
+      dir = "/tmp";
+    }
+
+  char * name = nullptr;
+  if (xsprintf(& name, "%s/vsearch_XXXXXX", dir) == -1)
+    {
+      fatal("Out of memory");
+    }
+
+  int fd = mkstemp(name);
+  if ((fd < 0) and ((errno == EMFILE) or (errno == ENFILE)))
+    {
+      fatal("Too many open files, unable to create temporary file "
+            "(raise the limit with ulimit -n)");
+    }
+  if (fd < 0)
+    {
+      fatal("Unable to create temporary file in directory %s", dir);
+    }
+
+  /* the file is removed when closed */
+  unlink(name);
+  xfree(name);
+
+  FILE * fp = fdopen(fd, "w+b");
+#endif
+
+  if (not fp)
+    {
+      fatal("Unable to open temporary file");
+    }
+  return fp;
+}
+
+void ext_write(FILE * fp, const void * data, uint64_t length)
+{
+  if (length and (fwrite(data, 1, length, fp) != length))
+    {
+      fatal("Unable to write to temporary file");
+    }
+}
+
+void ext_read(FILE * fp, void * data, uint64_t length)
+{
+  if (length and (fread(data, 1, length, fp) != length))
+    {
+      fatal("Unable to read from temporary file");
+    }
+}
+
+auto ext_read_record(FILE * fp, struct ext_record_s * r) -> bool
+{
+  return fread(r, sizeof(struct ext_record_s), 1, fp) == 1;
+}
+
+void ext_write_sequence(FILE * fp,
+                        struct ext_record_s * r,
+                        const char * header,
+                        const char * seq)
+{
+  ext_write(fp, r, sizeof(struct ext_record_s));
+  ext_write(fp, header, r->headerlen);
+  ext_write(fp, seq, r->seqlen);
+}
+
+void ext_rewind(FILE * fp)
+{
+  if (fflush(fp) or fseek(fp, 0, SEEK_SET))
+    {
+      fatal("Unable to rewind temporary file");
+    }
+}
+
+inline auto ext_partition(uint128 hash, int level) -> int
+{
+  return (Uint128High64(hash) >> (64 - ext_bits * (level + 1)))
+    & (ext_fanout - 1);
+}
+
+void ext_zero(struct ext_record_s * buckets, uint64_t size)
+{
+  for(uint64_t j = 0; j < size; j++)
+    {
+      buckets[j].hash.first = 0;
+      buckets[j].hash.second = 0;
+      buckets[j].ordinal = 0;
+      buckets[j].size = 0;
+      buckets[j].headerlen = 0;
+      buckets[j].seqlen = 0;
+    }
+}
+
+void ext_table_init(struct ext_table_s * t, uint64_t limit_bytes)
+{
+  t->limit = MAX(limit_bytes / sizeof(struct ext_record_s), 1024);
+  t->size = 1024;
+  t->count = 0;
+  t->buckets = (struct ext_record_s *)
+    xmalloc(t->size * sizeof(struct ext_record_s));
+  ext_zero(t->buckets, t->size);
+}
+
+void ext_table_exit(struct ext_table_s * t)
+{
+  xfree(t->buckets);
+  t->buckets = nullptr;
+}
+
+void ext_table_clear(struct ext_table_s * t)
+{
+  ext_zero(t->buckets, t->size);
+  t->count = 0;
+}
+
+auto ext_table_find(struct ext_table_s * t, uint128 hash)
+  -> struct ext_record_s *
+{
+  uint64_t j = hash2bucket(hash, t->size);
+  struct ext_record_s * bp = t->buckets + j;
+  while (bp->size and (hash != bp->hash))
+    {
+      j = next_bucket(j, t->size);
+      bp = t->buckets + j;
+    }
+  return bp;
+}
+
+auto ext_table_full(struct ext_table_s * t, bool force) -> bool
+{
+  /* keep fill rate at max 75%, double the size if allowed */
+
+  if (4 * (t->count + 1) <= 3 * t->size)
+    {
+      return false;
+    }
+
+  if ((not force) and (2 * t->size > t->limit))
+    {
+      return true;
+    }
+
+  struct ext_record_s * old_buckets = t->buckets;
+  uint64_t old_size = t->size;
+
+  t->size *= 2;
+  t->buckets = (struct ext_record_s *)
+    xmalloc(t->size * sizeof(struct ext_record_s));
+  ext_zero(t->buckets, t->size);
+
+  for (uint64_t i = 0; i < old_size; i++)
+    {
+      if (old_buckets[i].size)
+        {
+          * ext_table_find(t, old_buckets[i].hash) = old_buckets[i];
+        }
+    }
+
+  xfree(old_buckets);
+  return false;
+}
+
+void ext_spill(struct ext_table_s * t)
+{
+  /* write the counts in the table to the partitions */
+
+  for (uint64_t i = 0; i < t->size; i++)
+    {
+      struct ext_record_s * bp = t->buckets + i;
+      if (bp->size)
+        {
+          FILE * fp = ext_partitions[ext_partition(bp->hash, 0)];
+          ext_write(fp, bp, sizeof(struct ext_record_s));
+        }
+    }
+  ext_table_clear(t);
+}
+
+void ext_reader_init(struct ext_reader_s * r, FILE * fp, bool run)
+{
+  r->fp = fp;
+  r->run = run;
+  r->header = nullptr;
+  r->seq = nullptr;
+  r->header_alloc = 0;
+  r->seq_alloc = 0;
+}
+
+void ext_reader_next(struct ext_reader_s * r)
+{
+  /* read the next sequence record, or close the file at the end */
+
+  while (ext_read_record(r->fp, & r->record))
+    {
+      uint64_t headerlen = r->record.headerlen;
+      uint64_t seqlen = r->record.seqlen;
+
+      if (r->run or (r->record.size == 0))
+        {
+          if (headerlen + 1 > r->header_alloc)
+            {
+              r->header_alloc = headerlen + 1;
+              r->header = (char *) xrealloc(r->header, r->header_alloc);
+            }
+          if (seqlen + 1 > r->seq_alloc)
+            {
+              r->seq_alloc = seqlen + 1;
+              r->seq = (char *) xrealloc(r->seq, r->seq_alloc);
+            }
+          ext_read(r->fp, r->header, headerlen);
+          ext_read(r->fp, r->seq, seqlen);
+          r->header[headerlen] = 0;
+          r->seq[seqlen] = 0;
+          return;
+        }
+    }
+
+  fclose(r->fp);
+  r->fp = nullptr;
+}
+
+auto ext_merge_runs(std::vector<FILE *> & runs) -> FILE *
+{
+  /* merge run files in input order into a single run, closing them */
+
+  if (runs.size() == 1)
+    {
+      return runs[0];
+    }
+
+  FILE * out = ext_tmpfile();
+  const uint64_t run_count = runs.size();
+  auto * readers = (struct ext_reader_s *)
+    xmalloc(run_count * sizeof(struct ext_reader_s));
+
+  std::priority_queue<std::pair<uint64_t, uint64_t>,
+                      std::vector<std::pair<uint64_t, uint64_t>>,
+                      std::greater<std::pair<uint64_t, uint64_t>>> heap;
+
+  for (uint64_t i = 0; i < run_count; i++)
+    {
+      ext_reader_init(readers + i, runs[i], true);
+      ext_reader_next(readers + i);
+      if (readers[i].fp)
+        {
+          heap.emplace(readers[i].record.ordinal, i);
+        }
+    }
+
+  while (not heap.empty())
+    {
+      struct ext_reader_s * r = readers + heap.top().second;
+      heap.pop();
+      ext_write_sequence(out, & r->record, r->header, r->seq);
+      ext_reader_next(r);
+      if (r->fp)
+        {
+          heap.emplace(r->record.ordinal, r - readers);
+        }
+    }
+
+  for (uint64_t i = 0; i < run_count; i++)
+    {
+      if (readers[i].header)
+        {
+          xfree(readers[i].header);
+        }
+      if (readers[i].seq)
+        {
+          xfree(readers[i].seq);
+        }
+    }
+  xfree(readers);
+  runs.clear();
+
+  ext_rewind(out);
+  return out;
+}
+
+auto ext_merge_partition(FILE * fp, int level, struct ext_table_s * t) -> FILE *
+{
+  /* sum up the counts of all sequences in the partition */
+
+  ext_rewind(fp);
+  ext_table_clear(t);
+
+  const bool force = level + 1 >= ext_maxlevel;
+  bool overflow = false;
+  struct ext_record_s r;
+
+  while (ext_read_record(fp, & r))
+    {
+      if (r.size == 0)
+        {
+          if (fseek(fp, r.headerlen + r.seqlen, SEEK_CUR))
+            {
+              fatal("Unable to read from temporary file");
+            }
+          continue;
+        }
+
+      struct ext_record_s * bp = ext_table_find(t, r.hash);
+      if (bp->size)
+        {
+          bp->size += r.size;
+          bp->ordinal = MIN(bp->ordinal, r.ordinal);
+          continue;
+        }
+
+      if (ext_table_full(t, force))
+        {
+          overflow = true;
+          break;
+        }
+
+      bp = ext_table_find(t, r.hash);
+      * bp = r;
+      ++t->count;
+    }
+
+  if (overflow)
+    {
+      /*
+        Too many unique sequences, split the partition further. Only a
+        group of sub-partitions is split off per pass, and the runs of
+        each group are merged into one, to bound the number of files
+        open at the same time.
+      */
+
+      std::vector<FILE *> group_runs;
+      struct ext_reader_s reader;
+      ext_reader_init(& reader, fp, false);
+
+      for (int first = 0; first < ext_fanout; first += ext_group)
+        {
+          FILE * parts[ext_group];
+          for (auto & part : parts)
+            {
+              part = ext_tmpfile();
+            }
+
+          ext_rewind(fp);
+          while (ext_read_record(fp, & r))
+            {
+              const int p = ext_partition(r.hash, level + 1) - first;
+              const bool in_group = (p >= 0) and (p < ext_group);
+              if (r.size == 0)
+                {
+                  uint64_t length = r.headerlen + r.seqlen;
+                  if (not in_group)
+                    {
+                      if (fseek(fp, length, SEEK_CUR))
+                        {
+                          fatal("Unable to read from temporary file");
+                        }
+                      continue;
+                    }
+                  if (length + 1 > reader.seq_alloc)
+                    {
+                      reader.seq_alloc = length + 1;
+                      reader.seq = (char *) xrealloc(reader.seq, reader.seq_alloc);
+                    }
+                  ext_read(fp, reader.seq, length);
+                  ext_write_sequence(parts[p], & r, reader.seq, reader.seq + r.headerlen);
+                }
+              else if (in_group)
+                {
+                  ext_write(parts[p], & r, sizeof(struct ext_record_s));
+                }
+            }
+
+          std::vector<FILE *> runs;
+          for (auto & part : parts)
+            {
+              runs.push_back(ext_merge_partition(part, level + 1, t));
+            }
+          group_runs.push_back(ext_merge_runs(runs));
+        }
+
+      if (reader.seq)
+        {
+          xfree(reader.seq);
+        }
+      fclose(fp);
+
+      return ext_merge_runs(group_runs);
+    }
+
+  /* write the first occurrence of each sequence to a run file */
+
+  ext_rewind(fp);
+  FILE * run = ext_tmpfile();
+  struct ext_reader_s reader;
+  ext_reader_init(& reader, fp, false);
+
+  uint64_t clusters = 0;
+  uint64_t selected = 0;
+  uint64_t maxsize = 0;
+  std::map<uint64_t, uint64_t> histogram;
+
+  ext_reader_next(& reader);
+  while (reader.fp)
+    {
+      struct ext_record_s * bp = ext_table_find(t, reader.record.hash);
+      if (bp->ordinal == reader.record.ordinal)
+        {
+          uint64_t size = bp->size;
+          ++clusters;
+          ++histogram[size];
+          maxsize = MAX(maxsize, size);
+
+          if ((size >= (uint64_t) opt_minuniquesize) and
+              (size <= (uint64_t) opt_maxuniquesize))
+            {
+              ++selected;
+              reader.record.size = size;
+              ext_write_sequence(run, & reader.record, reader.header, reader.seq);
+            }
+        }
+      ext_reader_next(& reader);
+    }
+
+  if (reader.header)
+    {
+      xfree(reader.header);
+    }
+  if (reader.seq)
+    {
+      xfree(reader.seq);
+    }
+
+  ext_rewind(run);
+
+  xpthread_mutex_lock(& ext_mutex);
+  ext_clusters += clusters;
+  ext_selected += selected;
+  ext_maxsize = MAX(ext_maxsize, maxsize);
+  for (auto & entry : histogram)
+    {
+      ext_size_histogram[entry.first] += entry.second;
+    }
+  progress_update(ext_next_partition);
+  xpthread_mutex_unlock(& ext_mutex);
+
+  return run;
+}
+
+void * ext_merge_worker(void * vp)
+{
+  (void) vp;
+
+  struct ext_table_s table;
+  ext_table_init(& table, ext_thread_limit);
+
+  while (true)
+    {
+      xpthread_mutex_lock(& ext_mutex);
+      int p = ext_next_partition;
+      if (p < ext_fanout)
+        {
+          ++ext_next_partition;
+        }
+      xpthread_mutex_unlock(& ext_mutex);
+
+      if (p >= ext_fanout)
+        {
+          break;
+        }
+
+      FILE * run = ext_merge_partition(ext_partitions[p], 0, & table);
+
+      xpthread_mutex_lock(& ext_mutex);
+      ext_runs.push_back(run);
+      xpthread_mutex_unlock(& ext_mutex);
+    }
+
+  ext_table_exit(& table);
+  return nullptr;
+}
+
+auto ext_median() -> double
+{
+  /* find the median cluster size from the histogram of sizes */
+
+  if (ext_clusters == 0)
+    {
+      return 0.0;
+    }
+
+  const uint64_t lower = (ext_clusters - 1) / 2;
+  const uint64_t upper = ext_clusters / 2;
+  uint64_t seen = 0;
+  double lower_size = 0.0;
+
+  for (auto & entry : ext_size_histogram)
+    {
+      if ((seen <= lower) and (lower < seen + entry.second))
+        {
+          lower_size = entry.first;
+        }
+      if ((seen <= upper) and (upper < seen + entry.second))
+        {
+          return (lower_size + entry.first) / 2.0;
+        }
+      seen += entry.second;
+    }
+
+  return lower_size;
+}
+
+void derep_smallmem_external(fastx_handle h,
+                             char * input_filename,
+                             FILE * fp_fastaout)
+{
+  const int64_t limit_mb = opt_memory_limit ?
+    opt_memory_limit : ext_default_limit;
+  const uint64_t limit = limit_mb * 1024 * 1024;
+  ext_thread_limit = limit / opt_threads;
+
+  ext_partitions = (FILE **) xmalloc(ext_fanout * sizeof(FILE *));
+  for (int p = 0; p < ext_fanout; p++)
+    {
+      ext_partitions[p] = ext_tmpfile();
+    }
+
+  struct ext_table_s table;
+  ext_table_init(& table, limit);
+
+  uint64_t filesize = fastx_get_size(h);
+  int64_t alloc_seqlen = 1024;
+  char * seq_up = (char*) xmalloc(alloc_seqlen + 1);
+  char * rc_seq_up = (char*) xmalloc(alloc_seqlen + 1);
+
+  char * prompt = nullptr;
+  if (xsprintf(& prompt, "Dereplicating file %s", input_filename) == -1)
+    {
+      fatal("Out of memory");
+    }
+
+  progress_init(prompt, filesize);
+
+  uint64_t sequencecount = 0;
+  uint64_t nucleotidecount = 0;
+  int64_t shortest = INT64_MAX;
+  int64_t longest = 0;
+  uint64_t discarded_short = 0;
+  uint64_t discarded_long = 0;
+  int64_t sumsize = 0;
+
+  /* read input, count and write to partitions */
+
+  while(fastx_next(h, not opt_notrunclabels, chrmap_no_change))
+    {
+      int64_t seqlen = fastx_get_sequence_length(h);
+
+      if (seqlen < opt_minseqlength)
+        {
+          ++discarded_short;
+          continue;
+        }
+
+      if (seqlen > opt_maxseqlength)
+        {
+          ++discarded_long;
+          continue;
+        }
+
+      nucleotidecount += seqlen;
+      if (seqlen > longest)
+        {
+          longest = seqlen;
+        }
+      if (seqlen < shortest)
+        {
+          shortest = seqlen;
+        }
+
+      if (seqlen > alloc_seqlen)
+        {
+          alloc_seqlen = seqlen;
+          seq_up = (char*) xrealloc(seq_up, alloc_seqlen + 1);
+          rc_seq_up = (char*) xrealloc(rc_seq_up, alloc_seqlen + 1);
+        }
+
+      char * seq = fastx_get_sequence(h);
+
+      /* normalize sequence: uppercase and replace U by T  */
+      string_normalize(seq_up, seq, seqlen);
+
+      /* use the same hash for both strands if necessary */
+      uint128 hash = HASH(seq_up, seqlen);
+      if (opt_strand > 1)
+        {
+          reverse_complement(rc_seq_up, seq_up, seqlen);
+          uint128 rc_hash = HASH(rc_seq_up, seqlen);
+          if (rc_hash < hash)
+            {
+              hash = rc_hash;
+            }
+        }
+
+      int abundance = fastx_get_abundance(h);
+      int64_t ab = opt_sizein ? abundance : 1;
+      sumsize += ab;
+
+      struct ext_record_s * bp = ext_table_find(& table, hash);
+
+      if (bp->size)
+        {
+          bp->size += ab;
+        }
+      else
+        {
+          if (ext_table_full(& table, false))
+            {
+              ext_spill(& table);
+            }
+          bp = ext_table_find(& table, hash);
+
+          bp->hash = hash;
+          bp->ordinal = sequencecount;
+          bp->size = ab;
+          ++table.count;
+
+          struct ext_record_s r = * bp;
+          r.size = 0;
+          r.headerlen = fastx_get_header_length(h);
+          r.seqlen = seqlen;
+          ext_write_sequence(ext_partitions[ext_partition(hash, 0)],
+                             & r,
+                             fastx_get_header(h),
+                             seq);
+        }
+
+      ++sequencecount;
+      progress_update(fastx_get_position(h));
+    }
+  progress_done();
+  xfree(prompt);
+  fastx_close(h);
+
+  ext_spill(& table);
+  ext_table_exit(& table);
+  xfree(seq_up);
+  xfree(rc_seq_up);
+
+  show_rusage();
+
+  smallmem_report_input(sequencecount, nucleotidecount, shortest, longest,
+                        discarded_short, discarded_long);
+
+  show_rusage();
+
+  /* merge the partitions in parallel */
+
+  progress_init("Merging partitions", ext_fanout);
+  xpthread_mutex_init(& ext_mutex, nullptr);
+  ext_next_partition = 0;
+  auto * pthread = (pthread_t *) xmalloc(opt_threads * sizeof(pthread_t));
+  for (int t = 0; t < opt_threads; t++)
+    {
+      xpthread_create(pthread + t, nullptr, ext_merge_worker, nullptr);
+    }
+  for (int t = 0; t < opt_threads; t++)
+    {
+      xpthread_join(pthread[t], nullptr);
+    }
+  xfree(pthread);
+  xpthread_mutex_destroy(& ext_mutex);
+  xfree(ext_partitions);
+  ext_partitions = nullptr;
+  progress_done();
+
+  show_rusage();
+
+  smallmem_report_clusters(ext_clusters, sumsize, ext_median(), ext_maxsize);
+
+  show_rusage();
+
+  /* merge the runs in input order and write the output */
+
+  progress_init("Writing FASTA output file", ext_selected);
+
+  const uint64_t run_count = ext_runs.size();
+  auto * readers = (struct ext_reader_s *)
+    xmalloc(run_count * sizeof(struct ext_reader_s));
+
+  std::priority_queue<std::pair<uint64_t, uint64_t>,
+                      std::vector<std::pair<uint64_t, uint64_t>>,
+                      std::greater<std::pair<uint64_t, uint64_t>>> heap;
+
+  for (uint64_t i = 0; i < run_count; i++)
+    {
+      ext_reader_init(readers + i, ext_runs[i], true);
+      ext_reader_next(readers + i);
+      if (readers[i].fp)
+        {
+          heap.emplace(readers[i].record.ordinal, i);
+        }
+    }
+
+  uint64_t selected = 0;
+  while (not heap.empty())
+    {
+      struct ext_reader_s * r = readers + heap.top().second;
+      heap.pop();
+
+      ++selected;
+      fasta_print_general(fp_fastaout,
+                          nullptr,
+                          r->seq,
+                          r->record.seqlen,
+                          r->header,
+                          r->record.headerlen,
+                          r->record.size,
+                          selected,
+                          -1.0,
+                          -1, -1, nullptr, 0.0);
+      progress_update(selected);
+
+      ext_reader_next(r);
+      if (r->fp)
+        {
+          heap.emplace(r->record.ordinal, r - readers);
+        }
+    }
+  progress_done();
+  fclose(fp_fastaout);
+
+  for (uint64_t i = 0; i < run_count; i++)
+    {
+      if (readers[i].header)
+        {
+          xfree(readers[i].header);
+        }
+      if (readers[i].seq)
+        {
+          xfree(readers[i].seq);
+        }
+    }
+  xfree(readers);
+  ext_runs.clear();
+  ext_size_histogram.clear();
+
+  show_rusage();
+
+  smallmem_report_selected(selected, ext_clusters);
+
+  show_rusage();
+}
+
 void derep_smallmem(char * input_filename)
 {
   /*
@@ -226,11 +1210,6 @@ void derep_smallmem(char * input_filename)
       fatal("Unrecognized input file type (not proper FASTA or FASTQ format).");
     }
 
-  if (h->is_pipe)
-    {
-      fatal("The derep_smallmem command does not support input from a pipe.");
-    }
-
   FILE * fp_fastaout = nullptr;
 
   if (opt_fastaout)
@@ -246,6 +1225,13 @@ void derep_smallmem(char * input_filename)
       fatal("Output file for dereplication must be specified with --fastaout");
     }
 
+  if (h->is_pipe or opt_memory_limit)
+    {
+      /* the input can only be read once, or memory is limited */
+      derep_smallmem_external(h, input_filename, fp_fastaout);
+      return;
+    }
+
   uint64_t filesize = fastx_get_size(h);
 
   /* allocate initial memory for sequences of length up to 1023 chars */
@@ -286,6 +1272,7 @@ void derep_smallmem(char * input_filename)
   uint64_t clusters = 0;
   int64_t sumsize = 0;
   uint64_t maxsize = 0;
+  double median = 0.0;
 
   /* first pass */
 
@@ -415,124 +1402,18 @@ void derep_smallmem(char * input_filename)
 
   show_rusage();
 
-  if (not opt_quiet)
-    {
-      if (sequencecount > 0)
-        {
-          fprintf(stderr,
-                  "%" PRIu64 " nt in %" PRIu64 " seqs, min %" PRIu64
-                  ", max %" PRIu64 ", avg %.0f\n",
-                  nucleotidecount,
-                  sequencecount,
-                  shortest,
-                  longest,
-                  nucleotidecount * 1.0 / sequencecount);
-        }
-      else
-        {
-          fprintf(stderr,
-                  "%" PRIu64 " nt in %" PRIu64 " seqs\n",
-                  nucleotidecount,
-                  sequencecount);
-        }
-    }
-
-  if (opt_log)
-    {
-      if (sequencecount > 0)
-        {
-          fprintf(fp_log,
-                  "%" PRIu64 " nt in %" PRIu64 " seqs, min %" PRIu64
-                  ", max %" PRIu64 ", avg %.0f\n",
-                  nucleotidecount,
-                  sequencecount,
-                  shortest,
-                  longest,
-                  nucleotidecount * 1.0 / sequencecount);
-        }
-      else
-        {
-          fprintf(fp_log,
-                  "%" PRIu64 " nt in %" PRIu64 " seqs\n",
-                  nucleotidecount,
-                  sequencecount);
-        }
-    }
-
-  if (discarded_short)
-    {
-      fprintf(stderr,
-              "minseqlength %" PRId64 ": %" PRId64 " %s discarded.\n",
-              opt_minseqlength,
-              discarded_short,
-              (discarded_short == 1 ? "sequence" : "sequences"));
-
-      if (opt_log)
-        {
-          fprintf(fp_log,
-                  "minseqlength %" PRId64 ": %" PRId64 " %s discarded.\n\n",
-                  opt_minseqlength,
-                  discarded_short,
-                  (discarded_short == 1 ? "sequence" : "sequences"));
-        }
-    }
-
-  if (discarded_long)
-    {
-      fprintf(stderr,
-              "maxseqlength %" PRId64 ": %" PRId64 " %s discarded.\n",
-              opt_maxseqlength,
-              discarded_long,
-              (discarded_long == 1 ? "sequence" : "sequences"));
-
-      if (opt_log)
-        {
-          fprintf(fp_log,
-                  "maxseqlength %" PRId64 ": %" PRId64 " %s discarded.\n\n",
-                  opt_maxseqlength,
-                  discarded_long,
-                  (discarded_long == 1 ? "sequence" : "sequences"));
-        }
-    }
-
+  smallmem_report_input(sequencecount, nucleotidecount, shortest, longest,
+                        discarded_short, discarded_long);
 
   show_rusage();
 
-  if (clusters < 1)
-    {
-      if (not opt_quiet)
-        {
-          fprintf(stderr,
-                  "0 unique sequences\n");
-        }
-      if (opt_log)
-        {
-          fprintf(fp_log,
-                  "0 unique sequences\n\n");
-        }
-    }
-  else
+  if (clusters > 0)
     {
-      const double average = 1.0 * sumsize / clusters;
-      const auto median = find_median();
-      if (not opt_quiet)
-        {
-          fprintf(stderr,
-                  "%" PRId64
-                  " unique sequences, avg cluster %.1lf, median %.0f, max %"
-                  PRIu64 "\n",
-                  clusters, average, median, maxsize);
-        }
-      if (opt_log)
-        {
-          fprintf(fp_log,
-                  "%" PRId64
-                  " unique sequences, avg cluster %.1lf, median %.0f, max %"
-                  PRIu64 "\n\n",
-                  clusters, average, median, maxsize);
-        }
+      median = find_median();
     }
 
+  smallmem_report_clusters(clusters, sumsize, median, maxsize);
+
   show_rusage();
 
   /* second pass with output */
@@ -633,26 +1514,7 @@ void derep_smallmem(char * input_filename)
 
   show_rusage();
 
-  if (selected < clusters)
-    {
-      if (not opt_quiet)
-        {
-          fprintf(stderr,
-                  "%" PRId64 " uniques written, %"
-                  PRId64 " clusters discarded (%.1f%%)\n",
-                  selected, clusters - selected,
-                  100.0 * (clusters - selected) / clusters);
-        }
-
-      if (opt_log)
-        {
-          fprintf(fp_log,
-                  "%" PRId64 " uniques written, %"
-                  PRId64 " clusters discarded (%.1f%%)\n\n",
-                  selected, clusters - selected,
-                  100.0 * (clusters - selected) / clusters);
-        }
-    }
+  smallmem_report_selected(selected, clusters);
 
   show_rusage();
 
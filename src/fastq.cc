@@ -261,10 +261,16 @@ bool fastq_next(fastx_handle h,
           h->lineno++;
         }
 
+      /* A, C, G and T are legal and unchanged by all the mappings,
+         so a leading run of them can be copied as it is */
+      char * source = h->file_buffer.data + h->file_buffer.position;
+      uint64_t plain = span_nucleotides(source, len);
+      buffer_extend(& h->sequence_buffer, source, plain);
+
       buffer_filter_extend(h,
                            & h->sequence_buffer,
-                           h->file_buffer.data + h->file_buffer.position,
-                           len,
+                           source + plain,
+                           len - plain,
                            char_fq_action_seq, char_mapping,
                            & ok, & illegal_char);
       h->file_buffer.position += len;
@@ -388,10 +394,15 @@ bool fastq_next(fastx_handle h,
           h->lineno++;
         }
 
+      /* copy the leading run of legal quality characters as it is */
+      char * source = h->file_buffer.data + h->file_buffer.position;
+      uint64_t plain = span_quality_chars(source, len);
+      buffer_extend(& h->quality_buffer, source, plain);
+
       buffer_filter_extend(h,
                            & h->quality_buffer,
-                           h->file_buffer.data + h->file_buffer.position,
-                           len,
+                           source + plain,
+                           len - plain,
                            char_fq_action_qual, chrmap_identity,
                            & ok, & illegal_char);
       h->file_buffer.position += len;
@@ -65,6 +65,10 @@
 
 #define FASTX_BUFFER_ALLOC 8192
 
+/* the reader thread decompresses ahead into a ring of these blocks */
+#define FASTX_READER_BLOCKS 4
+#define FASTX_READER_BLOCK_SIZE (1024 * 1024)
+
 #ifdef HAVE_BZLIB_H
 #define BZ_VERBOSE_0 0
 #define BZ_VERBOSE_1 1
@@ -235,6 +239,7 @@ fastx_handle fastx_open(const char * filename)
   auto * h = (fastx_handle) xmalloc(sizeof(struct fastx_s));
 
   h->fp = nullptr;
+  h->blocks = nullptr;
 
 #ifdef HAVE_ZLIB_H
   h->fp_gz = nullptr;
@@ -259,7 +264,13 @@ fastx_handle fastx_open(const char * filename)
       fatal("Unable to get status for input file (%s)", filename);
     }
 
+  /* a socket (as in server mode) cannot be rewound either */
+
+#ifdef S_ISSOCK
+  h->is_pipe = S_ISFIFO(fs.st_mode) || S_ISSOCK(fs.st_mode);
+#else
   h->is_pipe = S_ISFIFO(fs.st_mode);
+#endif
 
   if (h->is_pipe)
     {
@@ -365,6 +376,8 @@ fastx_handle fastx_open(const char * filename)
 
   buffer_init(& h->file_buffer);
 
+  fastx_reader_start(h);
+
   /* start filling up file buffer */
 
   uint64_t rest = fastx_file_fill_buffer(h);
@@ -395,6 +408,8 @@ fastx_handle fastx_open(const char * filename)
         {
           /* close files if unrecognized file type */
 
+          fastx_reader_stop(h);
+
           switch(h->format)
             {
             case FORMAT_PLAIN:
@@ -508,6 +523,8 @@ void fastx_close(fastx_handle h)
         }
     }
 
+  fastx_reader_stop(h);
+
 #ifdef HAVE_BZLIB_H
   int bz_error;
 #endif
@@ -554,6 +571,213 @@ void fastx_close(fastx_handle h)
   h=nullptr;
 }
 
+auto fastx_read_raw(fastx_handle h, char * dest, uint64_t space) -> uint64_t
+{
+  /* read and decompress up to space bytes from the input file */
+
+  int bytes_read = 0;
+
+#ifdef HAVE_BZLIB_H
+  int bzError = 0;
+#endif
+
+  switch(h->format)
+    {
+    case FORMAT_PLAIN:
+      bytes_read = fread(dest, 1, space, h->fp);
+      break;
+
+    case FORMAT_GZIP:
+#ifdef HAVE_ZLIB_H
+      bytes_read = (*gzread_p)(h->fp_gz, dest, space);
+      if (bytes_read < 0)
+        {
+          fatal("Unable to read gzip compressed file");
+        }
+      break;
+#endif
+
+    case FORMAT_BZIP:
+#ifdef HAVE_BZLIB_H
+      bytes_read = (*BZ2_bzRead_p)(& bzError, h->fp_bz, dest, space);
+      if ((bytes_read < 0) ||
+          ! ((bzError == BZ_OK) ||
+             (bzError == BZ_STREAM_END) ||
+             (bzError == BZ_SEQUENCE_ERROR)))
+        {
+          fatal("Unable to read from bzip2 compressed file");
+        }
+      break;
+#endif
+
+    default:
+      fatal("Internal error");
+    }
+
+  return bytes_read;
+}
+
+auto fastx_reader_position(fastx_handle h) -> uint64_t
+{
+  /* position in the (compressed) input file */
+
+  if (h->is_pipe)
+    {
+      return 0;
+    }
+
+#ifdef HAVE_ZLIB_H
+  if (h->format == FORMAT_GZIP)
+    {
+      /* Circumvent the missing gzoffset function in zlib 1.2.3 and earlier */
+      int fd = dup(fileno(h->fp));
+      uint64_t position = xlseek(fd, 0, SEEK_CUR);
+      close(fd);
+      return position;
+    }
+#endif
+
+  return xftello(h->fp);
+}
+
+auto fastx_reader_worker(void * vp) -> void *
+{
+  /*
+    Read and decompress the input into a ring of large blocks, ahead
+    of the parser, so that I/O and decompression run concurrently
+    with parsing and with the threads processing the sequences.
+  */
+
+  auto h = (fastx_handle) vp;
+
+  while (true)
+    {
+      xpthread_mutex_lock(& h->reader_mutex);
+      while ((h->blocks_filled - h->blocks_consumed == FASTX_READER_BLOCKS)
+             && ! h->reader_stop)
+        {
+          xpthread_cond_wait(& h->reader_cond, & h->reader_mutex);
+        }
+      const bool stop = h->reader_stop;
+      struct fastx_block_s * block =
+        h->blocks + (h->blocks_filled % FASTX_READER_BLOCKS);
+      xpthread_mutex_unlock(& h->reader_mutex);
+
+      if (stop)
+        {
+          break;
+        }
+
+      block->length = fastx_read_raw(h, block->data, FASTX_READER_BLOCK_SIZE);
+      block->file_position = fastx_reader_position(h);
+
+      xpthread_mutex_lock(& h->reader_mutex);
+      if (block->length > 0)
+        {
+          h->blocks_filled++;
+        }
+      else
+        {
+          h->reader_eof = true;
+        }
+      xpthread_cond_broadcast(& h->reader_cond);
+      xpthread_mutex_unlock(& h->reader_mutex);
+
+      if (block->length == 0)
+        {
+          break;
+        }
+    }
+
+  return nullptr;
+}
+
+auto fastx_reader_start(fastx_handle h) -> void
+{
+  h->blocks = (struct fastx_block_s *)
+    xmalloc(FASTX_READER_BLOCKS * sizeof(struct fastx_block_s));
+  for (int i = 0; i < FASTX_READER_BLOCKS; i++)
+    {
+      h->blocks[i].data = (char *) xmalloc(FASTX_READER_BLOCK_SIZE);
+      h->blocks[i].length = 0;
+      h->blocks[i].file_position = 0;
+    }
+  h->blocks_filled = 0;
+  h->blocks_consumed = 0;
+  h->block_offset = 0;
+  h->reader_eof = false;
+  h->reader_stop = false;
+
+  xpthread_mutex_init(& h->reader_mutex, nullptr);
+  xpthread_cond_init(& h->reader_cond, nullptr);
+  xpthread_create(& h->reader, nullptr, fastx_reader_worker, (void *) h);
+}
+
+auto fastx_reader_stop(fastx_handle h) -> void
+{
+  if (! h->blocks)
+    {
+      return;
+    }
+
+  xpthread_mutex_lock(& h->reader_mutex);
+  h->reader_stop = true;
+  xpthread_cond_broadcast(& h->reader_cond);
+  xpthread_mutex_unlock(& h->reader_mutex);
+
+  xpthread_join(h->reader, nullptr);
+
+  xpthread_cond_destroy(& h->reader_cond);
+  xpthread_mutex_destroy(& h->reader_mutex);
+
+  for (int i = 0; i < FASTX_READER_BLOCKS; i++)
+    {
+      xfree(h->blocks[i].data);
+    }
+  xfree(h->blocks);
+  h->blocks = nullptr;
+}
+
+auto fastx_reader_copy(fastx_handle h, char * dest, uint64_t space) -> uint64_t
+{
+  /* copy up to space bytes from the ring, waiting for the reader */
+
+  /* check and take the block under the lock, so that the reader's
+     writes to it are visible here */
+  xpthread_mutex_lock(& h->reader_mutex);
+  while ((h->blocks_consumed == h->blocks_filled) && ! h->reader_eof)
+    {
+      xpthread_cond_wait(& h->reader_cond, & h->reader_mutex);
+    }
+  const bool empty = (h->blocks_consumed == h->blocks_filled);
+  struct fastx_block_s * block =
+    h->blocks + (h->blocks_consumed % FASTX_READER_BLOCKS);
+  xpthread_mutex_unlock(& h->reader_mutex);
+
+  if (empty)
+    {
+      return 0;
+    }
+
+  const uint64_t bytes = MIN(space, block->length - h->block_offset);
+
+  memcpy(dest, block->data + h->block_offset, bytes);
+  h->block_offset += bytes;
+  h->file_position = block->file_position;
+
+  if (h->block_offset == block->length)
+    {
+      /* give the block back to the reader */
+      xpthread_mutex_lock(& h->reader_mutex);
+      h->blocks_consumed++;
+      h->block_offset = 0;
+      xpthread_cond_broadcast(& h->reader_cond);
+      xpthread_mutex_unlock(& h->reader_mutex);
+    }
+
+  return bytes;
+}
+
 uint64_t fastx_file_fill_buffer(fastx_handle h)
 {
   /* read more data if necessary */
@@ -575,72 +799,10 @@ uint64_t fastx_file_fill_buffer(fastx_handle h)
           space = h->file_buffer.alloc;
         }
 
-      int bytes_read = 0;
-
-#ifdef HAVE_BZLIB_H
-      int bzError = 0;
-#endif
-
-      switch(h->format)
-        {
-        case FORMAT_PLAIN:
-          bytes_read = fread(h->file_buffer.data
-                             + h->file_buffer.position,
-                             1,
-                             space,
-                             h->fp);
-          break;
-
-        case FORMAT_GZIP:
-#ifdef HAVE_ZLIB_H
-          bytes_read = (*gzread_p)(h->fp_gz,
-                                   h->file_buffer.data
-                                   + h->file_buffer.position,
-                                   space);
-          if (bytes_read < 0)
-            {
-              fatal("Unable to read gzip compressed file");
-            }
-          break;
-#endif
-
-        case FORMAT_BZIP:
-#ifdef HAVE_BZLIB_H
-          bytes_read = (*BZ2_bzRead_p)(& bzError,
-                                       h->fp_bz,
-                                       h->file_buffer.data
-                                       + h->file_buffer.position,
-                                       space);
-          if ((bytes_read < 0) ||
-              ! ((bzError == BZ_OK) ||
-                 (bzError == BZ_STREAM_END) ||
-                 (bzError == BZ_SEQUENCE_ERROR)))
-            {
-              fatal("Unable to read from bzip2 compressed file");
-            }
-          break;
-#endif
-
-        default:
-          fatal("Internal error");
-        }
-
-      if (! h->is_pipe)
-        {
-#ifdef HAVE_ZLIB_H
-          if (h->format == FORMAT_GZIP)
-            {
-              /* Circumvent the missing gzoffset function in zlib 1.2.3 and earlier */
-              int fd = dup(fileno(h->fp));
-              h->file_position = xlseek(fd, 0, SEEK_CUR);
-              close(fd);
-            }
-          else
-#endif
-            {
-              h->file_position = xftello(h->fp);
-            }
-        }
+      uint64_t bytes_read = fastx_reader_copy(h,
+                                              h->file_buffer.data
+                                              + h->file_buffer.position,
+                                              space);
 
       h->file_buffer.length += bytes_read;
       return bytes_read;
@@ -60,6 +60,7 @@
 
 #include <cstdio>  // std::FILE
 #include <cstdint>  // uint64_t
+#include <pthread.h>
 
 
 struct fastx_buffer_s
@@ -77,6 +78,15 @@ auto buffer_extend(struct fastx_buffer_s * dest_buffer,
                    uint64_t len) -> void;
 auto buffer_makespace(struct fastx_buffer_s * buffer, uint64_t x) -> void;
 
+/* a block of raw (decompressed) input produced by the reader thread */
+
+struct fastx_block_s
+{
+  char * data;
+  uint64_t length;
+  uint64_t file_position; /* position in the input file after the block */
+};
+
 struct fastx_s
 {
   bool is_pipe;
@@ -95,6 +105,17 @@ struct fastx_s
 
   struct fastx_buffer_s file_buffer;
 
+  /* ring of blocks filled by the reader thread */
+  pthread_t reader;
+  pthread_mutex_t reader_mutex;
+  pthread_cond_t reader_cond;
+  struct fastx_block_s * blocks;
+  uint64_t blocks_filled;
+  uint64_t blocks_consumed;
+  uint64_t block_offset;
+  bool reader_eof;
+  bool reader_stop;
+
   struct fastx_buffer_s header_buffer;
   struct fastx_buffer_s sequence_buffer;
   struct fastx_buffer_s plusline_buffer;
@@ -140,3 +161,5 @@ auto fastx_get_quality(fastx_handle h) -> char *;
 auto fastx_get_abundance(fastx_handle h) -> int64_t;
 
 auto fastx_file_fill_buffer(fastx_handle h) -> uint64_t;
+auto fastx_reader_start(fastx_handle h) -> void;
+auto fastx_reader_stop(fastx_handle h) -> void;
@@ -105,6 +105,15 @@ inline int fastq_get_qual(char q)
   return qual;
 }
 
+/* chunk constants */
+
+static const int chunk_size = 500; /* reads (or pairs) per chunk */
+static const int chunk_factor = 2; /* chunks per thread */
+
+/* expected errors for each quality symbol, negative if outside qmin-qmax */
+
+static double filter_q2e[256];
+
 struct analysis_res
 {
   bool discarded;
@@ -114,10 +123,87 @@ struct analysis_res
   double ee;
 };
 
-struct analysis_res analyse(fastx_handle h)
+enum filter_state_enum
+  {
+    empty,
+    filled,
+    inprogress,
+    processed
+  };
+
+typedef struct filter_read_s
+{
+  char * header;
+  char * sequence;
+  char * quality;
+  int64_t header_len;
+  int64_t length;
+  int64_t abundance;
+  int64_t header_alloc;
+  int64_t seq_alloc;
+  struct analysis_res res;
+} filter_read_t;
+
+typedef struct filter_chunk_s
+{
+  int size; /* number of reads or pairs of reads */
+  filter_state_enum state; /* state of chunk: empty, read, processed */
+  filter_read_t * fwd;
+  filter_read_t * rev;
+} filter_chunk_t;
+
+static filter_chunk_t * chunks;
+
+static int chunk_count;
+static int chunk_read_next;
+static int chunk_process_next;
+static int chunk_write_next;
+static bool finished_reading = false;
+static bool finished_all = false;
+static int64_t reads_read = 0;
+static int64_t reads_written = 0;
+
+static pthread_mutex_t mutex_chunks;
+static pthread_cond_t cond_chunks;
+
+static fastx_handle h1 = nullptr;
+static fastx_handle h2 = nullptr;
+
+static FILE * fp_fastaout = nullptr;
+static FILE * fp_fastqout = nullptr;
+static FILE * fp_fastaout_discarded = nullptr;
+static FILE * fp_fastqout_discarded = nullptr;
+
+static FILE * fp_fastaout_rev = nullptr;
+static FILE * fp_fastqout_rev = nullptr;
+static FILE * fp_fastaout_discarded_rev = nullptr;
+static FILE * fp_fastqout_discarded_rev = nullptr;
+
+static int64_t kept = 0;
+static int64_t discarded = 0;
+static int64_t truncated = 0;
+
+
+void filter_precompute_qual()
+{
+  for (int c = 0; c < 256; c++)
+    {
+      const int qual = c - opt_fastq_ascii;
+      if ((qual < opt_fastq_qmin) || (qual > opt_fastq_qmax))
+        {
+          filter_q2e[c] = -1.0;
+        }
+      else
+        {
+          filter_q2e[c] = exp10(-0.1 * qual);
+        }
+    }
+}
+
+struct analysis_res analyse(filter_read_t * r)
 {
   struct analysis_res res = { false, false, 0, 0, -1.0 };
-  res.length = fastx_get_sequence_length(h);
+  res.length = r->length;
   int64_t old_length = res.length;
 
   /* strip left (5') end */
@@ -160,18 +246,22 @@ struct analysis_res analyse(fastx_handle h)
         }
     }
 
-  if (h->is_fastq)
+  if (r->quality)
     {
       /* truncate by quality and expected errors (ee) */
       res.ee = 0.0;
-      char * q = fastx_get_quality(h) + res.start;
+      auto * q = (unsigned char *) r->quality + res.start;
       for (int64_t i = 0; i < res.length; i++)
         {
-          int qual = fastq_get_qual(q[i]);
-          double e = exp10(-0.1 * qual);
+          double e = filter_q2e[q[i]];
+          if (e < 0.0)
+            {
+              /* report the quality value outside qmin-qmax */
+              fastq_get_qual(q[i]);
+            }
           res.ee += e;
 
-          if ((qual <= opt_fastq_truncqual) ||
+          if ((q[i] - opt_fastq_ascii <= opt_fastq_truncqual) ||
               (res.ee > opt_fastq_truncee))
             {
               res.ee -= e;
@@ -205,16 +295,12 @@ struct analysis_res analyse(fastx_handle h)
       res.discarded = true;
     }
 
-  /* filter by n's */
+  /* filter by n's, counted without branches so the loop is vectorised */
   int64_t ncount = 0;
-  char * p = fastx_get_sequence(h) + res.start;
+  char * p = r->sequence + res.start;
   for (int64_t i = 0; i < res.length; i++)
     {
-      int pc = p[i];
-      if ((pc == 'N') || (pc == 'n'))
-        {
-          ncount++;
-        }
+      ncount += ((p[i] | 0x20) == 'n');
     }
   if (ncount > opt_fastq_maxns)
     {
@@ -222,12 +308,11 @@ struct analysis_res analyse(fastx_handle h)
     }
 
   /* filter by abundance */
-  int64_t abundance = fastx_get_abundance(h);
-  if (abundance < opt_minsize)
+  if (r->abundance < opt_minsize)
     {
       res.discarded = true;
     }
-  if (abundance > opt_maxsize)
+  if (r->abundance > opt_maxsize)
     {
       res.discarded = true;
     }
@@ -237,6 +322,374 @@ struct analysis_res analyse(fastx_handle h)
   return res;
 }
 
+void filter_init_read(filter_read_t * r)
+{
+  r->header = nullptr;
+  r->sequence = nullptr;
+  r->quality = nullptr;
+  r->header_len = 0;
+  r->length = 0;
+  r->abundance = 0;
+  r->header_alloc = 0;
+  r->seq_alloc = 0;
+}
+
+void filter_free_read(filter_read_t * r)
+{
+  if (r->header)
+    {
+      xfree(r->header);
+    }
+  if (r->sequence)
+    {
+      xfree(r->sequence);
+    }
+  if (r->quality)
+    {
+      xfree(r->quality);
+    }
+}
+
+void filter_copy_read(filter_read_t * r, fastx_handle h)
+{
+  r->header_len = fastx_get_header_length(h);
+  r->length = fastx_get_sequence_length(h);
+  r->abundance = fastx_get_abundance(h);
+
+  if (r->header_len + 1 > r->header_alloc)
+    {
+      r->header_alloc = r->header_len + 1;
+      r->header = (char *) xrealloc(r->header, r->header_alloc);
+    }
+
+  if (r->length + 1 > r->seq_alloc)
+    {
+      r->seq_alloc = r->length + 1;
+      r->sequence = (char *) xrealloc(r->sequence, r->seq_alloc);
+      if (h->is_fastq)
+        {
+          r->quality = (char *) xrealloc(r->quality, r->seq_alloc);
+        }
+    }
+
+  memcpy(r->header, fastx_get_header(h), r->header_len + 1);
+  memcpy(r->sequence, fastx_get_sequence(h), r->length + 1);
+  if (h->is_fastq)
+    {
+      memcpy(r->quality, fastx_get_quality(h), r->length + 1);
+    }
+}
+
+bool filter_read_pair(filter_chunk_t * c, int i)
+{
+  if (! fastx_next(h1, false, chrmap_no_change))
+    {
+      if (h2 && fastx_next(h2, false, chrmap_no_change))
+        {
+          fatal("More reverse reads than forward reads");
+        }
+      return false;
+    }
+
+  if (h2 && ! fastx_next(h2, false, chrmap_no_change))
+    {
+      fatal("More forward reads than reverse reads");
+    }
+
+  filter_copy_read(c->fwd + i, h1);
+  if (h2)
+    {
+      filter_copy_read(c->rev + i, h2);
+    }
+  return true;
+}
+
+void filter_process(filter_chunk_t * c, int i)
+{
+  c->fwd[i].res = analyse(c->fwd + i);
+  if (h2)
+    {
+      c->rev[i].res = analyse(c->rev + i);
+    }
+  else
+    {
+      c->rev[i].res = { false, false, 0, 0, -1.0 };
+    }
+}
+
+void filter_output(FILE * fp_fasta,
+                   FILE * fp_fastq,
+                   filter_read_t * r,
+                   int64_t ordinal)
+{
+  if (fp_fasta)
+    {
+      fasta_print_general(fp_fasta,
+                          nullptr,
+                          r->sequence + r->res.start,
+                          r->res.length,
+                          r->header,
+                          r->header_len,
+                          r->abundance,
+                          ordinal,
+                          r->res.ee,
+                          -1,
+                          -1,
+                          nullptr,
+                          0.0);
+    }
+
+  if (fp_fastq)
+    {
+      fastq_print_general(fp_fastq,
+                          r->sequence + r->res.start,
+                          r->res.length,
+                          r->header,
+                          r->header_len,
+                          r->quality + r->res.start,
+                          r->abundance,
+                          ordinal,
+                          r->res.ee);
+    }
+}
+
+void filter_write(filter_chunk_t * c, int i)
+{
+  struct analysis_res & res1 = c->fwd[i].res;
+  struct analysis_res & res2 = c->rev[i].res;
+
+  if (res1.discarded || res2.discarded)
+    {
+      /* discard the sequence(s) */
+
+      discarded++;
+
+      filter_output(fp_fastaout_discarded,
+                    fp_fastqout_discarded,
+                    c->fwd + i,
+                    discarded);
+
+      if (h2)
+        {
+          filter_output(fp_fastaout_discarded_rev,
+                        fp_fastqout_discarded_rev,
+                        c->rev + i,
+                        discarded);
+        }
+    }
+  else
+    {
+      /* keep the sequence(s) */
+
+      kept++;
+
+      if (res1.truncated || res2.truncated)
+        {
+          truncated++;
+        }
+
+      filter_output(fp_fastaout, fp_fastqout, c->fwd + i, kept);
+
+      if (h2)
+        {
+          filter_output(fp_fastaout_rev, fp_fastqout_rev, c->rev + i, kept);
+        }
+    }
+}
+
+inline void filter_chunk_read()
+{
+  while((!finished_reading) && (chunks[chunk_read_next].state == empty))
+    {
+      xpthread_mutex_unlock(&mutex_chunks);
+      progress_update(fastx_get_position(h1));
+      int r = 0;
+      while ((r < chunk_size) &&
+             filter_read_pair(chunks + chunk_read_next, r))
+        {
+          r++;
+        }
+      chunks[chunk_read_next].size = r;
+      xpthread_mutex_lock(&mutex_chunks);
+      reads_read += r;
+      if (r > 0)
+        {
+          chunks[chunk_read_next].state = filled;
+          chunk_read_next = (chunk_read_next + 1) % chunk_count;
+        }
+      if (r < chunk_size)
+        {
+          finished_reading = true;
+          if (reads_written >= reads_read)
+            {
+              finished_all = true;
+            }
+        }
+      xpthread_cond_broadcast(&cond_chunks);
+    }
+}
+
+inline void filter_chunk_write()
+{
+  while (chunks[chunk_write_next].state == processed)
+    {
+      xpthread_mutex_unlock(&mutex_chunks);
+      for(int i = 0; i < chunks[chunk_write_next].size; i++)
+        {
+          filter_write(chunks + chunk_write_next, i);
+        }
+      xpthread_mutex_lock(&mutex_chunks);
+      reads_written += chunks[chunk_write_next].size;
+      chunks[chunk_write_next].state = empty;
+      if (finished_reading && (reads_written >= reads_read))
+        {
+          finished_all = true;
+        }
+      chunk_write_next = (chunk_write_next + 1) % chunk_count;
+      xpthread_cond_broadcast(&cond_chunks);
+    }
+}
+
+inline void filter_chunk_process()
+{
+  int chunk_current = chunk_process_next;
+  if (chunks[chunk_current].state == filled)
+    {
+      chunks[chunk_current].state = inprogress;
+      chunk_process_next = (chunk_current + 1) % chunk_count;
+      xpthread_cond_broadcast(&cond_chunks);
+      xpthread_mutex_unlock(&mutex_chunks);
+      for(int i = 0; i < chunks[chunk_current].size; i++)
+        {
+          filter_process(chunks + chunk_current, i);
+        }
+      xpthread_mutex_lock(&mutex_chunks);
+      chunks[chunk_current].state = processed;
+      xpthread_cond_broadcast(&cond_chunks);
+    }
+}
+
+void * filter_worker(void * vp)
+{
+  /*
+    The first thread reads chunks of reads and the last thread writes
+    them in the original order, while all threads analyse them.
+  */
+
+  auto t = (int64_t) vp;
+  const bool reader = (t == 0);
+  const bool writer = (t == opt_threads - 1);
+
+  xpthread_mutex_lock(&mutex_chunks);
+
+  while (! finished_all)
+    {
+      while (!
+             (
+              finished_all
+              ||
+              (chunks[chunk_process_next].state == filled)
+              ||
+              (reader &&
+               (!finished_reading) &&
+               (chunks[chunk_read_next].state == empty))
+              ||
+              (writer &&
+               (chunks[chunk_write_next].state == processed))
+              )
+             )
+        {
+          xpthread_cond_wait(&cond_chunks, &mutex_chunks);
+        }
+
+      if (reader)
+        {
+          filter_chunk_read();
+        }
+      filter_chunk_process();
+      if (writer)
+        {
+          filter_chunk_write();
+        }
+    }
+
+  xpthread_mutex_unlock(&mutex_chunks);
+
+  return nullptr;
+}
+
+void filter_all()
+{
+  /* prepare chunks */
+
+  chunk_count = chunk_factor * opt_threads;
+  chunk_read_next = 0;
+  chunk_process_next = 0;
+  chunk_write_next = 0;
+  finished_reading = false;
+  finished_all = false;
+  reads_read = 0;
+  reads_written = 0;
+
+  chunks = (filter_chunk_t *) xmalloc(chunk_count * sizeof(filter_chunk_t));
+
+  for (int i = 0; i < chunk_count; i++)
+    {
+      chunks[i].state = empty;
+      chunks[i].size = 0;
+      chunks[i].fwd =
+        (filter_read_t *) xmalloc(chunk_size * sizeof(filter_read_t));
+      chunks[i].rev =
+        (filter_read_t *) xmalloc(chunk_size * sizeof(filter_read_t));
+      for (int j = 0; j < chunk_size; j++)
+        {
+          filter_init_read(chunks[i].fwd + j);
+          filter_init_read(chunks[i].rev + j);
+        }
+    }
+
+  xpthread_mutex_init(&mutex_chunks, nullptr);
+  xpthread_cond_init(&cond_chunks, nullptr);
+
+  /* start threads and wait for them to terminate */
+
+  pthread_attr_t attr;
+  xpthread_attr_init(&attr);
+  xpthread_attr_setdetachstate(&attr, PTHREAD_CREATE_JOINABLE);
+  auto * pthread = (pthread_t *) xmalloc(opt_threads * sizeof(pthread_t));
+
+  for (int t = 0; t < opt_threads; t++)
+    {
+      xpthread_create(pthread + t, &attr, filter_worker, (void *) (int64_t) t);
+    }
+
+  for (int t = 0; t < opt_threads; t++)
+    {
+      xpthread_join(pthread[t], nullptr);
+    }
+
+  xfree(pthread);
+  xpthread_attr_destroy(&attr);
+
+  /* free chunks */
+
+  xpthread_cond_destroy(&cond_chunks);
+  xpthread_mutex_destroy(&mutex_chunks);
+
+  for (int i = 0; i < chunk_count; i++)
+    {
+      for (int j = 0; j < chunk_size; j++)
+        {
+          filter_free_read(chunks[i].fwd + j);
+          filter_free_read(chunks[i].rev + j);
+        }
+      xfree(chunks[i].fwd);
+      xfree(chunks[i].rev);
+    }
+  xfree(chunks);
+  chunks = nullptr;
+}
+
 void filter(bool fastq_only, char * filename)
 {
   if ((!opt_fastqout) && (!opt_fastaout) &&
@@ -247,10 +700,8 @@ void filter(bool fastq_only, char * filename)
       fatal("No output files specified");
     }
 
-  fastx_handle h1 = nullptr;
-  fastx_handle h2 = nullptr;
-
   h1 = fastx_open(filename);
+  h2 = nullptr;
 
   if (!h1)
     {
@@ -322,16 +773,6 @@ void filter(bool fastq_only, char * filename)
         }
     }
 
-  FILE * fp_fastaout = nullptr;
-  FILE * fp_fastqout = nullptr;
-  FILE * fp_fastaout_discarded = nullptr;
-  FILE * fp_fastqout_discarded = nullptr;
-
-  FILE * fp_fastaout_rev = nullptr;
-  FILE * fp_fastqout_rev = nullptr;
-  FILE * fp_fastaout_discarded_rev = nullptr;
-  FILE * fp_fastqout_discarded_rev = nullptr;
-
   if (opt_fastaout)
     {
       fp_fastaout = fopen_output(opt_fastaout);
@@ -409,180 +850,15 @@ void filter(bool fastq_only, char * filename)
 
   progress_init("Reading input file", filesize);
 
-  int64_t kept = 0;
-  int64_t discarded = 0;
-  int64_t truncated = 0;
-
-  while(fastx_next(h1, false, chrmap_no_change))
-    {
-      if (h2 && ! fastx_next(h2, false, chrmap_no_change))
-        {
-          fatal("More forward reads than reverse reads");
-        }
-
-      struct analysis_res res1 = { false, false, 0, 0, 0.0 } ;
-      struct analysis_res res2 = { false, false, 0, 0, -1.0 } ;
-
-      res1 = analyse(h1);
-      if (h2)
-        {
-          res2 = analyse(h2);
-        }
-
-      if (res1.discarded || res2.discarded)
-        {
-          /* discard the sequence(s) */
+  kept = 0;
+  discarded = 0;
+  truncated = 0;
 
-          discarded++;
-
-          if (opt_fastaout_discarded)
-            {
-              fasta_print_general(fp_fastaout_discarded,
-                                  nullptr,
-                                  fastx_get_sequence(h1) + res1.start,
-                                  res1.length,
-                                  fastx_get_header(h1),
-                                  fastx_get_header_length(h1),
-                                  fastx_get_abundance(h1),
-                                  discarded,
-                                  res1.ee,
-                                  -1,
-                                  -1,
-                                  nullptr,
-                                  0.0);
-            }
-
-          if (opt_fastqout_discarded)
-            {
-              fastq_print_general(fp_fastqout_discarded,
-                                  fastx_get_sequence(h1) + res1.start,
-                                  res1.length,
-                                  fastx_get_header(h1),
-                                  fastx_get_header_length(h1),
-                                  fastx_get_quality(h1) + res1.start,
-                                  fastx_get_abundance(h1),
-                                  discarded,
-                                  res1.ee);
-            }
-
-          if (h2)
-            {
-              if (opt_fastaout_discarded_rev)
-                {
-                  fasta_print_general(fp_fastaout_discarded_rev,
-                                      nullptr,
-                                      fastx_get_sequence(h2) + res2.start,
-                                      res2.length,
-                                      fastx_get_header(h2),
-                                      fastx_get_header_length(h2),
-                                      fastx_get_abundance(h2),
-                                      discarded,
-                                      res2.ee,
-                                      -1,
-                                      -1,
-                                      nullptr,
-                                      0.0);
-                }
-
-              if (opt_fastqout_discarded_rev)
-                {
-                  fastq_print_general(fp_fastqout_discarded_rev,
-                                      fastx_get_sequence(h2) + res2.start,
-                                      res2.length,
-                                      fastx_get_header(h2),
-                                      fastx_get_header_length(h2),
-                                      fastx_get_quality(h2) + res2.start,
-                                      fastx_get_abundance(h2),
-                                      discarded,
-                                      res2.ee);
-                }
-            }
-        }
-      else
-        {
-          /* keep the sequence(s) */
-
-          kept++;
-
-          if (res1.truncated || res2.truncated)
-            {
-              truncated++;
-            }
-
-          if (opt_fastaout)
-            {
-              fasta_print_general(fp_fastaout,
-                                  nullptr,
-                                  fastx_get_sequence(h1) + res1.start,
-                                  res1.length,
-                                  fastx_get_header(h1),
-                                  fastx_get_header_length(h1),
-                                  fastx_get_abundance(h1),
-                                  kept,
-                                  res1.ee,
-                                  -1,
-                                  -1,
-                                  nullptr,
-                                  0.0);
-            }
-
-          if (opt_fastqout)
-            {
-              fastq_print_general(fp_fastqout,
-                                  fastx_get_sequence(h1) + res1.start,
-                                  res1.length,
-                                  fastx_get_header(h1),
-                                  fastx_get_header_length(h1),
-                                  fastx_get_quality(h1) + res1.start,
-                                  fastx_get_abundance(h1),
-                                  kept,
-                                  res1.ee);
-            }
-
-          if (h2)
-            {
-              if (opt_fastaout_rev)
-                {
-                  fasta_print_general(fp_fastaout_rev,
-                                      nullptr,
-                                      fastx_get_sequence(h2) + res2.start,
-                                      res2.length,
-                                      fastx_get_header(h2),
-                                      fastx_get_header_length(h2),
-                                      fastx_get_abundance(h2),
-                                      kept,
-                                      res2.ee,
-                                      -1,
-                                      -1,
-                                      nullptr,
-                                      0.0);
-                }
-
-              if (opt_fastqout_rev)
-                {
-                  fastq_print_general(fp_fastqout_rev,
-                                      fastx_get_sequence(h2) + res2.start,
-                                      res2.length,
-                                      fastx_get_header(h2),
-                                      fastx_get_header_length(h2),
-                                      fastx_get_quality(h2) + res2.start,
-                                      fastx_get_abundance(h2),
-                                      kept,
-                                      res2.ee);
-                }
-            }
-        }
-
-      progress_update(fastx_get_position(h1));
-    }
+  filter_precompute_qual();
+  filter_all();
 
   progress_done();
 
-  if (h2 && fastx_next(h2, false, chrmap_no_change))
-    {
-      fatal("More reverse reads than forward reads");
-    }
-
   if (! opt_quiet)
     {
       fprintf(stderr,
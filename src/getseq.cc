@@ -62,11 +62,256 @@
    https://drive5.com/usearch/manual/cmd_fastx_getseqs.html                  */
 
 #include "vsearch.h"
+#include <cctype>  // std::tolower
+#include <cstdint>  // uint64_t, uint32_t
 
 static int labels_alloc = 0;
 static int labels_count = 0;
 static int labels_longest = 0;
 static char * * labels_data = nullptr;
+static char * field_buffer = nullptr;
+
+/*
+  With --labels, the labels are kept in a hash table keyed on their
+  case-folded contents, so that each header is looked up once instead
+  of being compared with every label. With --label_substr_match, an
+  Aho-Corasick automaton of the case-folded labels finds any label
+  occurring in a header in a single pass over it.
+*/
+
+static uint64_t labels_hash_mask = 0;
+static int * labels_hash = nullptr; /* label numbers, -1 if empty */
+static char * fold_buffer = nullptr;
+static int fold_buffer_alloc = 0;
+
+static uint32_t ac_node_count = 0;
+static uint32_t * ac_fail = nullptr;
+static bool * ac_match = nullptr;
+static uint64_t ac_edge_mask = 0;
+static uint64_t * ac_edge_key = nullptr; /* node * 256 + char + 1, 0 if empty */
+static uint32_t * ac_edge_child = nullptr;
+
+auto fold_label(const char * label, int len) -> char *
+{
+  /* return a lower case copy of the label in a shared buffer */
+
+  if (len + 1 > fold_buffer_alloc)
+    {
+      fold_buffer_alloc = len + 1024;
+      fold_buffer = (char *) xrealloc(fold_buffer, fold_buffer_alloc);
+    }
+  for (int i = 0; i < len; i++)
+    {
+      fold_buffer[i] = (char) tolower((unsigned char) label[i]);
+    }
+  fold_buffer[len] = 0;
+  return fold_buffer;
+}
+
+auto labels_hash_build() -> void
+{
+  uint64_t size = 1;
+  while (size < 2 * (uint64_t) labels_count)
+    {
+      size *= 2;
+    }
+  labels_hash_mask = size - 1;
+  labels_hash = (int *) xmalloc(size * sizeof(int));
+  for (uint64_t j = 0; j < size; j++)
+    {
+      labels_hash[j] = -1;
+    }
+
+  for (int i = 0; i < labels_count; i++)
+    {
+      int len = strlen(labels_data[i]);
+      uint64_t j = hash_cityhash64(fold_label(labels_data[i], len), len)
+        & labels_hash_mask;
+      while (labels_hash[j] >= 0)
+        {
+          j = (j + 1) & labels_hash_mask;
+        }
+      labels_hash[j] = i;
+    }
+}
+
+auto labels_hash_find(const char * header, int hlen) -> bool
+{
+  uint64_t j = hash_cityhash64(fold_label(header, hlen), hlen)
+    & labels_hash_mask;
+  while (labels_hash[j] >= 0)
+    {
+      char * label = labels_data[labels_hash[j]];
+      if ((strlen(label) == (size_t) hlen) && ! strcasecmp(header, label))
+        {
+          return true;
+        }
+      j = (j + 1) & labels_hash_mask;
+    }
+  return false;
+}
+
+inline auto ac_edge_slot(uint64_t key) -> uint64_t
+{
+  return (key * UINT64_C(0x9E3779B97F4A7C15) >> 17) & ac_edge_mask;
+}
+
+inline auto ac_child(uint32_t node, unsigned char c) -> uint32_t
+{
+  /* return the child of node along c, or 0 (the root) if none */
+
+  uint64_t key = (uint64_t) node * 256 + c + 1;
+  uint64_t j = ac_edge_slot(key);
+  while (ac_edge_key[j])
+    {
+      if (ac_edge_key[j] == key)
+        {
+          return ac_edge_child[j];
+        }
+      j = (j + 1) & ac_edge_mask;
+    }
+  return 0;
+}
+
+auto ac_build() -> void
+{
+  /* build the trie, node 0 is the root */
+
+  uint64_t total = 1;
+  for (int i = 0; i < labels_count; i++)
+    {
+      total += strlen(labels_data[i]);
+    }
+
+  if (total > UINT32_MAX)
+    {
+      fatal("Too many labels for substring matching");
+    }
+
+  auto * parent = (uint32_t *) xmalloc(total * sizeof(uint32_t));
+  auto * depth = (uint32_t *) xmalloc(total * sizeof(uint32_t));
+  auto * symbol = (unsigned char *) xmalloc(total);
+  ac_fail = (uint32_t *) xmalloc(total * sizeof(uint32_t));
+  ac_match = (bool *) xmalloc(total * sizeof(bool));
+
+  uint64_t size = 1;
+  while (size < 2 * total)
+    {
+      size *= 2;
+    }
+  ac_edge_mask = size - 1;
+  ac_edge_key = (uint64_t *) xmalloc(size * sizeof(uint64_t));
+  ac_edge_child = (uint32_t *) xmalloc(size * sizeof(uint32_t));
+  memset(ac_edge_key, 0, size * sizeof(uint64_t));
+
+  ac_node_count = 1;
+  parent[0] = 0;
+  depth[0] = 0;
+  symbol[0] = 0;
+  ac_match[0] = false;
+  uint32_t maxdepth = 0;
+
+  for (int i = 0; i < labels_count; i++)
+    {
+      uint32_t node = 0;
+      for (char * p = labels_data[i]; *p; p++)
+        {
+          auto c = (unsigned char) tolower((unsigned char) *p);
+          uint32_t child = ac_child(node, c);
+          if (! child)
+            {
+              child = ac_node_count++;
+              parent[child] = node;
+              depth[child] = depth[node] + 1;
+              symbol[child] = c;
+              ac_match[child] = false;
+              maxdepth = MAX(maxdepth, depth[child]);
+
+              uint64_t key = (uint64_t) node * 256 + c + 1;
+              uint64_t j = ac_edge_slot(key);
+              while (ac_edge_key[j])
+                {
+                  j = (j + 1) & ac_edge_mask;
+                }
+              ac_edge_key[j] = key;
+              ac_edge_child[j] = child;
+            }
+          node = child;
+        }
+      ac_match[node] = true;
+    }
+
+  /* order the nodes by depth (counting sort) */
+
+  auto * first = (uint32_t *) xmalloc((maxdepth + 2) * sizeof(uint32_t));
+  memset(first, 0, (maxdepth + 2) * sizeof(uint32_t));
+  for (uint32_t v = 0; v < ac_node_count; v++)
+    {
+      first[depth[v] + 1]++;
+    }
+  for (uint32_t d = 1; d <= maxdepth + 1; d++)
+    {
+      first[d] += first[d - 1];
+    }
+  auto * order = (uint32_t *) xmalloc(ac_node_count * sizeof(uint32_t));
+  for (uint32_t v = 0; v < ac_node_count; v++)
+    {
+      order[first[depth[v]]++] = v;
+    }
+
+  /* failure links, and matches through them, in breadth-first order */
+
+  for (uint32_t k = 0; k < ac_node_count; k++)
+    {
+      uint32_t v = order[k];
+      ac_fail[v] = 0;
+      if (depth[v] > 1)
+        {
+          uint32_t f = ac_fail[parent[v]];
+          uint32_t next = ac_child(f, symbol[v]);
+          while (f && ! next)
+            {
+              f = ac_fail[f];
+              next = ac_child(f, symbol[v]);
+            }
+          ac_fail[v] = next;
+        }
+      ac_match[v] = ac_match[v] || ac_match[ac_fail[v]];
+    }
+
+  xfree(order);
+  xfree(first);
+  xfree(symbol);
+  xfree(depth);
+  xfree(parent);
+}
+
+auto ac_search(const char * header) -> bool
+{
+  /* true if any label occurs in the header, ignoring case */
+
+  uint32_t node = 0;
+  if (ac_match[node])
+    {
+      return true;
+    }
+  for (const char * p = header; *p; p++)
+    {
+      auto c = (unsigned char) tolower((unsigned char) *p);
+      uint32_t next = ac_child(node, c);
+      while (node && ! next)
+        {
+          node = ac_fail[node];
+          next = ac_child(node, c);
+        }
+      node = next;
+      if (ac_match[node])
+        {
+          return true;
+        }
+    }
+  return false;
+}
 
 void read_labels_file(char * filename)
 {
@@ -143,6 +388,18 @@ void read_labels_file(char * filename)
           fprintf(fp_log, "WARNING: Labels longer than 1023 characters are not supported\n");
         }
     }
+
+  if (opt_labels)
+    {
+      if (opt_label_substr_match)
+        {
+          ac_build();
+        }
+      else
+        {
+          labels_hash_build();
+        }
+    }
 }
 
 void free_labels()
@@ -153,28 +410,58 @@ void free_labels()
     }
   free(labels_data);
   labels_data = nullptr;
+
+  if (labels_hash)
+    {
+      xfree(labels_hash);
+      labels_hash = nullptr;
+    }
+  if (ac_fail)
+    {
+      xfree(ac_fail);
+      xfree(ac_match);
+      xfree(ac_edge_key);
+      xfree(ac_edge_child);
+      ac_fail = nullptr;
+      ac_match = nullptr;
+      ac_edge_key = nullptr;
+      ac_edge_child = nullptr;
+    }
+  if (fold_buffer)
+    {
+      xfree(fold_buffer);
+      fold_buffer = nullptr;
+      fold_buffer_alloc = 0;
+    }
+  if (field_buffer)
+    {
+      xfree(field_buffer);
+      field_buffer = nullptr;
+    }
 }
 
 bool test_label_match(fastx_handle h)
 {
   char * header = fastx_get_header(h);
   int hlen = fastx_get_header_length(h);
-  char * field_buffer = nullptr;
   int field_len = 0;
   if (opt_label_field)
     {
       field_len = strlen(opt_label_field);
-      int field_buffer_size = field_len + 2;
-      if (opt_label_word)
+      if (! field_buffer)
         {
-          field_buffer_size += strlen(opt_label_word);
-        }
-      else
-        {
-          field_buffer_size += labels_longest;
+          int field_buffer_size = field_len + 2;
+          if (opt_label_word)
+            {
+              field_buffer_size += strlen(opt_label_word);
+            }
+          else
+            {
+              field_buffer_size += labels_longest;
+            }
+          field_buffer = (char *) xmalloc(field_buffer_size);
+          snprintf(field_buffer, field_buffer_size, "%s=", opt_label_field);
         }
-      field_buffer = (char *) xmalloc(field_buffer_size);
-      snprintf(field_buffer, field_buffer_size, "%s=", opt_label_field);
     }
 
   if (opt_label)
@@ -194,25 +481,11 @@ bool test_label_match(fastx_handle h)
     {
       if (opt_label_substr_match)
         {
-          for (int i = 0; i < labels_count; i++)
-            {
-              if (xstrcasestr(header, labels_data[i]))
-                {
-                  return true;
-                }
-            }
+          return ac_search(header);
         }
       else
         {
-          for (int i = 0; i < labels_count; i++)
-            {
-              char * needle = labels_data[i];
-              int wlen = strlen(needle);
-              if ((hlen == wlen) && ! strcasecmp(header, needle))
-                {
-                  return true;
-                }
-            }
+          return labels_hash_find(header, hlen);
         }
     }
   else if (opt_label_word)
@@ -590,10 +863,7 @@ void getseq(char * filename)
 
   fastx_close(h1);
 
-  if (opt_labels || opt_label_words)
-    {
-      free_labels();
-    }
+  free_labels();
 }
 
 void fastx_getseq()
@@ -88,7 +88,7 @@ LinearMemoryAligner::LinearMemoryAligner()
   scorematrix = nullptr;
 
   cigar_alloc = 0;
-  cigar_string = nullptr;
+  cigar_words = nullptr;
 
   vector_alloc = 0;
   HH = nullptr;
@@ -99,9 +99,9 @@ LinearMemoryAligner::LinearMemoryAligner()
 
 LinearMemoryAligner::~LinearMemoryAligner()
 {
-  if (cigar_string)
+  if (cigar_words)
     {
-      xfree(cigar_string);
+      xfree(cigar_words);
     }
   if (HH)
     {
@@ -183,9 +183,10 @@ void LinearMemoryAligner::cigar_reset()
   if (cigar_alloc < 1)
     {
       cigar_alloc = 64;
-      cigar_string = (char*) xrealloc(cigar_string, cigar_alloc);
+      cigar_words = (cigar_t *) xrealloc(cigar_words,
+                                         cigar_alloc * sizeof(cigar_t));
     }
-  cigar_string[0] = 0;
+  cigar_words[0] = 0;
   cigar_length = 0;
   op = 0;
   op_run = 0;
@@ -193,41 +194,20 @@ void LinearMemoryAligner::cigar_reset()
 
 void LinearMemoryAligner::cigar_flush()
 {
-  if (op_run > 0)
+  while (op_run > 0)
     {
-      while (true)
+      /* keep room for the terminating word */
+      if (cigar_length + 2 > cigar_alloc)
         {
-          /* try writing string until enough memory has been allocated */
-
-          int64_t rest = cigar_alloc - cigar_length;
-          int n;
-          if (op_run > 1)
-            {
-              n = snprintf(cigar_string + cigar_length,
-                           rest,
-                           "%" PRId64 "%c", op_run, op);
-            }
-          else
-            {
-              n = snprintf(cigar_string + cigar_length,
-                           rest,
-                           "%c", op);
-            }
-          if (n < 0)
-            {
-              fatal("snprintf returned a negative number.\n");
-            }
-          else if (n >= rest)
-            {
-              cigar_alloc += MAX(n - rest + 1, 64);
-              cigar_string = (char*) xrealloc(cigar_string, cigar_alloc);
-            }
-          else
-            {
-              cigar_length += n;
-              break;
-            }
+          cigar_alloc *= 2;
+          cigar_words = (cigar_t *) xrealloc(cigar_words,
+                                             cigar_alloc * sizeof(cigar_t));
         }
+
+      const int64_t run = MIN(op_run, cigar_run_max);
+      cigar_words[cigar_length++] = cigar_pack(op, run);
+      cigar_words[cigar_length] = 0;
+      op_run -= run;
     }
 }
 
@@ -674,10 +654,10 @@ void LinearMemoryAligner::set_parameters(int64_t * _scorematrix,
 
 
 
-char * LinearMemoryAligner::align(char * _a_seq,
-                                  char * _b_seq,
-                                  int64_t a_len,
-                                  int64_t b_len)
+cigar_t * LinearMemoryAligner::align(char * _a_seq,
+                                     char * _b_seq,
+                                     int64_t a_len,
+                                     int64_t b_len)
 {
   /* copy parameters */
   a_seq = _a_seq;
@@ -696,10 +676,10 @@ char * LinearMemoryAligner::align(char * _a_seq,
   cigar_flush();
 
   /* return cigar */
-  return cigar_string;
+  return cigar_words;
 }
 
-void LinearMemoryAligner::alignstats(char * cigar,
+void LinearMemoryAligner::alignstats(cigar_t * cigar,
                                      char * _a_seq,
                                      char * _b_seq,
                                      int64_t * _nwscore,
@@ -720,17 +700,14 @@ void LinearMemoryAligner::alignstats(char * cigar,
   int64_t a_pos = 0;
   int64_t b_pos = 0;
 
-  char * p = cigar;
+  cigar_t * p = cigar;
 
   int64_t g;
 
   while (*p)
     {
-      int64_t run = 1;
-      int scanlength = 0;
-      sscanf(p, "%" PRId64 "%n", &run, &scanlength);
-      p += scanlength;
-      switch (*p++)
+      const int64_t run = cigar_run(*p);
+      switch (cigar_op(*p++))
         {
         case 'M':
           nwalignmentlength += run;
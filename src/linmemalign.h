@@ -68,7 +68,7 @@ class LinearMemoryAligner
   int64_t op_run;
   int64_t cigar_alloc;
   int64_t cigar_length;
-  char * cigar_string;
+  cigar_t * cigar_words;
 
   char * a_seq;
   char * b_seq;
@@ -153,9 +153,9 @@ public:
   auto align(char * _a_seq,
              char * _b_seq,
              int64_t a_len,
-             int64_t b_len) -> char *;
+             int64_t b_len) -> cigar_t *;
 
-  auto alignstats(char * cigar,
+  auto alignstats(cigar_t * cigar,
                   char * a_seq,
                   char * b_seq,
                   int64_t * nwscore,
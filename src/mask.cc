@@ -187,28 +187,23 @@ void dust(char * m, int len)
 static pthread_t * pthread;
 static pthread_attr_t attr;
 static pthread_mutex_t mutex;
-static int nextseq = 0;
+static struct scheduler_s * sched;
 static int seqcount = 0;
 
 void * dust_all_worker(void * vp)
 {
-  (void) vp; // not used, but required for thread creation
-  while(true)
+  auto t = (int64_t) vp;
+  struct sched_query_s * * batch;
+  int64_t count = 0;
+  while ((count = scheduler_next(sched, t, & batch)) > 0)
     {
-      xpthread_mutex_lock(&mutex);
-      const int seqno = nextseq;
-      if (seqno < seqcount)
-        {
-          nextseq++;
-          progress_update(seqno);
-          xpthread_mutex_unlock(&mutex);
-          dust(db_getsequence(seqno), db_getsequencelen(seqno));
-        }
-      else
+      for (int64_t i = 0; i < count; i++)
         {
-          xpthread_mutex_unlock(&mutex);
-          break;
+          dust(batch[i]->sequence, batch[i]->sequence_len);
         }
+      xpthread_mutex_lock(&mutex);
+      progress_update(batch[count - 1]->seqno);
+      xpthread_mutex_unlock(&mutex);
     }
   return nullptr;
 }
@@ -216,11 +211,10 @@ void * dust_all_worker(void * vp)
 
 void dust_all()
 {
-  nextseq = 0;
-  seqcount = db_getsequencecount();
-  progress_init("Masking", seqcount);
+  progress_init("Masking", db_getsequencecount());
 
   xpthread_mutex_init(&mutex, nullptr);
+  sched = scheduler_init_db(opt_threads, 16);
 
   xpthread_attr_init(&attr);
   xpthread_attr_setdetachstate(&attr, PTHREAD_CREATE_JOINABLE);
@@ -241,6 +235,7 @@ void dust_all()
 
   xpthread_attr_destroy(&attr);
 
+  scheduler_exit(sched);
   xpthread_mutex_destroy(&mutex);
 
   progress_done();
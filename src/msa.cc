@@ -62,14 +62,10 @@
 #include "msa.h"
 #include <array>
 #include <algorithm>  // std::max()
-#include <cassert>
 #include <cctype>  // std::toupper
 #include <cinttypes>  // macro PRId64
-#include <climits>  // INT_MAX
 #include <cstdint>  // uint64_t
 #include <cstdio>  // std::FILE, std::sscanf, std::fprintf
-#include <cstdlib>  // str::strtoll
-#include <cstring>  // std::memset, std::strlen
 #include <iterator> // std::next
 #include <numeric> // std::accumulate
 #include <vector>
@@ -139,42 +135,17 @@ auto update_msa(char const nucleotide, int &position_in_alignment,
 }
 
 
-auto find_runlength_of_leftmost_operation(char * first_character, char ** first_non_digit) -> long long {
-  // std::strtoll:
-  // - start from the 'first_character' pointed to,
-  // - consume as many characters as possible to form a valid integer,
-  // - advance pointer to the first non-digit character,
-  // - return the valid integer
-  // - if there is no valid integer: pointer is not advanced and function returns zero,
-  static constexpr auto decimal_base = 10;
-  auto runlength = std::strtoll(first_character, first_non_digit, decimal_base);
-  assert(runlength <= INT_MAX);
-
-  // in the context of cigar strings, runlength is at least 1
-  if (runlength == 0) {
-    runlength = 1;
-  }
-  return runlength;  // is in [1, LLONG_MAX]
-}
-
-
 auto find_max_insertions_per_position(int const target_count,
                                       std::vector<struct msa_target_s> const & target_list_v,
                                       int const centroid_len) -> std::vector<int> {
   std::vector<int> max_insertions(centroid_len + 1);
   for(auto i = 1; i < target_count; ++i)
     {
-      char * cigar_start = target_list_v[i].cigar;
-      auto const cigar_length = static_cast<long>(std::strlen(cigar_start));
-      char * cigar_end = std::next(cigar_start, cigar_length);
-      auto * position_in_cigar = cigar_start;
       auto position_in_centroid = 0LL;
-      while (position_in_cigar < cigar_end)
+      for (auto const * word = target_list_v[i].cigar; *word != 0; ++word)
         {
-          auto** next_operation = &position_in_cigar;  // operations: match (M), insertion (I), or deletion (D)
-          auto const runlength = find_runlength_of_leftmost_operation(position_in_cigar, next_operation);
-          auto const operation = **next_operation;
-          position_in_cigar = std::next(position_in_cigar);
+          auto const runlength = cigar_run(*word);
+          auto const operation = cigar_op(*word);  // match (M), insertion (I), or deletion (D)
           switch (operation)
             {
             case 'M':
@@ -344,19 +315,11 @@ auto compute_and_print_msa(int const target_count,
       auto qpos = 0;
       auto tpos = 0;
 
-      char * cigar_start = target.cigar;
-      auto const cigar_length = static_cast<long>(std::strlen(cigar_start));
-      char * cigar_end = std::next(cigar_start, cigar_length);
-      auto * position_in_cigar = cigar_start;
-      while (position_in_cigar < cigar_end)
+      for (auto const * word = target.cigar; *word != 0; ++word)
         {
-          // Consume digits (if any), return the position of the
-          // first char (M, D, or I), store it, move cursor to the next byte.
           // Operations: match (M), insertion (I), or deletion (D)
-          auto** next_operation = &position_in_cigar;
-          auto const runlength = find_runlength_of_leftmost_operation(position_in_cigar, next_operation);
-          auto const operation = **next_operation;
-          position_in_cigar = std::next(position_in_cigar);
+          auto const runlength = cigar_run(*word);
+          auto const operation = cigar_op(*word);
 
           switch (operation) {
           case 'D':
@@ -66,7 +66,7 @@
 struct msa_target_s
 {
   int seqno;
-  char * cigar;
+  cigar_t * cigar;
   int strand;
 };
 
@@ -164,13 +164,9 @@ void orient()
     {
       udb_read(opt_db, true, true);
     }
-  else
+  else if (! udb_cache_lookup(opt_db, true))
     {
       db_read(opt_db, 0);
-    }
-
-  if (!is_udb)
-    {
       if (opt_dbmask == MASK_DUST)
         {
           dust_all();
@@ -179,12 +175,21 @@ void orient()
         {
           hardmask_all();
         }
+      if (opt_index_compress && ! udb_cache_pending())
+        {
+          dbindex_prepare_packed(1, opt_dbmask);
+        }
+      else
+        {
+          dbindex_prepare(1, opt_dbmask);
+          dbindex_addallsequences(opt_dbmask);
+          udb_cache_store();
+        }
     }
 
-  if (!is_udb)
+  if (opt_index_compress)
     {
-      dbindex_prepare(1, opt_dbmask);
-      dbindex_addallsequences(opt_dbmask);
+      dbindex_pack();
     }
 
   uhandle_s * uh_fwd = unique_init();
@@ -262,12 +262,20 @@ void results_show_uc_one(FILE * fp,
         }
 
       fprintf(fp,
-              "H\t%d\t%" PRId64 "\t%.1f\t%c\t0\t0\t%s\t",
+              "H\t%d\t%" PRId64 "\t%.1f\t%c\t0\t0\t",
               clusterno,
               qseqlen,
               hp->id,
-              hp->strand ? '-' : '+',
-              perfect ? "=" : hp->nwalignment);
+              hp->strand ? '-' : '+');
+      if (perfect)
+        {
+          fprintf(fp, "=");
+        }
+      else
+        {
+          cigar_fprint(fp, hp->nwalignment);
+        }
+      fprintf(fp, "\t");
       header_fprint_strip(fp,
                           query_head,
                           strlen(query_head),
@@ -400,7 +408,7 @@ void results_show_userout_one(FILE * fp, struct hit * hp,
         case 23: /* caln */
           if (hp)
             {
-              fprintf(fp, "%s", hp->nwalignment);
+              cigar_fprint(fp, hp->nwalignment);
             }
           break;
         case 24: /* qstrand */
@@ -706,7 +714,7 @@ void results_show_alnout(FILE * fp,
                      hp->trim_t_left,
                      "Tgt",
                      hp->nwalignment + hp->trim_aln_left,
-                     strlen(hp->nwalignment)
+                     cigar_count(hp->nwalignment)
                      - hp->trim_aln_left - hp->trim_aln_right,
                      numwidth,
                      3,
@@ -746,7 +754,7 @@ bool inline nucleotide_equal(char a, char b)
   return chrmap_4bit[(int)a] == chrmap_4bit[(int)b];
 }
 
-void build_sam_strings(char * alignment,
+void build_sam_strings(cigar_t * alignment,
                        char * queryseq,
                        char * targetseq,
                        xstring * cigar,
@@ -763,8 +771,7 @@ void build_sam_strings(char * alignment,
   cigar->empty();
   md->empty();
 
-  char * p = alignment;
-  char * e = p + strlen(p);
+  cigar_t * p = alignment;
 
   int qpos = 0;
   int tpos = 0;
@@ -772,13 +779,10 @@ void build_sam_strings(char * alignment,
   int matched = 0;
   bool flag = false; /* 1: MD string ends with a number */
 
-  while(p < e)
+  while(*p)
     {
-      int run = 1;
-      int scanned = 0;
-      sscanf(p, "%d%n", & run, & scanned);
-      p += scanned;
-      char op = *p++;
+      int run = cigar_run(*p);
+      char op = cigar_op(*p++);
 
       switch (op)
         {
@@ -0,0 +1,440 @@
+/*
+
+  VSEARCH: a versatile open source tool for metagenomics
+
+  Copyright (C) 2014-2024, Torbjorn Rognes, Frederic Mahe and Tomas Flouri
+  All rights reserved.
+
+  Contact: Torbjorn Rognes <torognes@ifi.uio.no>,
+  Department of Informatics, University of Oslo,
+  PO Box 1080 Blindern, NO-0316 Oslo, Norway
+
+  This software is dual-licensed and available under a choice
+  of one of two licenses, either under the terms of the GNU
+  General Public License version 3 or the BSD 2-Clause License.
+
+
+  GNU General Public License version 3
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+  The BSD 2-Clause License
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+
+  1. Redistributions of source code must retain the above copyright
+  notice, this list of conditions and the following disclaimer.
+
+  2. Redistributions in binary form must reproduce the above copyright
+  notice, this list of conditions and the following disclaimer in the
+  documentation and/or other materials provided with the distribution.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+  COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include "vsearch.h"
+#include <algorithm>  // std::min
+#include <cstdint>  // int64_t, uint64_t
+#include <cstring>  // std::memcpy
+#include <deque>
+#include <utility>  // std::move
+#include <vector>
+
+
+/* number of queries read from the input under one lock */
+constexpr int64_t sched_chunk_min = 64;
+
+struct sched_thread_s
+{
+  pthread_mutex_t mutex; /* protects queue, which may be stolen from */
+  std::deque<struct sched_query_s *> queue;
+  std::vector<struct sched_query_s *> current;
+  std::vector<struct sched_query_s *> pool;
+};
+
+struct scheduler_s
+{
+  fastx_handle h; /* nullptr: queries are taken from the database */
+  int thread_count;
+  int64_t batch;
+  int64_t chunk;
+  pthread_mutex_t mutex_input;
+  bool exhausted;
+  uint64_t next_seqno; /* database mode */
+  uint64_t seqcount; /* database mode */
+  struct sched_thread_s * threads;
+
+  /* file mode: chunks parsed by the parser thread, protected by mutex_input */
+  pthread_t parser;
+  pthread_cond_t cond_input;
+  std::deque<std::vector<struct sched_query_s *>> ready;
+  std::vector<struct sched_query_s *> spare;
+  size_t ready_max;
+};
+
+
+auto scheduler_init_common(fastx_handle h,
+                           int thread_count,
+                           int64_t batch) -> struct scheduler_s *
+{
+  auto * s = new struct scheduler_s;
+  s->h = h;
+  s->thread_count = thread_count;
+  s->batch = std::max(batch, (int64_t) 1);
+  s->chunk = std::max(4 * s->batch, sched_chunk_min);
+  s->exhausted = false;
+  s->next_seqno = 0;
+  s->seqcount = 0;
+  xpthread_mutex_init(& s->mutex_input, nullptr);
+  s->threads = new struct sched_thread_s[thread_count];
+  for (int t = 0; t < thread_count; t++)
+    {
+      xpthread_mutex_init(& s->threads[t].mutex, nullptr);
+    }
+  return s;
+}
+
+
+auto scheduler_new_query() -> struct sched_query_s *
+{
+  auto * q = (struct sched_query_s *) xmalloc(sizeof(struct sched_query_s));
+  q->header = nullptr;
+  q->sequence = nullptr;
+  q->header_alloc = 0;
+  q->sequence_alloc = 0;
+  return q;
+}
+
+
+auto scheduler_copy_fastx(struct sched_query_s * q, fastx_handle h) -> void;
+
+
+auto scheduler_parser(void * vp) -> void *
+{
+  /*
+    Parse the input file into chunks of queries ahead of the worker
+    threads, so that parsing runs concurrently with the searches.
+  */
+
+  auto * s = (struct scheduler_s *) vp;
+
+  while (not s->exhausted)
+    {
+      std::vector<struct sched_query_s *> chunk;
+
+      xpthread_mutex_lock(& s->mutex_input);
+      while (s->ready.size() >= s->ready_max)
+        {
+          xpthread_cond_wait(& s->cond_input, & s->mutex_input);
+        }
+      while ((not s->spare.empty()) && ((int64_t) chunk.size() < s->chunk))
+        {
+          chunk.push_back(s->spare.back());
+          s->spare.pop_back();
+        }
+      xpthread_mutex_unlock(& s->mutex_input);
+
+      int64_t count = 0;
+      bool more = true;
+      while ((count < s->chunk) &&
+             (more = fastx_next(s->h, ! opt_notrunclabels, chrmap_no_change)))
+        {
+          if (count == (int64_t) chunk.size())
+            {
+              chunk.push_back(scheduler_new_query());
+            }
+          scheduler_copy_fastx(chunk[count], s->h);
+          count++;
+        }
+
+      xpthread_mutex_lock(& s->mutex_input);
+      s->spare.insert(s->spare.end(), chunk.begin() + count, chunk.end());
+      chunk.resize(count);
+      if (count > 0)
+        {
+          s->ready.push_back(std::move(chunk));
+        }
+      if (not more)
+        {
+          s->exhausted = true;
+        }
+      xpthread_cond_broadcast(& s->cond_input);
+      xpthread_mutex_unlock(& s->mutex_input);
+    }
+
+  return nullptr;
+}
+
+
+auto scheduler_init_fastx(fastx_handle h,
+                          int thread_count,
+                          int64_t batch) -> struct scheduler_s *
+{
+  auto * s = scheduler_init_common(h, thread_count, batch);
+  s->ready_max = 2 * thread_count;
+  xpthread_cond_init(& s->cond_input, nullptr);
+  xpthread_create(& s->parser, nullptr, scheduler_parser, (void *) s);
+  return s;
+}
+
+
+auto scheduler_init_db(int thread_count, int64_t batch) -> struct scheduler_s *
+{
+  auto * s = scheduler_init_common(nullptr, thread_count, batch);
+  s->seqcount = db_getsequencecount();
+  return s;
+}
+
+
+auto scheduler_query_free(struct sched_query_s * q) -> void
+{
+  if (q->header_alloc)
+    {
+      xfree(q->header);
+    }
+  if (q->sequence_alloc)
+    {
+      xfree(q->sequence);
+    }
+  xfree(q);
+}
+
+
+auto scheduler_exit(struct scheduler_s * s) -> void
+{
+  if (s->h)
+    {
+      xpthread_join(s->parser, nullptr);
+      xpthread_cond_destroy(& s->cond_input);
+      for (auto & chunk : s->ready)
+        {
+          for (auto * q : chunk)
+            {
+              scheduler_query_free(q);
+            }
+        }
+      for (auto * q : s->spare)
+        {
+          scheduler_query_free(q);
+        }
+    }
+
+  for (int t = 0; t < s->thread_count; t++)
+    {
+      struct sched_thread_s * st = s->threads + t;
+      for (auto * q : st->queue)
+        {
+          scheduler_query_free(q);
+        }
+      for (auto * q : st->current)
+        {
+          scheduler_query_free(q);
+        }
+      for (auto * q : st->pool)
+        {
+          scheduler_query_free(q);
+        }
+      xpthread_mutex_destroy(& st->mutex);
+    }
+  delete [] s->threads;
+  xpthread_mutex_destroy(& s->mutex_input);
+  delete s;
+}
+
+
+auto scheduler_query_get(struct sched_thread_s * st) -> struct sched_query_s *
+{
+  if (not st->pool.empty())
+    {
+      auto * q = st->pool.back();
+      st->pool.pop_back();
+      return q;
+    }
+
+  return scheduler_new_query();
+}
+
+
+auto scheduler_copy_fastx(struct sched_query_s * q, fastx_handle h) -> void
+{
+  q->seqno = fastx_get_seqno(h);
+  q->size = fastx_get_abundance(h);
+  q->progress = fastx_get_position(h);
+  q->header_len = fastx_get_header_length(h);
+  q->sequence_len = fastx_get_sequence_length(h);
+
+  if (q->header_len + 1 > q->header_alloc)
+    {
+      q->header_alloc = q->header_len + 2001;
+      q->header = (char *) xrealloc(q->header, q->header_alloc);
+    }
+  if (q->sequence_len + 1 > q->sequence_alloc)
+    {
+      q->sequence_alloc = q->sequence_len + 2001;
+      q->sequence = (char *) xrealloc(q->sequence, q->sequence_alloc);
+    }
+
+  std::memcpy(q->header, fastx_get_header(h), q->header_len + 1);
+  std::memcpy(q->sequence, fastx_get_sequence(h), q->sequence_len + 1);
+}
+
+
+auto scheduler_copy_db(struct sched_query_s * q, uint64_t seqno) -> void
+{
+  /* database sequences are referenced, not copied */
+  q->seqno = seqno;
+  q->size = db_getabundance(seqno);
+  q->progress = seqno;
+  q->header = db_getheader(seqno);
+  q->sequence = db_getsequence(seqno);
+  q->header_len = db_getheaderlen(seqno);
+  q->sequence_len = db_getsequencelen(seqno);
+}
+
+
+auto scheduler_refill(struct scheduler_s * s, int thread) -> bool
+{
+  /* move a chunk of queries into the queue of this thread */
+
+  struct sched_thread_s * st = s->threads + thread;
+  std::vector<struct sched_query_s *> chunk;
+
+  xpthread_mutex_lock(& s->mutex_input);
+
+  if (s->h)
+    {
+      /* return used queries to the parser and wait for a parsed chunk */
+      s->spare.insert(s->spare.end(), st->pool.begin(), st->pool.end());
+      st->pool.clear();
+
+      while (s->ready.empty() && (not s->exhausted))
+        {
+          xpthread_cond_wait(& s->cond_input, & s->mutex_input);
+        }
+      if (not s->ready.empty())
+        {
+          chunk = std::move(s->ready.front());
+          s->ready.pop_front();
+          xpthread_cond_broadcast(& s->cond_input);
+        }
+    }
+  else
+    {
+      while ((s->next_seqno < s->seqcount) && ((int64_t) chunk.size() < s->chunk))
+        {
+          auto * q = scheduler_query_get(st);
+          scheduler_copy_db(q, s->next_seqno++);
+          chunk.push_back(q);
+        }
+    }
+
+  xpthread_mutex_unlock(& s->mutex_input);
+
+  if (chunk.empty())
+    {
+      return false;
+    }
+
+  xpthread_mutex_lock(& st->mutex);
+  st->queue.insert(st->queue.end(), chunk.begin(), chunk.end());
+  xpthread_mutex_unlock(& st->mutex);
+  return true;
+}
+
+
+auto scheduler_steal(struct scheduler_s * s, int thread) -> bool
+{
+  /* move the back half of the queue of another thread to this one */
+
+  struct sched_thread_s * st = s->threads + thread;
+
+  for (int i = 1; i < s->thread_count; i++)
+    {
+      struct sched_thread_s * victim =
+        s->threads + ((thread + i) % s->thread_count);
+
+      xpthread_mutex_lock(& victim->mutex);
+      const auto n = victim->queue.size();
+      if (n == 0)
+        {
+          xpthread_mutex_unlock(& victim->mutex);
+          continue;
+        }
+      const auto take = (n + 1) / 2;
+      std::vector<struct sched_query_s *> loot(victim->queue.end() - take,
+                                               victim->queue.end());
+      victim->queue.erase(victim->queue.end() - take, victim->queue.end());
+      xpthread_mutex_unlock(& victim->mutex);
+
+      xpthread_mutex_lock(& st->mutex);
+      st->queue.insert(st->queue.end(), loot.begin(), loot.end());
+      xpthread_mutex_unlock(& st->mutex);
+      return true;
+    }
+
+  return false;
+}
+
+
+auto scheduler_next(struct scheduler_s * s,
+                    int thread,
+                    struct sched_query_s * * * queries) -> int64_t
+{
+  /*
+    Return the next batch of up to s->batch queries for this thread.
+    They remain valid until the next call from the same thread.
+    Zero is returned when all queries have been handed out.
+  */
+
+  struct sched_thread_s * st = s->threads + thread;
+
+  st->pool.insert(st->pool.end(), st->current.begin(), st->current.end());
+  st->current.clear();
+
+  while (true)
+    {
+      xpthread_mutex_lock(& st->mutex);
+      const auto n = std::min((int64_t) st->queue.size(), s->batch);
+      st->current.assign(st->queue.begin(), st->queue.begin() + n);
+      st->queue.erase(st->queue.begin(), st->queue.begin() + n);
+      xpthread_mutex_unlock(& st->mutex);
+
+      if (n > 0)
+        {
+          *queries = st->current.data();
+          return n;
+        }
+
+      if ((not scheduler_refill(s, thread)) && (not scheduler_steal(s, thread)))
+        {
+          *queries = nullptr;
+          return 0;
+        }
+    }
+}
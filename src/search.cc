@@ -69,9 +69,9 @@ static int tophits; /* the maximum number of hits to keep */
 static int seqcount; /* number of database sequences */
 static pthread_attr_t attr;
 static fastx_handle query_fastx_h;
+static struct scheduler_s * sched;
 
 /* global data protected by mutex */
-static pthread_mutex_t mutex_input;
 static pthread_mutex_t mutex_output;
 static int qmatches;
 static uint64 qmatches_abundance;
@@ -302,11 +302,11 @@ void search_output_results(int hit_count,
   xpthread_mutex_unlock(&mutex_output);
 }
 
-int search_query(int64_t t)
+void search_query_kmers(int64_t q)
 {
   for (int s = 0; s < opt_strand; s++)
     {
-      struct searchinfo_s * si = s ? si_minus+t : si_plus+t;
+      struct searchinfo_s * si = s ? si_minus+q : si_plus+q;
 
       /* mask query */
       if (opt_qmask == MASK_DUST)
@@ -318,65 +318,76 @@ int search_query(int64_t t)
           hardmask(si->qsequence, si->qseqlen);
         }
 
-      /* perform search */
-      search_onequery(si, opt_qmask);
+      search_onequery_kmers(si, opt_qmask);
+    }
+}
+
+int search_query_hits(int64_t q)
+{
+  for (int s = 0; s < opt_strand; s++)
+    {
+      struct searchinfo_s * si = s ? si_minus+q : si_plus+q;
+      search_onequery_hits(si);
     }
 
   struct hit * hits;
   int hit_count;
 
-  search_joinhits(si_plus + t,
-                  opt_strand > 1 ? si_minus + t : nullptr,
+  search_joinhits(si_plus + q,
+                  opt_strand > 1 ? si_minus + q : nullptr,
                   & hits,
                   & hit_count);
 
   search_output_results(hit_count,
                         hits,
-                        si_plus[t].query_head,
-                        si_plus[t].qseqlen,
-                        si_plus[t].qsequence,
-                        opt_strand > 1 ? si_minus[t].qsequence : nullptr,
-                        si_plus[t].qsize);
+                        si_plus[q].query_head,
+                        si_plus[q].qseqlen,
+                        si_plus[q].qsequence,
+                        opt_strand > 1 ? si_minus[q].qsequence : nullptr,
+                        si_plus[q].qsize);
 
-  /* free memory for alignment strings */
-  for(int i=0; i<hit_count; i++)
-    {
-      if (hits[i].aligned)
-        {
-          xfree(hits[i].nwalignment);
-        }
-    }
-
-  xfree(hits);
+  /* the hits and their alignments are released with the next query */
 
   return hit_count;
 }
 
 void search_thread_run(int64_t t)
 {
+  /*
+    Each thread takes a batch of up to opt_query_batch queries at a
+    time from the scheduler. The kmer hits of all the queries and
+    strands of the batch are counted together, so that each posting
+    list is read once per batch, before the hits of each query are
+    aligned and output.
+  */
+
+  const int64_t batch_first = t * opt_query_batch;
+  auto * si_list = (struct searchinfo_s * *)
+    xmalloc(opt_query_batch * opt_strand * sizeof(struct searchinfo_s *));
+  struct searchbatch_s sb;
+  sb.alloc = 0;
+  sb.samples = nullptr;
+  sb.cursor = nullptr;
+  sb.run_first = nullptr;
+  sb.counters = nullptr;
+
   while (true)
     {
-      xpthread_mutex_lock(&mutex_input);
+      struct sched_query_s * * batch;
+      const int64_t batch_count = scheduler_next(sched, t, & batch);
 
-      if (fastx_next(query_fastx_h,
-                     ! opt_notrunclabels,
-                     chrmap_no_change))
+      for (int64_t i = 0; i < batch_count; i++)
         {
-          char * qhead = fastx_get_header(query_fastx_h);
-          int query_head_len = fastx_get_header_length(query_fastx_h);
-          char * qseq = fastx_get_sequence(query_fastx_h);
-          int qseqlen = fastx_get_sequence_length(query_fastx_h);
-          int query_no = fastx_get_seqno(query_fastx_h);
-          int qsize = fastx_get_abundance(query_fastx_h);
+          const int64_t q = batch_first + i;
 
           for (int s = 0; s < opt_strand; s++)
             {
-              struct searchinfo_s * si = s ? si_minus+t : si_plus+t;
+              struct searchinfo_s * si = s ? si_minus+q : si_plus+q;
 
-              si->query_head_len = query_head_len;
-              si->qseqlen = qseqlen;
-              si->query_no = query_no;
-              si->qsize = qsize;
+              si->query_head_len = batch[i]->header_len;
+              si->qseqlen = batch[i]->sequence_len;
+              si->query_no = batch[i]->seqno;
+              si->qsize = batch[i]->size;
               si->strand = s;
 
               /* allocate more memory for header and sequence, if necessary */
@@ -397,57 +408,91 @@ void search_thread_run(int64_t t)
             }
 
           /* plus strand: copy header and sequence */
-          strcpy(si_plus[t].query_head, qhead);
-          strcpy(si_plus[t].qsequence, qseq);
-
-          /* get progress as amount of input file read */
-          uint64_t progress = fastx_get_position(query_fastx_h);
+          strcpy(si_plus[q].query_head, batch[i]->header);
+          strcpy(si_plus[q].qsequence, batch[i]->sequence);
+        }
 
-          /* let other threads read input */
-          xpthread_mutex_unlock(&mutex_input);
+      if (batch_count == 0)
+        {
+          break;
+        }
 
+      unsigned int si_count = 0;
+      for(int64_t q = batch_first; q < batch_first + batch_count; q++)
+        {
           /* minus strand: copy header and reverse complementary sequence */
           if (opt_strand > 1)
             {
-              strcpy(si_minus[t].query_head, si_plus[t].query_head);
-              reverse_complement(si_minus[t].qsequence,
-                                 si_plus[t].qsequence,
-                                 si_plus[t].qseqlen);
+              strcpy(si_minus[q].query_head, si_plus[q].query_head);
+              reverse_complement(si_minus[q].qsequence,
+                                 si_plus[q].qsequence,
+                                 si_plus[q].qseqlen);
             }
 
-          int match = search_query(t);
+          search_query_kmers(q);
+
+          si_list[si_count++] = si_plus + q;
+          if (opt_strand > 1)
+            {
+              si_list[si_count++] = si_minus + q;
+            }
+        }
+
+      /* find database sequences with the most kmer hits */
+      if (opt_query_batch > 1)
+        {
+          search_topscores_batch(& sb, si_list, si_count);
+        }
+      else
+        {
+          for(unsigned int i = 0; i < si_count; i++)
+            {
+              search_topscores(si_list[i]);
+            }
+        }
+
+      for(int64_t q = batch_first; q < batch_first + batch_count; q++)
+        {
+          int match = search_query_hits(q);
 
           /* lock mutex for update of global data and output */
           xpthread_mutex_lock(&mutex_output);
 
           /* update stats */
           queries++;
-          queries_abundance += qsize;
+          queries_abundance += si_plus[q].qsize;
 
           if (match)
             {
               qmatches++;
-              qmatches_abundance += qsize;
+              qmatches_abundance += si_plus[q].qsize;
             }
 
           /* show progress */
-          progress_update(progress);
+          progress_update(batch[q - batch_first]->progress);
 
           xpthread_mutex_unlock(&mutex_output);
         }
-      else
-        {
-          xpthread_mutex_unlock(&mutex_input);
-          break;
-        }
     }
+
+  if (sb.samples)
+    {
+      xfree(sb.samples);
+      xfree(sb.cursor);
+      xfree(sb.run_first);
+      xfree(sb.counters);
+    }
+  xfree(si_list);
 }
 
 void search_thread_init(struct searchinfo_s * si)
 {
   /* thread specific initialiation */
   si->uh = unique_init();
-  si->kmers = (count_t *) xmalloc(seqcount * sizeof(count_t) + 32);
+  const auto kmers_count = MIN((unsigned int) seqcount, search_tile_size);
+  si->kmers = (count_t *) xmalloc(kmers_count * sizeof(count_t) + 32);
+  si->kmercursor = nullptr;
+  si->kmercursor_alloc = 0;
   si->m = minheap_init(tophits);
   si->hits = (struct hit *) xmalloc
     (sizeof(struct hit) * (tophits) * opt_strand);
@@ -475,11 +520,13 @@ void search_thread_init(struct searchinfo_s * si)
                         opt_gap_extension_target_interior,
                         opt_gap_extension_query_right,
                         opt_gap_extension_target_right);
+  search_scratch_init(si);
 }
 
 void search_thread_exit(struct searchinfo_s * si)
 {
   /* thread specific clean up */
+  search_scratch_exit(si);
   search16_exit(si->s);
 #ifdef COMPARENONVECTORIZED
   nw_exit(si->nw);
@@ -488,6 +535,10 @@ void search_thread_exit(struct searchinfo_s * si)
   xfree(si->hits);
   minheap_exit(si->m);
   xfree(si->kmers);
+  if (si->kmercursor)
+    {
+      xfree(si->kmercursor);
+    }
   if (si->query_head)
     {
       xfree(si->query_head);
@@ -517,10 +568,13 @@ void search_thread_worker_run()
   /* init and create worker threads, put them into stand-by mode */
   for(int t=0; t<opt_threads; t++)
     {
-      search_thread_init(si_plus+t);
-      if (si_minus)
+      for(int64_t q = t * opt_query_batch; q < (t + 1) * opt_query_batch; q++)
         {
-          search_thread_init(si_minus+t);
+          search_thread_init(si_plus+q);
+          if (si_minus)
+            {
+              search_thread_init(si_minus+q);
+            }
         }
       xpthread_create(pthread+t, &attr,
                       search_thread_worker, (void*)(int64_t)t);
@@ -530,10 +584,13 @@ void search_thread_worker_run()
   for(int t=0; t<opt_threads; t++)
     {
       xpthread_join(pthread[t], nullptr);
-      search_thread_exit(si_plus+t);
-      if (si_minus)
+      for(int64_t q = t * opt_query_batch; q < (t + 1) * opt_query_batch; q++)
         {
-          search_thread_exit(si_minus+t);
+          search_thread_exit(si_plus+q);
+          if (si_minus)
+            {
+              search_thread_exit(si_minus+q);
+            }
         }
     }
 
@@ -542,6 +599,49 @@ void search_thread_worker_run()
 
 
 
+void search_load_db()
+{
+  /* read, mask and index the database, or map a UDB file */
+
+  if (udb_detect_isudb(opt_db))
+    {
+      udb_read(opt_db, true, true);
+      show_rusage();
+    }
+  else if (udb_cache_lookup(opt_db, true))
+    {
+      show_rusage();
+    }
+  else
+    {
+      db_read(opt_db, 0);
+      if (opt_dbmask == MASK_DUST)
+        {
+          dust_all();
+        }
+      else if ((opt_dbmask == MASK_SOFT) && (opt_hardmask))
+        {
+          hardmask_all();
+        }
+      show_rusage();
+      if (opt_index_compress && ! udb_cache_pending())
+        {
+          dbindex_prepare_packed(1, opt_dbmask);
+        }
+      else
+        {
+          dbindex_prepare(1, opt_dbmask);
+          dbindex_addallsequences(opt_dbmask);
+          udb_cache_store();
+        }
+    }
+
+  if (opt_index_compress)
+    {
+      dbindex_pack();
+    }
+}
+
 void search_prep(char * cmdline, char * progheader)
 {
   /* open output files */
@@ -675,35 +775,15 @@ void search_prep(char * cmdline, char * progheader)
         }
     }
 
-  /* check if it may be an UDB file */
-
-  bool is_udb = udb_detect_isudb(opt_db);
-
-  if (is_udb)
-    {
-      udb_read(opt_db, true, true);
-      results_show_samheader(fp_samout, cmdline, opt_db);
-      show_rusage();
-      seqcount = db_getsequencecount();
-    }
-  else
+  if (! server_db_loaded())
     {
-      db_read(opt_db, 0);
-      results_show_samheader(fp_samout, cmdline, opt_db);
-      if (opt_dbmask == MASK_DUST)
-        {
-          dust_all();
-        }
-      else if ((opt_dbmask == MASK_SOFT) && (opt_hardmask))
-        {
-          hardmask_all();
-        }
-      show_rusage();
-      seqcount = db_getsequencecount();
-      dbindex_prepare(1, opt_dbmask);
-      dbindex_addallsequences(opt_dbmask);
+      search_load_db();
     }
 
+  seqcount = db_getsequencecount();
+
+  results_show_samheader(fp_samout, cmdline, opt_db);
+
   /* tophits = the maximum number of hits we need to store */
 
   if ((opt_maxrejects == 0) || (opt_maxrejects > seqcount))
@@ -813,11 +893,12 @@ void usearch_global(char * cmdline, char * progheader)
   query_fastx_h = fastx_open(opt_usearch_global);
 
   /* allocate memory for thread info */
-  si_plus = (struct searchinfo_s *) xmalloc(opt_threads *
+  const int64_t si_count = opt_threads * opt_query_batch;
+  si_plus = (struct searchinfo_s *) xmalloc(si_count *
                                             sizeof(struct searchinfo_s));
   if (opt_strand > 1)
     {
-      si_minus = (struct searchinfo_s *) xmalloc(opt_threads *
+      si_minus = (struct searchinfo_s *) xmalloc(si_count *
                                                  sizeof(struct searchinfo_s));
     }
   else
@@ -827,8 +908,8 @@ void usearch_global(char * cmdline, char * progheader)
 
   pthread = (pthread_t *) xmalloc(opt_threads * sizeof(pthread_t));
 
-  /* init mutexes for input and output */
-  xpthread_mutex_init(&mutex_input, nullptr);
+  /* init scheduler for input and mutex for output */
+  sched = scheduler_init_fastx(query_fastx_h, opt_threads, opt_query_batch);
   xpthread_mutex_init(&mutex_output, nullptr);
 
   progress_init("Searching", fastx_get_size(query_fastx_h));
@@ -836,7 +917,7 @@ void usearch_global(char * cmdline, char * progheader)
   progress_done();
 
   xpthread_mutex_destroy(&mutex_output);
-  xpthread_mutex_destroy(&mutex_input);
+  scheduler_exit(sched);
 
   xfree(pthread);
   xfree(si_plus);
@@ -59,3 +59,4 @@
 */
 
 auto usearch_global(char * cmdline, char * progheader) -> void;
+auto search_load_db() -> void;
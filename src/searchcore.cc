@@ -59,6 +59,7 @@
 */
 
 #include "vsearch.h"
+#include <algorithm>  // std::sort
 #include <limits>
 
 
@@ -202,6 +203,33 @@ bool search_enough_kmers(struct searchinfo_s * si,
   return (count >= opt_minwordmatches) or (count >= si->kmersamplecount);
 }
 
+void search_topscores_tile(struct searchinfo_s * si,
+                           unsigned int tile_first,
+                           unsigned int tile_count)
+{
+  /* add the sequences of a tile with enough kmer hits to the min heap */
+
+  const unsigned int minmatches = MIN(opt_minwordmatches,
+                                      si->kmersamplecount);
+
+  for(unsigned int i = 0; i < tile_count; i++)
+    {
+      count_t count = si->kmers[i];
+      if (count >= minmatches)
+        {
+          unsigned int seqno = dbindex_getmapping(tile_first + i);
+          unsigned int length = db_getsequencelen(seqno);
+
+          elem_t novel;
+          novel.count = count;
+          novel.seqno = seqno;
+          novel.length = length;
+
+          minheap_add(si->m, & novel);
+        }
+    }
+}
+
 void search_topscores(struct searchinfo_s * si)
 {
   /*
@@ -209,69 +237,251 @@ void search_topscores(struct searchinfo_s * si)
     make a sorted list of a given number (th)
     of the database sequences with the highest number of matching kmers.
     These are stored in the min heap array.
+
+    The index range is processed in tiles of search_tile_size database
+    sequences, applying all kmers of the query to one tile before
+    moving on to the next, so that only the counters of a single tile
+    are in use at any time and stay in the cache. The posting lists
+    are sorted, so a cursor for each kmer keeps track of where the
+    next tile starts. The compressed index has one container per
+    tile. The counters of the tile are checked against the threshold
+    before the next tile is started.
   */
 
   /* count kmer hits in the database sequences */
-  const int indexed_count = dbindex_getcount();
-
-  /* zero counts */
-  memset(si->kmers, 0, indexed_count * sizeof(count_t));
+  const unsigned int indexed_count = dbindex_getcount();
 
   minheap_empty(si->m);
 
+  if (si->kmersamplecount > si->kmercursor_alloc)
+    {
+      si->kmercursor_alloc = si->kmersamplecount;
+      si->kmercursor = (uint64_t *) xrealloc(si->kmercursor,
+                                             si->kmercursor_alloc
+                                             * sizeof(uint64_t));
+    }
+
   for(unsigned int i = 0; i < si->kmersamplecount; i++)
     {
       unsigned int kmer = si->kmersample[i];
-      unsigned char * bitmap = dbindex_getbitmap(kmer);
+      if (kmerpack)
+        {
+          si->kmercursor[i] = kmerpack_offset[kmer];
+        }
+      else if (! dbindex_getbitmap(kmer))
+        {
+          si->kmercursor[i] = kmerhash[kmer];
+        }
+    }
+
+  for(unsigned int tile_first = 0;
+      tile_first < indexed_count;
+      tile_first += search_tile_size)
+    {
+      const unsigned int tile_count = MIN(search_tile_size,
+                                          indexed_count - tile_first);
+      const unsigned int tile_end = tile_first + tile_count;
 
-      if (bitmap)
+      /* zero counts */
+      memset(si->kmers, 0, tile_count * sizeof(count_t));
+
+      for(unsigned int i = 0; i < si->kmersamplecount; i++)
         {
-#ifdef __x86_64__
-          if (ssse3_present)
+          unsigned int kmer = si->kmersample[i];
+          unsigned char * bitmap = dbindex_getbitmap(kmer);
+
+          if (kmerpack)
+            {
+              uint64_t end = kmerpack_offset[kmer + 1];
+              unsigned char * p = kmerpack + si->kmercursor[i];
+              if ((si->kmercursor[i] < end) &&
+                  (dbindex_packed_key(p) == tile_first / dbindex_pack_chunk))
+                {
+                  p = dbindex_count_container(si->kmers, p);
+                  si->kmercursor[i] = p - kmerpack;
+                }
+            }
+          else if (bitmap)
             {
-              increment_counters_from_bitmap_ssse3(si->kmers,
-                                                   bitmap, indexed_count);
+              bitmap += tile_first / 8;
+              increment_counters_from_bitmap(si->kmers, bitmap, tile_count);
             }
           else
             {
-              increment_counters_from_bitmap_sse2(si->kmers,
-                                                  bitmap, indexed_count);
+              uint64_t end = kmerhash[kmer] + dbindex_getmatchcount(kmer);
+              uint64_t j = si->kmercursor[i];
+              while ((j < end) && (kmerindex[j] < tile_end))
+                {
+                  si->kmers[kmerindex[j] - tile_first]++;
+                  j++;
+                }
+              si->kmercursor[i] = j;
             }
-#else
-          increment_counters_from_bitmap(si->kmers, bitmap, indexed_count);
-#endif
         }
-      else
+
+      search_topscores_tile(si, tile_first, tile_count);
+    }
+
+  minheap_sort(si->m);
+}
+
+void search_topscores_batch(struct searchbatch_s * sb,
+                            struct searchinfo_s * * si_list,
+                            unsigned int si_count)
+{
+  /*
+    Same as search_topscores, but for several queries at once.
+    The kmer samples of all the queries are sorted together, so that
+    the part of the posting list of each distinct kmer within a tile
+    is read only once and applied to the counters of every query in
+    the batch that contains this kmer.
+  */
+
+  unsigned int total = 0;
+  for(unsigned int q = 0; q < si_count; q++)
+    {
+      total += si_list[q]->kmersamplecount;
+      minheap_empty(si_list[q]->m);
+    }
+
+  if (total > sb->alloc)
+    {
+      sb->alloc = total;
+      sb->samples = (uint64_t *) xrealloc(sb->samples,
+                                          sb->alloc * sizeof(uint64_t));
+      sb->cursor = (uint64_t *) xrealloc(sb->cursor,
+                                         sb->alloc * sizeof(uint64_t));
+      sb->run_first = (unsigned int *)
+        xrealloc(sb->run_first, (sb->alloc + 1) * sizeof(unsigned int));
+      sb->counters = (count_t * *) xrealloc(sb->counters,
+                                            sb->alloc * sizeof(count_t *));
+    }
+
+  /* kmer in the upper and query number in the lower 32 bits */
+  unsigned int n = 0;
+  for(unsigned int q = 0; q < si_count; q++)
+    {
+      struct searchinfo_s * si = si_list[q];
+      for(unsigned int i = 0; i < si->kmersamplecount; i++)
         {
-          unsigned int * list = dbindex_getmatchlist(kmer);
-          unsigned int count = dbindex_getmatchcount(kmer);
-          for(unsigned int j = 0; j < count; j++)
-            {
-              si->kmers[list[j]]++;
-            }
+          sb->samples[n++] = ((uint64_t) si->kmersample[i] << 32) | q;
+        }
+    }
+  std::sort(sb->samples, sb->samples + total);
+
+  /* find the runs of samples of each distinct kmer */
+  unsigned int runs = 0;
+  for(unsigned int i = 0; i < total; i++)
+    {
+      auto kmer = (unsigned int) (sb->samples[i] >> 32);
+      auto q = (unsigned int) (sb->samples[i] & 0xffffffff);
+      sb->counters[i] = si_list[q]->kmers;
+
+      if ((i > 0) && ((sb->samples[i - 1] >> 32) == kmer))
+        {
+          continue;
+        }
+
+      sb->run_first[runs] = i;
+      if (kmerpack)
+        {
+          sb->cursor[runs] = kmerpack_offset[kmer];
         }
+      else if (! dbindex_getbitmap(kmer))
+        {
+          sb->cursor[runs] = kmerhash[kmer];
+        }
+      runs++;
     }
+  sb->run_first[runs] = total;
 
-  const int minmatches = MIN(opt_minwordmatches, si->kmersamplecount);
+  const unsigned int indexed_count = dbindex_getcount();
 
-  for(int i = 0; i < indexed_count; i++)
+  for(unsigned int tile_first = 0;
+      tile_first < indexed_count;
+      tile_first += search_tile_size)
     {
-      count_t count = si->kmers[i];
-      if (count >= minmatches)
+      const unsigned int tile_count = MIN(search_tile_size,
+                                          indexed_count - tile_first);
+      const unsigned int tile_end = tile_first + tile_count;
+
+      for(unsigned int q = 0; q < si_count; q++)
         {
-          unsigned int seqno = dbindex_getmapping(i);
-          unsigned int length = db_getsequencelen(seqno);
+          memset(si_list[q]->kmers, 0, tile_count * sizeof(count_t));
+        }
 
-          elem_t novel;
-          novel.count = count;
-          novel.seqno = seqno;
-          novel.length = length;
+      for(unsigned int r = 0; r < runs; r++)
+        {
+          const unsigned int first = sb->run_first[r];
+          const unsigned int last = sb->run_first[r + 1];
+          auto kmer = (unsigned int) (sb->samples[first] >> 32);
+          count_t * * counters = sb->counters;
+          unsigned char * bitmap = dbindex_getbitmap(kmer);
 
-          minheap_add(si->m, & novel);
+          if (kmerpack)
+            {
+              uint64_t end = kmerpack_offset[kmer + 1];
+              unsigned char * p = kmerpack + sb->cursor[r];
+              if ((sb->cursor[r] < end) &&
+                  (dbindex_packed_key(p) == tile_first / dbindex_pack_chunk))
+                {
+                  unsigned char * next = p;
+                  for(unsigned int j = first; j < last; j++)
+                    {
+                      next = dbindex_count_container(counters[j], p);
+                    }
+                  sb->cursor[r] = next - kmerpack;
+                }
+            }
+          else if (bitmap)
+            {
+              bitmap += tile_first / 8;
+              for(unsigned int j = first; j < last; j++)
+                {
+                  increment_counters_from_bitmap(counters[j],
+                                                 bitmap,
+                                                 tile_count);
+                }
+            }
+          else
+            {
+              uint64_t end = kmerhash[kmer] + dbindex_getmatchcount(kmer);
+              uint64_t k = sb->cursor[r];
+              if (last - first == 1)
+                {
+                  count_t * c = counters[first] - tile_first;
+                  while ((k < end) && (kmerindex[k] < tile_end))
+                    {
+                      c[kmerindex[k]]++;
+                      k++;
+                    }
+                }
+              else
+                {
+                  while ((k < end) && (kmerindex[k] < tile_end))
+                    {
+                      unsigned int x = kmerindex[k] - tile_first;
+                      for(unsigned int j = first; j < last; j++)
+                        {
+                          counters[j][x]++;
+                        }
+                      k++;
+                    }
+                }
+              sb->cursor[r] = k;
+            }
+        }
+
+      for(unsigned int q = 0; q < si_count; q++)
+        {
+          search_topscores_tile(si_list[q], tile_first, tile_count);
         }
     }
 
-  minheap_sort(si->m);
+  for(unsigned int q = 0; q < si_count; q++)
+    {
+      minheap_sort(si_list[q]->m);
+    }
 }
 
 int seqncmp(char * a, char * b, uint64_t n)
@@ -309,52 +519,36 @@ void align_trim(struct hit * hit)
 
   /* left trim alignment */
 
-  char * p = hit->nwalignment;
-  char op;
-  int64_t run;
-  if (*p)
+  cigar_t * p = hit->nwalignment;
+  if (*p and (cigar_op(*p) != 'M'))
     {
-      run = 1;
-      int scanlength = 0;
-      sscanf(p, "%" PRId64 "%n", &run, &scanlength);
-      op = *(p+scanlength);
-      if (op != 'M')
+      hit->trim_aln_left = 1;
+      if (cigar_op(*p) == 'D')
         {
-          hit->trim_aln_left = 1 + scanlength;
-          if (op == 'D')
-            {
-              hit->trim_q_left = run;
-            }
-          else
-            {
-              hit->trim_t_left = run;
-            }
+          hit->trim_q_left = cigar_run(*p);
+        }
+      else
+        {
+          hit->trim_t_left = cigar_run(*p);
         }
     }
 
   /* right trim alignment */
 
-  char * e = hit->nwalignment + strlen(hit->nwalignment);
-  if (e > hit->nwalignment)
+  int64_t count = cigar_count(hit->nwalignment);
+  if (count > 0)
     {
-      p = e - 1;
-      op = *p;
-      if (op != 'M')
+      p = hit->nwalignment + count - 1;
+      if (cigar_op(*p) != 'M')
         {
-          while ((p > hit->nwalignment) && (*(p-1) <= '9'))
+          hit->trim_aln_right = 1;
+          if (cigar_op(*p) == 'D')
             {
-              --p;
-            }
-          run = 1;
-          sscanf(p, "%" PRId64, &run);
-          hit->trim_aln_right = e - p;
-          if (op == 'D')
-            {
-              hit->trim_q_right = run;
+              hit->trim_q_right = cigar_run(*p);
             }
           else
             {
-              hit->trim_t_right = run;
+              hit->trim_t_right = cigar_run(*p);
             }
         }
     }
@@ -574,7 +768,7 @@ void align_delayed(struct searchinfo_s * si)
   unsigned short nwmatches_list[MAXDELAYED];
   unsigned short nwmismatches_list[MAXDELAYED];
   unsigned short nwgaps_list[MAXDELAYED];
-  char * nwcigar_list[MAXDELAYED];
+  cigar_t * nwcigar_list[MAXDELAYED];
 
   int target_count = 0;
 
@@ -618,7 +812,7 @@ void align_delayed(struct searchinfo_s * si)
               int64_t target = hit->target;
               int64_t nwscore = nwscore_list[i];
 
-              char * nwcigar;
+              cigar_t * nwcigar;
               int64_t nwalignmentlength;
               int64_t nwmatches;
               int64_t nwmismatches;
@@ -634,15 +828,11 @@ void align_delayed(struct searchinfo_s * si)
 
                   char * dseq = db_getsequence(target);
 
-                  if (nwcigar_list[i])
-                    {
-                      xfree(nwcigar_list[i]);
-                    }
-
-                  nwcigar = xstrdup(si->lma->align(si->qsequence,
-                                                   dseq,
-                                                   si->qseqlen,
-                                                   dseqlen));
+                  nwcigar = cigar_arena_dup(si->arena,
+                                            si->lma->align(si->qsequence,
+                                                           dseq,
+                                                           si->qseqlen,
+                                                           dseqlen));
 
                   si->lma->alignstats(nwcigar,
                                       si->qsequence,
@@ -694,26 +884,17 @@ void align_delayed(struct searchinfo_s * si)
         }
     }
 
-  /* free ignored alignments */
-  while (i < target_count)
-    {
-      xfree(nwcigar_list[i++]);
-    }
-
   si->finalized = si->hit_count;
 }
 
-void search_onequery(struct searchinfo_s * si, int seqmask)
+void search_scratch_init(struct searchinfo_s * si)
 {
-  si->hit_count = 0;
-
-  search16_qprep(si->s, si->qsequence, si->qseqlen);
+  /* state reused by every query searched with si: the linear memory
+     aligner, its score matrix and the arena holding the alignments */
 
   si->lma = new LinearMemoryAligner;
-
-  int64_t * scorematrix = si->lma->scorematrix_create(opt_match, opt_mismatch);
-
-  si->lma->set_parameters(scorematrix,
+  si->scorematrix = si->lma->scorematrix_create(opt_match, opt_mismatch);
+  si->lma->set_parameters(si->scorematrix,
                           opt_gap_open_query_left,
                           opt_gap_open_target_left,
                           opt_gap_open_query_interior,
@@ -726,20 +907,45 @@ void search_onequery(struct searchinfo_s * si, int seqmask)
                           opt_gap_extension_target_interior,
                           opt_gap_extension_query_right,
                           opt_gap_extension_target_right);
+  si->arena = arena_init();
+  if (si->s)
+    {
+      search16_set_arena(si->s, si->arena);
+    }
+}
+
+void search_scratch_exit(struct searchinfo_s * si)
+{
+  arena_exit(si->arena);
+  delete si->lma;
+  xfree(si->scorematrix);
+}
 
+void search_onequery_kmers(struct searchinfo_s * si, int seqmask)
+{
   /* extract unique kmer samples from query*/
   unique_count(si->uh, opt_wordlength,
                si->qseqlen, si->qsequence,
                & si->kmersamplecount, & si->kmersample, seqmask);
+}
 
-  /* find database sequences with the most kmer hits */
-  search_topscores(si);
-
+void search_onequery_hits(struct searchinfo_s * si)
+{
   /* analyse targets with the highest number of kmer hits */
+
+  si->hit_count = 0;
+
+  /* drop the cigars and hit lists of the previous query */
+  arena_reset(si->arena);
+
+  search16_qprep(si->s, si->qsequence, si->qseqlen);
+
   si->accepts = 0;
   si->rejects = 0;
   si->finalized = 0;
 
+  /* align as many candidates together as the aligner has channels */
+  const int delayed_max = search16_channels(si->s);
   int delayed = 0;
 
   while ((si->finalized + delayed < opt_maxaccepts + opt_maxrejects - 1) &&
@@ -772,7 +978,7 @@ void search_onequery(struct searchinfo_s * si, int seqmask)
 
       si->hit_count++;
 
-      if (delayed == MAXDELAYED)
+      if (delayed == delayed_max)
         {
           align_delayed(si);
           delayed = 0;
@@ -782,9 +988,16 @@ void search_onequery(struct searchinfo_s * si, int seqmask)
     {
       align_delayed(si);
     }
+}
 
-  delete si->lma;
-  xfree(scorematrix);
+void search_onequery(struct searchinfo_s * si, int seqmask)
+{
+  search_onequery_kmers(si, seqmask);
+
+  /* find database sequences with the most kmer hits */
+  search_topscores(si);
+
+  search_onequery_hits(si);
 }
 
 struct hit * search_findbest2_byid(struct searchinfo_s * si_p,
@@ -857,7 +1070,8 @@ void search_joinhits(struct searchinfo_s * si_p,
                      int * hit_count)
 {
   /* join and sort accepted and weak hits from both strands */
-  /* free the remaining alignments */
+  /* the list and its alignments live in the arena of si_p and stay
+     valid until the next query is searched with si_p */
 
   /* first, just count the number of hits to keep */
   int a = 0;
@@ -875,7 +1089,8 @@ void search_joinhits(struct searchinfo_s * si_p,
     }
 
   /* allocate new array of hits */
-  auto * hits = (struct hit *) xmalloc(a * sizeof(struct hit));
+  auto * hits = (struct hit *) arena_alloc(si_p->arena,
+                                           a * sizeof(struct hit));
 
   /* copy over the hits to be kept */
   a = 0;
@@ -889,10 +1104,6 @@ void search_joinhits(struct searchinfo_s * si_p,
             {
               hits[a++] = *h;
             }
-          else if (h->aligned)
-            {
-              xfree(h->nwalignment);
-            }
         }
     }
 
@@ -61,8 +61,9 @@
 #include <array>
 
 
-/* the number of alignments that can be delayed */
-constexpr auto MAXDELAYED = 8U;
+/* the number of alignments that can be delayed, at most one per
+   channel of the widest SIMD aligner (see search16_channels) */
+constexpr auto MAXDELAYED = 32U;
 
 /* Default minimum number of word matches for word lengths 3-15 */
 constexpr std::array<int, 16> minwordmatches_defaults =
@@ -89,7 +90,7 @@ struct hit
   int nwindels;          /* indels in global alignment */
   int nwalignmentlength; /* length of global alignment */
   double nwid;           /* percent identity of global alignment */
-  char * nwalignment;    /* alignment string (cigar) of global alignment */
+  cigar_t * nwalignment; /* packed cigar of global alignment */
   int matches;
   int mismatches;
 
@@ -102,8 +103,8 @@ struct hit
   int trim_q_right;
   int trim_t_left;
   int trim_t_right;
-  int trim_aln_left;
-  int trim_aln_right;
+  int trim_aln_left;     /* cigar words trimmed at the left end */
+  int trim_aln_right;    /* cigar words trimmed at the right end */
 
   /* more info */
 
@@ -131,22 +132,51 @@ struct searchinfo_s
   unsigned int kmersamplecount; /* number of kmer samples from query */
   unsigned int * kmersample;    /* list of kmers sampled from query */
   count_t * kmers;              /* list of kmer counts for each db seq */
+  uint64_t * kmercursor;        /* position in the list of each kmer */
+  unsigned int kmercursor_alloc; /* number of kmer positions allocated */
   struct hit * hits;            /* list of hits */
   int hit_count;                /* number of hits in the above list */
   struct uhandle_s * uh;        /* unique kmer finder instance */
   struct s16info_s * s;         /* SIMD aligner instance */
   struct nwinfo_s * nw;         /* NW aligner instance */
   LinearMemoryAligner * lma;    /* Linear memory aligner instance pointer */
+  int64_t * scorematrix;        /* score matrix of the above aligner */
+  struct arena_s * arena;       /* cigars and hit lists of current query */
   int accepts;                  /* number of accepts */
   int rejects;                  /* number of rejects */
   minheap_t * m;                /* min heap with the top kmer db seqs */
   int finalized;
 };
 
+struct searchbatch_s
+{
+  unsigned int alloc;           /* number of samples allocated */
+  uint64_t * samples;           /* kmer and query of all samples, sorted */
+  uint64_t * cursor;            /* list position of each distinct kmer */
+  unsigned int * run_first;     /* first sample of each distinct kmer */
+  count_t * * counters;         /* counters of the query of each sample */
+};
+
+/* number of database sequences counted at a time by search_topscores */
+constexpr unsigned int search_tile_size = dbindex_pack_chunk;
+
+
+auto search_scratch_init(struct searchinfo_s * si) -> void;
+
+auto search_scratch_exit(struct searchinfo_s * si) -> void;
+
 auto search_topscores(struct searchinfo_s * si) -> void;
 
+auto search_topscores_batch(struct searchbatch_s * sb,
+                            struct searchinfo_s * * si_list,
+                            unsigned int si_count) -> void;
+
 auto search_onequery(struct searchinfo_s * si, int seqmask) -> void;
 
+auto search_onequery_kmers(struct searchinfo_s * si, int seqmask) -> void;
+
+auto search_onequery_hits(struct searchinfo_s * si) -> void;
+
 auto search_findbest2_byid(struct searchinfo_s * si_p,
                            struct searchinfo_s * si_m) -> struct hit *;
 
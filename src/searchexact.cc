@@ -70,8 +70,9 @@ static int seqcount; /* number of database sequences */
 static pthread_attr_t attr;
 static fastx_handle query_fastx_h;
 
+static struct scheduler_s * sched;
+
 /* global data protected by mutex */
-static pthread_mutex_t mutex_input;
 static pthread_mutex_t mutex_output;
 static int qmatches;
 static uint64 qmatches_abundance;
@@ -118,11 +119,8 @@ void add_hit(struct searchinfo_s * si, uint64_t seqno)
       hp->matches = si->qseqlen;
       hp->mismatches = 0;
 
-      int ret = xsprintf(&hp->nwalignment, "%dM", si->qseqlen);
-      if ((ret == -1) || (!hp->nwalignment))
-        {
-          fatal("Out of memory");
-        }
+      cigar_t cigar[2] = { cigar_pack('M', si->qseqlen), 0 };
+      hp->nwalignment = cigar_arena_dup(si->arena, cigar);
 
       hp->internal_alignmentlength = si->qseqlen;
       hp->internal_gaps = 0;
@@ -159,7 +157,11 @@ void search_exact_onequery(struct searchinfo_s * si)
 
   char * seq = si->qsequence;
   uint64_t seqlen = si->qseqlen;
-  char * normalized = (char*) xmalloc(seqlen+1);
+
+  /* drop the cigars and hit lists of the previous query */
+  arena_reset(si->arena);
+
+  auto * normalized = (char *) arena_alloc(si->arena, seqlen + 1);
   string_normalize(normalized, seq, seqlen);
 
   si->hit_count = 0;
@@ -170,7 +172,6 @@ void search_exact_onequery(struct searchinfo_s * si)
       add_hit(si, ret);
       ret = dbhash_search_next(&info);
     }
-  xfree(normalized);
 }
 
 void search_exact_output_results(int hit_count,
@@ -405,106 +406,78 @@ int search_exact_query(int64_t t)
                               opt_strand > 1 ? si_minus[t].qsequence : nullptr,
                               si_plus[t].qsize);
 
-  /* free memory for alignment strings */
-  for(int i=0; i<hit_count; i++)
-    {
-      if (hits[i].aligned)
-        {
-          xfree(hits[i].nwalignment);
-        }
-    }
-
-  xfree(hits);
+  /* the hits and their alignments are released with the next query */
 
   return hit_count;
 }
 
 void search_exact_thread_run(int64_t t)
 {
-  while (true)
+  struct sched_query_s * * batch;
+
+  while (scheduler_next(sched, t, & batch) > 0)
     {
-      xpthread_mutex_lock(&mutex_input);
+      struct sched_query_s * query = batch[0];
 
-      if (fastx_next(query_fastx_h, ! opt_notrunclabels, chrmap_no_change))
+      for (int s = 0; s < opt_strand; s++)
         {
-          char * qhead = fastx_get_header(query_fastx_h);
-          int query_head_len = fastx_get_header_length(query_fastx_h);
-          char * qseq = fastx_get_sequence(query_fastx_h);
-          int qseqlen = fastx_get_sequence_length(query_fastx_h);
-          int query_no = fastx_get_seqno(query_fastx_h);
-          int qsize = fastx_get_abundance(query_fastx_h);
-
-          for (int s = 0; s < opt_strand; s++)
-            {
-              struct searchinfo_s * si = s ? si_minus+t : si_plus+t;
-
-              si->query_head_len = query_head_len;
-              si->qseqlen = qseqlen;
-              si->query_no = query_no;
-              si->qsize = qsize;
-              si->strand = s;
+          struct searchinfo_s * si = s ? si_minus+t : si_plus+t;
 
-              /* allocate more memory for header and sequence, if necessary */
+          si->query_head_len = query->header_len;
+          si->qseqlen = query->sequence_len;
+          si->query_no = query->seqno;
+          si->qsize = query->size;
+          si->strand = s;
 
-              if (si->query_head_len + 1 > si->query_head_alloc)
-                {
-                  si->query_head_alloc = si->query_head_len + 2001;
-                  si->query_head = (char*)
-                    xrealloc(si->query_head, (size_t)(si->query_head_alloc));
-                }
+          /* allocate more memory for header and sequence, if necessary */
 
-              if (si->qseqlen + 1 > si->seq_alloc)
-                {
-                  si->seq_alloc = si->qseqlen + 2001;
-                  si->qsequence = (char*)
-                    xrealloc(si->qsequence, (size_t)(si->seq_alloc));
-                }
+          if (si->query_head_len + 1 > si->query_head_alloc)
+            {
+              si->query_head_alloc = si->query_head_len + 2001;
+              si->query_head = (char*)
+                xrealloc(si->query_head, (size_t)(si->query_head_alloc));
             }
 
-          /* plus strand: copy header and sequence */
-          strcpy(si_plus[t].query_head, qhead);
-          strcpy(si_plus[t].qsequence, qseq);
-
-          /* get progress as amount of input file read */
-          uint64_t progress = fastx_get_position(query_fastx_h);
-
-          /* let other threads read input */
-          xpthread_mutex_unlock(&mutex_input);
-
-          /* minus strand: copy header and reverse complementary sequence */
-          if (opt_strand > 1)
+          if (si->qseqlen + 1 > si->seq_alloc)
             {
-              strcpy(si_minus[t].query_head, si_plus[t].query_head);
-              reverse_complement(si_minus[t].qsequence,
-                                 si_plus[t].qsequence,
-                                 si_plus[t].qseqlen);
+              si->seq_alloc = si->qseqlen + 2001;
+              si->qsequence = (char*)
+                xrealloc(si->qsequence, (size_t)(si->seq_alloc));
             }
+        }
 
-          int match = search_exact_query(t);
+      /* plus strand: copy header and sequence */
+      strcpy(si_plus[t].query_head, query->header);
+      strcpy(si_plus[t].qsequence, query->sequence);
 
-          /* lock mutex for update of global data and output */
-          xpthread_mutex_lock(&mutex_output);
+      /* minus strand: copy header and reverse complementary sequence */
+      if (opt_strand > 1)
+        {
+          strcpy(si_minus[t].query_head, si_plus[t].query_head);
+          reverse_complement(si_minus[t].qsequence,
+                             si_plus[t].qsequence,
+                             si_plus[t].qseqlen);
+        }
 
-          /* update stats */
-          queries++;
-          queries_abundance += qsize;
+      int match = search_exact_query(t);
 
-          if (match)
-            {
-              qmatches++;
-              qmatches_abundance += qsize;
-            }
+      /* lock mutex for update of global data and output */
+      xpthread_mutex_lock(&mutex_output);
 
-          /* show progress */
-          progress_update(progress);
+      /* update stats */
+      queries++;
+      queries_abundance += query->size;
 
-          xpthread_mutex_unlock(&mutex_output);
-        }
-      else
+      if (match)
         {
-          xpthread_mutex_unlock(&mutex_input);
-          break;
+          qmatches++;
+          qmatches_abundance += query->size;
         }
+
+      /* show progress */
+      progress_update(query->progress);
+
+      xpthread_mutex_unlock(&mutex_output);
     }
 }
 
@@ -513,6 +486,8 @@ void search_exact_thread_init(struct searchinfo_s * si)
   /* thread specific initialiation */
   si->uh = nullptr;
   si->kmers = nullptr;
+  si->kmercursor = nullptr;
+  si->kmercursor_alloc = 0;
   si->m = nullptr;
   si->hits = (struct hit *) xmalloc
     (sizeof(struct hit) * (tophits) * opt_strand);
@@ -523,11 +498,13 @@ void search_exact_thread_init(struct searchinfo_s * si)
   si->qsequence = nullptr;
   si->nw = nullptr;
   si->s = nullptr;
+  search_scratch_init(si);
 }
 
 void search_exact_thread_exit(struct searchinfo_s * si)
 {
   /* thread specific clean up */
+  search_scratch_exit(si);
   xfree(si->hits);
   if (si->query_head)
     {
@@ -579,6 +556,27 @@ void search_exact_thread_worker_run()
   xpthread_attr_destroy(&attr);
 }
 
+void search_exact_load_db()
+{
+  /* read and mask the database and build the sequence hash */
+
+  db_read(opt_db, 0);
+
+  if (opt_dbmask == MASK_DUST)
+    {
+      dust_all();
+    }
+  else if ((opt_dbmask == MASK_SOFT) && (opt_hardmask))
+    {
+      hardmask_all();
+    }
+
+  show_rusage();
+
+  dbhash_open(db_getsequencecount());
+  dbhash_add_all();
+}
+
 void search_exact_prep(char * cmdline, char * progheader)
 {
   /* open output files */
@@ -721,20 +719,12 @@ void search_exact_prep(char * cmdline, char * progheader)
         }
     }
 
-  db_read(opt_db, 0);
-
-  results_show_samheader(fp_samout, cmdline, opt_db);
-
-  if (opt_dbmask == MASK_DUST)
+  if (! server_db_loaded())
     {
-      dust_all();
-    }
-  else if ((opt_dbmask == MASK_SOFT) && (opt_hardmask))
-    {
-      hardmask_all();
+      search_exact_load_db();
     }
 
-  show_rusage();
+  results_show_samheader(fp_samout, cmdline, opt_db);
 
   seqcount = db_getsequencecount();
 
@@ -743,9 +733,6 @@ void search_exact_prep(char * cmdline, char * progheader)
 
   dbmatched = (uint64*) xmalloc(seqcount * sizeof(uint64*));
   memset(dbmatched, 0, seqcount * sizeof(uint64*));
-
-  dbhash_open(seqcount);
-  dbhash_add_all();
 }
 
 void search_exact_done()
@@ -838,8 +825,8 @@ void search_exact(char * cmdline, char * progheader)
 
   pthread = (pthread_t *) xmalloc(opt_threads * sizeof(pthread_t));
 
-  /* init mutexes for input and output */
-  xpthread_mutex_init(&mutex_input, nullptr);
+  /* init scheduler for input and mutex for output */
+  sched = scheduler_init_fastx(query_fastx_h, opt_threads, 1);
   xpthread_mutex_init(&mutex_output, nullptr);
 
   progress_init("Searching", fastx_get_size(query_fastx_h));
@@ -847,7 +834,7 @@ void search_exact(char * cmdline, char * progheader)
   progress_done();
 
   xpthread_mutex_destroy(&mutex_output);
-  xpthread_mutex_destroy(&mutex_input);
+  scheduler_exit(sched);
 
   xfree(pthread);
   xfree(si_plus);
@@ -59,3 +59,4 @@
 */
 
 auto search_exact(char * cmdline, char * progheader) -> void;
+auto search_exact_load_db() -> void;
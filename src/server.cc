@@ -0,0 +1,876 @@
+/*
+
+  VSEARCH: a versatile open source tool for metagenomics
+
+  Copyright (C) 2014-2024, Torbjorn Rognes, Frederic Mahe and Tomas Flouri
+  All rights reserved.
+
+  Contact: Torbjorn Rognes <torognes@ifi.uio.no>,
+  Department of Informatics, University of Oslo,
+  PO Box 1080 Blindern, NO-0316 Oslo, Norway
+
+  This software is dual-licensed and available under a choice
+  of one of two licenses, either under the terms of the GNU
+  General Public License version 3 or the BSD 2-Clause License.
+
+
+  GNU General Public License version 3
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+  The BSD 2-Clause License
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+
+  1. Redistributions of source code must retain the above copyright
+  notice, this list of conditions and the following disclaimer.
+
+  2. Redistributions in binary form must reproduce the above copyright
+  notice, this list of conditions and the following disclaimer in the
+  documentation and/or other materials provided with the distribution.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+  COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include "vsearch.h"
+#include <cerrno>  // errno, EINTR
+#include <csignal>  // sigaction, SIGINT, SIGTERM, SIGPIPE, SIGCHLD
+#include <cstdio>  // std::FILE, std::fprintf
+#include <cstring>  // std::strcmp, std::strlen, std::strncmp, std::memset
+#include <ctime>  // std::time
+
+#include <vector>  // std::vector
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#endif
+
+/*
+  Resident server mode (--server SOCKET)
+
+  The master process listens on a Unix domain socket. A client sends
+  one line with the options of a usearch_global, search_exact or
+  sintax command, with the query file given as "-", followed by the
+  query sequences, and then shuts down its side of the connection.
+  Output files given as "-" are written back on the connection, which
+  is closed when the command has finished.
+
+  For each kind of command, the master starts a worker process the
+  first time such a request arrives. The worker reads and indexes the
+  database once, with the database options given to the server, and
+  then waits for connections passed to it by the master. Each request
+  is run by a process forked from the worker, which shares the
+  database and index with it, so no time is spent reading or indexing
+  the database. Any options affecting the database are taken from the
+  server and ignored in the requests.
+*/
+
+constexpr int server_kinds = 3;
+constexpr int server_kind_usearch_global = 0;
+constexpr int server_kind_search_exact = 1;
+constexpr int server_kind_sintax = 2;
+constexpr int server_line_max = 65536;
+constexpr int server_line_timeout = 10; /* seconds */
+
+static const char * server_commands[server_kinds] =
+  { "usearch_global", "search_exact", "sintax" };
+
+/* options passed from the server to the workers, and their commands */
+
+struct server_option_s
+{
+  const char * name;
+  bool has_argument;
+  bool valid[server_kinds];
+};
+
+static const struct server_option_s server_options[] =
+  {
+    { "db",             true,  { true,  true,  true  } },
+    { "dbcache",        true,  { true,  false, true  } },
+    { "dbmask",         true,  { true,  true,  true  } },
+    { "dbshm",          true,  { true,  false, true  } },
+    { "hardmask",       false, { true,  true,  false } },
+    { "index_compress", false, { true,  false, true  } },
+    { "maxseqlength",   true,  { true,  true,  true  } },
+    { "minseqlength",   true,  { true,  true,  true  } },
+    { "notrunclabels",  false, { true,  true,  true  } },
+    { "quiet",          false, { true,  true,  true  } },
+    { "wordlength",     true,  { true,  false, true  } }
+  };
+
+static bool server_db_is_loaded = false;
+
+auto server_db_loaded() -> bool
+{
+  return server_db_is_loaded;
+}
+
+#ifdef _WIN32
+
+auto server(int argc, char ** argv) -> void
+{
+  (void) argc;
+  (void) argv;
+  fatal("The --server command is not supported on Windows");
+}
+
+#else
+
+/* database settings of a worker, restored after parsing a request */
+
+struct server_dbopts_s
+{
+  char * db;
+  char * dbcache;
+  char * dbshm;
+  int dbmask;
+  bool hardmask;
+  bool index_compress;
+  int64_t maxseqlength;
+  int64_t minseqlength;
+  int64_t notrunclabels;
+  int64_t wordlength;
+};
+
+static struct server_dbopts_s server_dbopts;
+static volatile sig_atomic_t server_quit = 0;
+
+auto server_signal_handler(int signum) -> void
+{
+  (void) signum;
+  server_quit = 1;
+}
+
+auto server_args_init(int argc, char ** argv) -> void
+{
+  /* parse the options again, from the start */
+
+#if defined(__APPLE__) || defined(__FreeBSD__) || defined(__NetBSD__)
+  optreset = 1;
+  optind = 1;
+#else
+  optind = 0;
+#endif
+
+  args_init(argc, argv);
+}
+
+auto server_split(char * line, int * argc) -> char * *
+{
+  /* split a line into words separated by white space, in place */
+
+  int max = 2;
+  for (char * p = line; *p; p++)
+    {
+      if ((*p == ' ') || (*p == '\t') || (*p == '\r'))
+        {
+          max++;
+        }
+    }
+
+  auto * argv = (char * *) xmalloc((max + 1) * sizeof(char *));
+  int count = 0;
+  argv[count++] = (char *) PROG_NAME;
+
+  char * p = line;
+  while (*p)
+    {
+      while ((*p == ' ') || (*p == '\t') || (*p == '\r'))
+        {
+          *p++ = 0;
+        }
+      if (*p)
+        {
+          argv[count++] = p;
+          while (*p && (*p != ' ') && (*p != '\t') && (*p != '\r'))
+            {
+              p++;
+            }
+        }
+    }
+  argv[count] = nullptr;
+  *argc = count;
+  return argv;
+}
+
+/* a connection of which the request line has not been read yet */
+
+struct server_pending_s
+{
+  int fd;
+  int len;
+  time_t deadline;
+  char * line;
+  bool rejected;       /* the rest is read and discarded */
+};
+
+constexpr int server_line_done = 1;
+constexpr int server_line_partial = 0;
+constexpr int server_line_failed = -1;
+
+auto server_read_line(struct server_pending_s * c) -> int
+{
+  /*
+    read as much of the request line as is available, byte by byte to
+    leave the queries unread, without waiting for the client
+  */
+
+  while (c->rejected)
+    {
+      ssize_t n = read(c->fd, c->line, server_line_max);
+      if (n < 0 && errno == EINTR)
+        {
+          continue;
+        }
+      if (n < 0 && ((errno == EAGAIN) || (errno == EWOULDBLOCK)))
+        {
+          return server_line_partial;
+        }
+      if (n <= 0)
+        {
+          return server_line_failed;
+        }
+    }
+
+  while (c->len < server_line_max - 1)
+    {
+      char ch = 0;
+      ssize_t n = read(c->fd, & ch, 1);
+      if (n < 0 && errno == EINTR)
+        {
+          continue;
+        }
+      if (n < 0 && ((errno == EAGAIN) || (errno == EWOULDBLOCK)))
+        {
+          return server_line_partial;
+        }
+      if (n <= 0)
+        {
+          return server_line_failed;
+        }
+      if (ch == '\n')
+        {
+          c->line[c->len] = 0;
+          return server_line_done;
+        }
+      c->line[c->len++] = ch;
+    }
+  return server_line_failed;
+}
+
+auto server_request_kind(const char * line) -> int
+{
+  /* the command must come first, with "-" as the query file */
+
+  for (int k = 0; k < server_kinds; k++)
+    {
+      const char * p = line;
+      while ((*p == ' ') || (*p == '\t'))
+        {
+          p++;
+        }
+      if (*p == '-')
+        {
+          p++;
+        }
+      if (*p == '-')
+        {
+          p++;
+        }
+      size_t len = strlen(server_commands[k]);
+      if ((strncmp(p, server_commands[k], len) == 0) &&
+          ((p[len] == ' ') || (p[len] == '\t')))
+        {
+          p += len;
+          while ((*p == ' ') || (*p == '\t'))
+            {
+              p++;
+            }
+          if ((p[0] == '-') &&
+              ((p[1] == 0) || (p[1] == ' ') || (p[1] == '\t') || (p[1] == '\r')))
+            {
+              return k;
+            }
+        }
+    }
+  return -1;
+}
+
+auto server_send_fd(int channel, int fd, const char * line) -> bool
+{
+  /* pass the connection and the request line to a worker */
+
+  struct iovec iov;
+  iov.iov_base = (void *) line;
+  iov.iov_len = strlen(line) + 1;
+
+  union
+  {
+    struct cmsghdr align;
+    char buf[CMSG_SPACE(sizeof(int))];
+  } control;
+  memset(& control, 0, sizeof(control));
+
+  struct msghdr msg;
+  memset(& msg, 0, sizeof(msg));
+  msg.msg_iov = & iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control.buf;
+  msg.msg_controllen = sizeof(control.buf);
+
+  struct cmsghdr * cmsg = CMSG_FIRSTHDR(& msg);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+  memcpy(CMSG_DATA(cmsg), & fd, sizeof(int));
+
+  return sendmsg(channel, & msg, 0) >= 0;
+}
+
+auto server_receive_fd(int channel, char * line) -> int
+{
+  /* receive a connection and its request line, -1 when finished */
+
+  struct iovec iov;
+  iov.iov_base = line;
+  iov.iov_len = server_line_max;
+
+  union
+  {
+    struct cmsghdr align;
+    char buf[CMSG_SPACE(sizeof(int))];
+  } control;
+
+  struct msghdr msg;
+  memset(& msg, 0, sizeof(msg));
+  msg.msg_iov = & iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control.buf;
+  msg.msg_controllen = sizeof(control.buf);
+
+  ssize_t n = 0;
+  do
+    {
+      n = recvmsg(channel, & msg, 0);
+    }
+  while ((n < 0) && (errno == EINTR));
+
+  struct cmsghdr * cmsg = CMSG_FIRSTHDR(& msg);
+  if ((n <= 0) || (! cmsg) || (cmsg->cmsg_type != SCM_RIGHTS))
+    {
+      return -1;
+    }
+
+  line[server_line_max - 1] = 0;
+  int fd = -1;
+  memcpy(& fd, CMSG_DATA(cmsg), sizeof(int));
+  return fd;
+}
+
+auto server_request_exit() -> void
+{
+  /*
+    send all output, including any error message, and consume the rest
+    of the queries, so that the connection is not reset before the
+    client has read the reply
+  */
+
+  fflush(stdout);
+  fflush(stderr);
+  shutdown(STDOUT_FILENO, SHUT_WR);
+
+  char buffer[4096];
+  ssize_t n = 0;
+  do
+    {
+      n = read(STDIN_FILENO, buffer, sizeof(buffer));
+    }
+  while ((n > 0) || ((n < 0) && (errno == EINTR)));
+}
+
+auto server_run_request(int kind, int fd, char * line) -> void
+{
+  /* run one request in a process forked from a worker */
+
+  if ((dup2(fd, STDIN_FILENO) < 0) || (dup2(fd, STDOUT_FILENO) < 0))
+    {
+      fatal("Unable to redirect input and output to connection");
+    }
+
+  /* errors and warnings are reported to the client */
+
+  if (dup2(fd, STDERR_FILENO) < 0)
+    {
+      fatal("Unable to redirect errors to connection");
+    }
+  close(fd);
+  atexit(server_request_exit);
+
+  int argc = 0;
+  char ** argv = server_split(line, & argc);
+
+  server_args_init(argc, argv);
+  getentirecommandline(argc, argv);
+  cpu_features_limit();
+  random_init();
+
+  if (opt_log)
+    {
+      fatal("The --log option is not supported in server requests");
+    }
+
+  opt_quiet = true;
+
+  opt_db = server_dbopts.db;
+  opt_dbcache = server_dbopts.dbcache;
+  opt_dbshm = server_dbopts.dbshm;
+  opt_dbmask = server_dbopts.dbmask;
+  opt_hardmask = server_dbopts.hardmask;
+  opt_index_compress = server_dbopts.index_compress;
+  opt_maxseqlength = server_dbopts.maxseqlength;
+  opt_minseqlength = server_dbopts.minseqlength;
+  opt_notrunclabels = server_dbopts.notrunclabels;
+  opt_wordlength = server_dbopts.wordlength;
+
+  switch (kind)
+    {
+    case server_kind_usearch_global:
+      cmd_usearch_global();
+      break;
+    case server_kind_search_exact:
+      cmd_search_exact();
+      break;
+    case server_kind_sintax:
+      sintax();
+      break;
+    }
+
+  xfree(argv);
+  fflush(stdout);
+  exit(EXIT_SUCCESS);
+}
+
+auto server_worker(int kind, int channel, int argc, char ** argv) -> void
+{
+  /* load the database for one kind of command and serve requests */
+
+  int wargc = 0;
+  auto * wargv = (char * *) xmalloc((argc + 3) * sizeof(char *));
+  char command[32];
+  snprintf(command, sizeof(command), "--%s", server_commands[kind]);
+  wargv[wargc++] = argv[0];
+  wargv[wargc++] = command;
+  wargv[wargc++] = (char *) "-";
+
+  for (int i = 1; i < argc; i++)
+    {
+      const char * name = argv[i] + ((argv[i][1] == '-') ? 2 : 1);
+      for (auto const & option : server_options)
+        {
+          if (strcmp(name, option.name) == 0)
+            {
+              if (option.valid[kind])
+                {
+                  wargv[wargc++] = argv[i];
+                  if (option.has_argument)
+                    {
+                      wargv[wargc++] = argv[i + 1];
+                    }
+                }
+              if (option.has_argument)
+                {
+                  i++;
+                }
+              break;
+            }
+        }
+    }
+  wargv[wargc] = nullptr;
+
+  server_args_init(wargc, wargv);
+
+  switch (kind)
+    {
+    case server_kind_usearch_global:
+      search_load_db();
+      break;
+    case server_kind_search_exact:
+      search_exact_load_db();
+      break;
+    case server_kind_sintax:
+      sintax_load_db();
+      break;
+    }
+
+  server_db_is_loaded = true;
+
+  server_dbopts.db = opt_db;
+  server_dbopts.dbcache = opt_dbcache;
+  server_dbopts.dbshm = opt_dbshm;
+  server_dbopts.dbmask = opt_dbmask;
+  server_dbopts.hardmask = opt_hardmask;
+  server_dbopts.index_compress = opt_index_compress;
+  server_dbopts.maxseqlength = opt_maxseqlength;
+  server_dbopts.minseqlength = opt_minseqlength;
+  server_dbopts.notrunclabels = opt_notrunclabels;
+  server_dbopts.wordlength = opt_wordlength;
+
+  if (! opt_quiet)
+    {
+      fprintf(stderr, "Ready for %s requests\n", server_commands[kind]);
+    }
+
+  /* request processes are reaped automatically */
+
+  signal(SIGCHLD, SIG_IGN);
+
+  auto * line = (char *) xmalloc(server_line_max);
+
+  while (true)
+    {
+      int fd = server_receive_fd(channel, line);
+      if (fd < 0)
+        {
+          break;
+        }
+
+      pid_t pid = fork();
+      if (pid == 0)
+        {
+          close(channel);
+          signal(SIGCHLD, SIG_DFL);
+          server_run_request(kind, fd, line);
+        }
+      else if (pid < 0)
+        {
+          fprintf(stderr, "WARNING: Unable to start process for request\n");
+        }
+      close(fd);
+    }
+
+  xfree(line);
+  exit(EXIT_SUCCESS);
+}
+
+auto server_check_options(int argc, char ** argv) -> void
+{
+  /* options are passed on to the workers by their full names */
+
+  for (int i = 1; i < argc; i++)
+    {
+      const char * arg = argv[i];
+      if (arg[0] != '-')
+        {
+          fatal("Unrecognized string on command line (%s)", arg);
+        }
+      const char * name = arg + ((arg[1] == '-') ? 2 : 1);
+      if (strcmp(name, "server") == 0)
+        {
+          i++;
+          continue;
+        }
+      bool found = false;
+      for (auto const & option : server_options)
+        {
+          if (strcmp(name, option.name) == 0)
+            {
+              found = true;
+              if (option.has_argument)
+                {
+                  i++;
+                }
+              break;
+            }
+        }
+      if (! found)
+        {
+          fatal("Options to --server must be given separately and by their full names (%s)",
+                arg);
+        }
+    }
+}
+
+auto server(int argc, char ** argv) -> void
+{
+  if (! opt_db)
+    {
+      fatal("Database filename not specified with --db");
+    }
+
+  server_check_options(argc, argv);
+
+  struct sockaddr_un addr;
+  memset(& addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if (strlen(opt_server) >= sizeof(addr.sun_path))
+    {
+      fatal("Socket path too long (%s)", opt_server);
+    }
+  strcpy(addr.sun_path, opt_server);
+
+  /* replace a socket left behind by an earlier server */
+
+  xstat_t fs;
+  if ((xstat(opt_server, & fs) == 0) && S_ISSOCK(fs.st_mode))
+    {
+      unlink(opt_server);
+    }
+
+  int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (listener < 0)
+    {
+      fatal("Unable to create socket");
+    }
+
+  mode_t old_umask = umask(S_IRWXG | S_IRWXO);
+  if (bind(listener, (struct sockaddr *) & addr, sizeof(addr)) ||
+      listen(listener, 64))
+    {
+      fatal("Unable to listen on socket (%s)", opt_server);
+    }
+  umask(old_umask);
+
+  struct sigaction sa;
+  memset(& sa, 0, sizeof(sa));
+  sa.sa_handler = server_signal_handler;
+  sigemptyset(& sa.sa_mask);
+  sigaction(SIGINT, & sa, nullptr);
+  sigaction(SIGTERM, & sa, nullptr);
+  signal(SIGPIPE, SIG_IGN);
+
+  if (! opt_quiet)
+    {
+      fprintf(stderr, "Listening on socket %s\n", opt_server);
+    }
+
+  pid_t worker_pid[server_kinds];
+  int worker_channel[server_kinds];
+  for (int k = 0; k < server_kinds; k++)
+    {
+      worker_pid[k] = 0;
+      worker_channel[k] = -1;
+    }
+
+  /*
+    The request lines are read from all pending connections as they
+    arrive, so that a slow or silent client never delays the others.
+  */
+
+  std::vector<struct server_pending_s> pending;
+  std::vector<struct pollfd> pollfds;
+
+  while (! server_quit)
+    {
+      pollfds.clear();
+      struct pollfd pfd;
+      pfd.fd = listener;
+      pfd.events = POLLIN;
+      pfd.revents = 0;
+      pollfds.push_back(pfd);
+      for (auto const & c : pending)
+        {
+          pfd.fd = c.fd;
+          pollfds.push_back(pfd);
+        }
+
+      if (poll(pollfds.data(), pollfds.size(), pending.empty() ? -1 : 1000) < 0)
+        {
+          continue;
+        }
+
+      /* forget workers that have terminated */
+
+      pid_t pid = 0;
+      while ((pid = waitpid(-1, nullptr, WNOHANG)) > 0)
+        {
+          for (int k = 0; k < server_kinds; k++)
+            {
+              if (worker_pid[k] == pid)
+                {
+                  close(worker_channel[k]);
+                  worker_pid[k] = 0;
+                  worker_channel[k] = -1;
+                }
+            }
+        }
+
+      /* read from the pending connections, then accept new ones */
+
+      const time_t now = time(nullptr);
+      std::vector<struct server_pending_s> waiting;
+
+      for (size_t i = 0; i < pending.size(); i++)
+        {
+          struct server_pending_s c = pending[i];
+
+          int status = server_line_partial;
+          if (pollfds[i + 1].revents)
+            {
+              status = server_read_line(& c);
+            }
+          else if (now > c.deadline)
+            {
+              status = server_line_failed;
+            }
+
+          if (status == server_line_partial)
+            {
+              waiting.push_back(c);
+              continue;
+            }
+
+          int kind = -1;
+          if ((status == server_line_done) && ! c.rejected)
+            {
+              kind = server_request_kind(c.line);
+            }
+
+          if ((kind < 0) && (status == server_line_done))
+            {
+              /* tell the client, and discard the queries it sends */
+
+              static const char message[] =
+                "\n\nFatal error: Request must start with "
+                "--usearch_global, --search_exact or --sintax and -\n";
+              fprintf(stderr,
+                      "WARNING: Ignoring request not starting with "
+                      "--usearch_global, --search_exact or --sintax and -\n");
+              send(c.fd, message, sizeof(message) - 1, MSG_DONTWAIT);
+              shutdown(c.fd, SHUT_WR);
+              c.rejected = true;
+              c.deadline = now + server_line_timeout;
+              waiting.push_back(c);
+              continue;
+            }
+
+          if (kind < 0)
+            {
+              close(c.fd);
+              xfree(c.line);
+              continue;
+            }
+
+          /* the connection is passed on in blocking mode */
+
+          fcntl(c.fd, F_SETFL, fcntl(c.fd, F_GETFL) & ~O_NONBLOCK);
+
+          if (! worker_pid[kind])
+            {
+              int channel[2];
+              if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, channel))
+                {
+                  fatal("Unable to create socket pair");
+                }
+              pid = fork();
+              if (pid < 0)
+                {
+                  fatal("Unable to start worker process");
+                }
+              if (pid == 0)
+                {
+                  close(listener);
+                  close(channel[0]);
+                  for (int k = 0; k < server_kinds; k++)
+                    {
+                      if (worker_channel[k] >= 0)
+                        {
+                          close(worker_channel[k]);
+                        }
+                    }
+                  for (size_t j = i; j < pending.size(); j++)
+                    {
+                      close(pending[j].fd);
+                    }
+                  for (auto const & other : waiting)
+                    {
+                      close(other.fd);
+                    }
+                  signal(SIGINT, SIG_DFL);
+                  signal(SIGTERM, SIG_DFL);
+                  server_worker(kind, channel[1], argc, argv);
+                }
+              close(channel[1]);
+              worker_pid[kind] = pid;
+              worker_channel[kind] = channel[0];
+            }
+
+          if (! server_send_fd(worker_channel[kind], c.fd, c.line))
+            {
+              fprintf(stderr, "WARNING: Unable to pass request to worker\n");
+            }
+          close(c.fd);
+          xfree(c.line);
+        }
+
+      pending.swap(waiting);
+
+      if (pollfds[0].revents & POLLIN)
+        {
+          int fd = accept(listener, nullptr, nullptr);
+          if (fd >= 0)
+            {
+              fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+              struct server_pending_s c;
+              c.fd = fd;
+              c.len = 0;
+              c.rejected = false;
+              c.deadline = now + server_line_timeout;
+              c.line = (char *) xmalloc(server_line_max);
+              pending.push_back(c);
+            }
+        }
+    }
+
+  for (auto const & c : pending)
+    {
+      close(c.fd);
+      xfree(c.line);
+    }
+
+  /* the workers finish when their channels are closed */
+
+  for (int k = 0; k < server_kinds; k++)
+    {
+      if (worker_pid[k])
+        {
+          close(worker_channel[k]);
+          waitpid(worker_pid[k], nullptr, 0);
+        }
+    }
+
+  close(listener);
+  unlink(opt_server);
+}
+
+#endif
@@ -0,0 +1,381 @@
+/*
+
+  VSEARCH: a versatile open source tool for metagenomics
+
+  Copyright (C) 2014-2024, Torbjorn Rognes, Frederic Mahe and Tomas Flouri
+  All rights reserved.
+
+  Contact: Torbjorn Rognes <torognes@ifi.uio.no>,
+  Department of Informatics, University of Oslo,
+  PO Box 1080 Blindern, NO-0316 Oslo, Norway
+
+  This software is dual-licensed and available under a choice
+  of one of two licenses, either under the terms of the GNU
+  General Public License version 3 or the BSD 2-Clause License.
+
+
+  GNU General Public License version 3
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+  The BSD 2-Clause License
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+
+  1. Redistributions of source code must retain the above copyright
+  notice, this list of conditions and the following disclaimer.
+
+  2. Redistributions in binary form must reproduce the above copyright
+  notice, this list of conditions and the following disclaimer in the
+  documentation and/or other materials provided with the distribution.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+  COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include "vsearch.h"
+#include <cinttypes>  // macro PRId64
+#include <cstdint>  // uint64_t
+#include <cstdio>  // std::FILE, std::fprintf, std::fgets
+#include <cstring>  // std::memcpy, std::strlen, std::strchr
+
+
+/*
+  Sharded clustering (cluster_size and cluster_unoise)
+
+  With --shards N and --shard I, only the sequences whose hash falls
+  in shard I (0 to N - 1) are read and clustered, so that the shards
+  can be clustered by independent processes on one or more machines.
+  Identical sequences, including sequences differing only in case or
+  in U and T, and reverse complements with --strand both, always fall
+  in the same shard.
+
+  The centroids of all shards (written without --sizeout, so that
+  they keep their own abundance) and their --uc files are then
+  concatenated, and the centroids are clustered again with --sizein
+  and with --shard_uc giving the concatenated --uc file. The --uc
+  output of this merge has the usual records for the shard centroids,
+  followed by an H record for every other member of the shards,
+  assigned to the final cluster of its shard centroid. The identity
+  and alignment of these records are unknown and given as *, and the
+  strand is the combination of the two assignments. The abundance of
+  the members is added to their final clusters, for the C records and
+  for the centroids written with --sizeout.
+
+  The final centroids have the same properties as with clustering on
+  a single node, as they are selected greedily among the shard
+  centroids in the same order of decreasing abundance. A member,
+  however, is only guaranteed to be within twice the distance allowed
+  by --id of its final centroid (identity of at least 2 * id - 1), as
+  it was assigned to the centroid of its shard.
+*/
+
+static uint64_t shard_hash_mask = 0;
+static int * shard_hash = nullptr; /* sequence numbers, -1 if empty */
+static char * * shard_keys = nullptr;
+
+
+auto shard_select(char * sequence, uint64_t length) -> bool
+{
+  /*
+    hash the sequence as dereplication compares it: in upper case with
+    U replaced by T, and on the strand with the lowest hash when both
+    strands are considered
+  */
+
+  char * normalized = (char *) xmalloc(2 * length + 2);
+  string_normalize(normalized, sequence, length);
+  uint64_t hash = hash_cityhash64(normalized, length);
+  if (opt_strand > 1)
+    {
+      char * rc = normalized + length + 1;
+      reverse_complement(rc, normalized, length);
+      hash = MIN(hash, hash_cityhash64(rc, length));
+    }
+  xfree(normalized);
+
+  return (hash % opt_shards) == (uint64_t) opt_shard;
+}
+
+
+auto shard_label_key(char * header, int header_length) -> char *
+{
+  /* copy of the label without the size annotation and trailing ; */
+
+  char * key = (char *) xmalloc(header_length + 1);
+  int start = 0;
+  int end = 0;
+  int length = 0;
+  if (header_find_attribute(header, header_length, "size=",
+                            & start, & end, false))
+    {
+      memcpy(key, header, start);
+      length = start;
+      if ((end < header_length) and (header[end] == ';'))
+        {
+          ++end;
+        }
+      memcpy(key + length, header + end, header_length - end);
+      length += header_length - end;
+    }
+  else
+    {
+      memcpy(key, header, header_length);
+      length = header_length;
+    }
+
+  while ((length > 0) and (key[length - 1] == ';'))
+    {
+      --length;
+    }
+  key[length] = 0;
+  return key;
+}
+
+
+auto shard_hash_build() -> void
+{
+  int const seqcount = db_getsequencecount();
+
+  uint64_t size = 1;
+  while (size < 2 * (uint64_t) seqcount)
+    {
+      size *= 2;
+    }
+  shard_hash_mask = size - 1;
+  shard_hash = (int *) xmalloc(size * sizeof(int));
+  for (uint64_t j = 0; j < size; j++)
+    {
+      shard_hash[j] = -1;
+    }
+
+  shard_keys = (char * *) xmalloc(MAX(seqcount, 1) * sizeof(char *));
+  for (int i = 0; i < seqcount; i++)
+    {
+      char * key = shard_label_key(db_getheader(i), db_getheaderlen(i));
+      shard_keys[i] = key;
+      uint64_t j = hash_cityhash64(key, strlen(key)) & shard_hash_mask;
+      while (shard_hash[j] >= 0)
+        {
+          if (strcmp(shard_keys[shard_hash[j]], key) == 0)
+            {
+              fatal("Duplicate label among shard centroids (%s)", key);
+            }
+          j = (j + 1) & shard_hash_mask;
+        }
+      shard_hash[j] = i;
+    }
+}
+
+
+auto shard_hash_find(char * label) -> int
+{
+  char * key = shard_label_key(label, strlen(label));
+  uint64_t j = hash_cityhash64(key, strlen(key)) & shard_hash_mask;
+  int seqno = -1;
+  while (shard_hash[j] >= 0)
+    {
+      if (strcmp(shard_keys[shard_hash[j]], key) == 0)
+        {
+          seqno = shard_hash[j];
+          break;
+        }
+      j = (j + 1) & shard_hash_mask;
+    }
+  xfree(key);
+  return seqno;
+}
+
+
+auto shard_hash_free() -> void
+{
+  int const seqcount = db_getsequencecount();
+  for (int i = 0; i < seqcount; i++)
+    {
+      xfree(shard_keys[i]);
+    }
+  xfree(shard_keys);
+  shard_keys = nullptr;
+  xfree(shard_hash);
+  shard_hash = nullptr;
+}
+
+
+auto shard_read_line(std::FILE * fp, char * * buffer, int * alloc) -> bool
+{
+  /* read a complete line of any length, without the newline */
+
+  int length = 0;
+  while (true)
+    {
+      if (*alloc - length < 2)
+        {
+          *alloc += 1024;
+          *buffer = (char *) xrealloc(*buffer, *alloc);
+        }
+      if (not fgets(*buffer + length, *alloc - length, fp))
+        {
+          return length > 0;
+        }
+      length += strlen(*buffer + length);
+      if ((length > 0) and ((*buffer)[length - 1] == '\n'))
+        {
+          (*buffer)[length - 1] = 0;
+          return true;
+        }
+    }
+}
+
+
+auto shard_merge_uc(std::FILE * fp_uc,
+                    int * seq_cluster,
+                    int * seq_strand,
+                    int * cluster_centroid,
+                    int64_t * cluster_abundance,
+                    int * cluster_size) -> int64_t
+{
+  std::FILE * fp_shard_uc = fopen_input(opt_shard_uc);
+  if (not fp_shard_uc)
+    {
+      fatal("Unable to open shard uc file (%s)", opt_shard_uc);
+    }
+
+  xstat_t fs;
+  uint64_t file_size = 0;
+  if ((xfstat(fileno(fp_shard_uc), & fs) == 0) and S_ISREG(fs.st_mode))
+    {
+      file_size = fs.st_size;
+    }
+
+  shard_hash_build();
+
+  constexpr int uc_fields = 10;
+  char * line = nullptr;
+  int line_alloc = 0;
+  uint64_t position = 0;
+  int64_t members = 0;
+
+  progress_init("Merging shard clusters", file_size);
+
+  while (shard_read_line(fp_shard_uc, & line, & line_alloc))
+    {
+      position += strlen(line) + 1;
+
+      /* split the line into its tab separated fields */
+      char * field[uc_fields];
+      int fields = 0;
+      char * p = line;
+      while ((fields < uc_fields) and p)
+        {
+          field[fields++] = p;
+          p = strchr(p, '\t');
+          if (p)
+            {
+              *p++ = 0;
+            }
+        }
+
+      if ((line[0] == 0) or (line[0] == '#'))
+        {
+          continue;
+        }
+
+      if (fields < uc_fields)
+        {
+          fatal("Invalid line in shard uc file (%s)", opt_shard_uc);
+        }
+
+      /* only members need to be assigned again, the shard centroids
+         have been clustered */
+      if (field[0][0] != 'H')
+        {
+          continue;
+        }
+
+      int const seqno = shard_hash_find(field[9]);
+      if (seqno < 0)
+        {
+          fatal("Shard centroid not found among the input sequences (%s)",
+                field[9]);
+        }
+
+      bool const reverse = (field[4][0] == '-') != (seq_strand[seqno] != 0);
+      int const clusterno = seq_cluster[seqno];
+      int const centroid = cluster_centroid[clusterno];
+
+      fprintf(fp_uc, "H\t%d\t%s\t*\t%c\t0\t0\t*\t%s\t",
+              clusterno,
+              field[2],
+              reverse ? '-' : '+',
+              field[8]);
+      header_fprint_strip(fp_uc,
+                          db_getheader(centroid),
+                          db_getheaderlen(centroid),
+                          opt_xsize,
+                          opt_xee,
+                          opt_xlength);
+      fprintf(fp_uc, "\n");
+      ++members;
+
+      int64_t abundance = 1;
+      if (opt_sizein)
+        {
+          abundance = header_get_size(field[8], strlen(field[8]));
+          if (abundance == 0)
+            {
+              abundance = 1;
+            }
+        }
+      cluster_abundance[clusterno] += abundance;
+      cluster_size[clusterno]++;
+
+      progress_update(position);
+    }
+  progress_done();
+
+  if (line)
+    {
+      xfree(line);
+    }
+  fclose(fp_shard_uc);
+  shard_hash_free();
+
+  if (not opt_quiet)
+    {
+      fprintf(stderr, "Assigned %" PRId64 " shard members to merged clusters\n",
+              members);
+    }
+
+  if (opt_log)
+    {
+      fprintf(fp_log, "Assigned %" PRId64 " shard members to merged clusters\n",
+              members);
+    }
+
+  return members;
+}
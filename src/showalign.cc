@@ -195,7 +195,7 @@ void align_show(std::FILE * f,
                 int64_t seq2len,
                 int64_t seq2off,
                 const char * seq2name,
-                char * cigar,
+                cigar_t * cigar,
                 int64_t cigarlen,
                 int numwidth,
                 int namewidth,
@@ -213,8 +213,8 @@ void align_show(std::FILE * f,
   d_len = seq2len;
   d_name = seq2name;
 
-  char * p = cigar;
-  char * e = p + cigarlen;
+  cigar_t * p = cigar;
+  cigar_t * e = p + cigarlen;
 
   poswidth = numwidth;
   headwidth = namewidth;
@@ -231,16 +231,8 @@ void align_show(std::FILE * f,
 
   while(p < e)
     {
-      int64_t len;
-      int n;
-      if (sscanf(p, "%" PRId64 "%n", & len, & n) == 0)
-        {
-          n = 0;
-          len = 1;
-        }
-      p += n;
-      const char op = *p++;
-      putop(op, len);
+      putop(cigar_op(*p), cigar_run(*p));
+      ++p;
     }
 
   putop(0, 1);
@@ -250,24 +242,17 @@ void align_show(std::FILE * f,
   xfree(d_line);
 }
 
-char * align_getrow(char * seq, char * cigar, int alignlen, int origin)
+char * align_getrow(char * seq, cigar_t * cigar, int alignlen, int origin)
 {
   char * row = (char*) xmalloc(alignlen + 1);
   char * r = row;
-  char * p = cigar;
+  cigar_t * p = cigar;
   char * s = seq;
 
   while(*p != 0)
     {
-      int64_t len;
-      int n;
-      if (sscanf(p, "%" PRId64 "%n", & len, & n) == 0)
-        {
-          n = 0;
-          len = 1;
-        }
-      p += n;
-      const char op = *p++;
+      const int64_t len = cigar_run(*p);
+      const char op = cigar_op(*p++);
 
       if ((op == 'M') or
           ((op == 'D') and (origin == 0)) or
@@ -291,32 +276,15 @@ char * align_getrow(char * seq, char * cigar, int alignlen, int origin)
   return row;
 }
 
-void align_fprint_uncompressed_alignment(std::FILE * f, char * cigar)
+void align_fprint_uncompressed_alignment(std::FILE * f, cigar_t * cigar)
 {
-  char * p = cigar;
-  while (*p != 0)
+  /* one letter for each alignment column */
+  for(cigar_t * p = cigar; *p != 0; p++)
     {
-      if (*p > '9')
-        {
-          fprintf(f, "%c", *p++);
-        }
-      else
+      const char op = cigar_op(*p);
+      for(int64_t i = 0; i < cigar_run(*p); i++)
         {
-          int n = 0;
-          char c = 0;
-          int x = 0;
-          if (sscanf(p, "%d%c%n", &n, &c, &x) == 2)
-            {
-              for(int i = 0; i<n; i++)
-                {
-                  fprintf(f, "%c", c);
-                }
-              p += x;
-            }
-          else
-            {
-              fatal("bad alignment string");
-            }
+          fputc(op, f);
         }
     }
 }
@@ -62,9 +62,9 @@
 #include <cstdio>  // FILE
 
 
-auto align_getrow(char * seq, char * cigar, int alignlen, int origin) -> char *;
+auto align_getrow(char * seq, cigar_t * cigar, int alignlen, int origin) -> char *;
 
-auto align_fprint_uncompressed_alignment(std::FILE * f, char * cigar) -> void;
+auto align_fprint_uncompressed_alignment(std::FILE * f, cigar_t * cigar) -> void;
 
 auto align_show(std::FILE * f,
                 char * seq1,
@@ -75,7 +75,7 @@ auto align_show(std::FILE * f,
                 int64_t seq2len,
                 int64_t seq2off,
                 const char * seq2name,
-                char * cigar,
+                cigar_t * cigar,
                 int64_t cigarlen,
                 int numwidth,
                 int namewidth,
@@ -78,10 +78,13 @@
 */
 
 #include "vsearch.h"
+#include <cstdint>  // uint64_t
+#include <cstring>  // std::memset
 
 static struct searchinfo_s * si_plus;
 static struct searchinfo_s * si_minus;
 static pthread_t * pthread;
+static uint64_t * * touched_list; /* per thread bitmaps, for sparse counts */
 
 /* global constants/data, no need for synchronization */
 static int tophits; /* the maximum number of hits to keep */
@@ -92,8 +95,9 @@ static fastx_handle query_fastx_h;
 const int subset_size = 32;
 const int bootstrap_count = 100;
 
+static struct scheduler_s * sched;
+
 /* global data protected by mutex */
-static pthread_mutex_t mutex_input;
 static pthread_mutex_t mutex_output;
 static FILE * fp_tabbedout;
 static int queries = 0;
@@ -253,7 +257,55 @@ void sintax_analyse(char * query_head,
   xpthread_mutex_unlock(&mutex_output);
 }
 
-void sintax_search_topscores(struct searchinfo_s * si)
+inline void sintax_update_best(elem_t * best,
+                               unsigned int * tophits,
+                               count_t count,
+                               unsigned int i)
+{
+  /* consider indexed sequence i with the given kmer count as the best */
+
+  if (count < best->count)
+    {
+      return;
+    }
+
+  unsigned int seqno = dbindex_getmapping(i);
+  unsigned int length = db_getsequencelen(best->seqno);
+
+  if (count > best->count)
+    {
+      best->count = count;
+      best->seqno = seqno;
+      best->length = length;
+      *tophits = 1;
+    }
+  else if (opt_sintax_random)
+    {
+      (*tophits)++;
+      if (random_int(*tophits) == 0)
+        {
+          best->seqno = seqno;
+          best->length = length;
+        }
+    }
+  else
+    {
+      if (length < best->length)
+        {
+          best->seqno = seqno;
+          best->length = length;
+        }
+      else if (length == best->length)
+        {
+          if (seqno < best->seqno)
+            {
+              best->seqno = seqno;
+            }
+        }
+    }
+}
+
+void sintax_search_topscores(struct searchinfo_s * si, uint64_t * touched)
 {
   /*
     Count the number of kmer hits in each database sequence and select
@@ -263,47 +315,35 @@ void sintax_search_topscores(struct searchinfo_s * si)
     shortest. If two are equally short, choose the one that comes
     first in the database.  If the sintax_random option is in effect,
     ties will instead be chosen randomly.
+
+    When the posting lists of the sampled kmers are short compared to
+    the number of indexed sequences, only the sequences in those lists
+    are counted, and a bitmap of the sequences hit is used to visit
+    them in database order (sparse evaluation). Otherwise all counters
+    are scanned and zeroed (dense evaluation). Both give the same
+    result. The counters and the bitmap are all zero between calls.
   */
 
-  /* count kmer hits in the database sequences */
-  const int indexed_count = dbindex_getcount();
+  const unsigned int indexed_count = dbindex_getcount();
+
+  /* sum of posting list lengths, unless some kmer has no list */
 
-  /* zero counts */
-  memset(si->kmers, 0, indexed_count * sizeof(count_t));
+  uint64_t postings = 0;
+  bool sparse = ! kmerpack;
 
-  for(unsigned int i = 0; i < si->kmersamplecount; i++)
+  for(unsigned int i = 0; sparse && (i < si->kmersamplecount); i++)
     {
       unsigned int kmer = si->kmersample[i];
-      unsigned char * bitmap = dbindex_getbitmap(kmer);
-
-      if (bitmap)
-        {
-#ifdef __x86_64__
-          if (ssse3_present)
-            {
-              increment_counters_from_bitmap_ssse3(si->kmers,
-                                                   bitmap, indexed_count);
-            }
-          else
-            {
-              increment_counters_from_bitmap_sse2(si->kmers,
-                                                  bitmap, indexed_count);
-            }
-#else
-          increment_counters_from_bitmap(si->kmers, bitmap, indexed_count);
-#endif
-        }
-      else
+      if (dbindex_getbitmap(kmer))
         {
-          unsigned int * list = dbindex_getmatchlist(kmer);
-          unsigned int count = dbindex_getmatchcount(kmer);
-          for(unsigned int j = 0; j < count; j++)
-            {
-              si->kmers[list[j]]++;
-            }
+          sparse = false;
         }
+      postings += dbindex_getmatchcount(kmer);
     }
 
+  /* use sparse evaluation when postings < indexed sequences */
+  sparse = sparse && (postings < indexed_count);
+
   unsigned int tophits = 0;
 
   elem_t best;
@@ -311,46 +351,97 @@ void sintax_search_topscores(struct searchinfo_s * si)
   best.seqno = 0;
   best.length = 0;
 
-  for(int i = 0; i < indexed_count; i++)
+  if (sparse)
     {
-      count_t count = si->kmers[i];
-      unsigned int seqno = dbindex_getmapping(i);
-      unsigned int length = db_getsequencelen(best.seqno);
+      /* count hits, marking each sequence the first time it is hit */
 
-      if (count > best.count)
+      for(unsigned int i = 0; i < si->kmersamplecount; i++)
         {
-          best.count = count;
-          best.seqno = seqno;
-          best.length = length;
-          tophits = 1;
+          unsigned int kmer = si->kmersample[i];
+          unsigned int * list = dbindex_getmatchlist(kmer);
+          unsigned int count = dbindex_getmatchcount(kmer);
+          for(unsigned int j = 0; j < count; j++)
+            {
+              unsigned int x = list[j];
+              if (si->kmers[x]++ == 0)
+                {
+                  touched[x >> 6] |= UINT64_C(1) << (x & 63);
+                }
+            }
         }
-      else if (count == best.count)
+
+      /*
+        With random tie breaking, the sequences without hits that come
+        before the first hit are ties too and consume random numbers.
+        Without random tie breaking, they never change the best hit.
+      */
+
+      bool leading = opt_sintax_random;
+      unsigned int next = 0;
+      const unsigned int words = (indexed_count + 63) / 64;
+
+      for(unsigned int w = 0; w < words; w++)
         {
-          if (opt_sintax_random)
+          uint64_t bits = touched[w];
+          touched[w] = 0;
+          while (bits)
             {
-              tophits++;
-              if (random_int(tophits) == 0)
+              unsigned int i = 64 * w + __builtin_ctzll(bits);
+              bits &= bits - 1;
+              if (leading)
                 {
-                  best.seqno = seqno;
-                  best.length = length;
+                  for(; next < i; next++)
+                    {
+                      sintax_update_best(& best, & tophits, 0, next);
+                    }
+                  leading = false;
                 }
+              sintax_update_best(& best, & tophits, si->kmers[i], i);
+              si->kmers[i] = 0;
+            }
+        }
+
+      if (leading)
+        {
+          for(; next < indexed_count; next++)
+            {
+              sintax_update_best(& best, & tophits, 0, next);
+            }
+        }
+    }
+  else
+    {
+      for(unsigned int i = 0; i < si->kmersamplecount; i++)
+        {
+          unsigned int kmer = si->kmersample[i];
+          unsigned char * bitmap = dbindex_getbitmap(kmer);
+
+          if (kmerpack)
+            {
+              dbindex_count_packed(si->kmers, kmer);
+            }
+          else if (bitmap)
+            {
+              increment_counters_from_bitmap(si->kmers, bitmap, indexed_count);
             }
           else
             {
-              if (length < best.length)
-                {
-                  best.seqno = seqno;
-                  best.length = length;
-                }
-              else if (length == best.length)
+              unsigned int * list = dbindex_getmatchlist(kmer);
+              unsigned int count = dbindex_getmatchcount(kmer);
+              for(unsigned int j = 0; j < count; j++)
                 {
-                  if (seqno < best.seqno)
-                    {
-                      best.seqno = seqno;
-                    }
+                  si->kmers[list[j]]++;
                 }
             }
         }
+
+      for(unsigned int i = 0; i < indexed_count; i++)
+        {
+          sintax_update_best(& best, & tophits, si->kmers[i], i);
+        }
+
+      /* zero counts */
+      memset(si->kmers, 0, indexed_count * sizeof(count_t));
     }
 
   minheap_empty(si->m);
@@ -405,7 +496,7 @@ void sintax_query(int64_t t)
               si->kmersamplecount = subsamples;
               si->kmersample = kmersample_subset;
 
-              sintax_search_topscores(si);
+              sintax_search_topscores(si, touched_list[t]);
 
               if (! minheap_isempty(si->m))
                 {
@@ -461,82 +552,61 @@ void sintax_query(int64_t t)
 
 void sintax_thread_run(int64_t t)
 {
-  while (true)
+  struct sched_query_s * * batch;
+
+  while (scheduler_next(sched, t, & batch) > 0)
     {
-      xpthread_mutex_lock(&mutex_input);
+      struct sched_query_s * query = batch[0];
 
-      if (fastx_next(query_fastx_h,
-                     ! opt_notrunclabels,
-                     chrmap_no_change))
+      for (int s = 0; s < opt_strand; s++)
         {
-          char * qhead = fastx_get_header(query_fastx_h);
-          int query_head_len = fastx_get_header_length(query_fastx_h);
-          char * qseq = fastx_get_sequence(query_fastx_h);
-          int qseqlen = fastx_get_sequence_length(query_fastx_h);
-          int query_no = fastx_get_seqno(query_fastx_h);
-          int qsize = fastx_get_abundance(query_fastx_h);
-
-          for (int s = 0; s < opt_strand; s++)
-            {
-              struct searchinfo_s * si = s ? si_minus+t : si_plus+t;
+          struct searchinfo_s * si = s ? si_minus+t : si_plus+t;
 
-              si->query_head_len = query_head_len;
-              si->qseqlen = qseqlen;
-              si->query_no = query_no;
-              si->qsize = qsize;
-              si->strand = s;
+          si->query_head_len = query->header_len;
+          si->qseqlen = query->sequence_len;
+          si->query_no = query->seqno;
+          si->qsize = query->size;
+          si->strand = s;
 
-              /* allocate more memory for header and sequence, if necessary */
+          /* allocate more memory for header and sequence, if necessary */
 
-              if (si->query_head_len + 1 > si->query_head_alloc)
-                {
-                  si->query_head_alloc = si->query_head_len + 2001;
-                  si->query_head = (char*)
-                    xrealloc(si->query_head, (size_t)(si->query_head_alloc));
-                }
-
-              if (si->qseqlen + 1 > si->seq_alloc)
-                {
-                  si->seq_alloc = si->qseqlen + 2001;
-                  si->qsequence = (char*)
-                    xrealloc(si->qsequence, (size_t)(si->seq_alloc));
-                }
+          if (si->query_head_len + 1 > si->query_head_alloc)
+            {
+              si->query_head_alloc = si->query_head_len + 2001;
+              si->query_head = (char*)
+                xrealloc(si->query_head, (size_t)(si->query_head_alloc));
             }
 
-          /* plus strand: copy header and sequence */
-          strcpy(si_plus[t].query_head, qhead);
-          strcpy(si_plus[t].qsequence, qseq);
-
-          /* get progress as amount of input file read */
-          uint64_t progress = fastx_get_position(query_fastx_h);
-
-          /* let other threads read input */
-          xpthread_mutex_unlock(&mutex_input);
-
-          /* minus strand: copy header and reverse complementary sequence */
-          if (opt_strand > 1)
+          if (si->qseqlen + 1 > si->seq_alloc)
             {
-              strcpy(si_minus[t].query_head, si_plus[t].query_head);
-              reverse_complement(si_minus[t].qsequence,
-                                 si_plus[t].qsequence,
-                                 si_plus[t].qseqlen);
+              si->seq_alloc = si->qseqlen + 2001;
+              si->qsequence = (char*)
+                xrealloc(si->qsequence, (size_t)(si->seq_alloc));
             }
+        }
 
-          sintax_query(t);
-
-          /* lock mutex for update of global data and output */
-          xpthread_mutex_lock(&mutex_output);
-
-          /* show progress */
-          progress_update(progress);
+      /* plus strand: copy header and sequence */
+      strcpy(si_plus[t].query_head, query->header);
+      strcpy(si_plus[t].qsequence, query->sequence);
 
-          xpthread_mutex_unlock(&mutex_output);
-        }
-      else
+      /* minus strand: copy header and reverse complementary sequence */
+      if (opt_strand > 1)
         {
-          xpthread_mutex_unlock(&mutex_input);
-          break;
+          strcpy(si_minus[t].query_head, si_plus[t].query_head);
+          reverse_complement(si_minus[t].qsequence,
+                             si_plus[t].qsequence,
+                             si_plus[t].qseqlen);
         }
+
+      sintax_query(t);
+
+      /* lock mutex for update of global data and output */
+      xpthread_mutex_lock(&mutex_output);
+
+      /* show progress */
+      progress_update(query->progress);
+
+      xpthread_mutex_unlock(&mutex_output);
     }
 }
 
@@ -545,6 +615,7 @@ void sintax_thread_init(struct searchinfo_s * si)
   /* thread specific initialiation */
   si->uh = unique_init();
   si->kmers = (count_t *) xmalloc(seqcount * sizeof(count_t) + 32);
+  memset(si->kmers, 0, seqcount * sizeof(count_t));
   si->m = minheap_init(tophits);
   si->hits = nullptr;
   si->qsize = 1;
@@ -589,6 +660,9 @@ void sintax_thread_worker_run()
   /* init and create worker threads, put them into stand-by mode */
   for(int t=0; t<opt_threads; t++)
     {
+      const size_t words = (seqcount + 63) / 64;
+      touched_list[t] = (uint64_t *) xmalloc(words * sizeof(uint64_t));
+      memset(touched_list[t], 0, words * sizeof(uint64_t));
       sintax_thread_init(si_plus+t);
       if (si_minus)
         {
@@ -602,6 +676,7 @@ void sintax_thread_worker_run()
   for(int t=0; t<opt_threads; t++)
     {
       xpthread_join(pthread[t], nullptr);
+      xfree(touched_list[t]);
       sintax_thread_exit(si_plus+t);
       if (si_minus)
         {
@@ -612,6 +687,35 @@ void sintax_thread_worker_run()
   xpthread_attr_destroy(&attr);
 }
 
+void sintax_load_db()
+{
+  /* read and index the database, or map a UDB file */
+
+  if (udb_detect_isudb(opt_db))
+    {
+      udb_read(opt_db, true, true);
+    }
+  else if (! udb_cache_lookup(opt_db, false))
+    {
+      db_read(opt_db, 0);
+      if (opt_index_compress && ! udb_cache_pending())
+        {
+          dbindex_prepare_packed(1, opt_dbmask);
+        }
+      else
+        {
+          dbindex_prepare(1, opt_dbmask);
+          dbindex_addallsequences(opt_dbmask);
+          udb_cache_store();
+        }
+    }
+
+  if (opt_index_compress)
+    {
+      dbindex_pack();
+    }
+}
+
 void sintax()
 {
   /* tophits = the maximum number of hits we need to store */
@@ -638,27 +742,13 @@ void sintax()
       fatal("No output file specified with --tabbedout");
     }
 
-  /* check if db may be an UDB file */
-
-  bool is_udb = udb_detect_isudb(opt_db);
-
-  if (is_udb)
+  if (! server_db_loaded())
     {
-      udb_read(opt_db, true, true);
-    }
-  else
-    {
-      db_read(opt_db, 0);
+      sintax_load_db();
     }
 
   seqcount = db_getsequencecount();
 
-  if (!is_udb)
-    {
-      dbindex_prepare(1, opt_dbmask);
-      dbindex_addallsequences(opt_dbmask);
-    }
-
   /* prepare reading of queries */
 
   query_fastx_h = fastx_open(opt_sintax);
@@ -678,9 +768,10 @@ void sintax()
     }
 
   pthread = (pthread_t *) xmalloc(opt_threads * sizeof(pthread_t));
+  touched_list = (uint64_t * *) xmalloc(opt_threads * sizeof(uint64_t *));
 
-  /* init mutexes for input and output */
-  xpthread_mutex_init(&mutex_input, nullptr);
+  /* init scheduler for input and mutex for output */
+  sched = scheduler_init_fastx(query_fastx_h, opt_threads, 1);
   xpthread_mutex_init(&mutex_output, nullptr);
 
   /* run */
@@ -712,9 +803,10 @@ void sintax()
   /* clean up */
 
   xpthread_mutex_destroy(&mutex_output);
-  xpthread_mutex_destroy(&mutex_input);
+  scheduler_exit(sched);
 
   xfree(pthread);
+  xfree(touched_list);
   xfree(si_plus);
   if (si_minus)
     {
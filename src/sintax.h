@@ -59,3 +59,4 @@
 */
 
 auto sintax() -> void;
+auto sintax_load_db() -> void;
@@ -59,9 +59,12 @@
 */
 
 #include "vsearch.h"
+#include <algorithm>  // std::min, std::sort
 #include <cinttypes>  // macros PRIu64 and PRId64
+#include <cmath>  // std::exp, std::floor, std::log, std::log1p
 #include <cstdint>  // int64_t
 #include <cstdio>  // std::FILE, std::fprintf
+#include <cstring>  // std::memcpy
 #include <vector>
 
 
@@ -73,48 +76,375 @@
 //    - std::discrete_distribution()
 
 
-auto subsample() -> void
+/*
+  Streaming subsampling (--sample_stream, or input from a pipe)
+
+  The input is read only once and is not kept in memory. With
+  --sample_pct, each read is kept independently with the given
+  probability (Bernoulli thinning), so the number of reads sampled
+  follows a binomial distribution instead of being exactly the given
+  percentage of the total. With --sizein, the number of reads kept
+  from an amplicon is drawn by skipping ahead over its reads with
+  geometric gaps. Sampled and discarded amplicons are written as they
+  are read.
+
+  With --sample_size, a reservoir of that many reads is maintained
+  (algorithm L, Li 1994), so that every subset of reads of that size
+  is equally likely, as in the in-memory mode. With --sizein, the
+  reads of an amplicon are consecutive positions in the stream, and
+  only the amplicons currently in the reservoir are kept in memory.
+  They are written in input order at the end. Discarded amplicons are
+  written when they are no longer in the reservoir, so that output is
+  not in input order.
+*/
+
+struct subsample_amplicon_s
 {
-  std::FILE * fp_fastaout = nullptr;
-  std::FILE * fp_fastaout_discarded = nullptr;
-  std::FILE * fp_fastqout = nullptr;
-  std::FILE * fp_fastqout_discarded = nullptr;
+  uint64_t ordinal;
+  char * header;
+  char * sequence;
+  char * quality;
+  int header_length;
+  int sequence_length;
+  int64_t abundance;
+  int64_t count;                /* reads in the reservoir */
+  bool listed;
+};
+
+struct subsample_output_s
+{
+  std::FILE * fastaout;
+  std::FILE * fastqout;
+  std::FILE * fastaout_discarded;
+  std::FILE * fastqout_discarded;
+  int samples;
+  int discarded;
+};
 
-  if (opt_fastaout != nullptr)
+
+auto subsample_uniform() -> double
+{
+  /* random number in the open interval (0, 1) */
+  const uint64_t range = UINT64_C(1) << 53;
+  return (random_ulong(range) + 0.5) / range;
+}
+
+
+auto subsample_geometric(double log_q) -> uint64_t
+{
+  /* number of failures before the next success, log_q = log(1 - p) */
+  double const skip = std::floor(std::log(subsample_uniform()) / log_q);
+  if (skip >= 4.0e18)
     {
-      fp_fastaout = fopen_output(opt_fastaout);
-      if (fp_fastaout == nullptr)
-        {
-          fatal("Unable to open FASTA output file for writing");
-        }
+      return UINT64_C(4000000000000000000);
     }
+  return (uint64_t) skip;
+}
 
-  if (opt_fastaout_discarded != nullptr)
+
+auto subsample_write(struct subsample_output_s * out,
+                     bool sampled,
+                     char * header,
+                     int header_length,
+                     char * sequence,
+                     int sequence_length,
+                     char * quality,
+                     int64_t abundance) -> void
+{
+  std::FILE * fp_fasta = sampled ? out->fastaout : out->fastaout_discarded;
+  std::FILE * fp_fastq = sampled ? out->fastqout : out->fastqout_discarded;
+  int const ordinal = sampled ? ++out->samples : ++out->discarded;
+
+  if (fp_fasta != nullptr)
     {
-      fp_fastaout_discarded = fopen_output(opt_fastaout_discarded);
-      if (fp_fastaout_discarded == nullptr)
-        {
-          fatal("Unable to open FASTA output file for writing");
-        }
+      fasta_print_general(fp_fasta,
+                          nullptr,
+                          sequence,
+                          sequence_length,
+                          header,
+                          header_length,
+                          abundance,
+                          ordinal,
+                          -1.0,
+                          -1, -1, nullptr, 0.0);
     }
 
-  if (opt_fastqout != nullptr)
+  if (fp_fastq != nullptr)
     {
-      fp_fastqout = fopen_output(opt_fastqout);
-      if (fp_fastqout == nullptr)
+      fastq_print_general(fp_fastq,
+                          sequence,
+                          sequence_length,
+                          header,
+                          header_length,
+                          quality,
+                          abundance,
+                          ordinal,
+                          -1.0);
+    }
+}
+
+
+auto subsample_amplicon_write(struct subsample_output_s * out,
+                              struct subsample_amplicon_s * amp,
+                              bool sampled,
+                              int64_t abundance) -> void
+{
+  subsample_write(out, sampled,
+                  amp->header, amp->header_length,
+                  amp->sequence, amp->sequence_length,
+                  amp->quality, abundance);
+}
+
+
+auto subsample_amplicon_free(struct subsample_amplicon_s * amp) -> void
+{
+  xfree(amp->header);
+  xfree(amp->sequence);
+  if (amp->quality != nullptr)
+    {
+      xfree(amp->quality);
+    }
+  xfree(amp);
+}
+
+
+auto subsample_amplicon_copy(fastx_handle h,
+                             uint64_t ordinal,
+                             int64_t abundance) -> struct subsample_amplicon_s *
+{
+  auto * amp = (struct subsample_amplicon_s *)
+    xmalloc(sizeof(struct subsample_amplicon_s));
+  amp->ordinal = ordinal;
+  amp->header_length = fastx_get_header_length(h);
+  amp->sequence_length = fastx_get_sequence_length(h);
+  amp->header = (char *) xmalloc(amp->header_length + 1);
+  std::memcpy(amp->header, fastx_get_header(h), amp->header_length + 1);
+  amp->sequence = (char *) xmalloc(amp->sequence_length + 1);
+  std::memcpy(amp->sequence, fastx_get_sequence(h), amp->sequence_length + 1);
+  amp->quality = nullptr;
+  if (fastx_is_fastq(h))
+    {
+      amp->quality = (char *) xmalloc(amp->sequence_length + 1);
+      std::memcpy(amp->quality, fastx_get_quality(h), amp->sequence_length + 1);
+    }
+  amp->abundance = abundance;
+  amp->count = 0;
+  amp->listed = false;
+  return amp;
+}
+
+
+auto subsample_stream(fastx_handle h, struct subsample_output_s * out) -> void
+{
+  bool const by_size = opt_sample_size != 0;
+  uint64_t const n = opt_sample_size;
+  double const p = opt_sample_pct / 100.0;
+  double const log_q = std::log1p(-p);
+
+  /* reservoir state */
+  std::vector<struct subsample_amplicon_s *> slots;
+  if (by_size)
+    {
+      slots.reserve(n);
+    }
+  double w = 0.0;
+  uint64_t next = 0;            /* position of next read to enter */
+
+  uint64_t mass_total = 0;
+  uint64_t sampled_total = 0;
+  int amplicons = 0;
+
+  progress_init("Subsampling", fastx_get_size(h));
+
+  while (fastx_next(h, not opt_notrunclabels, chrmap_no_change))
+    {
+      int64_t const length = fastx_get_sequence_length(h);
+      if ((length < opt_minseqlength) || (length > opt_maxseqlength))
         {
-          fatal("Unable to open FASTQ output file for writing");
+          continue;
+        }
+
+      int64_t const abundance = opt_sizein ? fastx_get_abundance(h) : 1;
+      uint64_t const first = mass_total;
+      uint64_t const end = mass_total + abundance;
+      mass_total = end;
+      ++amplicons;
+
+      if (not by_size)
+        {
+          /* Bernoulli thinning, read by read */
+          int64_t kept = 0;
+          if (p >= 1.0)
+            {
+              kept = abundance;
+            }
+          else if (p > 0.0)
+            {
+              uint64_t pos = subsample_geometric(log_q);
+              while (pos < (uint64_t) abundance)
+                {
+                  ++kept;
+                  pos += subsample_geometric(log_q) + 1;
+                }
+            }
+          sampled_total += kept;
+
+          if (kept > 0)
+            {
+              subsample_write(out, true,
+                              fastx_get_header(h), fastx_get_header_length(h),
+                              fastx_get_sequence(h), length,
+                              fastx_get_quality(h), kept);
+            }
+          if (abundance - kept > 0)
+            {
+              subsample_write(out, false,
+                              fastx_get_header(h), fastx_get_header_length(h),
+                              fastx_get_sequence(h), length,
+                              fastx_get_quality(h), abundance - kept);
+            }
         }
+      else
+        {
+          /* reservoir sampling with geometric skips */
+          struct subsample_amplicon_s * amp = nullptr;
+          uint64_t pos = first;
+
+          while (pos < end)
+            {
+              if (slots.size() < n)
+                {
+                  /* fill the reservoir */
+                  if (amp == nullptr)
+                    {
+                      amp = subsample_amplicon_copy(h, amplicons, abundance);
+                    }
+                  uint64_t const take = std::min(end - pos, n - slots.size());
+                  slots.insert(slots.end(), take, amp);
+                  amp->count += take;
+                  pos += take;
+
+                  if (slots.size() == n)
+                    {
+                      w = std::exp(std::log(subsample_uniform()) / n);
+                      next = n + subsample_geometric(std::log1p(-w));
+                    }
+                  continue;
+                }
+
+              if ((n == 0) || (next >= end))
+                {
+                  break;
+                }
+
+              /* the read at position next replaces a random one */
+              if (amp == nullptr)
+                {
+                  amp = subsample_amplicon_copy(h, amplicons, abundance);
+                }
+              uint64_t const slot = random_ulong(n);
+              struct subsample_amplicon_s * old = slots[slot];
+              slots[slot] = amp;
+              ++amp->count;
+              --old->count;
+              if (old->count == 0)
+                {
+                  subsample_amplicon_write(out, old, false, old->abundance);
+                  subsample_amplicon_free(old);
+                }
+              w *= std::exp(std::log(subsample_uniform()) / n);
+              next += subsample_geometric(std::log1p(-w)) + 1;
+            }
+
+          if (amp == nullptr)
+            {
+              subsample_write(out, false,
+                              fastx_get_header(h), fastx_get_header_length(h),
+                              fastx_get_sequence(h), length,
+                              fastx_get_quality(h), abundance);
+            }
+          else if (amp->count == 0)
+            {
+              subsample_amplicon_write(out, amp, false, amp->abundance);
+              subsample_amplicon_free(amp);
+            }
+        }
+
+      progress_update(fastx_get_position(h));
     }
+  progress_done();
 
-  if (opt_fastqout_discarded != nullptr)
+  if (not opt_quiet)
     {
-      fp_fastqout_discarded = fopen_output(opt_fastqout_discarded);
-      if (fp_fastqout_discarded == nullptr)
+      fprintf(stderr, "Got %" PRIu64 " reads from %d amplicons\n",
+              mass_total, amplicons);
+    }
+
+  if (opt_log != nullptr)
+    {
+      fprintf(fp_log, "Got %" PRIu64 " reads from %d amplicons\n",
+              mass_total, amplicons);
+    }
+
+  if (by_size)
+    {
+      if (n > mass_total)
         {
-          fatal("Unable to open FASTQ output file for writing");
+          fatal("Cannot subsample more reads than in the original sample");
         }
+
+      /* write the amplicons in the reservoir in input order */
+      std::vector<struct subsample_amplicon_s *> kept;
+      for (auto * amp : slots)
+        {
+          if (not amp->listed)
+            {
+              amp->listed = true;
+              kept.push_back(amp);
+            }
+        }
+      std::sort(kept.begin(), kept.end(),
+                [](struct subsample_amplicon_s * a,
+                   struct subsample_amplicon_s * b) -> bool
+                {
+                  return a->ordinal < b->ordinal;
+                });
+
+      for (auto * amp : kept)
+        {
+          subsample_amplicon_write(out, amp, true, amp->count);
+        }
+      for (auto * amp : kept)
+        {
+          if (amp->abundance > amp->count)
+            {
+              subsample_amplicon_write(out, amp, false,
+                                       amp->abundance - amp->count);
+            }
+          subsample_amplicon_free(amp);
+        }
+      sampled_total = n;
+    }
+
+  if (not opt_quiet)
+    {
+      fprintf(stderr, "Subsampled %" PRIu64 " reads from %d amplicons\n",
+              sampled_total, out->samples);
+    }
+  if (opt_log != nullptr)
+    {
+      fprintf(fp_log, "Subsampled %" PRIu64 " reads from %d amplicons\n",
+              sampled_total, out->samples);
     }
+}
+
+
+auto subsample_memory(struct subsample_output_s * out) -> void
+{
+  std::FILE * fp_fastaout = out->fastaout;
+  std::FILE * fp_fastqout = out->fastqout;
+  std::FILE * fp_fastaout_discarded = out->fastaout_discarded;
+  std::FILE * fp_fastqout_discarded = out->fastqout_discarded;
 
   db_read(opt_fastx_subsample, 0);
   show_rusage();
@@ -297,6 +627,83 @@ auto subsample() -> void
     }
 
   db_free();
+}
+
+
+auto subsample() -> void
+{
+  std::FILE * fp_fastaout = nullptr;
+  std::FILE * fp_fastaout_discarded = nullptr;
+  std::FILE * fp_fastqout = nullptr;
+  std::FILE * fp_fastqout_discarded = nullptr;
+
+  if (opt_fastaout != nullptr)
+    {
+      fp_fastaout = fopen_output(opt_fastaout);
+      if (fp_fastaout == nullptr)
+        {
+          fatal("Unable to open FASTA output file for writing");
+        }
+    }
+
+  if (opt_fastaout_discarded != nullptr)
+    {
+      fp_fastaout_discarded = fopen_output(opt_fastaout_discarded);
+      if (fp_fastaout_discarded == nullptr)
+        {
+          fatal("Unable to open FASTA output file for writing");
+        }
+    }
+
+  if (opt_fastqout != nullptr)
+    {
+      fp_fastqout = fopen_output(opt_fastqout);
+      if (fp_fastqout == nullptr)
+        {
+          fatal("Unable to open FASTQ output file for writing");
+        }
+    }
+
+  if (opt_fastqout_discarded != nullptr)
+    {
+      fp_fastqout_discarded = fopen_output(opt_fastqout_discarded);
+      if (fp_fastqout_discarded == nullptr)
+        {
+          fatal("Unable to open FASTQ output file for writing");
+        }
+    }
+
+  /* stream the input if requested, or if it cannot be read twice */
+
+  fastx_handle h = fastx_open(opt_fastx_subsample);
+  if (h == nullptr)
+    {
+      fatal("Unrecognized file type (not proper FASTA or FASTQ format)");
+    }
+
+  struct subsample_output_s out = { fp_fastaout,
+                                    fp_fastqout,
+                                    fp_fastaout_discarded,
+                                    fp_fastqout_discarded,
+                                    0,
+                                    0 };
+
+  if (opt_sample_stream or fastx_is_pipe(h))
+    {
+      if ((fp_fastqout != nullptr or fp_fastqout_discarded != nullptr) and
+          not fastx_is_fastq(h))
+        {
+          fatal("Cannot write FASTQ output with a FASTA input file, lacking quality scores");
+        }
+
+      subsample_stream(h, & out);
+      fastx_close(h);
+    }
+  else
+    {
+      fastx_close(h);
+      subsample_memory(& out);
+    }
 
   if (opt_fastaout != nullptr)
     {
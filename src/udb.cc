@@ -59,6 +59,7 @@
 */
 
 #include "vsearch.h"
+#include <cerrno>  // errno, ENOENT, EEXIST
 #include <cmath>
 #include <cstdio> // std::FILE, std::fprintf, std::size_t
 
@@ -67,6 +68,70 @@
 
 static unsigned int udb_dbaccel = 0;
 
+/*
+  Mappable UDB layout (written with --udb_mmap)
+
+  The classic UDB format stores sequences without terminators and
+  headers through an offset table, so it has to be copied and
+  reorganised in memory after reading. The mappable layout is instead
+  a snapshot of the in-memory database and k-mer index, with every
+  section starting on a page boundary, so that the file can be mapped
+  read-only and used directly. Concurrent processes mapping the same
+  file share a single copy in the page cache.
+
+  header page, kmercount[], kmerhash[], kmerindex[], bitmap kmers[],
+  bitmaps, seqindex[], dbindex_map[], data (headers and sequences)
+
+  All posting lists are complete (as in classic UDB files), bitmaps
+  are stored in addition for the most frequent k-mers.
+*/
+
+constexpr uint32_t udb_signature = 0x55444246; /* FBDU UDBF */
+constexpr uint32_t udb_mmap_signature = 0x55444256; /* VBDU UDBV */
+constexpr uint32_t udb_mmap_signature_end = 0x55444276; /* vBDU UDBv */
+constexpr uint32_t udb_mmap_version = 1;
+constexpr uint64_t udb_mmap_alignment = 65536; /* multiple of page sizes */
+
+struct udb_mmap_header_s
+{
+  uint32_t signature;
+  uint32_t version;
+  uint32_t wordlength;
+  uint32_t is_fastq;
+  uint64_t seqcount;
+  uint64_t nucleotides;
+  uint64_t longest;
+  uint64_t shortest;
+  uint64_t longestheader;
+  uint64_t kmerindexsize;
+  uint64_t bitmapcount;
+  uint64_t bitmapbytes;
+  uint64_t kmercount_offset;
+  uint64_t kmerhash_offset;
+  uint64_t kmerindex_offset;
+  uint64_t bitmapkmers_offset;
+  uint64_t bitmaps_offset;
+  uint64_t seqindex_offset;
+  uint64_t dbindex_map_offset;
+  uint64_t data_offset;
+  uint64_t data_length;
+  uint64_t filesize;
+  uint64_t cache_key[2];
+  uint32_t seqinfo_size;
+  uint32_t signature_end;
+};
+
+static void * udb_mapping = nullptr;
+static uint64_t udb_mapping_size = 0;
+static bitmap_t * udb_mapped_bitmaps = nullptr;
+static seqinfo_t * udb_seqindex_copy = nullptr;
+static uint128 udb_cache_key;
+static char * udb_cache_filename = nullptr;
+static uint128 udb_shm_key;
+static char * udb_shm_name = nullptr;
+static bool udb_shm_stale = false;
+static const time_t udb_shm_stale_age = 10; /* seconds */
+
 typedef struct wordfreq
 {
   unsigned int kmer;
@@ -154,6 +219,399 @@ uint64_t largewrite(int fd, void * buf, uint64_t nbyte, uint64_t offset)
   return nbyte;
 }
 
+auto udb_mmap_align(uint64_t offset) -> uint64_t
+{
+  return (offset + udb_mmap_alignment - 1) / udb_mmap_alignment
+    * udb_mmap_alignment;
+}
+
+auto udb_get_matchlist(unsigned int kmer, unsigned int * buffer) -> unsigned int *
+{
+  /* return the complete list of seqnos for a kmer, expanding bitmaps */
+
+  if (kmerbitmap[kmer])
+    {
+      unsigned int seqcount = db_getsequencecount();
+      unsigned int elements = 0;
+      for (unsigned int j = 0; j < seqcount; j++)
+        {
+          if (bitmap_get(kmerbitmap[kmer], j))
+            {
+              buffer[elements++] = j;
+            }
+        }
+      return buffer;
+    }
+  else
+    {
+      return kmerindex + kmerhash[kmer];
+    }
+}
+
+auto udb_mmap_check(struct udb_mmap_header_s * hdr, uint64_t filesize) -> void
+{
+  if ((hdr->signature != udb_mmap_signature) ||
+      (hdr->signature_end != udb_mmap_signature_end) ||
+      (hdr->wordlength < 3) ||
+      (hdr->wordlength > 15) ||
+      (hdr->seqcount == 0) ||
+      (hdr->seqcount > UINT_MAX))
+    {
+      fatal("Invalid UDB file");
+    }
+
+  if (hdr->version != udb_mmap_version)
+    {
+      fatal("Unsupported version of mappable UDB file");
+    }
+
+  if (hdr->seqinfo_size != sizeof(seqinfo_t))
+    {
+      fatal("Mappable UDB file was created on an incompatible platform");
+    }
+
+  if (hdr->filesize != filesize)
+    {
+      fatal("Incorrect UDB file size");
+    }
+
+  uint64_t hashsize = 1ULL << (2 * hdr->wordlength);
+
+  const uint64_t sections[][2] =
+    {
+      { hdr->kmercount_offset, 4 * hashsize },
+      { hdr->kmerhash_offset, 8 * (hashsize + 1) },
+      { hdr->kmerindex_offset, 4 * hdr->kmerindexsize },
+      { hdr->bitmapkmers_offset, 4 * hdr->bitmapcount },
+      { hdr->bitmaps_offset, hdr->bitmapbytes * hdr->bitmapcount },
+      { hdr->seqindex_offset, sizeof(seqinfo_t) * hdr->seqcount },
+      { hdr->dbindex_map_offset, 4 * hdr->seqcount },
+      { hdr->data_offset, hdr->data_length }
+    };
+
+  for (auto const & section : sections)
+    {
+      if ((section[0] % udb_mmap_alignment) ||
+          (section[0] > filesize) ||
+          (section[1] > filesize - section[0]))
+        {
+          fatal("Invalid UDB file");
+        }
+    }
+
+  if (hdr->bitmapbytes < (hdr->seqcount + 127 + 7) / 8)
+    {
+      fatal("Invalid UDB file");
+    }
+}
+
+auto udb_mmap_put(int fd_output,
+                  unsigned char * mapping,
+                  void * buf,
+                  uint64_t nbyte,
+                  uint64_t offset) -> void
+{
+  /* write to the output, or copy into its mapping if it has one */
+
+  if (mapping)
+    {
+      memcpy(mapping + offset, buf, nbyte);
+      progress_update(offset + nbyte);
+    }
+  else
+    {
+      largewrite(fd_output, buf, nbyte, offset);
+    }
+}
+
+auto udb_mmap_write(int fd_output, uint128 cache_key, bool map_output) -> void
+{
+  /*
+    write the database and index in memory as a mappable UDB file;
+    with map_output the output is sized and filled through a mapping
+    instead, as shared memory objects cannot be written to on all
+    systems
+  */
+
+  unsigned int seqcount = db_getsequencecount();
+  unsigned int bitmap_mincount = seqcount / 8;
+
+  struct udb_mmap_header_s hdr;
+  memset(& hdr, 0, sizeof(hdr));
+
+  hdr.signature = udb_mmap_signature;
+  hdr.version = udb_mmap_version;
+  hdr.wordlength = opt_wordlength;
+  hdr.is_fastq = db_is_fastq() ? 1 : 0;
+  hdr.seqcount = seqcount;
+  hdr.nucleotides = db_getnucleotidecount();
+  hdr.longest = db_getlongestsequence();
+  hdr.shortest = db_getshortestsequence();
+  hdr.longestheader = db_getlongestheader();
+  hdr.bitmapbytes = (((seqcount + 127 + 7) / 8) + 15) / 16 * 16;
+  hdr.cache_key[0] = Uint128Low64(cache_key);
+  hdr.cache_key[1] = Uint128High64(cache_key);
+  hdr.seqinfo_size = sizeof(seqinfo_t);
+  hdr.signature_end = udb_mmap_signature_end;
+
+  /* offsets to the start of all lists, with bitmap kmers included */
+
+  auto * fullhash = (uint64_t *) xmalloc((kmerhashsize + 1) * sizeof(uint64_t));
+  uint64_t sum = 0;
+  for (unsigned int i = 0; i < kmerhashsize; i++)
+    {
+      fullhash[i] = sum;
+      sum += kmercount[i];
+      if ((kmercount[i] > 0) && (kmercount[i] >= bitmap_mincount))
+        {
+          ++hdr.bitmapcount;
+        }
+    }
+  fullhash[kmerhashsize] = sum;
+  hdr.kmerindexsize = sum;
+
+  /* the data area ends after the last header, sequence or quality */
+
+  for (unsigned int i = 0; i < seqcount; i++)
+    {
+      seqinfo_t * info = seqindex + i;
+      uint64_t end = MAX(info->header_p + info->headerlen + 1,
+                         info->seq_p + info->seqlen + 1);
+      if (hdr.is_fastq)
+        {
+          end = MAX(end, info->qual_p + info->seqlen + 1);
+        }
+      hdr.data_length = MAX(hdr.data_length, end);
+    }
+
+  uint64_t offset = udb_mmap_align(sizeof(hdr));
+  hdr.kmercount_offset = offset;
+  offset = udb_mmap_align(offset + 4ULL * kmerhashsize);
+  hdr.kmerhash_offset = offset;
+  offset = udb_mmap_align(offset + 8ULL * (kmerhashsize + 1));
+  hdr.kmerindex_offset = offset;
+  offset = udb_mmap_align(offset + 4 * hdr.kmerindexsize);
+  hdr.bitmapkmers_offset = offset;
+  offset = udb_mmap_align(offset + 4 * hdr.bitmapcount);
+  hdr.bitmaps_offset = offset;
+  offset = udb_mmap_align(offset + hdr.bitmapbytes * hdr.bitmapcount);
+  hdr.seqindex_offset = offset;
+  offset = udb_mmap_align(offset + sizeof(seqinfo_t) * seqcount);
+  hdr.dbindex_map_offset = offset;
+  offset = udb_mmap_align(offset + 4ULL * seqcount);
+  hdr.data_offset = offset;
+  hdr.filesize = offset + hdr.data_length;
+
+  unsigned char * mapping = nullptr;
+  if (map_output)
+    {
+      mapping = (unsigned char *) xmmap_write(fd_output, hdr.filesize);
+      if (! mapping)
+        {
+          fatal("Unable to write to UDB file");
+        }
+    }
+
+  progress_init("Writing UDB file", hdr.filesize);
+
+  udb_mmap_put(fd_output, mapping, kmercount, 4ULL * kmerhashsize,
+               hdr.kmercount_offset);
+  udb_mmap_put(fd_output, mapping, fullhash, 8ULL * (kmerhashsize + 1),
+               hdr.kmerhash_offset);
+
+  auto * buffer = (unsigned int *) xmalloc(4 * MAX(seqcount, hdr.bitmapcount));
+  auto * bitmap = (unsigned char *) xmalloc(hdr.bitmapbytes);
+  uint64_t bitmapno = 0;
+
+  for (unsigned int i = 0; i < kmerhashsize; i++)
+    {
+      unsigned int count = kmercount[i];
+      if (count == 0)
+        {
+          continue;
+        }
+
+      unsigned int * list = udb_get_matchlist(i, buffer);
+      udb_mmap_put(fd_output, mapping, list, 4ULL * count,
+                   hdr.kmerindex_offset + 4 * fullhash[i]);
+
+      if (count >= bitmap_mincount)
+        {
+          memset(bitmap, 0, hdr.bitmapbytes);
+          for (unsigned int j = 0; j < count; j++)
+            {
+              bitmap[list[j] >> 3] |= 1 << (list[j] & 7);
+            }
+          udb_mmap_put(fd_output, mapping, bitmap, hdr.bitmapbytes,
+                       hdr.bitmaps_offset + hdr.bitmapbytes * bitmapno);
+          ++bitmapno;
+        }
+    }
+
+  /* kmers with bitmaps, in the same order as the bitmaps */
+
+  bitmapno = 0;
+  for (unsigned int i = 0; i < kmerhashsize; i++)
+    {
+      if ((kmercount[i] > 0) && (kmercount[i] >= bitmap_mincount))
+        {
+          buffer[bitmapno++] = i;
+        }
+    }
+  udb_mmap_put(fd_output, mapping, buffer, 4 * hdr.bitmapcount,
+               hdr.bitmapkmers_offset);
+
+  udb_mmap_put(fd_output, mapping, seqindex, sizeof(seqinfo_t) * seqcount,
+               hdr.seqindex_offset);
+  udb_mmap_put(fd_output, mapping, dbindex_map, 4ULL * seqcount,
+               hdr.dbindex_map_offset);
+  udb_mmap_put(fd_output, mapping, datap, hdr.data_length, hdr.data_offset);
+
+  /* header last, so that a complete header implies complete contents */
+
+  udb_mmap_put(fd_output, mapping, & hdr, sizeof(hdr), 0);
+
+  progress_done();
+
+  if (mapping)
+    {
+      xmunmap(mapping, hdr.filesize);
+    }
+
+  xfree(bitmap);
+  xfree(buffer);
+  xfree(fullhash);
+}
+
+auto udb_read_mapped(const char * filename,
+                     int fd_udb,
+                     uint64_t filesize,
+                     bool create_bitmaps,
+                     bool parse_abundances) -> void
+{
+  /* map a mappable UDB file and point the database and index into it */
+
+  char * prompt = nullptr;
+  if (xsprintf(& prompt, "Mapping UDB file %s", filename) == -1)
+    {
+      fatal("Out of memory");
+    }
+
+  progress_init(prompt, filesize);
+
+  udb_mapping = xmmap_read(fd_udb, filesize);
+  if (! udb_mapping)
+    {
+      fatal("Unable to map UDB file into memory");
+    }
+  udb_mapping_size = filesize;
+
+  close(fd_udb);
+
+  auto * hdr = (struct udb_mmap_header_s *) udb_mapping;
+  udb_mmap_check(hdr, filesize);
+
+  char * base = (char *) udb_mapping;
+  unsigned int seqcount = hdr->seqcount;
+  udb_dbaccel = 100;
+
+  if (hdr->wordlength != opt_wordlength)
+    {
+      fprintf(stderr, "\nWARNING: Wordlength adjusted to %u as indicated in UDB file\n", hdr->wordlength);
+      opt_wordlength = hdr->wordlength;
+    }
+
+  kmerhashsize = 1 << (2 * hdr->wordlength);
+  kmercount = (unsigned int *) (base + hdr->kmercount_offset);
+  kmerhash = (uint64_t *) (base + hdr->kmerhash_offset);
+  kmerindex = (unsigned int *) (base + hdr->kmerindex_offset);
+  kmerindexsize = hdr->kmerindexsize;
+
+  if (kmerhash[kmerhashsize] != kmerindexsize)
+    {
+      fatal("Invalid UDB file");
+    }
+
+  kmerbitmap = (bitmap_t * *) xmalloc(kmerhashsize * sizeof(bitmap_t *));
+  memset(kmerbitmap, 0, kmerhashsize * sizeof(bitmap_t *));
+
+  if (create_bitmaps && hdr->bitmapcount)
+    {
+      auto * bitmapkmers = (unsigned int *) (base + hdr->bitmapkmers_offset);
+      udb_mapped_bitmaps = (bitmap_t *) xmalloc(hdr->bitmapcount * sizeof(bitmap_t));
+      for (uint64_t i = 0; i < hdr->bitmapcount; i++)
+        {
+          unsigned int kmer = bitmapkmers[i];
+          if (kmer >= kmerhashsize)
+            {
+              fatal("Invalid UDB file");
+            }
+          udb_mapped_bitmaps[i].size = seqcount + 127;
+          udb_mapped_bitmaps[i].bitmap = (unsigned char *)
+            (base + hdr->bitmaps_offset + hdr->bitmapbytes * i);
+          kmerbitmap[kmer] = udb_mapped_bitmaps + i;
+        }
+    }
+
+  seqindex = (seqinfo_t *) (base + hdr->seqindex_offset);
+  datap = base + hdr->data_offset;
+
+  /*
+    The recorded abundances are those given in the headers. Without
+    parsing, all abundances are 1, as with a classic UDB file, and the
+    sequence index is copied to change them.
+  */
+
+  if (! parse_abundances)
+    {
+      udb_seqindex_copy = (seqinfo_t *) xmalloc(MAX(seqcount, 1)
+                                                * sizeof(seqinfo_t));
+      memcpy(udb_seqindex_copy, seqindex, seqcount * sizeof(seqinfo_t));
+      for (unsigned int i = 0; i < seqcount; i++)
+        {
+          udb_seqindex_copy[i].size = 1;
+        }
+      seqindex = udb_seqindex_copy;
+    }
+
+  dbindex_map = (unsigned int *) (base + hdr->dbindex_map_offset);
+  dbindex_count = seqcount;
+  dbindex_uh = unique_init();
+
+  db_setinfo(hdr->is_fastq,
+             seqcount,
+             hdr->nucleotides,
+             hdr->longest,
+             hdr->shortest,
+             hdr->longestheader);
+
+  progress_done();
+  xfree(prompt);
+}
+
+
+auto udb_is_mapped() -> bool
+{
+  return udb_mapping != nullptr;
+}
+
+auto udb_unmap() -> void
+{
+  if (udb_mapped_bitmaps)
+    {
+      xfree(udb_mapped_bitmaps);
+      udb_mapped_bitmaps = nullptr;
+    }
+  if (udb_seqindex_copy)
+    {
+      xfree(udb_seqindex_copy);
+      udb_seqindex_copy = nullptr;
+    }
+  xmunmap(udb_mapping, udb_mapping_size);
+  udb_mapping = nullptr;
+  udb_mapping_size = 0;
+}
+
 auto udb_detect_isudb(const char * filename) -> bool
 {
   /*
@@ -161,7 +619,6 @@ auto udb_detect_isudb(const char * filename) -> bool
     It must be an uncompressed regular file, not a pipe.
   */
 
-  constexpr static uint32_t udb_file_signature {0x55444246};
   constexpr static uint64_t expected_n_bytes {sizeof(uint32_t)};
 
   xstat_t fs;
@@ -188,7 +645,8 @@ auto udb_detect_isudb(const char * filename) -> bool
   uint64_t bytesread = read(fd, & magic, expected_n_bytes);
   close(fd);
 
-  if ((bytesread == expected_n_bytes) && (magic == udb_file_signature))
+  if ((bytesread == expected_n_bytes) &&
+      ((magic == udb_signature) || (magic == udb_mmap_signature)))
     {
       return true;
     }
@@ -196,6 +654,19 @@ auto udb_detect_isudb(const char * filename) -> bool
   return false;
 }
 
+auto udb_info_mapped(std::FILE * fp, struct udb_mmap_header_s * hdr) -> void
+{
+  fprintf(fp, "           Seqs  %" PRIu64 "\n", hdr->seqcount);
+  fprintf(fp, "          Alpha  nt (4)\n");
+  fprintf(fp, "     Word width  %u\n", hdr->wordlength);
+  fprintf(fp, "      Dict size  %u (%.1fk)\n",
+          (1U << (2 * hdr->wordlength)),
+          (1U << (2 * hdr->wordlength)) * 1.0 / 1000.0);
+  fprintf(fp, "          Words  %" PRIu64 "\n", hdr->kmerindexsize);
+  fprintf(fp, "        Bitmaps  %" PRIu64 "\n", hdr->bitmapcount);
+  fprintf(fp, "         Layout  mappable, version %u\n", hdr->version);
+}
+
 void udb_info()
 {
   /* Read UDB header and show basic info */
@@ -216,6 +687,30 @@ void udb_info()
       fatal("Unable to read from UDB file or invalid UDB file");
     }
 
+  if (buffer[0] == udb_mmap_signature)
+    {
+      xstat_t fs;
+      if (xfstat(fd_udbinfo, & fs))
+        {
+          fatal("Unable to get status for input file (%s)", opt_udbinfo);
+        }
+      struct udb_mmap_header_s hdr;
+      memcpy(& hdr, buffer, sizeof(hdr));
+      udb_mmap_check(& hdr, fs.st_size);
+      close(fd_udbinfo);
+
+      if (!opt_quiet)
+        {
+          udb_info_mapped(stderr, & hdr);
+        }
+
+      if (opt_log)
+        {
+          udb_info_mapped(fp_log, & hdr);
+        }
+      return;
+    }
+
   if ((buffer[0]  != 0x55444246) ||
       (buffer[2] != 32) ||
       (buffer[4] < 3) ||
@@ -258,6 +753,53 @@ void udb_info()
   close(fd_udbinfo);
 }
 
+auto udb_show_dbinfo() -> void
+{
+  /* some stats */
+
+  if (!opt_quiet)
+    {
+      if (db_getsequencecount() > 0)
+        {
+          fprintf(stderr,
+                  "%" PRIu64 " nt in %" PRIu64 " seqs, min %" PRIu64 ", max %" PRIu64 ", avg %.0f\n",
+                  db_getnucleotidecount(),
+                  db_getsequencecount(),
+                  db_getshortestsequence(),
+                  db_getlongestsequence(),
+                  db_getnucleotidecount() * 1.0 / db_getsequencecount());
+        }
+      else
+        {
+          fprintf(stderr,
+                  "%" PRIu64 " nt in %" PRIu64 " seqs\n",
+                  db_getnucleotidecount(),
+                  db_getsequencecount());
+        }
+    }
+
+  if (opt_log)
+    {
+      if (db_getsequencecount() > 0)
+        {
+          fprintf(fp_log,
+                  "%" PRIu64 " nt in %" PRIu64 " seqs, min %" PRIu64 ", max %" PRIu64 ", avg %.0f\n\n",
+                  db_getnucleotidecount(),
+                  db_getsequencecount(),
+                  db_getshortestsequence(),
+                  db_getlongestsequence(),
+                  db_getnucleotidecount() * 1.0 / db_getsequencecount());
+        }
+      else
+        {
+          fprintf(fp_log,
+                  "%" PRIu64 " nt in %" PRIu64 " seqs\n\n",
+                  db_getnucleotidecount(),
+                  db_getsequencecount());
+        }
+    }
+}
+
 void udb_read(const char * filename,
               bool create_bitmaps,
               bool parse_abundances)
@@ -309,6 +851,16 @@ void udb_read(const char * filename,
 
   pos += largeread(fd_udb, buffer, 4 * 50, pos);
 
+  if (buffer[0] == udb_mmap_signature)
+    {
+      progress_done();
+      xfree(prompt);
+      udb_read_mapped(filename, fd_udb, filesize, create_bitmaps,
+                      parse_abundances);
+      udb_show_dbinfo();
+      return;
+    }
+
   if ((buffer[0]  != 0x55444246) ||
       (buffer[2] != 32) ||
       (buffer[4] < 3) ||
@@ -559,51 +1111,369 @@ void udb_read(const char * filename,
       dbindex_map[i] = i;
     }
 
-  /* done */
+  udb_show_dbinfo();
+}
 
-  /* some stats */
+auto udb_cache_hash_file(const char * filename) -> uint128
+{
+  /* chained hash of the raw file contents */
 
-  if (!opt_quiet)
+  int fd = xopen_read(filename);
+  if (fd < 0)
+    {
+      fatal("Unable to open input file for reading (%s)", filename);
+    }
+
+  xstat_t fs;
+  if (xfstat(fd, & fs))
+    {
+      fatal("Unable to get status for input file (%s)", filename);
+    }
+
+  progress_init("Hashing database file", fs.st_size);
+
+  auto * buffer = (char *) xmalloc(BLOCKSIZE);
+  uint128 hash(fs.st_size, 0);
+  uint64_t total = 0;
+  int64_t bytesread = 0;
+  while ((bytesread = read(fd, buffer, BLOCKSIZE)) > 0)
+    {
+      hash = CityHash128WithSeed(buffer, bytesread, hash);
+      total += bytesread;
+      progress_update(total);
+    }
+  if (bytesread < 0)
+    {
+      fatal("Unable to read from input file (%s)", filename);
+    }
+
+  xfree(buffer);
+  close(fd);
+  progress_done();
+  return hash;
+}
+
+auto udb_cache_key_params(bool masked, uint128 seed) -> uint128
+{
+  /* combine the given seed with all options affecting the index */
+
+  struct
+  {
+    uint64_t version;
+    uint64_t seqinfo_size;
+    uint64_t wordlength;
+    uint64_t dbmask;
+    uint64_t hardmask;
+    uint64_t masked;
+    uint64_t notrunclabels;
+    uint64_t minseqlength;
+    uint64_t maxseqlength;
+    uint64_t fastq_ascii;
+    uint64_t fastq_qmin;
+    uint64_t fastq_qmax;
+  } params;
+
+  memset(& params, 0, sizeof(params));
+  params.version = udb_mmap_version;
+  params.seqinfo_size = sizeof(seqinfo_t);
+  params.wordlength = opt_wordlength;
+  params.dbmask = opt_dbmask;
+  params.hardmask = opt_hardmask;
+  params.masked = masked ? 1 : 0;
+  params.notrunclabels = opt_notrunclabels;
+  params.minseqlength = opt_minseqlength;
+  params.maxseqlength = opt_maxseqlength;
+  params.fastq_ascii = opt_fastq_ascii;
+  params.fastq_qmin = opt_fastq_qmin;
+  params.fastq_qmax = opt_fastq_qmax;
+
+  return CityHash128WithSeed((const char *) & params, sizeof(params), seed);
+}
+
+auto udb_shm_read_header(int fd_shm,
+                         const xstat_t & ss,
+                         struct udb_mmap_header_s * hdr) -> bool
+{
+  /* shared memory objects can only be mapped, not read, on all systems */
+
+  if ((uint64_t) ss.st_size < sizeof(struct udb_mmap_header_s))
+    {
+      return false;
+    }
+  void * mapping = xmmap_read(fd_shm, sizeof(struct udb_mmap_header_s));
+  if (! mapping)
     {
-      if (seqcount > 0)
+      return false;
+    }
+  memcpy(hdr, mapping, sizeof(struct udb_mmap_header_s));
+  xmunmap(mapping, sizeof(struct udb_mmap_header_s));
+  return true;
+}
+
+auto udb_shm_lookup(const xstat_t & fs, bool masked) -> bool
+{
+  /*
+    Attach to the shared memory database named with --dbshm, if it
+    has been completely written and was built from the same file with
+    the same options. The key covers the size, modification time and
+    inode of the file instead of its contents, so that attaching does
+    not require reading the database file at all.
+  */
+
+  uint64_t file_id[4] = { (uint64_t) fs.st_size,
+                          (uint64_t) fs.st_mtime,
+                          (uint64_t) fs.st_ino,
+                          (uint64_t) fs.st_dev };
+  udb_shm_key = udb_cache_key_params(masked,
+                                     CityHash128((const char *) file_id,
+                                                 sizeof(file_id)));
+
+  if (xsprintf(& udb_shm_name,
+               "%s%s",
+               opt_dbshm[0] == '/' ? "" : "/",
+               opt_dbshm) == -1)
+    {
+      fatal("Out of memory");
+    }
+
+  int fd_shm = xshm_open_read(udb_shm_name);
+  if (fd_shm < 0)
+    {
+      if (errno != ENOENT)
         {
-          fprintf(stderr,
-                  "%" PRIu64 " nt in %" PRIu64 " seqs, min %" PRIu64 ", max %" PRIu64 ", avg %.0f\n",
-                  db_getnucleotidecount(),
-                  db_getsequencecount(),
-                  db_getshortestsequence(),
-                  db_getlongestsequence(),
-                  db_getnucleotidecount() * 1.0 / db_getsequencecount());
+          fatal("Unable to open shared memory database (%s)", udb_shm_name);
         }
-      else
+      return false;
+    }
+
+  /* a segment still being written by another process has no header */
+
+  struct udb_mmap_header_s hdr;
+  xstat_t ss;
+  if (xfstat(fd_shm, & ss) ||
+      (! udb_shm_read_header(fd_shm, ss, & hdr)) ||
+      (hdr.signature != udb_mmap_signature) ||
+      (hdr.signature_end != udb_mmap_signature_end) ||
+      (hdr.filesize != (uint64_t) ss.st_size))
+    {
+      /*
+        The writer holds a lock until the segment is complete. If the
+        lock is free and the segment has not changed for a while, the
+        writer has been terminated, and the segment is replaced.
+      */
+
+      if (xshm_trylock(fd_shm) &&
+          (time(nullptr) - ss.st_mtime >= udb_shm_stale_age))
         {
           fprintf(stderr,
-                  "%" PRIu64 " nt in %" PRIu64 " seqs\n",
-                  db_getnucleotidecount(),
-                  db_getsequencecount());
+                  "WARNING: Shared memory database (%s) left incomplete "
+                  "by a terminated process, replacing it\n",
+                  udb_shm_name);
+          close(fd_shm);
+          udb_shm_stale = true;
+          return false;
         }
+
+      fprintf(stderr,
+              "WARNING: Shared memory database (%s) is incomplete, not used\n",
+              udb_shm_name);
+      close(fd_shm);
+      xfree(udb_shm_name);
+      udb_shm_name = nullptr;
+      return false;
     }
 
-  if (opt_log)
+  if ((hdr.version != udb_mmap_version) ||
+      (hdr.cache_key[0] != Uint128Low64(udb_shm_key)) ||
+      (hdr.cache_key[1] != Uint128High64(udb_shm_key)))
     {
-      if (seqcount > 0)
+      /* replaced by udb_cache_store() once the index has been built */
+      udb_shm_stale = true;
+      close(fd_shm);
+      return false;
+    }
+
+  udb_read_mapped(udb_shm_name, fd_shm, ss.st_size, true, true);
+  udb_show_dbinfo();
+
+  xfree(udb_shm_name);
+  udb_shm_name = nullptr;
+
+  return true;
+}
+
+auto udb_shm_store() -> void
+{
+  /* copy the database and index into a new shared memory object */
+
+  if (udb_shm_stale && xshm_unlink(udb_shm_name) && (errno != ENOENT))
+    {
+      fprintf(stderr,
+              "WARNING: Unable to remove outdated shared memory database (%s)\n",
+              udb_shm_name);
+    }
+
+  /* if another process has created the object first, leave it alone */
+
+  int fd_shm = xshm_open_create(udb_shm_name);
+  if (fd_shm < 0)
+    {
+      if (errno != EEXIST)
         {
-          fprintf(fp_log,
-                  "%" PRIu64 " nt in %" PRIu64 " seqs, min %" PRIu64 ", max %" PRIu64 ", avg %.0f\n\n",
-                  db_getnucleotidecount(),
-                  db_getsequencecount(),
-                  db_getshortestsequence(),
-                  db_getlongestsequence(),
-                  db_getnucleotidecount() * 1.0 / db_getsequencecount());
+          fprintf(stderr,
+                  "WARNING: Unable to create shared memory database (%s)\n",
+                  udb_shm_name);
         }
-      else
+    }
+  else
+    {
+      /* locked until complete, see udb_shm_lookup() */
+      xshm_trylock(fd_shm);
+      udb_mmap_write(fd_shm, udb_shm_key, true);
+      close(fd_shm);
+    }
+
+  xfree(udb_shm_name);
+  udb_shm_name = nullptr;
+  udb_shm_stale = false;
+}
+
+auto udb_cache_lookup(const char * filename, bool masked) -> bool
+{
+  /*
+    Look for a copy of the database and k-mer index built from the
+    given FASTA or FASTQ file, first in the shared memory object named
+    with --dbshm, then in the --dbcache directory, and map it if
+    present. The key of a cache file covers the file contents and all
+    options affecting the database and index. If no valid copy is
+    found, the keys are remembered and udb_cache_store() saves the
+    index after it has been built.
+  */
+
+  if (! opt_dbcache && ! opt_dbshm)
+    {
+      return false;
+    }
+
+  xstat_t fs;
+  if (xstat(filename, & fs))
+    {
+      fatal("Unable to get status for input file (%s)", filename);
+    }
+
+  if (! S_ISREG(fs.st_mode))
+    {
+      return false;
+    }
+
+  if (opt_dbshm && udb_shm_lookup(fs, masked))
+    {
+      return true;
+    }
+
+  if (! opt_dbcache)
+    {
+      return false;
+    }
+
+  udb_cache_key = udb_cache_key_params(masked, udb_cache_hash_file(filename));
+
+  if (xsprintf(& udb_cache_filename,
+               "%s/vsearch-%016" PRIx64 "%016" PRIx64 ".udb",
+               opt_dbcache,
+               Uint128High64(udb_cache_key),
+               Uint128Low64(udb_cache_key)) == -1)
+    {
+      fatal("Out of memory");
+    }
+
+  int fd_cache = xopen_read(udb_cache_filename);
+  if (fd_cache < 0)
+    {
+      return false;
+    }
+
+  struct udb_mmap_header_s hdr;
+  xstat_t cs;
+  if (xfstat(fd_cache, & cs) ||
+      (read(fd_cache, & hdr, sizeof(hdr)) != (int64_t) sizeof(hdr)) ||
+      (hdr.signature != udb_mmap_signature) ||
+      (hdr.version != udb_mmap_version) ||
+      (hdr.filesize != (uint64_t) cs.st_size) ||
+      (hdr.cache_key[0] != Uint128Low64(udb_cache_key)) ||
+      (hdr.cache_key[1] != Uint128High64(udb_cache_key)))
+    {
+      close(fd_cache);
+      return false;
+    }
+
+  udb_read_mapped(udb_cache_filename, fd_cache, cs.st_size, true, true);
+  udb_show_dbinfo();
+
+  xfree(udb_cache_filename);
+  udb_cache_filename = nullptr;
+
+  if (udb_shm_name)
+    {
+      udb_shm_store();
+    }
+
+  return true;
+}
+
+auto udb_cache_pending() -> bool
+{
+  /* will the index built after a cache miss be stored? */
+
+  return (udb_shm_name != nullptr) || (udb_cache_filename != nullptr);
+}
+
+auto udb_cache_store() -> void
+{
+  /* save the database and index after a cache miss */
+
+  if (udb_shm_name)
+    {
+      udb_shm_store();
+    }
+
+  if (! udb_cache_filename)
+    {
+      return;
+    }
+
+  char * tempname = nullptr;
+  if (xsprintf(& tempname, "%s.%d.tmp", udb_cache_filename, (int) getpid()) == -1)
+    {
+      fatal("Out of memory");
+    }
+
+  int fd_cache = xopen_write(tempname);
+  if (fd_cache < 0)
+    {
+      fprintf(stderr,
+              "WARNING: Unable to write database cache file (%s)\n",
+              tempname);
+    }
+  else
+    {
+      udb_mmap_write(fd_cache, udb_cache_key, false);
+
+      /* replace atomically, so that concurrent readers never see
+         a partially written file */
+
+      if ((close(fd_cache) != 0) || rename(tempname, udb_cache_filename))
         {
-          fprintf(fp_log,
-                  "%" PRIu64 " nt in %" PRIu64 " seqs\n\n",
-                  db_getnucleotidecount(),
-                  db_getsequencecount());
+          fprintf(stderr,
+                  "WARNING: Unable to write database cache file (%s)\n",
+                  udb_cache_filename);
+          remove(tempname);
         }
     }
+
+  xfree(tempname);
+  xfree(udb_cache_filename);
+  udb_cache_filename = nullptr;
 }
 
 void udb_fasta()
@@ -899,6 +1769,18 @@ void udb_make()
   dbindex_prepare(1, opt_dbmask);
   dbindex_addallsequences(opt_dbmask);
 
+  if (opt_udb_mmap)
+    {
+      udb_mmap_write(fd_output, uint128(0, 0), false);
+      if (close(fd_output) != 0)
+        {
+          fatal("Unable to close UDB file");
+        }
+      dbindex_free();
+      db_free();
+      return;
+    }
+
   unsigned int seqcount = db_getsequencecount();
   uint64_t ntcount = db_getnucleotidecount();
 
@@ -957,28 +1839,12 @@ void udb_make()
   /* lists of sequence no's with matches for all words */
   for(unsigned int i = 0; i < kmerhashsize; i++)
     {
-      if (kmerbitmap[i])
+      if (kmercount[i] > 0)
         {
-          memset(buffer, 0, 4 * kmercount[i]);
-          unsigned int elements = 0;
-          for (unsigned int j = 0; j < seqcount; j++)
-            {
-              if (bitmap_get(kmerbitmap[i], j))
-                {
-                  buffer[elements++] = j;
-                }
-            }
-          pos += largewrite(fd_output, buffer, 4 * elements, pos);
-        }
-      else
-        {
-          if (kmercount[i] > 0)
-            {
-              pos += largewrite(fd_output,
-                                kmerindex + kmerhash[i],
-                                4 * kmercount[i],
-                                pos);
-            }
+          pos += largewrite(fd_output,
+                            udb_get_matchlist(i, buffer),
+                            4 * kmercount[i],
+                            pos);
         }
     }
 
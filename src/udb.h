@@ -62,6 +62,11 @@ auto udb_detect_isudb(const char * filename) -> bool;
 auto udb_read(const char * filename,
               bool create_bitmaps,
               bool parse_abundances) -> void;
+auto udb_cache_lookup(const char * filename, bool masked) -> bool;
+auto udb_cache_store() -> void;
+auto udb_cache_pending() -> bool;
+auto udb_is_mapped() -> bool;
+auto udb_unmap() -> void;
 auto udb_fasta() -> void;
 auto udb_info() -> void;
 auto udb_make() -> void;
@@ -234,6 +234,19 @@ void reverse_complement(char * rc, char * seq, int64_t len)
      The memory for rc must be long enough for the rc of the sequence
      (identical to the length of seq + 1. */
 
+#ifdef __x86_64__
+  if (avx2_present)
+    {
+      reverse_complement_avx2(rc, seq, len);
+      return;
+    }
+  if (ssse3_present)
+    {
+      reverse_complement_ssse3(rc, seq, len);
+      return;
+    }
+#endif
+
   for(int64_t i=0; i<len; i++)
     {
       rc[i] = chrmap_complement[(int)(seq[len-1-i])];
@@ -289,13 +302,29 @@ uint64_t random_ulong(uint64_t n)
 void string_normalize(char * normalized, char * s, unsigned int len)
 {
   /* convert string to upper case and replace U by T */
-  char * p = s;
-  char * q = normalized;
-  for(unsigned int i=0; i<len; i++)
+
+  /*
+    Runs of A, C, G, T and U are normalized with the vectorized
+    normalize_nucleotides. The table is only used for other symbols.
+  */
+
+  unsigned int i = 0;
+  while (i < len)
     {
-      *q++ = chrmap_normalize[(int)(*p++)];
+      i += normalize_nucleotides(normalized + i, s + i, len - i);
+
+      while (i < len)
+        {
+          const unsigned char m = chrmap_normalize[(unsigned char) s[i]];
+          normalized[i] = m;
+          ++i;
+          if ((m == 'A') or (m == 'C') or (m == 'G') or (m == 'T'))
+            {
+              break;
+            }
+        }
     }
-  *q = 0;
+  normalized[len] = 0;
 }
 
 void fprint_hex(FILE * fp, unsigned char * data, int len)
@@ -72,6 +72,7 @@ bool opt_fastq_eeout;
 bool opt_fastq_nostagger;
 bool opt_fastq_qout_max;
 bool opt_gzip_decompress;
+bool opt_index_compress;
 bool opt_label_substr_match;
 bool opt_lengthout;
 bool opt_no_progress;
@@ -86,6 +87,7 @@ bool opt_sintax_random;
 bool opt_sizein;
 bool opt_sizeorder;
 bool opt_sizeout;
+bool opt_udb_mmap;
 bool opt_xee;
 bool opt_xlength;
 bool opt_xsize;
@@ -107,6 +109,8 @@ char * opt_consout;
 char * opt_cut;
 char * opt_cut_pattern;
 char * opt_db;
+char * opt_dbcache;
+char * opt_dbshm;
 char * opt_dbmatched;
 char * opt_dbnotmatched;
 char * opt_derep_fulllength;
@@ -166,6 +170,7 @@ char * opt_orient;
 char * opt_otutabout;
 char * opt_output;
 char * opt_pattern;
+char * opt_previous;
 char * opt_profile;
 char * opt_qsegout;
 char * opt_relabel;
@@ -174,12 +179,17 @@ char * opt_reverse;
 char * opt_samout;
 char * opt_sample;
 char * opt_search_exact;
+char * opt_server;
+char * opt_shard_uc;
 char * opt_sff_convert;
 char * opt_shuffle;
+char * opt_simd;
 char * opt_sintax;
+char * opt_snapshotout;
 char * opt_sortbylength;
 char * opt_sortbysize;
 char * opt_tabbedout;
+char * opt_tmpdir;
 char * opt_tsegout;
 char * opt_uc;
 char * opt_uchime2_denovo;
@@ -288,6 +298,7 @@ int64_t opt_maxseqlength;
 int64_t opt_maxsize;
 int64_t opt_maxsubs;
 int64_t opt_maxuniquesize;
+int64_t opt_memory_limit;
 int64_t opt_mincols;
 int64_t opt_minseqlength;
 int64_t opt_minsize;
@@ -298,10 +309,14 @@ int64_t opt_mismatch;
 int64_t opt_notrunclabels;
 int64_t opt_output_no_hits;
 int64_t opt_qmask;
+int64_t opt_query_batch;
 int64_t opt_randseed;
 int64_t opt_rightjust;
 int64_t opt_rowlen;
 int64_t opt_sample_size;
+int64_t opt_shard;
+int64_t opt_shards;
+bool opt_sample_stream;
 int64_t opt_self;
 int64_t opt_selfid;
 int64_t opt_strand;
@@ -329,6 +344,7 @@ int64_t sse42_present = 0;
 int64_t popcnt_present = 0;
 int64_t avx_present = 0;
 int64_t avx2_present = 0;
+int64_t avx512bw_present = 0;
 
 static char * progname;
 static char progheader[80];
@@ -346,6 +362,19 @@ char * STDOUT_NAME = (char*) "/dev/stdout";
   __asm__ __volatile__ ("cpuid"                                         \
                         : "=a" (a), "=b" (b), "=c" (c), "=d" (d)        \
                         : "a" (f1), "c" (f2));
+
+/* read an extended control register, XCR0 tells which register state
+   the operating system saves on context switches */
+#define xgetbv(n, a, d)                                                 \
+  __asm__ __volatile__ (".byte 0x0f, 0x01, 0xd0"                        \
+                        : "=a" (a), "=d" (d)                            \
+                        : "c" (n));
+
+/* instructions supported by the cpu, maybe not enabled by the system;
+   the *_present flags above, used to select the code paths everywhere,
+   are only set when both hold */
+static int64_t avx2_cpu = 0;
+static int64_t avx512bw_cpu = 0;
 #endif
 
 void cpu_features_detect()
@@ -381,10 +410,26 @@ void cpu_features_detect()
       popcnt_present = (c >> 23) & 1;
       avx_present    = (c >> 28) & 1;
 
+      /* the YMM (bits 1-2) and the opmask and ZMM state (bits 5-7)
+         must be enabled by the operating system (OSXSAVE, XCR0) */
+      unsigned int xcr0 = 0;
+      if ((c >> 27) & 1)
+        {
+          unsigned int xcr0_high = 0;
+          xgetbv(0, xcr0, xcr0_high);
+        }
+      const bool ymm_enabled = (xcr0 & 0x6) == 0x6;
+      const bool zmm_enabled = (xcr0 & 0xe6) == 0xe6;
+
+      avx_present = avx_present && ymm_enabled;
+
       if (maxlevel >= 7)
         {
           cpuid(7, 0, a, b, c, d);
-          avx2_present = (b >>  5) & 1;
+          avx2_cpu = (b >>  5) & 1;
+          avx512bw_cpu = (b >> 30) & 1;
+          avx2_present = avx2_cpu && ymm_enabled;
+          avx512bw_present = avx512bw_cpu && zmm_enabled;
         }
     }
 #else
@@ -392,6 +437,114 @@ void cpu_features_detect()
 #endif
 }
 
+void cpu_features_limit()
+{
+  /* Turn off the cpu features above the level selected with --simd,
+     so that the code for that level is used everywhere */
+
+  if ((opt_simd == nullptr) || (strcasecmp(opt_simd, "auto") == 0))
+    {
+      return;
+    }
+
+#ifdef __x86_64__
+  if (strcasecmp(opt_simd, "sse2") == 0)
+    {
+      ssse3_present = 0;
+      sse41_present = 0;
+      sse42_present = 0;
+      avx_present = 0;
+      avx2_present = 0;
+      avx512bw_present = 0;
+    }
+  else if (strcasecmp(opt_simd, "ssse3") == 0)
+    {
+      if (! ssse3_present)
+        {
+          fatal("This cpu does not support %s instructions", "ssse3");
+        }
+      sse41_present = 0;
+      sse42_present = 0;
+      avx_present = 0;
+      avx2_present = 0;
+      avx512bw_present = 0;
+    }
+  else if (strcasecmp(opt_simd, "sse4.2") == 0)
+    {
+      if (! sse42_present)
+        {
+          fatal("This cpu does not support %s instructions", "sse4.2");
+        }
+      avx_present = 0;
+      avx2_present = 0;
+      avx512bw_present = 0;
+    }
+  else if (strcasecmp(opt_simd, "avx2") == 0)
+    {
+      if (! avx2_cpu)
+        {
+          fatal("This cpu does not support %s instructions", "avx2");
+        }
+      if (! avx2_present)
+        {
+          fatal("The operating system has not enabled %s instructions", "avx2");
+        }
+      avx512bw_present = 0;
+    }
+  else if (strcasecmp(opt_simd, "avx512bw") == 0)
+    {
+      if (! avx512bw_cpu)
+        {
+          fatal("This cpu does not support %s instructions", "avx512bw");
+        }
+      if (! avx512bw_present)
+        {
+          fatal("The operating system has not enabled %s instructions",
+                "avx512bw");
+        }
+    }
+  else
+    {
+      fatal("The argument to --simd must be auto, sse2, ssse3, sse4.2, avx2 or avx512bw");
+    }
+#elif defined __aarch64__
+  if (strcasecmp(opt_simd, "neon") != 0)
+    {
+      fatal("The argument to --simd must be auto or neon");
+    }
+#elif defined __PPC__
+  if (strcasecmp(opt_simd, "altivec") != 0)
+    {
+      fatal("The argument to --simd must be auto or altivec");
+    }
+#endif
+}
+
+auto cpu_simd_level() -> const char *
+{
+  /* the instruction set used by the fastest code paths selected */
+
+#ifdef __x86_64__
+  if (avx512bw_present)
+    {
+      return "avx512bw";
+    }
+  if (avx2_present)
+    {
+      return "avx2";
+    }
+  if (ssse3_present)
+    {
+      return "ssse3";
+    }
+  return "sse2";
+#elif defined __aarch64__
+  return "neon";
+#else
+  return "altivec";
+#endif
+}
+
 void cpu_features_show()
 {
   fprintf(stderr, "CPU features:");
@@ -443,6 +596,10 @@ void cpu_features_show()
     {
       fprintf(stderr, " avx2");
     }
+  if (avx512bw_present)
+    {
+      fprintf(stderr, " avx512bw");
+    }
   fprintf(stderr, "\n");
 }
 
@@ -776,6 +933,8 @@ void args_init(int argc, char **argv)
   opt_cut = nullptr;
   opt_cut_pattern = nullptr;
   opt_db = nullptr;
+  opt_dbcache = nullptr;
+  opt_dbshm = nullptr;
   opt_dbmask = MASK_DUST;
   opt_dbmatched = nullptr;
   opt_dbnotmatched = nullptr;
@@ -869,6 +1028,7 @@ void args_init(int argc, char **argv)
   opt_iddef = 2;
   opt_idprefix = 0;
   opt_idsuffix = 0;
+  opt_index_compress = false;
   opt_join_padgap = nullptr;
   opt_join_padgapq = nullptr;
   opt_label = nullptr;
@@ -905,6 +1065,7 @@ void args_init(int argc, char **argv)
   opt_maxsl = DBL_MAX;
   opt_maxsubs = INT_MAX;
   opt_maxuniquesize = LONG_MAX;
+  opt_memory_limit = 0;
   opt_mid = 0.0;
   opt_min_unmasked_pct = 0.0;
   opt_mincols = 0;
@@ -932,9 +1093,11 @@ void args_init(int argc, char **argv)
   opt_output = nullptr;
   opt_output_no_hits = 0;
   opt_pattern = nullptr;
+  opt_previous = nullptr;
   opt_profile = nullptr;
   opt_qmask = MASK_DUST;
   opt_qsegout = nullptr;
+  opt_query_batch = 1;
   opt_query_cov = 0.0;
   opt_quiet = false;
   opt_randseed = 0;
@@ -952,12 +1115,18 @@ void args_init(int argc, char **argv)
   opt_sample = nullptr;
   opt_sample_pct = 0;
   opt_sample_size = 0;
+  opt_sample_stream = false;
   opt_search_exact = nullptr;
+  opt_server = nullptr;
+  opt_shard = 0;
+  opt_shard_uc = nullptr;
+  opt_shards = 0;
   opt_self = 0;
   opt_selfid = 0;
   opt_sff_clip = false;
   opt_sff_convert = nullptr;
   opt_shuffle = nullptr;
+  opt_simd = nullptr;
   opt_sintax = nullptr;
   opt_sintax_cutoff = 0.0;
   opt_sintax_random = false;
@@ -965,6 +1134,7 @@ void args_init(int argc, char **argv)
   opt_sizeorder = false;
   opt_sizeout = false;
   opt_slots = 0;
+  opt_snapshotout = nullptr;
   opt_sortbylength = nullptr;
   opt_sortbysize = nullptr;
   opt_strand = 1;
@@ -973,6 +1143,7 @@ void args_init(int argc, char **argv)
   opt_tabbedout = nullptr;
   opt_target_cov = 0.0;
   opt_threads = 0;
+  opt_tmpdir = nullptr;
   opt_top_hits_only = 0;
   opt_topn = LONG_MAX;
   opt_tsegout = nullptr;
@@ -986,6 +1157,7 @@ void args_init(int argc, char **argv)
   opt_uchimeout = nullptr;
   opt_uchimeout5 = 0;
   opt_udb2fasta = nullptr;
+  opt_udb_mmap = false;
   opt_udbinfo = nullptr;
   opt_udbstats = nullptr;
   opt_unoise_alpha = 2.0;
@@ -1033,9 +1205,11 @@ void args_init(int argc, char **argv)
       option_cut,
       option_cut_pattern,
       option_db,
+      option_dbcache,
       option_dbmask,
       option_dbmatched,
       option_dbnotmatched,
+      option_dbshm,
       option_derep_fulllength,
       option_derep_id,
       option_derep_prefix,
@@ -1115,6 +1289,7 @@ void args_init(int argc, char **argv)
       option_iddef,
       option_idprefix,
       option_idsuffix,
+      option_index_compress,
       option_join_padgap,
       option_join_padgapq,
       option_label,
@@ -1149,6 +1324,7 @@ void args_init(int argc, char **argv)
       option_maxsl,
       option_maxsubs,
       option_maxuniquesize,
+      option_memory_limit,
       option_mid,
       option_min_unmasked_pct,
       option_mincols,
@@ -1177,9 +1353,11 @@ void args_init(int argc, char **argv)
       option_output,
       option_output_no_hits,
       option_pattern,
+      option_previous,
       option_profile,
       option_qmask,
       option_qsegout,
+      option_query_batch,
       option_query_cov,
       option_quiet,
       option_randseed,
@@ -1197,12 +1375,18 @@ void args_init(int argc, char **argv)
       option_sample,
       option_sample_pct,
       option_sample_size,
+      option_sample_stream,
       option_search_exact,
+      option_server,
       option_self,
       option_selfid,
       option_sff_clip,
       option_sff_convert,
+      option_shard,
+      option_shard_uc,
+      option_shards,
       option_shuffle,
+      option_simd,
       option_sintax,
       option_sintax_cutoff,
       option_sintax_random,
@@ -1210,6 +1394,7 @@ void args_init(int argc, char **argv)
       option_sizeorder,
       option_sizeout,
       option_slots,
+      option_snapshotout,
       option_sortbylength,
       option_sortbysize,
       option_strand,
@@ -1218,6 +1403,7 @@ void args_init(int argc, char **argv)
       option_tabbedout,
       option_target_cov,
       option_threads,
+      option_tmpdir,
       option_top_hits_only,
       option_topn,
       option_tsegout,
@@ -1231,6 +1417,7 @@ void args_init(int argc, char **argv)
       option_uchimeout,
       option_uchimeout5,
       option_udb2fasta,
+      option_udb_mmap,
       option_udbinfo,
       option_udbstats,
       option_unoise_alpha,
@@ -1280,9 +1467,11 @@ void args_init(int argc, char **argv)
       {"cut",                   required_argument, nullptr, 0 },
       {"cut_pattern",           required_argument, nullptr, 0 },
       {"db",                    required_argument, nullptr, 0 },
+      {"dbcache",               required_argument, nullptr, 0 },
       {"dbmask",                required_argument, nullptr, 0 },
       {"dbmatched",             required_argument, nullptr, 0 },
       {"dbnotmatched",          required_argument, nullptr, 0 },
+      {"dbshm",                 required_argument, nullptr, 0 },
       {"derep_fulllength",      required_argument, nullptr, 0 },
       {"derep_id",              required_argument, nullptr, 0 },
       {"derep_prefix",          required_argument, nullptr, 0 },
@@ -1362,6 +1551,7 @@ void args_init(int argc, char **argv)
       {"iddef",                 required_argument, nullptr, 0 },
       {"idprefix",              required_argument, nullptr, 0 },
       {"idsuffix",              required_argument, nullptr, 0 },
+      {"index_compress",        no_argument,       nullptr, 0 },
       {"join_padgap",           required_argument, nullptr, 0 },
       {"join_padgapq",          required_argument, nullptr, 0 },
       {"label",                 required_argument, nullptr, 0 },
@@ -1396,6 +1586,7 @@ void args_init(int argc, char **argv)
       {"maxsl",                 required_argument, nullptr, 0 },
       {"maxsubs",               required_argument, nullptr, 0 },
       {"maxuniquesize",         required_argument, nullptr, 0 },
+      {"memory_limit",          required_argument, nullptr, 0 },
       {"mid",                   required_argument, nullptr, 0 },
       {"min_unmasked_pct",      required_argument, nullptr, 0 },
       {"mincols",               required_argument, nullptr, 0 },
@@ -1424,9 +1615,11 @@ void args_init(int argc, char **argv)
       {"output",                required_argument, nullptr, 0 },
       {"output_no_hits",        no_argument,       nullptr, 0 },
       {"pattern",               required_argument, nullptr, 0 },
+      {"previous",              required_argument, nullptr, 0 },
       {"profile",               required_argument, nullptr, 0 },
       {"qmask",                 required_argument, nullptr, 0 },
       {"qsegout",               required_argument, nullptr, 0 },
+      {"query_batch",           required_argument, nullptr, 0 },
       {"query_cov",             required_argument, nullptr, 0 },
       {"quiet",                 no_argument,       nullptr, 0 },
       {"randseed",              required_argument, nullptr, 0 },
@@ -1444,12 +1637,18 @@ void args_init(int argc, char **argv)
       {"sample",                required_argument, nullptr, 0 },
       {"sample_pct",            required_argument, nullptr, 0 },
       {"sample_size",           required_argument, nullptr, 0 },
+      {"sample_stream",         no_argument,       nullptr, 0 },
       {"search_exact",          required_argument, nullptr, 0 },
+      {"server",                required_argument, nullptr, 0 },
       {"self",                  no_argument,       nullptr, 0 },
       {"selfid",                no_argument,       nullptr, 0 },
       {"sff_clip",              no_argument,       nullptr, 0 },
       {"sff_convert",           required_argument, nullptr, 0 },
+      {"shard",                 required_argument, nullptr, 0 },
+      {"shard_uc",              required_argument, nullptr, 0 },
+      {"shards",                required_argument, nullptr, 0 },
       {"shuffle",               required_argument, nullptr, 0 },
+      {"simd",                  required_argument, nullptr, 0 },
       {"sintax",                required_argument, nullptr, 0 },
       {"sintax_cutoff",         required_argument, nullptr, 0 },
       {"sintax_random",         no_argument,       nullptr, 0 },
@@ -1457,6 +1656,7 @@ void args_init(int argc, char **argv)
       {"sizeorder",             no_argument,       nullptr, 0 },
       {"sizeout",               no_argument,       nullptr, 0 },
       {"slots",                 required_argument, nullptr, 0 },
+      {"snapshotout",           required_argument, nullptr, 0 },
       {"sortbylength",          required_argument, nullptr, 0 },
       {"sortbysize",            required_argument, nullptr, 0 },
       {"strand",                required_argument, nullptr, 0 },
@@ -1465,6 +1665,7 @@ void args_init(int argc, char **argv)
       {"tabbedout",             required_argument, nullptr, 0 },
       {"target_cov",            required_argument, nullptr, 0 },
       {"threads",               required_argument, nullptr, 0 },
+      {"tmpdir",                required_argument, nullptr, 0 },
       {"top_hits_only",         no_argument,       nullptr, 0 },
       {"topn",                  required_argument, nullptr, 0 },
       {"tsegout",               required_argument, nullptr, 0 },
@@ -1478,6 +1679,7 @@ void args_init(int argc, char **argv)
       {"uchimeout",             required_argument, nullptr, 0 },
       {"uchimeout5",            no_argument,       nullptr, 0 },
       {"udb2fasta",             required_argument, nullptr, 0 },
+      {"udb_mmap",              no_argument,       nullptr, 0 },
       {"udbinfo",               required_argument, nullptr, 0 },
       {"udbstats",              required_argument, nullptr, 0 },
       {"unoise_alpha",          required_argument, nullptr, 0 },
@@ -2019,6 +2221,10 @@ void args_init(int argc, char **argv)
           opt_sample_size = args_getlong(optarg);
           break;
 
+        case option_sample_stream:
+          opt_sample_stream = true;
+          break;
+
         case option_fastaout:
           opt_fastaout = optarg;
           break;
@@ -2163,6 +2369,22 @@ void args_init(int argc, char **argv)
           opt_search_exact = optarg;
           break;
 
+        case option_server:
+          opt_server = optarg;
+          break;
+
+        case option_shard:
+          opt_shard = args_getlong(optarg);
+          break;
+
+        case option_shard_uc:
+          opt_shard_uc = optarg;
+          break;
+
+        case option_shards:
+          opt_shards = args_getlong(optarg);
+          break;
+
         case option_fastx_mask:
           opt_fastx_mask = optarg;
           break;
@@ -2555,6 +2777,46 @@ void args_init(int argc, char **argv)
           opt_sintax_random = true;
           break;
 
+        case option_udb_mmap:
+          opt_udb_mmap = true;
+          break;
+
+        case option_dbcache:
+          opt_dbcache = optarg;
+          break;
+
+        case option_dbshm:
+          opt_dbshm = optarg;
+          break;
+
+        case option_index_compress:
+          opt_index_compress = true;
+          break;
+
+        case option_query_batch:
+          opt_query_batch = args_getlong(optarg);
+          break;
+
+        case option_simd:
+          opt_simd = optarg;
+          break;
+
+        case option_memory_limit:
+          opt_memory_limit = args_getlong(optarg);
+          break;
+
+        case option_tmpdir:
+          opt_tmpdir = optarg;
+          break;
+
+        case option_previous:
+          opt_previous = optarg;
+          break;
+
+        case option_snapshotout:
+          opt_snapshotout = optarg;
+          break;
+
         default:
           fatal("Internal error in option parsing");
         }
@@ -2611,6 +2873,7 @@ void args_init(int argc, char **argv)
       option_orient,
       option_rereplicate,
       option_search_exact,
+      option_server,
       option_sff_convert,
       option_shuffle,
       option_sintax,
@@ -2635,7 +2898,7 @@ void args_init(int argc, char **argv)
     The first line is the command and the lines below are the valid options.
   */
 
-  const int valid_options[][98] =
+  const int valid_options[][102] =
     {
       {
         option_allpairs_global,
@@ -2705,6 +2968,7 @@ void args_init(int argc, char **argv)
         option_sample,
         option_self,
         option_selfid,
+        option_simd,
         option_sizein,
         option_sizeout,
         option_slots,
@@ -2753,6 +3017,7 @@ void args_init(int argc, char **argv)
         option_relabel_self,
         option_relabel_sha1,
         option_sample,
+        option_simd,
         option_sizein,
         option_sizeout,
         option_tabbedout,
@@ -2839,6 +3104,7 @@ void args_init(int argc, char **argv)
         option_sample,
         option_self,
         option_selfid,
+        option_simd,
         option_sizein,
         option_sizeorder,
         option_sizeout,
@@ -2936,6 +3202,10 @@ void args_init(int argc, char **argv)
         option_sample,
         option_self,
         option_selfid,
+        option_shard,
+        option_shard_uc,
+        option_shards,
+        option_simd,
         option_sizein,
         option_sizeorder,
         option_sizeout,
@@ -3033,6 +3303,7 @@ void args_init(int argc, char **argv)
         option_sample,
         option_self,
         option_selfid,
+        option_simd,
         option_sizein,
         option_sizeorder,
         option_sizeout,
@@ -3132,6 +3403,10 @@ void args_init(int argc, char **argv)
         option_sample,
         option_self,
         option_selfid,
+        option_shard,
+        option_shard_uc,
+        option_shards,
+        option_simd,
         option_sizein,
         option_sizeorder,
         option_sizeout,
@@ -3174,6 +3449,7 @@ void args_init(int argc, char **argv)
         option_relabel_self,
         option_relabel_sha1,
         option_sample,
+        option_simd,
         option_sizein,
         option_sizeout,
         option_xee,
@@ -3194,6 +3470,7 @@ void args_init(int argc, char **argv)
         option_no_progress,
         option_notrunclabels,
         option_output,
+        option_previous,
         option_quiet,
         option_relabel,
         option_relabel_keep,
@@ -3201,8 +3478,10 @@ void args_init(int argc, char **argv)
         option_relabel_self,
         option_relabel_sha1,
         option_sample,
+        option_simd,
         option_sizein,
         option_sizeout,
+        option_snapshotout,
         option_strand,
         option_threads,
         option_topn,
@@ -3226,6 +3505,7 @@ void args_init(int argc, char **argv)
         option_no_progress,
         option_notrunclabels,
         option_output,
+        option_previous,
         option_quiet,
         option_relabel,
         option_relabel_keep,
@@ -3233,8 +3513,10 @@ void args_init(int argc, char **argv)
         option_relabel_self,
         option_relabel_sha1,
         option_sample,
+        option_simd,
         option_sizein,
         option_sizeout,
+        option_snapshotout,
         option_strand,
         option_threads,
         option_topn,
@@ -3265,6 +3547,7 @@ void args_init(int argc, char **argv)
         option_relabel_self,
         option_relabel_sha1,
         option_sample,
+        option_simd,
         option_sizein,
         option_sizeout,
         option_strand,
@@ -3289,6 +3572,7 @@ void args_init(int argc, char **argv)
         option_log,
         option_maxseqlength,
         option_maxuniquesize,
+        option_memory_limit,
         option_minseqlength,
         option_minuniquesize,
         option_no_progress,
@@ -3300,10 +3584,12 @@ void args_init(int argc, char **argv)
         option_relabel_self,
         option_relabel_sha1,
         option_sample,
+        option_simd,
         option_sizein,
         option_sizeout,
         option_strand,
         option_threads,
+        option_tmpdir,
         option_xee,
         option_xlength,
         option_xsize,
@@ -3326,6 +3612,7 @@ void args_init(int argc, char **argv)
         option_relabel_self,
         option_relabel_sha1,
         option_sample,
+        option_simd,
         option_sizein,
         option_sizeout,
         option_threads,
@@ -3341,6 +3628,7 @@ void args_init(int argc, char **argv)
         option_log,
         option_no_progress,
         option_quiet,
+        option_simd,
         option_threads,
         -1 },
 
@@ -3365,6 +3653,7 @@ void args_init(int argc, char **argv)
         option_relabel_self,
         option_relabel_sha1,
         option_sample,
+        option_simd,
         option_sizein,
         option_sizeout,
         option_threads,
@@ -3383,6 +3672,7 @@ void args_init(int argc, char **argv)
         option_no_progress,
         option_output,
         option_quiet,
+        option_simd,
         option_threads,
         -1 },
 
@@ -3398,6 +3688,7 @@ void args_init(int argc, char **argv)
         option_no_progress,
         option_output,
         option_quiet,
+        option_simd,
         option_threads,
         -1 },
 
@@ -3443,6 +3734,7 @@ void args_init(int argc, char **argv)
         option_relabel_sha1,
         option_reverse,
         option_sample,
+        option_simd,
         option_sizein,
         option_sizeout,
         option_threads,
@@ -3473,6 +3765,7 @@ void args_init(int argc, char **argv)
         option_relabel_self,
         option_relabel_sha1,
         option_reverse,
+        option_simd,
         option_sizein,
         option_sizeout,
         option_threads,
@@ -3523,6 +3816,7 @@ void args_init(int argc, char **argv)
         option_relabel_sha1,
         option_reverse,
         option_sample,
+        option_simd,
         option_sizein,
         option_sizeout,
         option_threads,
@@ -3541,6 +3835,7 @@ void args_init(int argc, char **argv)
         option_no_progress,
         option_output,
         option_quiet,
+        option_simd,
         option_threads,
         -1 },
 
@@ -3587,6 +3882,7 @@ void args_init(int argc, char **argv)
         option_relabel_sha1,
         option_reverse,
         option_sample,
+        option_simd,
         option_sizein,
         option_sizeout,
         option_threads,
@@ -3620,6 +3916,7 @@ void args_init(int argc, char **argv)
         option_relabel_self,
         option_relabel_sha1,
         option_sample,
+        option_simd,
         option_sizein,
         option_sizeout,
         option_threads,
@@ -3657,6 +3954,7 @@ void args_init(int argc, char **argv)
         option_relabel_self,
         option_relabel_sha1,
         option_sample,
+        option_simd,
         option_sizein,
         option_sizeout,
         option_threads,
@@ -3690,6 +3988,7 @@ void args_init(int argc, char **argv)
         option_relabel_self,
         option_relabel_sha1,
         option_sample,
+        option_simd,
         option_sizein,
         option_sizeout,
         option_subseq_end,
@@ -3725,6 +4024,7 @@ void args_init(int argc, char **argv)
         option_relabel_self,
         option_relabel_sha1,
         option_sample,
+        option_simd,
         option_sizein,
         option_sizeout,
         option_threads,
@@ -3754,6 +4054,7 @@ void args_init(int argc, char **argv)
         option_relabel_self,
         option_relabel_sha1,
         option_sample,
+        option_simd,
         option_sizein,
         option_sizeout,
         option_threads,
@@ -3788,6 +4089,8 @@ void args_init(int argc, char **argv)
         option_sample,
         option_sample_pct,
         option_sample_size,
+        option_sample_stream,
+        option_simd,
         option_sizein,
         option_sizeout,
         option_threads,
@@ -3818,6 +4121,7 @@ void args_init(int argc, char **argv)
         option_minuniquesize,
         option_no_progress,
         option_notrunclabels,
+        option_previous,
         option_quiet,
         option_relabel,
         option_relabel_keep,
@@ -3825,8 +4129,10 @@ void args_init(int argc, char **argv)
         option_relabel_self,
         option_relabel_sha1,
         option_sample,
+        option_simd,
         option_sizein,
         option_sizeout,
+        option_snapshotout,
         option_strand,
         option_tabbedout,
         option_threads,
@@ -3840,12 +4146,14 @@ void args_init(int argc, char **argv)
       { option_h,
         option_log,
         option_quiet,
+        option_simd,
         option_threads,
         -1 },
 
       { option_help,
         option_log,
         option_quiet,
+        option_simd,
         option_threads,
         -1 },
 
@@ -3861,7 +4169,9 @@ void args_init(int argc, char **argv)
         option_notrunclabels,
         option_output,
         option_quiet,
+        option_simd,
         option_threads,
+        option_udb_mmap,
         option_wordlength,
         -1 },
 
@@ -3888,6 +4198,7 @@ void args_init(int argc, char **argv)
         option_relabel_self,
         option_relabel_sha1,
         option_sample,
+        option_simd,
         option_sizein,
         option_sizeout,
         option_threads,
@@ -3899,11 +4210,14 @@ void args_init(int argc, char **argv)
       { option_orient,
         option_bzip2_decompress,
         option_db,
+        option_dbcache,
+        option_dbshm,
         option_dbmask,
         option_fasta_width,
         option_fastaout,
         option_fastqout,
         option_gzip_decompress,
+        option_index_compress,
         option_label_suffix,
         option_lengthout,
         option_log,
@@ -3918,6 +4232,7 @@ void args_init(int argc, char **argv)
         option_relabel_self,
         option_relabel_sha1,
         option_sample,
+        option_simd,
         option_sizein,
         option_sizeout,
         option_tabbedout,
@@ -3945,6 +4260,7 @@ void args_init(int argc, char **argv)
         option_relabel_self,
         option_relabel_sha1,
         option_sample,
+        option_simd,
         option_sizein,
         option_sizeout,
         option_threads,
@@ -4005,6 +4321,7 @@ void args_init(int argc, char **argv)
         option_samout,
         option_sample,
         option_self,
+        option_simd,
         option_sizein,
         option_sizeout,
         option_strand,
@@ -4020,6 +4337,20 @@ void args_init(int argc, char **argv)
         option_xsize,
         -1 },
 
+      { option_server,
+        option_db,
+        option_dbcache,
+        option_dbmask,
+        option_dbshm,
+        option_hardmask,
+        option_index_compress,
+        option_maxseqlength,
+        option_minseqlength,
+        option_notrunclabels,
+        option_quiet,
+        option_wordlength,
+        -1 },
+
       { option_sff_convert,
         option_fastq_asciiout,
         option_fastq_qmaxout,
@@ -4037,6 +4368,7 @@ void args_init(int argc, char **argv)
         option_relabel_sha1,
         option_sample,
         option_sff_clip,
+        option_simd,
         option_sizeout,
         option_threads,
         -1 },
@@ -4064,6 +4396,7 @@ void args_init(int argc, char **argv)
         option_relabel_self,
         option_relabel_sha1,
         option_sample,
+        option_simd,
         option_sizein,
         option_sizeout,
         option_threads,
@@ -4076,11 +4409,14 @@ void args_init(int argc, char **argv)
       { option_sintax,
         option_bzip2_decompress,
         option_db,
+        option_dbcache,
+        option_dbshm,
         option_dbmask,
         option_fastq_ascii,
         option_fastq_qmax,
         option_fastq_qmin,
         option_gzip_decompress,
+        option_index_compress,
         option_label_suffix,
         option_log,
         option_maxseqlength,
@@ -4089,6 +4425,7 @@ void args_init(int argc, char **argv)
         option_notrunclabels,
         option_quiet,
         option_randseed,
+        option_simd,
         option_sintax_cutoff,
         option_sintax_random,
         option_strand,
@@ -4119,6 +4456,7 @@ void args_init(int argc, char **argv)
         option_relabel_self,
         option_relabel_sha1,
         option_sample,
+        option_simd,
         option_sizein,
         option_sizeout,
         option_threads,
@@ -4152,6 +4490,7 @@ void args_init(int argc, char **argv)
         option_relabel_self,
         option_relabel_sha1,
         option_sample,
+        option_simd,
         option_sizein,
         option_sizeout,
         option_threads,
@@ -4193,6 +4532,7 @@ void args_init(int argc, char **argv)
         option_relabel_self,
         option_relabel_sha1,
         option_sample,
+        option_simd,
         option_sizein,
         option_sizeout,
         option_threads,
@@ -4237,6 +4577,7 @@ void args_init(int argc, char **argv)
         option_relabel_self,
         option_relabel_sha1,
         option_sample,
+        option_simd,
         option_sizein,
         option_sizeout,
         option_threads,
@@ -4281,6 +4622,7 @@ void args_init(int argc, char **argv)
         option_relabel_self,
         option_relabel_sha1,
         option_sample,
+        option_simd,
         option_sizein,
         option_sizeout,
         option_threads,
@@ -4299,6 +4641,8 @@ void args_init(int argc, char **argv)
         option_borderline,
         option_chimeras,
         option_db,
+        option_dbcache,
+        option_dbshm,
         option_dbmask,
         option_dn,
         option_fasta_score,
@@ -4306,6 +4650,7 @@ void args_init(int argc, char **argv)
         option_gapext,
         option_gapopen,
         option_hardmask,
+        option_index_compress,
         option_label_suffix,
         option_lengthout,
         option_log,
@@ -4329,6 +4674,7 @@ void args_init(int argc, char **argv)
         option_sample,
         option_self,
         option_selfid,
+        option_simd,
         option_sizein,
         option_sizeout,
         option_strand,
@@ -4356,6 +4702,7 @@ void args_init(int argc, char **argv)
         option_relabel_self,
         option_relabel_sha1,
         option_sample,
+        option_simd,
         option_sizein,
         option_sizeout,
         option_threads,
@@ -4367,6 +4714,7 @@ void args_init(int argc, char **argv)
       { option_udbinfo,
         option_log,
         option_quiet,
+        option_simd,
         option_threads,
         -1 },
 
@@ -4374,6 +4722,7 @@ void args_init(int argc, char **argv)
         option_log,
         option_no_progress,
         option_quiet,
+        option_simd,
         option_threads,
         -1 },
 
@@ -4384,6 +4733,8 @@ void args_init(int argc, char **argv)
         option_blast6out,
         option_bzip2_decompress,
         option_db,
+        option_dbcache,
+        option_dbshm,
         option_dbmask,
         option_dbmatched,
         option_dbnotmatched,
@@ -4399,6 +4750,7 @@ void args_init(int argc, char **argv)
         option_iddef,
         option_idprefix,
         option_idsuffix,
+        option_index_compress,
         option_label_suffix,
         option_lca_cutoff,
         option_lcaout,
@@ -4438,6 +4790,7 @@ void args_init(int argc, char **argv)
         option_pattern,
         option_qmask,
         option_qsegout,
+        option_query_batch,
         option_query_cov,
         option_quiet,
         option_relabel,
@@ -4452,6 +4805,7 @@ void args_init(int argc, char **argv)
         option_sample,
         option_self,
         option_selfid,
+        option_simd,
         option_sizein,
         option_sizeout,
         option_slots,
@@ -4475,12 +4829,14 @@ void args_init(int argc, char **argv)
       { option_v,
         option_log,
         option_quiet,
+        option_simd,
         option_threads,
         -1 },
 
       { option_version,
         option_log,
         option_quiet,
+        option_simd,
         option_threads,
         -1 }
     };
@@ -4582,9 +4938,12 @@ void args_init(int argc, char **argv)
     }
 
   if (opt_allpairs_global || opt_cluster_fast || opt_cluster_size ||
-      opt_cluster_smallmem || opt_cluster_unoise || opt_fastq_mergepairs ||
-      opt_fastx_mask || opt_maskfasta || opt_search_exact || opt_sintax ||
-      opt_uchime_ref || opt_usearch_global)
+      opt_cluster_smallmem || opt_cluster_unoise || opt_derep_fulllength ||
+      opt_derep_id || opt_derep_smallmem || opt_fastq_filter ||
+      opt_fastq_mergepairs || opt_fastx_filter || opt_fastx_mask ||
+      opt_fastx_uniques || opt_makeudb_usearch || opt_maskfasta ||
+      opt_search_exact || opt_sintax || opt_uchime_ref ||
+      opt_usearch_global)
     {
       if (opt_threads == 0)
         {
@@ -4700,6 +5059,26 @@ void args_init(int argc, char **argv)
       fatal("The argument to --sample_size must not be negative");
     }
 
+  if (opt_shards < 0)
+    {
+      fatal("The argument to --shards must not be negative");
+    }
+
+  if ((opt_shard < 0) || ((opt_shards > 0) && (opt_shard >= opt_shards)))
+    {
+      fatal("The argument to --shard must be in the range 0 to --shards minus 1");
+    }
+
+  if ((opt_shards > 0) && opt_shard_uc)
+    {
+      fatal("Options --shards and --shard_uc cannot be combined");
+    }
+
+  if (opt_shard_uc && not opt_uc)
+    {
+      fatal("Option --shard_uc requires --uc");
+    }
+
   if (((opt_relabel ? 1 : 0) +
        opt_relabel_md5 + opt_relabel_self + opt_relabel_sha1) > 1)
     {
@@ -4791,6 +5170,11 @@ void args_init(int argc, char **argv)
       fatal("The argument to maxuniquesize must be at least 1");
     }
 
+  if (opt_memory_limit < 0)
+    {
+      fatal("The argument to --memory_limit must not be negative");
+    }
+
   if (opt_maxsize < 1)
     {
       fatal("The argument to maxsize must be at least 1");
@@ -4801,6 +5185,11 @@ void args_init(int argc, char **argv)
       fatal("The argument to maxhits cannot be negative");
     }
 
+  if ((opt_query_batch < 1) || (opt_query_batch > 256))
+    {
+      fatal("The argument to --query_batch must be in the range 1 to 256");
+    }
+
   if (opt_chimeras_length_min < 1)
     {
       fatal("The argument to chimeras_length_min must be at least 1");
@@ -5017,6 +5406,7 @@ void cmd_help()
               "  --no_progress               do not show progress indicator\n"
               "  --notrunclabels             do not truncate labels at first space\n"
               "  --quiet                     output just warnings and fatal errors to stderr\n"
+              "  --simd STRING               SIMD instruction set to use, or auto (auto)\n"
               "  --threads INT               number of threads to use, zero for all cores (0)\n"
               "  --version | -v              display version information\n"
               "\n"
@@ -5050,6 +5440,9 @@ void cmd_help()
               "  --uchime_ref FILENAME       detect chimeras using a reference database\n"
               " Data\n"
               "  --db FILENAME               reference database for --uchime_ref\n"
+              "  --dbcache DIRECTORY         cache k-mer index of FASTA db in given directory\n"
+              "  --dbshm NAME                share k-mer index of FASTA db in shared memory\n"
+              "  --index_compress            compress k-mer index to reduce memory usage\n"
               " Parameters\n"
               "  --abskew REAL               minimum abundance ratio (2.0, 16.0 for uchime3)\n"
               "  --dn REAL                   'no' vote pseudo-count (1.4)\n"
@@ -5087,6 +5480,9 @@ void cmd_help()
               "  --id REAL                   reject if identity lower, accepted values: 0-1.0\n"
               "  --iddef INT                 id definition, 0-4=CD-HIT,all,int,MBL,BLAST (2)\n"
               "  --qmask none|dust|soft      mask seqs with dust, soft or no method (dust)\n"
+              "  --shard INT                 cluster only this shard, 0 to --shards - 1 (size)\n"
+              "  --shard_uc FILENAME         merge shards: uc output of the shards (size)\n"
+              "  --shards INT                number of shards to split input into (size)\n"
               "  --sizein                    propagate abundance annotation from input\n"
               "  --strand plus|both          cluster using plus or both strands (plus)\n"
               "  --usersort                  indicate sequences not pre-sorted by length\n"
@@ -5132,9 +5528,11 @@ void cmd_help()
               "  --rereplicate FILENAME      rereplicate sequences in the given FASTA file\n"
               " Parameters\n"
               "  --maxuniquesize INT         maximum abundance for output from dereplication\n"
+              "  --memory_limit INT          derep_smallmem: use temporary files, max INT MB\n"
               "  --minuniquesize INT         minimum abundance for output from dereplication\n"
               "  --sizein                    propagate abundance annotation from input\n"
               "  --strand plus|both          dereplicate plus or both strands (plus)\n"
+              "  --tmpdir DIRECTORY          directory for temporary files (TMPDIR or /tmp)\n"
               " Output\n"
               "  --fastq_ascii INT           FASTQ input quality score ASCII base char (33)\n"
               "  --fastq_qmax INT            maximum base quality value for FASTQ input (41)\n"
@@ -5144,12 +5542,14 @@ void cmd_help()
               "  --fastaout FILENAME         output FASTA file (for fastx_uniques)\n"
               "  --fastqout FILENAME         output FASTQ file (for fastx_uniques)\n"
               "  --output FILENAME           output FASTA file (not for fastx_uniques)\n"
+              "  --previous FILENAME         add to previous derep result (FASTA/FASTQ/snapshot)\n"
               "  --relabel STRING            relabel with this prefix string\n"
               "  --relabel_keep              keep the old label after the new when relabelling\n"
               "  --relabel_md5               relabel with md5 digest of normalized sequence\n"
               "  --relabel_self              relabel with the sequence itself as label\n"
               "  --relabel_sha1              relabel with sha1 digest of normalized sequence\n"
               "  --sizeout                   write abundance annotation to output\n"
+              "  --snapshotout FILENAME      write binary snapshot of all unique sequences\n"
               "  --tabbedout FILENAME        write cluster info to tsv file for fastx_uniques\n"
               "  --topn INT                  output only n most abundant sequences after derep\n"
               "  --uc FILENAME               filename for UCLUST-like dereplication output\n"
@@ -5220,6 +5620,9 @@ void cmd_help()
               "  --orient FILENAME           orient sequences in given FASTA/FASTQ file\n"
               " Data\n"
               "  --db FILENAME               database of sequences in correct orientation\n"
+              "  --dbcache DIRECTORY         cache k-mer index of FASTA db in given directory\n"
+              "  --dbshm NAME                share k-mer index of FASTA db in shared memory\n"
+              "  --index_compress            compress k-mer index to reduce memory usage\n"
               "  --dbmask none|dust|soft     mask db seqs with dust, soft or no method (dust)\n"
               "  --qmask none|dust|soft      mask query with dust, soft or no method (dust)\n"
               "  --wordlength INT            length of words used for matching 3-15 (12)\n"
@@ -5304,6 +5707,9 @@ void cmd_help()
               "  --usearch_global FILENAME   filename of queries for global alignment search\n"
               " Data\n"
               "  --db FILENAME               name of UDB or FASTA database for search\n"
+              "  --dbcache DIRECTORY         cache k-mer index of FASTA db in given directory\n"
+              "  --dbshm NAME                share k-mer index of FASTA db in shared memory\n"
+              "  --index_compress            compress k-mer index to reduce memory usage\n"
               " Parameters\n"
               "  --dbmask none|dust|soft     mask db with dust, soft or no method (dust)\n"
               "  --fulldp                    full dynamic programming alignment (always on)\n"
@@ -5338,6 +5744,7 @@ void cmd_help()
               "  --mismatch INT              score for mismatch (-4)\n"
               "  --pattern STRING            option is ignored\n"
               "  --qmask none|dust|soft      mask query with dust, soft or no method (dust)\n"
+              "  --query_batch INT           queries searched together by each thread (1)\n"
               "  --query_cov REAL            reject if fraction of query seq. aligned lower\n"
               "  --rightjust                 reject if terminal gaps at alignment right end\n"
               "  --sizein                    propagate abundance annotation from input\n"
@@ -5371,6 +5778,14 @@ void cmd_help()
               "  --userfields STRING         fields to output in userout file\n"
               "  --userout FILENAME          filename for user-defined tab-separated output\n"
               "\n"
+              "Server\n"
+              "  --server FILENAME           serve search and sintax requests on Unix socket\n"
+              " Data\n"
+              "  --db FILENAME               database for usearch_global, search_exact, sintax\n"
+              " Parameters\n"
+              "  --dbcache, --dbmask, --dbshm, --hardmask, --index_compress, --maxseqlength,\n"
+              "  --minseqlength, --notrunclabels and --wordlength apply to the database\n"
+              "\n"
               "Shuffling and sorting\n"
               "  --shuffle FILENAME          shuffle order of sequences in FASTA file randomly\n"
               "  --sortbylength FILENAME     sort sequences by length in given FASTA file\n"
@@ -5400,6 +5815,7 @@ void cmd_help()
               "  --randseed INT              seed for PRNG, zero to use random data source (0)\n"
               "  --sample_pct REAL           sampling percentage between 0.0 and 100.0\n"
               "  --sample_size INT           sampling size\n"
+              "  --sample_stream             read input once, without loading it in memory\n"
               "  --sizein                    consider abundance info from input, do not ignore\n"
               " Output\n"
               "  --fastaout FILENAME         output subsampled sequences to FASTA file\n"
@@ -5418,6 +5834,9 @@ void cmd_help()
               "  --sintax FILENAME           classify sequences in given FASTA/FASTQ file\n"
               " Parameters\n"
               "  --db FILENAME               taxonomic reference db in given FASTA or UDB file\n"
+              "  --dbcache DIRECTORY         cache k-mer index of FASTA db in given directory\n"
+              "  --dbshm NAME                share k-mer index of FASTA db in shared memory\n"
+              "  --index_compress            compress k-mer index to reduce memory usage\n"
               "  --sintax_cutoff REAL        confidence value cutoff level (0.0)\n"
               "  --sintax_random             use random sequence, not shortest, if equal match\n"
               " Output\n"
@@ -5471,6 +5890,7 @@ void cmd_help()
               " Parameters\n"
               "  --dbmask none|dust|soft     mask db with dust, soft or no method (dust)\n"
               "  --hardmask                  mask by replacing with N instead of lower case\n"
+              "  --udb_mmap                  write page-aligned UDB file for memory mapping\n"
               "  --wordlength INT            length of words for database index 3-15 (8)\n"
               " Output\n"
               "  --output FILENAME           UDB or FASTA output file\n"
@@ -5766,6 +6186,8 @@ int main(int argc, char** argv)
 
   args_init(argc, argv);
 
+  cpu_features_limit();
+
   if (opt_log)
     {
       fp_log = fopen_output(opt_log);
@@ -5781,6 +6203,7 @@ int main(int argc, char** argv)
       struct tm * tm_start = localtime(& time_start);
       strftime(time_string, 26, "%Y-%m-%dT%H:%M:%S", tm_start);
       fprintf(fp_log, "Started  %s\n", time_string);
+      fprintf(fp_log, "SIMD code path: %s\n", cpu_simd_level());
     }
 
   random_init();
@@ -5876,6 +6299,10 @@ int main(int argc, char** argv)
     {
       cmd_search_exact();
     }
+  else if (opt_server)
+    {
+      server(argc, argv);
+    }
   else if (opt_fastx_mask)
     {
       fastx_mask();
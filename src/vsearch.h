@@ -96,6 +96,9 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/time.h>
+#ifndef _WIN32
+#include <sys/mman.h>
+#endif
 #include <pthread.h>
 #include <getopt.h>
 #include <fcntl.h>
@@ -212,6 +215,8 @@
 #include "dynlibs.h"
 #include "util.h"
 #include "xstring.h"
+#include "arena.h"
+#include "cigar.h"
 #include "align_simd.h"
 #include "maps.h"
 #include "attributes.h"
@@ -219,6 +224,7 @@
 #include "align.h"
 #include "unique.h"
 #include "bitmap.h"
+#include "cpu.h"
 #include "dbindex.h"
 #include "minheap.h"
 #include "search.h"
@@ -234,7 +240,6 @@
 #include "mask.h"
 #include "cluster.h"
 #include "chimera.h"
-#include "cpu.h"
 #include "allpairs.h"
 #include "subsample.h"
 #include "fastx.h"
@@ -259,6 +264,9 @@
 #include "orient.h"
 #include "fa2fq.h"
 #include "derepsmallmem.h"
+#include "scheduler.h"
+#include "server.h"
+#include "shard.h"
 
 /* options */
 
@@ -272,6 +280,7 @@ extern bool opt_fastq_eeout;
 extern bool opt_fastq_nostagger;
 extern bool opt_fastq_qout_max;
 extern bool opt_gzip_decompress;
+extern bool opt_index_compress;
 extern bool opt_label_substr_match;
 extern bool opt_lengthout;
 extern bool opt_no_progress;
@@ -286,6 +295,7 @@ extern bool opt_sintax_random;
 extern bool opt_sizein;
 extern bool opt_sizeorder;
 extern bool opt_sizeout;
+extern bool opt_udb_mmap;
 extern bool opt_xee;
 extern bool opt_xlength;
 extern bool opt_xsize;
@@ -306,6 +316,8 @@ extern char * opt_consout;
 extern char * opt_cut;
 extern char * opt_cut_pattern;
 extern char * opt_db;
+extern char * opt_dbcache;
+extern char * opt_dbshm;
 extern char * opt_dbmatched;
 extern char * opt_dbnotmatched;
 extern char * opt_derep_fulllength;
@@ -364,6 +376,7 @@ extern char * opt_orient;
 extern char * opt_otutabout;
 extern char * opt_output;
 extern char * opt_pattern;
+extern char * opt_previous;
 extern char * opt_profile;
 extern char * opt_qsegout;
 extern char * opt_relabel;
@@ -372,12 +385,17 @@ extern char * opt_reverse;
 extern char * opt_samout;
 extern char * opt_sample;
 extern char * opt_search_exact;
+extern char * opt_server;
+extern char * opt_shard_uc;
 extern char * opt_sff_convert;
 extern char * opt_shuffle;
+extern char * opt_simd;
 extern char * opt_sintax;
+extern char * opt_snapshotout;
 extern char * opt_sortbylength;
 extern char * opt_sortbysize;
 extern char * opt_tabbedout;
+extern char * opt_tmpdir;
 extern char * opt_tsegout;
 extern char * opt_uc;
 extern char * opt_uchime2_denovo;
@@ -486,6 +504,7 @@ extern int64_t opt_maxseqlength;
 extern int64_t opt_maxsize;
 extern int64_t opt_maxsubs;
 extern int64_t opt_maxuniquesize;
+extern int64_t opt_memory_limit;
 extern int64_t opt_mincols;
 extern int64_t opt_minseqlength;
 extern int64_t opt_minsize;
@@ -496,10 +515,14 @@ extern int64_t opt_mismatch;
 extern int64_t opt_notrunclabels;
 extern int64_t opt_output_no_hits;
 extern int64_t opt_qmask;
+extern int64_t opt_query_batch;
 extern int64_t opt_randseed;
 extern int64_t opt_rightjust;
 extern int64_t opt_rowlen;
 extern int64_t opt_sample_size;
+extern int64_t opt_shard;
+extern int64_t opt_shards;
+extern bool opt_sample_stream;
 extern int64_t opt_self;
 extern int64_t opt_selfid;
 extern int64_t opt_strand;
@@ -522,5 +545,14 @@ extern int64_t sse42_present;
 extern int64_t popcnt_present;
 extern int64_t avx_present;
 extern int64_t avx2_present;
+extern int64_t avx512bw_present;
 
 extern FILE * fp_log;
+
+/* functions in vsearch.cc, also used to run requests in server mode */
+
+auto args_init(int argc, char ** argv) -> void;
+auto getentirecommandline(int argc, char ** argv) -> void;
+auto cpu_features_limit() -> void;
+auto cmd_usearch_global() -> void;
+auto cmd_search_exact() -> void;